@@ -0,0 +1,101 @@
+// Copyright 2026 Global Phasing Ltd.
+
+// Microbenchmark of reading and writing mmJSON, compared with mmCIF.
+// The document is kept in memory, so file I/O and gzip are not measured.
+// Usage: json-bm [mmjson-or-mmcif-file]   (default: tests/3wup.json.gz)
+
+#include "gemmi/json.hpp"      // for read_mmjson_insitu
+#include "gemmi/to_json.hpp"   // for write_json_to_stream
+#include "gemmi/read_cif.hpp"  // for read_cif_or_mmjson_gz, read_cif_from_memory
+#include "gemmi/to_cif.hpp"    // for write_cif_to_stream
+#include <sstream>
+#include <benchmark/benchmark.h>
+
+static std::string json_text;
+static std::string cif_text;
+
+static void read_mmjson(benchmark::State& state) {
+  for (auto _ : state) {
+    // the parser works in-situ, so it needs a fresh copy of the text
+    std::string copy = json_text;
+    gemmi::cif::Document doc =
+      gemmi::cif::read_mmjson_insitu(&copy[0], copy.size(), "mmjson");
+    benchmark::DoNotOptimize(doc);
+  }
+}
+
+static void read_mmcif(benchmark::State& state) {
+  for (auto _ : state) {
+    gemmi::cif::Document doc =
+      gemmi::read_cif_from_memory(cif_text.data(), cif_text.size(), "mmcif");
+    benchmark::DoNotOptimize(doc);
+  }
+}
+
+static void write_mmjson(benchmark::State& state, const gemmi::cif::Document& doc,
+                         int nthreads) {
+  for (auto _ : state) {
+    std::ostringstream os;
+    gemmi::cif::write_json_to_stream(os, doc, gemmi::cif::JsonWriteOptions::mmjson(),
+                                     nthreads);
+    benchmark::DoNotOptimize(os);
+  }
+}
+
+static void write_mmcif(benchmark::State& state, const gemmi::cif::Document& doc) {
+  for (auto _ : state) {
+    std::ostringstream os;
+    gemmi::cif::write_cif_to_stream(os, doc, gemmi::cif::WriteOptions());
+    benchmark::DoNotOptimize(os);
+  }
+}
+
+static void roundtrip_mmjson(benchmark::State& state) {
+  for (auto _ : state) {
+    std::string copy = json_text;
+    gemmi::cif::Document doc =
+      gemmi::cif::read_mmjson_insitu(&copy[0], copy.size(), "mmjson");
+    std::ostringstream os;
+    gemmi::cif::write_mmjson_to_stream(os, doc);
+    benchmark::DoNotOptimize(os);
+  }
+}
+
+static void roundtrip_mmcif(benchmark::State& state) {
+  for (auto _ : state) {
+    gemmi::cif::Document doc =
+      gemmi::read_cif_from_memory(cif_text.data(), cif_text.size(), "mmcif");
+    std::ostringstream os;
+    gemmi::cif::write_cif_to_stream(os, doc, gemmi::cif::WriteOptions());
+    benchmark::DoNotOptimize(os);
+  }
+}
+
+int main(int argc, char** argv) {
+  benchmark::Initialize(&argc, argv);
+  const char* path = argc > 1 ? argv[argc-1] : "tests/3wup.json.gz";
+  gemmi::cif::Document doc;
+  try {
+    doc = gemmi::read_cif_or_mmjson_gz(path);
+  } catch (std::exception& e) {
+    printf("%s\nCall it with path to an mmJSON or mmCIF file as an argument.\n",
+           e.what());
+    return 1;
+  }
+  std::ostringstream json_os;
+  gemmi::cif::write_mmjson_to_stream(json_os, doc);
+  json_text = json_os.str();
+  std::ostringstream cif_os;
+  gemmi::cif::write_cif_to_stream(cif_os, doc, gemmi::cif::WriteOptions());
+  cif_text = cif_os.str();
+
+  benchmark::RegisterBenchmark("read_mmjson", read_mmjson);
+  benchmark::RegisterBenchmark("read_mmcif", read_mmcif);
+  benchmark::RegisterBenchmark("write_mmjson", write_mmjson, doc, 1);
+  benchmark::RegisterBenchmark("write_mmjson_mt", write_mmjson, doc, 0);
+  benchmark::RegisterBenchmark("write_mmcif", write_mmcif, doc);
+  benchmark::RegisterBenchmark("roundtrip_mmjson", roundtrip_mmjson);
+  benchmark::RegisterBenchmark("roundtrip_mmcif", roundtrip_mmcif);
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+}
@@ -0,0 +1,103 @@
+// Copyright 2026 Global Phasing Ltd.
+
+// Microbenchmark of anisotropic scaling with bulk solvent (scaling.hpp)
+// on a synthetic pair of AsuData. The number of reflections depends on
+// d_min, which can be given as an argument (default: 1.0 -> ~180k refl.).
+
+#include <cstdlib>  // for atof
+#include <random>
+#include <gemmi/scaling.hpp>
+#include <benchmark/benchmark.h>
+
+using Scaling = gemmi::Scaling<float>;
+
+static gemmi::AsuData<std::complex<float>> fcalc, fmask;
+static gemmi::AsuData<gemmi::ValueSigma<float>> fobs;
+
+static void prepare_data(double d_min) {
+  gemmi::UnitCell cell(60, 70, 80, 90, 90, 90);
+  const gemmi::SpaceGroup* sg = gemmi::find_spacegroup_by_name("P 21 21 21");
+  gemmi::ReciprocalAsu asu(sg);
+  std::mt19937 rng(12345);
+  std::uniform_real_distribution<float> phase(0.f, 6.2831853f);
+  std::exponential_distribution<float> wilson(1.f);
+  std::normal_distribution<float> noise(0.f, 1.f);
+  // parameters used to generate Fobs
+  Scaling model(cell, sg);
+  model.use_solvent = true;
+  model.k_overall = 2.5;
+  model.k_sol = 0.4;
+  model.b_sol = 50;
+  model.set_b_overall({12, 15, 18, 0, 0, 0});
+  for (auto* data : {&fcalc, &fmask}) {
+    data->unit_cell_ = cell;
+    data->spacegroup_ = sg;
+  }
+  fobs.unit_cell_ = cell;
+  fobs.spacegroup_ = sg;
+  double max_1_d2 = 1. / (d_min * d_min);
+  int hmax = int(cell.a / d_min) + 1;
+  int kmax = int(cell.b / d_min) + 1;
+  int lmax = int(cell.c / d_min) + 1;
+  for (int h = -hmax; h <= hmax; ++h)
+    for (int k = -kmax; k <= kmax; ++k)
+      for (int l = -lmax; l <= lmax; ++l) {
+        gemmi::Miller hkl{{h, k, l}};
+        if (hkl == gemmi::Miller{{0, 0, 0}} || !asu.is_in(hkl) ||
+            cell.calculate_1_d2(hkl) > max_1_d2)
+          continue;
+        double stol2 = cell.calculate_stol_sq(hkl);
+        float amp = 100.f * std::sqrt(wilson(rng)) * (float) std::exp(-10 * stol2);
+        auto fc = std::polar(amp, phase(rng));
+        auto fm = std::polar(300.f * (float) std::exp(-60 * stol2), phase(rng));
+        auto total = fc + (float) model.get_solvent_scale(stol2) * fm;
+        float f = std::abs(total) * (float) model.get_overall_scale_factor(hkl);
+        float sigma = 0.05f * f + 1.f;
+        fcalc.v.push_back({hkl, fc});
+        fmask.v.push_back({hkl, fm});
+        fobs.v.push_back({hkl, {f + sigma * noise(rng), sigma}});
+      }
+  fcalc.ensure_sorted();
+  fmask.ensure_sorted();
+  fobs.ensure_sorted();
+  printf("Synthetic data: %zu reflections to %g A\n", fobs.size(), d_min);
+}
+
+static Scaling prepare_scaling() {
+  Scaling scaling(fcalc.unit_cell_, fcalc.spacegroup_);
+  scaling.use_solvent = true;
+  scaling.prepare_points(fcalc, fobs, &fmask);
+  scaling.fit_isotropic_b_approximately();
+  return scaling;
+}
+
+static void lm_matrices(benchmark::State& state) {
+  Scaling scaling = prepare_scaling();
+  size_t na = scaling.get_parameters().size();
+  std::vector<double> alpha(na * na), beta(na);
+  for (auto _ : state) {
+    double wssr = gemmi::compute_lm_matrices(scaling, alpha, beta, (int) state.range(0));
+    benchmark::DoNotOptimize(wssr);
+  }
+  state.SetItemsProcessed(state.iterations() * scaling.points.size());
+}
+
+static void fit_parameters(benchmark::State& state) {
+  Scaling scaling = prepare_scaling();
+  std::vector<double> initial = scaling.get_parameters();
+  for (auto _ : state) {
+    scaling.set_parameters(initial);
+    double wssr = scaling.fit_parameters((int) state.range(0));
+    benchmark::DoNotOptimize(wssr);
+  }
+}
+
+BENCHMARK(lm_matrices)->Arg(1)->Arg(2)->Arg(4)->Arg(0)->Unit(benchmark::kMillisecond);
+BENCHMARK(fit_parameters)->Arg(1)->Arg(2)->Arg(4)->Arg(0)->Unit(benchmark::kMillisecond);
+
+int main(int argc, char** argv) {
+  benchmark::Initialize(&argc, argv);
+  prepare_data(argc > 1 ? std::atof(argv[1]) : 1.0);
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+}
@@ -0,0 +1,108 @@
+// Copyright 2026 Global Phasing Ltd.
+
+// Microbenchmark of number formatting: snprintf_z vs *_to_chars_z.
+// To see the effect on whole files, compare with writecif-bm.
+
+#include <cstdio>
+#include <random>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include <gemmi/sprintf.hpp>
+
+// coordinates and B-factors, as read from a PDB file
+static std::vector<double> make_numbers() {
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<int> dist(-99999, 99999);
+  std::vector<double> v(10000);
+  for (double& x : v)
+    x = dist(rng) / 1000.;
+  return v;
+}
+
+static void snprintf_f(benchmark::State& state) {
+  std::vector<double> v = make_numbers();
+  char buf[32];
+  for (auto _ : state)
+    for (double x : v) {
+      gemmi::snprintf_z(buf, 32, "%8.3f", x);
+      benchmark::DoNotOptimize(buf);
+    }
+}
+
+static void fixed_to_chars(benchmark::State& state) {
+  std::vector<double> v = make_numbers();
+  char buf[32];
+  for (auto _ : state)
+    for (double x : v) {
+      gemmi::fixed_to_chars_z(buf, buf + 32, x, 3, 8);
+      benchmark::DoNotOptimize(buf);
+    }
+}
+
+static void snprintf_g(benchmark::State& state) {
+  std::vector<double> v = make_numbers();
+  char buf[32];
+  for (auto _ : state)
+    for (double x : v) {
+      gemmi::snprintf_z(buf, 32, "%.9g", x);
+      benchmark::DoNotOptimize(buf);
+    }
+}
+
+static void general_to_chars(benchmark::State& state) {
+  std::vector<double> v = make_numbers();
+  char buf[32];
+  for (auto _ : state)
+    for (double x : v) {
+      gemmi::general_to_chars_z(buf, buf + 32, x, 9);
+      benchmark::DoNotOptimize(buf);
+    }
+}
+
+static void snprintf_17g(benchmark::State& state) {
+  std::vector<double> v = make_numbers();
+  char buf[32];
+  for (auto _ : state)
+    for (double x : v) {
+      gemmi::snprintf_z(buf, 32, "%.17g", x);
+      benchmark::DoNotOptimize(buf);
+    }
+}
+
+static void shortest_to_chars(benchmark::State& state) {
+  std::vector<double> v = make_numbers();
+  char buf[32];
+  for (auto _ : state)
+    for (double x : v) {
+      gemmi::shortest_to_chars_z(buf, buf + 32, x);
+      benchmark::DoNotOptimize(buf);
+    }
+}
+
+static void snprintf_d(benchmark::State& state) {
+  char buf[32];
+  for (auto _ : state)
+    for (int i = -5000; i < 5000; ++i) {
+      gemmi::snprintf_z(buf, 32, "%d", i);
+      benchmark::DoNotOptimize(buf);
+    }
+}
+
+static void int_to_chars(benchmark::State& state) {
+  char buf[32];
+  for (auto _ : state)
+    for (int i = -5000; i < 5000; ++i) {
+      gemmi::to_chars_z(buf, buf + 32, i);
+      benchmark::DoNotOptimize(buf);
+    }
+}
+
+BENCHMARK(snprintf_f);
+BENCHMARK(fixed_to_chars);
+BENCHMARK(snprintf_g);
+BENCHMARK(general_to_chars);
+BENCHMARK(snprintf_17g);
+BENCHMARK(shortest_to_chars);
+BENCHMARK(snprintf_d);
+BENCHMARK(int_to_chars);
+BENCHMARK_MAIN();
@@ -1,9 +1,15 @@
 // Copyright 2018 Global Phasing Ltd.
 
 // Microbenchmark of CIF writing function.
+// For mmCIF files, also writing of Structure as mmCIF and PDB,
+// and formatting of all coordinates as round-trip numbers.
 
 #include "gemmi/to_cif.hpp"
 #include "gemmi/read_cif.hpp"
+#include "gemmi/mmcif.hpp"     // for make_structure_from_block
+#include "gemmi/to_mmcif.hpp"  // for write_mmcif_to_stream
+#include "gemmi/to_pdb.hpp"    // for write_pdb
+#include "gemmi/sprintf.hpp"   // for snprintf_z, shortest_to_chars_z
 #include <sstream>
 #include <benchmark/benchmark.h>
 
@@ -16,6 +22,41 @@ static void write_cif(benchmark::State& state, const gemmi::cif::Document& doc,
   }
 }
 
+static void write_mmcif(benchmark::State& state, const gemmi::Structure& st) {
+  for (auto _ : state) {
+    std::ostringstream os;
+    gemmi::write_mmcif_to_stream(os, st);
+    benchmark::DoNotOptimize(os);
+  }
+}
+
+static void write_pdb(benchmark::State& state, const gemmi::Structure& st) {
+  for (auto _ : state) {
+    std::ostringstream os;
+    gemmi::write_pdb(st, os);
+    benchmark::DoNotOptimize(os);
+  }
+}
+
+// Formats coordinates with all digits that are needed to read them back.
+// Compare with write_pdb and write_mmcif, which use fixed precision.
+static void format_xyz(benchmark::State& state, const gemmi::Structure& st,
+                       bool shortest) {
+  char buf[32];
+  for (auto _ : state)
+    for (const gemmi::Model& model : st.models)
+      for (const gemmi::Chain& chain : model.chains)
+        for (const gemmi::Residue& res : chain.residues)
+          for (const gemmi::Atom& atom : res.atoms)
+            for (int i = 0; i < 3; ++i) {
+              if (shortest)
+                gemmi::shortest_to_chars_z(buf, buf + 32, atom.pos.at(i));
+              else
+                gemmi::snprintf_z(buf, 32, "%.17g", atom.pos.at(i));
+              benchmark::DoNotOptimize(buf);
+            }
+}
+
 int main(int argc, char** argv) {
   if (argc < 2) {
     printf("Call it with path to a cif file as an argument.\n");
@@ -32,6 +73,14 @@ int main(int argc, char** argv) {
   options3.align_pairs = 33;
   options3.align_loops = 30;
   benchmark::RegisterBenchmark("write_cif3", write_cif, doc, options3);
+  gemmi::Structure st;
+  if (doc.blocks.size() == 1 && doc.blocks[0].find_mmcif_category("_atom_site.").ok()) {
+    st = gemmi::make_structure_from_block(doc.blocks[0]);
+    benchmark::RegisterBenchmark("write_mmcif", write_mmcif, st);
+    benchmark::RegisterBenchmark("write_pdb", write_pdb, st);
+    benchmark::RegisterBenchmark("format_xyz_17g", format_xyz, st, false);
+    benchmark::RegisterBenchmark("format_xyz_shortest", format_xyz, st, true);
+  }
   benchmark::Initialize(&argc, argv);
   benchmark::RunSpecifiedBenchmarks();
   benchmark::Shutdown();
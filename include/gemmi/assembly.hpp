@@ -155,9 +155,87 @@ inline void ensure_unique_chain_name(const Model& model, Chain& chain) {
 /// @param model The input model to transform
 /// @param how The strategy for naming copied chains
 /// @param logging Logger for warning messages
+/// @param nthreads Number of threads used to copy and transform chains
+///        (0 = all available cores)
 /// @return A new Model containing the assembled biological unit
 GEMMI_DLL Model make_assembly(const Assembly& assembly, const Model& model,
-                              HowToNameCopiedChain how, const Logger& logging);
+                              HowToNameCopiedChain how, const Logger& logging,
+                              int nthreads=1);
+
+/// One chain of a Model (or selected subchains of it) placed in an assembly
+/// by one operator.
+struct AssemblyInstance {
+  /// The source chain in the Model
+  const Chain* chain;
+  /// Name of the chain in the assembly
+  std::string name;
+  /// Segment of copied residues (set only with HowToNameCopiedChain::Dup)
+  std::string segment;
+  /// The operator applied to the chain
+  Transform transform;
+  /// If false, only residues from subchains are included
+  bool whole_chain;
+  /// Included subchains (used when whole_chain is false)
+  std::vector<std::string> subchains;
+
+  /// Check if a residue of the source chain is included in this instance.
+  bool includes(const Residue& res) const {
+    return whole_chain || in_vector(res.subchain, subchains);
+  }
+};
+
+/// Assembly as a list of chain instances that refer to the original Model,
+/// without copying atoms.
+///
+/// The instances have the same order and names as chains in the Model
+/// returned by make_assembly(). The Model must not be modified
+/// while the view is used.
+struct InstancedAssembly {
+  /// The strategy used for naming copied chains
+  HowToNameCopiedChain how = HowToNameCopiedChain::AddNumber;
+  /// Chain instances, in the order of generators and operators
+  std::vector<AssemblyInstance> instances;
+
+  /// Count atoms in the assembly.
+  ///
+  /// @return Total number of atoms in all instances
+  size_t atom_count() const {
+    size_t n = 0;
+    for (const AssemblyInstance& inst : instances)
+      for (const Residue& res : inst.chain->residues)
+        if (inst.includes(res))
+          n += res.atoms.size();
+    return n;
+  }
+
+  /// Call func(instance, residue, atom, pos) for each atom in the assembly,
+  /// where pos is the position of the atom after transformation.
+  ///
+  /// @param func Callback function
+  template<typename Func>
+  void for_each_atom(Func&& func) const {
+    for (const AssemblyInstance& inst : instances)
+      for (const Residue& res : inst.chain->residues)
+        if (inst.includes(res))
+          for (const Atom& atom : res.atoms)
+            func(inst, res, atom, Position(inst.transform.apply(atom.pos)));
+  }
+};
+
+/// Determine chain instances of an assembly without copying the model.
+///
+/// Chains are named and checked in the same way as in make_assembly(),
+/// which copies and transforms the instances returned by this function.
+///
+/// @param assembly The assembly record containing transformation operators
+/// @param model The input model; the returned view points to its chains
+/// @param how The strategy for naming copied chains
+/// @param logging Logger for warning messages
+/// @return Instances that make up the assembly
+GEMMI_DLL InstancedAssembly make_instanced_assembly(const Assembly& assembly,
+                                                    const Model& model,
+                                                    HowToNameCopiedChain how,
+                                                    const Logger& logging);
 
 /// Create a pseudo-assembly representing all unit-cell images.
 ///
@@ -191,9 +269,11 @@ inline Assembly pseudo_assembly_for_unit_cell(const UnitCell& cell) {
 /// @param logging Logger for warning messages
 /// @param keep_spacegroup If true, preserve the original space group and unit cell
 /// @param merge_dist Distance threshold for merging nearby atoms (default 0.2 Å)
+/// @param nthreads Number of threads used in make_assembly()
 GEMMI_DLL void transform_to_assembly(Structure& st, const std::string& assembly_name,
                                      HowToNameCopiedChain how, const Logger& logging,
-                                     bool keep_spacegroup=false, double merge_dist=0.2);
+                                     bool keep_spacegroup=false, double merge_dist=0.2,
+                                     int nthreads=1);
 
 
 /// Expand a model by applying NCS operations.
@@ -204,9 +284,10 @@ GEMMI_DLL void transform_to_assembly(Structure& st, const std::string& assembly_
 /// @param model The input model to expand
 /// @param ncs Vector of NCS operations to apply
 /// @param how The strategy for naming copied chains
+/// @param nthreads Number of threads used to copy and transform chains
 /// @return A new Model containing the original and all NCS-transformed copies
 GEMMI_DLL Model expand_ncs_model(const Model& model, const std::vector<NcsOp>& ncs,
-                                 HowToNameCopiedChain how);
+                                 HowToNameCopiedChain how, int nthreads=1);
 
 /// Merge atoms within a distance threshold after NCS or assembly expansion.
 ///
@@ -238,7 +319,9 @@ GEMMI_DLL void shorten_chain_names(Structure& st);
 /// @param st The structure to expand in-place
 /// @param how The strategy for naming copied chains
 /// @param merge_dist Distance threshold for merging atoms (default 0.2 Å)
-GEMMI_DLL void expand_ncs(Structure& st, HowToNameCopiedChain how, double merge_dist=0.2);
+/// @param nthreads Number of threads used to copy and transform chains
+GEMMI_DLL void expand_ncs(Structure& st, HowToNameCopiedChain how, double merge_dist=0.2,
+                          int nthreads=1);
 
 /// Split chains at residue segment boundaries into separate chains.
 ///
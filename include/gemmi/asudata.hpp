@@ -8,6 +8,8 @@
 
 #include <complex>       // for arg, abs
 #include <algorithm>     // for sort, is_sorted
+#include <cstdint>       // for int64_t
+#include <unordered_map>
 #include "unitcell.hpp"
 #include "symmetry.hpp"
 #include "stats.hpp"     // for Correlation
@@ -52,6 +54,95 @@ struct ComplexCorrelation {
 };
 
 
+/// @brief Lookup table: Miller index -> position in a list of reflections.
+/// Built once in linear time, it makes joining reflection lists
+/// linear-time without sorting them. Positions are stored in a dense 3D
+/// table spanning the ranges of h, k and l in the data, which is compact
+/// for reflections in the ASU (or in a hemisphere). If the table would be
+/// much larger than the data (few, scattered indices), a hash map is used.
+/// If the same hkl occurs more than once, the first position is stored.
+/// Used by for_matching_reflections() and the functions that take b_index.
+/// AsuData, get_asu_values() and Scaling still sort their data and join
+/// reflection lists by merging sorted lists.
+struct HklIndex {
+  HklIndex() = default;
+  /// @param refl reflections; T must have member hkl (e.g. HklValue)
+  template<typename T>
+  explicit HklIndex(const std::vector<T>& refl) {
+    build(refl.size(), [&](size_t i) { return refl[i].hkl; });
+  }
+  HklIndex(const Miller* hkls, size_t n) {
+    build(n, [&](size_t i) { return hkls[i]; });
+  }
+
+  /// @brief (Re)build the index.
+  /// @param n number of reflections
+  /// @param get_hkl callable(size_t i) returning Miller indices of i-th reflection
+  template<typename GetHkl>
+  void build(size_t n, GetHkl get_hkl) {
+    table_.clear();
+    map_.clear();
+    size_ = n;
+    extent_ = {{0, 0, 0}};
+    if (n == 0)
+      return;
+    Miller lo = get_hkl(0);
+    Miller hi = lo;
+    for (size_t i = 1; i != n; ++i) {
+      Miller hkl = get_hkl(i);
+      for (int j = 0; j != 3; ++j) {
+        lo[j] = std::min(lo[j], hkl[j]);
+        hi[j] = std::max(hi[j], hkl[j]);
+      }
+    }
+    min_ = lo;
+    double volume = 1.;
+    for (int j = 0; j != 3; ++j) {
+      extent_[j] = (std::int64_t) hi[j] - lo[j] + 1;
+      volume *= extent_[j];
+    }
+    if (volume <= 8. * n + (1 << 20)) {
+      table_.resize((size_t) volume, -1);
+      for (size_t i = 0; i != n; ++i) {
+        int& pos = table_[offset(get_hkl(i))];
+        if (pos == -1)
+          pos = (int) i;
+      }
+    } else {
+      map_.reserve(n);
+      for (size_t i = 0; i != n; ++i)
+        map_.emplace(get_hkl(i), (int) i);  // doesn't overwrite
+    }
+  }
+
+  /// Number of reflections used to build the index.
+  size_t size() const { return size_; }
+
+  /// @brief Position of hkl in the indexed list, or -1 if absent.
+  int find(const Miller& hkl) const {
+    if (!table_.empty()) {
+      for (int j = 0; j != 3; ++j)
+        if ((std::uint64_t) ((std::int64_t) hkl[j] - min_[j]) >= (std::uint64_t) extent_[j])
+          return -1;
+      return table_[offset(hkl)];
+    }
+    auto it = map_.find(hkl);
+    return it != map_.end() ? it->second : -1;
+  }
+
+private:
+  size_t size_ = 0;
+  Miller min_ = {{0, 0, 0}};
+  std::array<std::int64_t, 3> extent_ = {{0, 0, 0}};
+  std::vector<int> table_;
+  std::unordered_map<Miller, int, MillerHash> map_;
+
+  size_t offset(const Miller& hkl) const {
+    return size_t(((hkl[0] - min_[0]) * extent_[1] + (hkl[1] - min_[1])) * extent_[2]
+                  + (hkl[2] - min_[2]));
+  }
+};
+
 /// @brief Apply a function to matching reflections from two sorted lists.
 /// Iterates through reflections with matching HKLs in both lists and calls func.
 /// @pre Vectors a and b are sorted by HKL.
@@ -79,48 +170,87 @@ void for_matching_reflections(const std::vector<T>& a,
   }
 }
 
+/// @brief Apply a function to matching reflections from two lists in any order.
+/// For each reflection in a (in order) that is also in b, func is called.
+/// @tparam Func Callable type taking (const T&, const T&).
+/// @tparam T Reflection data type (must have hkl member).
+/// @param a First reflection list.
+/// @param b Second reflection list.
+/// @param b_index HklIndex of b.
+/// @param func Function to call for each matching pair.
+template<typename Func, typename T>
+void for_matching_reflections(const std::vector<T>& a,
+                              const std::vector<T>& b,
+                              const HklIndex& b_index,
+                              const Func& func) {
+  if (b_index.size() != b.size())
+    fail("for_matching_reflections(): HklIndex doesn't match the data");
+  for (const T& r1 : a) {
+    int pos = b_index.find(r1.hkl);
+    if (pos >= 0)
+      func(r1, b[pos]);
+  }
+}
+
+namespace impl {
+template<typename Func, typename T>
+void for_matching_refl(const std::vector<T>& a, const std::vector<T>& b,
+                       const HklIndex* b_index, const Func& func) {
+  if (b_index)
+    for_matching_reflections(a, b, *b_index, func);
+  else
+    for_matching_reflections(a, b, func);
+}
+} // namespace impl
+
 /// @brief Calculate correlation of intensity values between two sorted lists.
-/// @pre Vectors a and b are sorted by HKL.
+/// @pre Vectors a and b are sorted by HKL, unless b_index is given.
 /// @tparam T Reflection data type (must have hkl and value members).
 /// @param a First reflection list.
 /// @param b Second reflection list.
+/// @param b_index Optional HklIndex of b, for data in any order.
 /// @return Correlation object computed from matching HKLs.
 template<typename T>
 Correlation calculate_hkl_value_correlation(const std::vector<T>& a,
-                                            const std::vector<T>& b) {
+                                            const std::vector<T>& b,
+                                            const HklIndex* b_index=nullptr) {
   Correlation cor;
-  for_matching_reflections(a, b, [&cor](const T& x, const T& y) {
+  impl::for_matching_refl(a, b, b_index, [&cor](const T& x, const T& y) {
       cor.add_point(x.value, y.value);
   });
   return cor;
 }
 
 /// @brief Calculate correlation of complex-valued reflection data between two sorted lists.
-/// @pre Vectors a and b are sorted by HKL.
+/// @pre Vectors a and b are sorted by HKL, unless b_index is given.
 /// @tparam T Reflection data type (must have hkl and value members).
 /// @param a First reflection list.
 /// @param b Second reflection list.
+/// @param b_index Optional HklIndex of b, for data in any order.
 /// @return ComplexCorrelation object computed from matching HKLs.
 template<typename T>
 ComplexCorrelation calculate_hkl_complex_correlation(const std::vector<T>& a,
-                                                     const std::vector<T>& b) {
+                                                     const std::vector<T>& b,
+                                                     const HklIndex* b_index=nullptr) {
   ComplexCorrelation cor;
-  for_matching_reflections(a, b, [&cor](const T& x, const T& y) {
+  impl::for_matching_refl(a, b, b_index, [&cor](const T& x, const T& y) {
       cor.add_point(x.value, y.value);
   });
   return cor;
 }
 
 /// @brief Count matching reflections with identical values in two sorted lists.
-/// @pre Vectors a and b are sorted by HKL.
+/// @pre Vectors a and b are sorted by HKL, unless b_index is given.
 /// @tparam T Reflection data type (must have hkl and value members).
 /// @param a First reflection list.
 /// @param b Second reflection list.
+/// @param b_index Optional HklIndex of b, for data in any order.
 /// @return Number of matching HKLs with equal values.
 template<typename T>
-int count_equal_values(const std::vector<T>& a, const std::vector<T>& b) {
+int count_equal_values(const std::vector<T>& a, const std::vector<T>& b,
+                       const HklIndex* b_index=nullptr) {
   int count = 0;
-  for_matching_reflections(a, b, [&count](const T& x, const T& y) {
+  impl::for_matching_refl(a, b, b_index, [&count](const T& x, const T& y) {
       if (x.value == y.value)
         ++count;
   });
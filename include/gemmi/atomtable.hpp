@@ -0,0 +1,228 @@
+// Copyright 2026 Global Phasing Ltd.
+//
+// AtomTable - numerical atom data from Model stored as struct of arrays.
+
+/// @file atomtable.hpp
+/// @brief AtomTable: positions, B-factors, occupancies, elements, etc. of all
+/// atoms in a Model stored in separate arrays, with indices back to the Model.
+///
+/// Model stores atoms in nested vectors (chains -> residues -> atoms) and
+/// each Atom has a name, serial number, flags, etc. Bulk numerical passes
+/// over all atoms (structure factors, density, neighbor search) need only
+/// a few numbers per atom; AtomTable keeps these numbers in contiguous arrays.
+/// The table is built in one pass and can be synchronized with the Model
+/// in both directions (update_from() and copy_to()) as long as the hierarchy
+/// is not changed.
+
+#ifndef GEMMI_ATOMTABLE_HPP_
+#define GEMMI_ATOMTABLE_HPP_
+
+#include <vector>
+#include "model.hpp"      // for Model, Atom, CRA
+#include "calculate.hpp"  // for CenterOfMass, count_atom_sites
+
+namespace gemmi {
+
+struct AtomTable {
+  /// @brief Numerical data of one atom, copied from the table.
+  /// Has the same member names as Atom, so it can be used in templates
+  /// (DensityCalculator, StructureFactorCalculator) in place of Atom.
+  struct Site {
+    Position pos;
+    float occ;
+    float b_iso;
+    SMat33<float> aniso;
+    Element element;
+    signed char charge;
+    int serial;
+  };
+
+  std::vector<Position> pos;           ///< Cartesian coordinates
+  std::vector<float> b_iso;            ///< isotropic B-factors
+  std::vector<float> occ;              ///< occupancies
+  std::vector<SMat33<float>> aniso;    ///< anisotropic ADPs (zero if isotropic)
+  std::vector<Element> element;        ///< chemical elements
+  std::vector<signed char> charge;     ///< formal charges
+  std::vector<char> altloc;            ///< altlocs ('\0' = none)
+  std::vector<char> flag;              ///< custom flags (Atom::flag)
+  std::vector<int> serial;             ///< atom serial numbers
+  std::vector<int> chain_idx;          ///< index of the chain in Model::chains
+  std::vector<int> residue_idx;        ///< index of the residue in Chain::residues
+  std::vector<int> atom_idx;           ///< index of the atom in Residue::atoms
+
+  AtomTable() = default;
+  explicit AtomTable(const Model& model) { build(model); }
+
+  size_t size() const { return pos.size(); }
+  bool empty() const { return pos.empty(); }
+
+  /// @brief (Re)build the table from all atoms in the model.
+  void build(const Model& model) {
+    size_t n = count_atom_sites(model);
+    resize(n);
+    size_t i = 0;
+    for (int ic = 0; ic != (int) model.chains.size(); ++ic) {
+      const Chain& chain = model.chains[ic];
+      for (int ir = 0; ir != (int) chain.residues.size(); ++ir) {
+        const Residue& res = chain.residues[ir];
+        for (int ia = 0; ia != (int) res.atoms.size(); ++ia, ++i) {
+          const Atom& atom = res.atoms[ia];
+          copy_numbers(atom, i);
+          element[i] = atom.element;
+          charge[i] = atom.charge;
+          altloc[i] = atom.altloc;
+          flag[i] = atom.flag;
+          serial[i] = atom.serial;
+          chain_idx[i] = ic;
+          residue_idx[i] = ir;
+          atom_idx[i] = ia;
+        }
+      }
+    }
+  }
+
+  /// @brief Check if the table still corresponds to the model hierarchy.
+  /// Checks the first and last atom of each residue, not atom names.
+  bool matches(const Model& model) const {
+    size_t i = 0;
+    for (int ic = 0; ic != (int) model.chains.size(); ++ic) {
+      const Chain& chain = model.chains[ic];
+      for (int ir = 0; ir != (int) chain.residues.size(); ++ir) {
+        int n = (int) chain.residues[ir].atoms.size();
+        if (n == 0)
+          continue;
+        size_t last = i + n - 1;
+        if (last >= size() || atom_idx[i] != 0 || atom_idx[last] != n - 1 ||
+            chain_idx[i] != ic || residue_idx[i] != ir ||
+            chain_idx[last] != ic || residue_idx[last] != ir)
+          return false;
+        i += n;
+      }
+    }
+    return i == size();
+  }
+
+  /// @brief Copy coordinates, B, occupancies and ADPs from the model to the table.
+  /// The hierarchy must not have changed since build().
+  void update_from(const Model& model) {
+    check_matches(model);
+    for (size_t i = 0; i != size(); ++i)
+      copy_numbers(atom(model, i), i);
+  }
+
+  /// @brief Copy coordinates, B, occupancies and ADPs from the table to the model.
+  /// The hierarchy must not have changed since build().
+  void copy_to(Model& model) const {
+    check_matches(model);
+    for (size_t i = 0; i != size(); ++i) {
+      Atom& a = atom(model, i);
+      a.pos = pos[i];
+      a.b_iso = b_iso[i];
+      a.occ = occ[i];
+      a.aniso = aniso[i];
+    }
+  }
+
+  Site site(size_t i) const {
+    return {pos[i], occ[i], b_iso[i], aniso[i], element[i], charge[i], serial[i]};
+  }
+
+  const Atom& atom(const Model& model, size_t i) const {
+    return model.chains[chain_idx[i]].residues[residue_idx[i]].atoms[atom_idx[i]];
+  }
+  Atom& atom(Model& model, size_t i) const {
+    return model.chains[chain_idx[i]].residues[residue_idx[i]].atoms[atom_idx[i]];
+  }
+  CRA to_cra(Model& model, size_t i) const {
+    Chain& c = model.chains.at(chain_idx.at(i));
+    Residue& r = c.residues.at(residue_idx[i]);
+    return {&c, &r, &r.atoms.at(atom_idx[i])};
+  }
+  const_CRA to_cra(const Model& model, size_t i) const {
+    const Chain& c = model.chains.at(chain_idx.at(i));
+    const Residue& r = c.residues.at(residue_idx[i]);
+    return {&c, &r, &r.atoms.at(atom_idx[i])};
+  }
+
+private:
+  void resize(size_t n) {
+    pos.resize(n);
+    b_iso.resize(n);
+    occ.resize(n);
+    aniso.resize(n);
+    element.resize(n, El::X);
+    charge.resize(n);
+    altloc.resize(n);
+    flag.resize(n);
+    serial.resize(n);
+    chain_idx.resize(n);
+    residue_idx.resize(n);
+    atom_idx.resize(n);
+  }
+
+  void copy_numbers(const Atom& a, size_t i) {
+    pos[i] = a.pos;
+    b_iso[i] = a.b_iso;
+    occ[i] = a.occ;
+    aniso[i] = a.aniso;
+  }
+
+  void check_matches(const Model& model) const {
+    if (!matches(model))
+      fail("AtomTable doesn't match the model, call build() after modifying the model");
+  }
+};
+
+/// @brief Copy one member (pos, b_iso, occ, ...) of all atoms in the model
+/// to an array, in the same order as in AtomTable, without building a table.
+/// @param out must have room for count_atom_sites(model) values
+template<typename T>
+void copy_atom_values(const Model& model, T Atom::*member, T* out) {
+  for (const Chain& chain : model.chains)
+    for (const Residue& res : chain.residues)
+      for (const Atom& atom : res.atoms)
+        *out++ = atom.*member;
+}
+
+/// @brief The reverse of copy_atom_values(): set one member of all atoms.
+/// @param values array of count_atom_sites(model) values
+template<typename T>
+void set_atom_values(Model& model, T Atom::*member, const T* values) {
+  for (Chain& chain : model.chains)
+    for (Residue& res : chain.residues)
+      for (Atom& atom : res.atoms)
+        atom.*member = *values++;
+}
+
+/// @brief Calculate the center of mass of atoms in the table.
+inline CenterOfMass calculate_center_of_mass(const AtomTable& table) {
+  CenterOfMass total{{}, 0.};
+  for (size_t i = 0; i != table.size(); ++i) {
+    double w_mass = table.element[i].weight() * table.occ[i];
+    total.weighted_sum += table.pos[i] * w_mass;
+    total.mass += w_mass;
+  }
+  return total;
+}
+
+/// @brief Calculate min and max isotropic B-factors in the table.
+inline std::pair<float,float> calculate_b_iso_range(const AtomTable& table) {
+  std::pair<float, float> range{INFINITY, -INFINITY};
+  for (float b : table.b_iso) {
+    range.first = std::min(range.first, b);
+    range.second = std::max(range.second, b);
+  }
+  return range;
+}
+
+/// @brief Apply transformation to positions and ADPs in the table.
+inline void transform_pos_and_adp(AtomTable& table, const Transform& tr) {
+  for (size_t i = 0; i != table.size(); ++i) {
+    table.pos[i] = Position(tr.apply(table.pos[i]));
+    if (table.aniso[i].nonzero())
+      table.aniso[i] = table.aniso[i].transformed_by<float>(tr.mat);
+  }
+}
+
+} // namespace gemmi
+#endif
@@ -8,6 +8,7 @@
 
 #include <vector>
 #include <limits>        // for numeric_limits
+#include "parallel.hpp"  // for parallel_for_chunks
 #include "unitcell.hpp"  // for UnitCell
 
 namespace gemmi {
@@ -170,40 +171,64 @@ struct Binner {
     return get_bin_from_1_d2_hinted(inv_d2, hint);
   }
 
+  /// @brief Find bin index using branchless binary search.
+  /// Gives the same result as get_bin_from_1_d2(), but the time doesn't
+  /// depend on the order of reflections (no mispredicted branches).
+  /// @param inv_d2 Squared reciprocal resolution (1/d^2).
+  /// @return Bin index (0 to size()-1).
+  int get_bin_from_1_d2_branchless(double inv_d2) const {
+    const double* first = limits.data();
+    const double* base = first;
+    for (size_t n = limits.size(); n > 1; ) {
+      size_t half = n / 2;
+      base = base[half] < inv_d2 ? base + half : base;
+      n -= half;
+    }
+    return int(base - first) + int(*base < inv_d2);
+  }
+
   /// @brief Get bin indices for all reflections in a DataProxy.
-  /// Uses hinting for fast processing of sorted data.
+  /// Reflections are processed in chunks, optionally on multiple threads.
   /// @tparam DataProxy Type with size(), stride(), get_hkl() interface.
   /// @param proxy Data proxy object.
+  /// @param nthreads Number of threads (see resolve_thread_count()).
   /// @return Vector of bin indices (length = proxy.size() / proxy.stride()).
   template<typename DataProxy>
-  std::vector<int> get_bins(const DataProxy& proxy) const {
+  std::vector<int> get_bins(const DataProxy& proxy, int nthreads=1) const {
     ensure_limits_are_set();
-    int hint = 0;
-    std::vector<int> nums(proxy.size() / proxy.stride());
-    for (size_t i = 0, offset = 0; i < nums.size(); ++i, offset += proxy.stride())
-      nums[i] = get_bin_hinted(proxy.get_hkl(offset), hint);
+    size_t stride = proxy.stride();
+    std::vector<int> nums(proxy.size() / stride);
+    parallel_for_chunks(nums.size(), 1 << 14, nthreads, [&](size_t begin, size_t end) {
+      fill_bins(begin, end, nums.data(), [&](size_t i) {
+          return cell.calculate_1_d2(proxy.get_hkl(i * stride));
+      });
+    });
     return nums;
   }
 
   /// @brief Get bin indices for an array of 1/d^2 values.
-  /// Uses hinting for fast processing of sorted data.
+  /// Values are processed in chunks, optionally on multiple threads.
   /// @param inv_d2 Pointer to array of squared reciprocal resolutions.
   /// @param size Number of values in array.
+  /// @param nthreads Number of threads (see resolve_thread_count()).
   /// @return Vector of bin indices (length = size).
-  std::vector<int> get_bins_from_1_d2(const double* inv_d2, size_t size) const {
+  std::vector<int> get_bins_from_1_d2(const double* inv_d2, size_t size,
+                                      int nthreads=1) const {
     ensure_limits_are_set();
-    int hint = 0;
     std::vector<int> nums(size);
-    for (size_t i = 0; i < size; ++i)
-      nums[i] = get_bin_from_1_d2_hinted(inv_d2[i], hint);
+    parallel_for_chunks(size, 1 << 14, nthreads, [&](size_t begin, size_t end) {
+      fill_bins(begin, end, nums.data(), [&](size_t i) { return inv_d2[i]; });
+    });
     return nums;
   }
 
   /// @brief Get bin indices for a vector of 1/d^2 values.
   /// @param inv_d2 Vector of squared reciprocal resolutions.
+  /// @param nthreads Number of threads (see resolve_thread_count()).
   /// @return Vector of bin indices (length = inv_d2.size()).
-  std::vector<int> get_bins_from_1_d2(const std::vector<double>& inv_d2) const {
-    return get_bins_from_1_d2(inv_d2.data(), inv_d2.size());
+  std::vector<int> get_bins_from_1_d2(const std::vector<double>& inv_d2,
+                                      int nthreads=1) const {
+    return get_bins_from_1_d2(inv_d2.data(), inv_d2.size(), nthreads);
   }
 
   /// @brief Get minimum resolution (highest 1/d^2) of a bin.
@@ -227,6 +252,28 @@ struct Binner {
   double max_1_d2;               ///< Maximum 1/d^2 in data (highest resolution)
   std::vector<double> limits;    ///< Upper limit (1/d^2) of each bin
   std::vector<double> mids;      ///< Midpoint (1/d^2) of each bin
+
+private:
+  // Hinted search is the fastest for data sorted by resolution or by hkl.
+  // If the hint is often far from the result (unsorted data),
+  // the rest of the chunk is processed with branchless search.
+  template<typename Func>
+  void fill_bins(size_t begin, size_t end, int* nums, Func&& get_1_d2) const {
+    int hint = 0;
+    size_t far_jumps = 0;
+    size_t i = begin;
+    while (i != end) {
+      int prev = hint;
+      nums[i] = get_bin_from_1_d2_hinted(get_1_d2(i), hint);
+      if (hint > prev + 1 || hint < prev - 1)
+        ++far_jumps;
+      ++i;
+      if (far_jumps > 16 + (i - begin) / 8)
+        break;
+    }
+    for (; i != end; ++i)
+      nums[i] = get_bin_from_1_d2_branchless(get_1_d2(i));
+  }
 };
 
 } // namespace gemmi
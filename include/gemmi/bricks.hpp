@@ -0,0 +1,238 @@
+// Copyright 2026 Global Phasing Ltd.
+//
+// Sorting atoms into grid bricks for fast masking and rasterization.
+
+/// @file bricks.hpp
+/// @brief Rasterization of many spheres (atoms) on a grid, brick by brick.
+///
+/// Grid::use_points_around() handles one sphere at a time. When a whole model
+/// is put on a fine grid, it is faster to first sort the spheres into bricks
+/// (rectangular blocks of grid points) and then process each brick separately:
+/// all indices inside a brick are already normalized, rows of points are short
+/// contiguous arrays, and different bricks can be processed on different threads.
+///
+/// Distances are updated along rows in the same way as in Grid::use_points_in_box(),
+/// so the same points are selected as when the spheres are processed one by one.
+/// Grid::set_points_around(), which takes a single sphere, fills the rows
+/// with the same sphere_row_range() as SphereBricks::set_points() -- for one
+/// sphere, sorting into bricks would not save anything.
+
+#ifndef GEMMI_BRICKS_HPP_
+#define GEMMI_BRICKS_HPP_
+
+#include <cstdint>     // for int8_t, uint32_t
+#include <vector>
+#include "grid.hpp"      // for Grid, modulo, sphere_row_range
+#include "parallel.hpp"  // for parallel_for
+
+namespace gemmi {
+
+/// @brief A sphere to be rasterized: center in fractional coordinates and radius.
+struct GridSphere {
+  Fractional fpos;  ///< center in fractional coordinates
+  double radius;    ///< radius in Angstroms
+};
+
+/// @brief Spheres sorted into bricks of a grid with periodic boundary conditions.
+///
+/// Each sphere is assigned to all bricks overlapping its bounding box
+/// (the same box as in Grid::use_points_around() with PBC). The order of spheres
+/// within each brick is the same as in the input, so callbacks that depend
+/// on the order (e.g. "keep the first nearest atom") give the same results
+/// as the one-sphere-at-a-time approach.
+struct SphereBricks {
+  /// Sphere reference stored in a brick, with the periodic image shift.
+  struct Entry {
+    std::uint32_t sphere;        ///< index of the sphere
+    std::int8_t ku, kv, kw;      ///< image shift in units of nu, nv, nw
+  };
+  /// Sphere data precomputed for the rasterization.
+  struct Prepared {
+    double nx, ny, nz;           ///< center in grid units (fractional * n)
+    double r2;                   ///< squared radius
+    int u_lo, u_hi, v_lo, v_hi, w_lo, w_hi;  ///< bounding box, shifted by base_*
+    int base_u, base_v, base_w;  ///< shift (multiple of n) that puts the center in the cell
+  };
+
+  int brick_u = 256; ///< brick size along u (rows are contiguous in memory)
+  int brick_v = 16;  ///< brick size along v
+  int brick_w = 16;  ///< brick size along w
+  int nu = 0, nv = 0, nw = 0;     ///< grid dimensions
+  int nbu = 0, nbv = 0, nbw = 0;  ///< number of bricks along each axis
+  std::vector<Prepared> spheres;
+  std::vector<size_t> offsets;    ///< entries of brick i: [offsets[i], offsets[i+1])
+  std::vector<Entry> entries;
+
+  size_t brick_count() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+
+  /// @brief Sort spheres into bricks of the grid.
+  /// @param grid grid whose dimensions and spacing are used
+  /// @param input spheres to be sorted
+  template<typename T>
+  void prepare(const Grid<T>& grid, const std::vector<GridSphere>& input) {
+    nu = grid.nu;
+    nv = grid.nv;
+    nw = grid.nw;
+    nbu = (nu + brick_u - 1) / brick_u;
+    nbv = (nv + brick_v - 1) / brick_v;
+    nbw = (nw + brick_w - 1) / brick_w;
+    spheres.resize(input.size());
+    for (size_t i = 0; i != input.size(); ++i) {
+      const GridSphere& s = input[i];
+      Prepared& p = spheres[i];
+      p.nx = s.fpos.x * nu;
+      p.ny = s.fpos.y * nv;
+      p.nz = s.fpos.z * nw;
+      p.r2 = s.radius * s.radius;
+      // the same limits as in use_points_around() + check_size_for_points_in_box()
+      int du = std::min((int) std::ceil(s.radius / grid.spacing[0]), nu - 1);
+      int dv = std::min((int) std::ceil(s.radius / grid.spacing[1]), nv - 1);
+      int dw = std::min((int) std::ceil(s.radius / grid.spacing[2]), nw - 1);
+      int u0 = iround(p.nx);
+      int v0 = iround(p.ny);
+      int w0 = iround(p.nz);
+      // keep image shifts of the bricks small (they are stored as int8)
+      p.base_u = u0 - modulo(u0, nu);
+      p.base_v = v0 - modulo(v0, nv);
+      p.base_w = w0 - modulo(w0, nw);
+      u0 -= p.base_u;
+      v0 -= p.base_v;
+      w0 -= p.base_w;
+      p.u_lo = u0 - du;
+      p.u_hi = u0 + du;
+      p.v_lo = v0 - dv;
+      p.v_hi = v0 + dv;
+      p.w_lo = w0 - dw;
+      p.w_hi = w0 + dw;
+    }
+    // two passes: count entries per brick, then fill them in
+    offsets.assign(size_t(nbu) * nbv * nbw + 1, 0);
+    for (size_t i = 0; i != spheres.size(); ++i)
+      for_bricks_of(spheres[i], [&](size_t brick, int, int, int) { ++offsets[brick+1]; });
+    for (size_t i = 1; i < offsets.size(); ++i)
+      offsets[i] += offsets[i-1];
+    entries.resize(offsets.back());
+    std::vector<size_t> pos(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i != spheres.size(); ++i)
+      for_bricks_of(spheres[i], [&](size_t brick, int ku, int kv, int kw) {
+        entries[pos[brick]++] = {(std::uint32_t)i, (std::int8_t)ku,
+                                 (std::int8_t)kv, (std::int8_t)kw};
+      });
+  }
+
+  /// @brief Process rows of grid points inside spheres, brick by brick.
+  ///
+  /// For each sphere and each row of points (constant v and w) that is both
+  /// in the brick and in the sphere's bounding box, row_func is called as
+  /// row_func(ptr, len, dx0, a11, dist_sq0, r2, sphere, u, v, w),
+  /// where ptr points to the first point of the row segment, (u, v, w) are
+  /// its non-normalized indices (as in use_points_in_box()), and the
+  /// squared distance of a point is dist_sq0 + dx^2, with dx starting at dx0
+  /// and decreased by a11 at each next point. dx0 is obtained in the same way,
+  /// starting from the first point of the sphere's bounding box, so that
+  /// rounding is the same as in Grid::use_points_in_box().
+  /// Different bricks are processed in parallel.
+  template<typename T, typename RowFunc>
+  void for_each_row(Grid<T>& grid, RowFunc&& row_func, int nthreads=1) const {
+    if (grid.nu != nu || grid.nv != nv || grid.nw != nw)
+      fail("SphereBricks: grid size differs from the prepared one");
+    const UpperTriangularMat33& orth_n = grid.orth_n;
+    parallel_for(brick_count(), nthreads, [&](size_t brick) {
+      int bu = int(brick % nbu);
+      int bv = int(brick / nbu % nbv);
+      int bw = int(brick / (size_t(nbu) * nbv));
+      int bu_lo = bu * brick_u, bu_hi = std::min(bu_lo + brick_u, nu) - 1;
+      int bv_lo = bv * brick_v, bv_hi = std::min(bv_lo + brick_v, nv) - 1;
+      int bw_lo = bw * brick_w, bw_hi = std::min(bw_lo + brick_w, nw) - 1;
+      for (size_t n = offsets[brick]; n != offsets[brick+1]; ++n) {
+        const Entry& e = entries[n];
+        const Prepared& s = spheres[e.sphere];
+        int su = e.ku * nu, sv = e.kv * nv, sw = e.kw * nw;
+        // the box of the sphere in normalized coordinates intersected with the brick
+        int u_lo = std::max(s.u_lo - su, bu_lo), u_hi = std::min(s.u_hi - su, bu_hi);
+        int v_lo = std::max(s.v_lo - sv, bv_lo), v_hi = std::min(s.v_hi - sv, bv_hi);
+        int w_lo = std::max(s.w_lo - sw, bw_lo), w_hi = std::min(s.w_hi - sw, bw_hi);
+        su += s.base_u;
+        sv += s.base_v;
+        sw += s.base_w;
+        int len = u_hi - u_lo + 1;
+        // number of points between the start of the box and the start of the segment
+        int skip = u_lo - (s.u_lo - e.ku * nu);
+        Fractional fdelta(s.nx - (s.u_lo + s.base_u), 0, 0);
+        for (int w = w_lo; w <= w_hi; ++w) {
+          fdelta.z = s.nz - (w + sw);
+          for (int v = v_lo; v <= v_hi; ++v) {
+            fdelta.y = s.ny - (v + sv);
+            Position delta(orth_n.multiply(fdelta));
+            double dist_sq0 = sq(delta.y) + sq(delta.z);
+            if (dist_sq0 > s.r2)
+              continue;
+            for (int k = 0; k < skip; ++k)
+              delta.x -= orth_n.a11;
+            T* ptr = &grid.data[grid.index_q(u_lo, v, w)];
+            row_func(ptr, len, delta.x, orth_n.a11, dist_sq0, s.r2,
+                     (size_t) e.sphere, u_lo + su, v + sv, w + sw);
+          }
+        }
+      }
+    });
+  }
+
+  /// @brief Call func(ref, dist_sq, sphere, u, v, w) for each grid point within spheres.
+  /// @param grid grid with the same dimensions as in prepare()
+  /// @param func callback; u, v, w are non-normalized indices (as in use_points_in_box())
+  /// @param nthreads number of threads (0 = all available)
+  template<typename T, typename Func>
+  void use_points(Grid<T>& grid, Func&& func, int nthreads=1) const {
+    for_each_row(grid, [&](T* ptr, int len, double dx0, double a11, double dist_sq0,
+                           double r2, size_t sphere, int u, int v, int w) {
+      double dx = dx0;
+      for (int k = 0; k < len; ++k) {
+        double d2 = dist_sq0 + sq(dx);
+        if (!(d2 > r2))
+          func(ptr[k], d2, sphere, u + k, v, w);
+        dx -= a11;
+      }
+    }, nthreads);
+  }
+
+  /// @brief Set all grid points within spheres to value.
+  ///
+  /// Points of a row that are inside a sphere form a contiguous range;
+  /// the range is found with sphere_row_range() and filled without per-point tests.
+  template<typename T>
+  void set_points(Grid<T>& grid, T value, int nthreads=1) const {
+    for_each_row(grid, [&](T* ptr, int len, double dx0, double a11, double dist_sq0,
+                           double r2, size_t, int, int, int) {
+      int k_lo, k_hi;
+      if (sphere_row_range(len, dx0, a11, dist_sq0, r2, k_lo, k_hi))
+        std::fill(ptr + k_lo, ptr + k_hi + 1, value);
+    }, nthreads);
+  }
+
+private:
+  // Calls func(brick_index, ku, kv, kw) for each brick overlapping the box of s.
+  template<typename Func>
+  void for_bricks_of(const Prepared& s, Func&& func) const {
+    auto k_lo = [](int lo, int n) { return (lo - modulo(lo, n)) / n; };
+    for (int kw = k_lo(s.w_lo, nw); kw * nw <= s.w_hi; ++kw) {
+      int w_lo = std::max(s.w_lo - kw * nw, 0) / brick_w;
+      int w_hi = std::min(s.w_hi - kw * nw, nw - 1) / brick_w;
+      for (int kv = k_lo(s.v_lo, nv); kv * nv <= s.v_hi; ++kv) {
+        int v_lo = std::max(s.v_lo - kv * nv, 0) / brick_v;
+        int v_hi = std::min(s.v_hi - kv * nv, nv - 1) / brick_v;
+        for (int ku = k_lo(s.u_lo, nu); ku * nu <= s.u_hi; ++ku) {
+          int u_lo = std::max(s.u_lo - ku * nu, 0) / brick_u;
+          int u_hi = std::min(s.u_hi - ku * nu, nu - 1) / brick_u;
+          for (int bw = w_lo; bw <= w_hi; ++bw)
+            for (int bv = v_lo; bv <= v_hi; ++bv)
+              for (int bu = u_lo; bu <= u_hi; ++bu)
+                func((size_t(bw) * nbv + bv) * nbu + bu, ku, kv, kw);
+        }
+      }
+    }
+  }
+};
+
+} // namespace gemmi
+#endif
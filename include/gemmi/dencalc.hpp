@@ -18,6 +18,7 @@
 #include "grid.hpp"     // for Grid
 #include "model.hpp"    // for Structure, ...
 #include "calculate.hpp" // for calculate_b_aniso_range
+#include "atomtable.hpp" // for AtomTable
 
 namespace gemmi {
 
@@ -190,6 +191,7 @@ struct DensityCalculator {
   }
 
   /// @brief Internal: place electron density on grid for an atom with given scattering factors.
+  /// @tparam Site Atom or AtomTable::Site
   /// @tparam Coef Scattering factor coefficients type
   /// @param atom Atom with position, occupancy, B-factor, anisotropic U-tensor
   /// @param coef Precalculated scattering factor coefficients (from Table::get())
@@ -197,8 +199,8 @@ struct DensityCalculator {
   ///
   /// Handles isotropic B-factor case with radial density sampling and anisotropic case
   /// with box-based sampling respecting the anisotropic U-tensor.
-  template<typename Coef>
-  void do_add_atom_density_to_grid(const Atom& atom, const Coef& coef, float addend) {
+  template<typename Site, typename Coef>
+  void do_add_atom_density_to_grid(const Site& atom, const Coef& coef, float addend) {
 #if GEMMI_COUNT_DC
     ++atoms_added;
 #endif
@@ -267,6 +269,19 @@ struct DensityCalculator {
           add_atom_density_to_grid(atom);
   }
 
+  /// @brief Add electron density contributions from all atoms in a table.
+  /// @param table AtomTable built from a model
+  ///
+  /// Same as add_model_density_to_grid(), but reads atoms from contiguous arrays.
+  void add_model_density_to_grid(const AtomTable& table) {
+    grid.check_not_empty();
+    for (size_t i = 0; i != table.size(); ++i) {
+      Element el = table.element[i];
+      const auto& coef = Table::get(el, table.charge[i], table.serial[i]);
+      do_add_atom_density_to_grid(table.site(i), coef, addends.get(el));
+    }
+  }
+
   /// @brief Initialize grid and add all atom densities from a model.
   /// @param model Atomic model
   ///
@@ -277,6 +292,14 @@ struct DensityCalculator {
     grid.symmetrize_sum();
   }
 
+  /// @brief Initialize grid and add all atom densities from an AtomTable.
+  /// @param table AtomTable built from a model
+  void put_model_density_on_grid(const AtomTable& table) {
+    initialize_grid();
+    add_model_density_to_grid(table);
+    grid.symmetrize_sum();
+  }
+
   /// @brief Set grid unit cell and space group from a structure.
   /// @param st Structure providing unit cell and space group
   /// @deprecated Use grid.setup_from(st) directly
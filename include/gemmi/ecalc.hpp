@@ -7,50 +7,21 @@
 
 #include <cassert>
 #include "binner.hpp"
+#include "reflgeom.hpp"  // for ReflectionGeometry
 
 namespace gemmi {
 
-/// @brief Compute per-reflection amplitude normalization factors for E-scale conversion.
-/// Uses the Karle approach: E = F / sqrt(Σ f²), with resolution-bin-based averaging and smoothing.
-/// @tparam DataProxy Type satisfying the data proxy interface: must provide size(), stride(),
-///         spacegroup(), unit_cell(), get_hkl(n), and get_num(n) methods.
-/// @param data Data proxy (e.g., MtzDataProxy or ReflDataProxy).
-/// @param fcol_idx Column index of F amplitudes in the proxy.
-/// @param binner Binner object defining resolution shells.
-/// @return Vector of multipliers (one per reflection); NaN for missing values.
-///         Algorithm: collects F² in bins, applies [0.75, 1, 0.75] smoothing kernel,
-///         returns 1/sqrt(<F²>) per reflection for normalization.
-template<typename DataProxy>
-std::vector<double> calculate_amplitude_normalizers(const DataProxy& data, int fcol_idx,
-                                                    const Binner& binner) {
-  struct CountAndSum {
-    int n = 0;
-    double sum = 0.;
-  };
-  int nreflections = data.size() / data.stride();
-  std::vector<double> multipliers(nreflections, NAN);
-  if (data.spacegroup() == nullptr)
-    gemmi::fail("unknown space group in the data file");
-  GroupOps gops = data.spacegroup()->operations();
-  std::vector<double> inv_d2(multipliers.size());
-  for (size_t i = 0, n = 0; n < data.size(); n += data.stride(), ++i)
-    inv_d2[i] = data.unit_cell().calculate_1_d2(data.get_hkl(n));
-  std::vector<int> bin_index = binner.get_bins_from_1_d2(inv_d2);
-  std::vector<CountAndSum> stats(binner.size());
-  for (size_t i = 0, n = 0; n < data.size(); n += data.stride(), i++) {
-    Miller hkl = data.get_hkl(n);
-    double f = data.get_num(n + fcol_idx);
-    if (!std::isnan(f)) {
-      int epsilon = gops.epsilon_factor(hkl);
-      double inv_epsilon = 1.0 / epsilon;
-      double f2 = f * f * inv_epsilon;
-      multipliers[i] = std::sqrt(inv_epsilon);
-      CountAndSum& cs = stats[bin_index[i]];
-      cs.n++;
-      cs.sum += f2;
-    }
-  }
+namespace impl {
+struct CountAndSum {
+  int n = 0;
+  double sum = 0.;
+};
 
+// Smooth <F^2/epsilon> in bins and divide multipliers by interpolated rms.
+inline void divide_by_smoothed_rms(std::vector<double>& multipliers,
+                                   const std::vector<CountAndSum>& stats,
+                                   const double* inv_d2, const int* bin_index,
+                                   const Binner& binner) {
   // simple smoothing with kernel [0.75 1 0.75]
   std::vector<double> smoothed(stats.size());
   {
@@ -68,8 +39,8 @@ std::vector<double> calculate_amplitude_normalizers(const DataProxy& data, int f
     // print shell statistics
     std::vector<int> refl_counts(binner.size());
     printf(" shell\t    #F\t    d\t <F^2>\tsmoothd\t  #refl\t mid d\n");
-    for (int idx : bin_index)
-      ++refl_counts[idx];
+    for (size_t i = 0; i < multipliers.size(); ++i)
+      ++refl_counts[bin_index[i]];
     for (size_t i = 0; i < binner.size(); ++i) {
       double d = 1 / std::sqrt(binner.limits[i]);
       double mid_d = 1 / std::sqrt(binner.mids[i]);
@@ -100,6 +71,80 @@ std::vector<double> calculate_amplitude_normalizers(const DataProxy& data, int f
     }
     multipliers[i] /= rms;
   }
+}
+} // namespace impl
+
+/// @brief Compute per-reflection amplitude normalization factors for E-scale conversion.
+/// Uses the Karle approach: E = F / sqrt(Σ f²), with resolution-bin-based averaging and smoothing.
+/// @tparam DataProxy Type satisfying the data proxy interface: must provide size(), stride(),
+///         spacegroup(), unit_cell(), get_hkl(n), and get_num(n) methods.
+/// @param data Data proxy (e.g., MtzDataProxy or ReflDataProxy).
+/// @param fcol_idx Column index of F amplitudes in the proxy.
+/// @param binner Binner object defining resolution shells.
+/// @return Vector of multipliers (one per reflection); NaN for missing values.
+///         Algorithm: collects F² in bins, applies [0.75, 1, 0.75] smoothing kernel,
+///         returns 1/sqrt(<F²>) per reflection for normalization.
+template<typename DataProxy>
+std::vector<double> calculate_amplitude_normalizers(const DataProxy& data, int fcol_idx,
+                                                    const Binner& binner) {
+  int nreflections = data.size() / data.stride();
+  std::vector<double> multipliers(nreflections, NAN);
+  if (data.spacegroup() == nullptr)
+    gemmi::fail("unknown space group in the data file");
+  GroupOps gops = data.spacegroup()->operations();
+  std::vector<double> inv_d2(multipliers.size());
+  for (size_t i = 0, n = 0; n < data.size(); n += data.stride(), ++i)
+    inv_d2[i] = data.unit_cell().calculate_1_d2(data.get_hkl(n));
+  std::vector<int> bin_index = binner.get_bins_from_1_d2(inv_d2);
+  std::vector<impl::CountAndSum> stats(binner.size());
+  for (size_t i = 0, n = 0; n < data.size(); n += data.stride(), i++) {
+    Miller hkl = data.get_hkl(n);
+    double f = data.get_num(n + fcol_idx);
+    if (!std::isnan(f)) {
+      int epsilon = gops.epsilon_factor(hkl);
+      double inv_epsilon = 1.0 / epsilon;
+      double f2 = f * f * inv_epsilon;
+      multipliers[i] = std::sqrt(inv_epsilon);
+      impl::CountAndSum& cs = stats[bin_index[i]];
+      cs.n++;
+      cs.sum += f2;
+    }
+  }
+  impl::divide_by_smoothed_rms(multipliers, stats, inv_d2.data(), bin_index.data(), binner);
+  return multipliers;
+}
+
+/// @brief The same as above, but 1/d², epsilon factors and (if assigned)
+/// bins are taken from ReflectionGeometry computed for the same reflections.
+template<typename DataProxy>
+std::vector<double> calculate_amplitude_normalizers(const DataProxy& data, int fcol_idx,
+                                                    const Binner& binner,
+                                                    const ReflectionGeometry& geom) {
+  size_t nreflections = data.size() / data.stride();
+  if (geom.size() != nreflections)
+    fail("calculate_amplitude_normalizers: ReflectionGeometry has wrong size");
+  if (geom.epsilon.size() != nreflections)
+    fail("unknown space group in the data file");
+  std::vector<double> multipliers(nreflections, NAN);
+  std::vector<int> bin_index;
+  const int* bins = geom.bin.data();
+  if (geom.bin.size() != nreflections) {
+    bin_index = binner.get_bins_from_1_d2(geom.inv_d2);
+    bins = bin_index.data();
+  }
+  std::vector<impl::CountAndSum> stats(binner.size());
+  for (size_t i = 0, n = 0; i < nreflections; n += data.stride(), i++) {
+    double f = data.get_num(n + fcol_idx);
+    if (!std::isnan(f)) {
+      double inv_epsilon = 1.0 / geom.epsilon[i];
+      double f2 = f * f * inv_epsilon;
+      multipliers[i] = std::sqrt(inv_epsilon);
+      impl::CountAndSum& cs = stats[bins[i]];
+      cs.n++;
+      cs.sum += f2;
+    }
+  }
+  impl::divide_by_smoothed_rms(multipliers, stats, geom.inv_d2.data(), bins, binner);
   return multipliers;
 }
 
@@ -57,6 +57,47 @@ inline int modulo(int a, int n) {
   return a;
 }
 
+/// @brief Find the points of a row of grid points that are within a sphere.
+///
+/// Point k of the row (0 <= k < len) is inside if dist_sq0 + dx^2 <= r2,
+/// where dx starts at dx0 and is decreased by a11 at each step -- the same
+/// incremental update as in Grid::use_points_in_box(), so that the same points
+/// are selected. The range is estimated from the quadratic equation;
+/// only points near its ends are tested.
+/// @param len number of points in the row
+/// @param dx0 x component of (center - first point), in Angstroms
+/// @param a11 distance between consecutive points in the row (orth_n.a11)
+/// @param dist_sq0 squared distance in the yz plane
+/// @param r2 squared radius
+/// @param k_lo set to the first point inside
+/// @param k_hi set to the last point inside
+/// @return false if no points of the row are inside
+inline bool sphere_row_range(int len, double dx0, double a11, double dist_sq0, double r2,
+                             int& k_lo, int& k_hi) {
+  double h = std::sqrt(std::max(r2 - dist_sq0, 0.));
+  auto clamp = [len](double x) { return (int) std::min(std::max(x, 0.), (double) len); };
+  // points more than one step away from the estimated ends are not tested
+  int skip_lo = clamp(std::ceil((dx0 - h) / a11) - 1);
+  int skip_hi = clamp(std::floor((dx0 + h) / a11) - 1);
+  int end = clamp(std::floor((dx0 + h) / a11) + 2);
+  double dx = dx0;
+  auto outside = [&] { return dist_sq0 + sq(dx) > r2; };
+  int k = 0;
+  for (; k < skip_lo; ++k)
+    dx -= a11;
+  for (; k < end && outside(); ++k)
+    dx -= a11;
+  if (k >= end)
+    return false;
+  k_lo = k;
+  for (; k < skip_hi; ++k)
+    dx -= a11;
+  for (; k < end && !outside(); ++k)
+    dx -= a11;
+  k_hi = k - 1;
+  return true;
+}
+
 /// @brief Check if n has only small prime factors (2, 3, 5).
 /// @param n Integer to check
 /// @return True if n = 2^a * 3^b * 5^c for non-negative a, b, c
@@ -954,19 +995,24 @@ struct Grid : GridBase<T> {
     }
   }
 
-  /// @brief Internal: iterate over grid points in a box around a fractional coordinate.
+  /// @brief Internal: iterate over rows (lines along u) of grid points in a box.
+  ///
+  /// For each row with points within the radius, calls
+  /// row_func(len, u_, v_, w_, delta, dist_sq0, u, v, w), where
+  /// len is the number of points in the row, (u_, v_, w_) are normalized and
+  /// (u, v, w) non-normalized indices of the first point, delta is the
+  /// position of the center relative to the first point and
+  /// dist_sq0 = delta.y^2 + delta.z^2. With PBC, the row can wrap around.
   /// @tparam UsePbc If true, apply periodic boundary conditions
-  /// @tparam Func Callable(T&, double, Position, int, int, int) invoked for each point
   /// @param fctr Fractional center coordinate
   /// @param du Half-extent along first axis (in grid points)
   /// @param dv Half-extent along second axis (in grid points)
   /// @param dw Half-extent along third axis (in grid points)
-  /// @param func Callback function(value_ref, distance_sq, delta_position, u, v, w)
-  /// @param radius Optional spherical radius limit (INFINITY for box only)
-  template <bool UsePbc, typename Func>
-  void do_use_points_in_box(const Fractional& fctr, int du, int dv, int dw, Func&& func,
-                            double radius=INFINITY) {
-    double max_dist_sq = radius * radius;
+  /// @param max_dist_sq Squared radius (INFINITY for box only)
+  /// @param row_func Callback function called for each row
+  template <bool UsePbc, typename RowFunc>
+  void do_use_rows_in_box(const Fractional& fctr, int du, int dv, int dw,
+                          double max_dist_sq, RowFunc&& row_func) {
     const Fractional nctr(fctr.x * nu, fctr.y * nv, fctr.z * nw);
     int u0 = iround(nctr.x);
     int v0 = iround(nctr.y);
@@ -984,6 +1030,8 @@ struct Grid : GridBase<T> {
       v_hi = std::min(v_hi, nv - 1);
       w_lo = std::max(w_lo, 0);
       w_hi = std::min(w_hi, nw - 1);
+      if (u_lo > u_hi)
+        return;
     }
     int u_0 = UsePbc ? modulo(u_lo, nu) : u_lo;
     int v_0 = UsePbc ? modulo(v_lo, nv) : v_lo;
@@ -995,29 +1043,48 @@ struct Grid : GridBase<T> {
       for (int v = v_lo, v_ = v_0; v <= v_hi; ++v, wrap(++v_, nv)) {
         fdelta.y = nctr.y - v;
         Position delta(orth_n.multiply(fdelta));
-        T* t = &data[this->index_q(u_0, v_, w_)];
         double dist_sq0 = sq(delta.y) + sq(delta.z);
         if (dist_sq0 > max_dist_sq)
           continue;
-        for (int u = u_lo, u_ = u_0;;) {
-          double dist_sq = dist_sq0 + sq(delta.x);
-          if (!(dist_sq > max_dist_sq))
-            func(*t, dist_sq, delta, u, v, w);
-          if (u >= u_hi)
-            break;
-          ++u;
-          ++u_;
-          ++t;
-          if (UsePbc && u_ == nu) {
-            u_ = 0;
-            t -= nu;
-          }
-          delta.x -= orth_n.a11;
-        }
+        row_func(u_hi - u_lo + 1, u_0, v_, w_, delta, dist_sq0, u_lo, v, w);
       }
     }
   }
 
+  /// @brief Internal: iterate over grid points in a box around a fractional coordinate.
+  /// @tparam UsePbc If true, apply periodic boundary conditions
+  /// @tparam Func Callable(T&, double, Position, int, int, int) invoked for each point
+  /// @param fctr Fractional center coordinate
+  /// @param du Half-extent along first axis (in grid points)
+  /// @param dv Half-extent along second axis (in grid points)
+  /// @param dw Half-extent along third axis (in grid points)
+  /// @param func Callback function(value_ref, distance_sq, delta_position, u, v, w)
+  /// @param radius Optional spherical radius limit (INFINITY for box only)
+  template <bool UsePbc, typename Func>
+  void do_use_points_in_box(const Fractional& fctr, int du, int dv, int dw, Func&& func,
+                            double radius=INFINITY) {
+    double max_dist_sq = radius * radius;
+    do_use_rows_in_box<UsePbc>(fctr, du, dv, dw, max_dist_sq,
+        [&](int len, int u_, int v_, int w_, Position& delta, double dist_sq0,
+            int u, int v, int w) {
+      T* t = &data[this->index_q(u_, v_, w_)];
+      for (int u_end = u + len;;) {
+        double dist_sq = dist_sq0 + sq(delta.x);
+        if (!(dist_sq > max_dist_sq))
+          func(*t, dist_sq, delta, u, v, w);
+        if (++u == u_end)
+          break;
+        ++u_;
+        ++t;
+        if (UsePbc && u_ == nu) {
+          u_ = 0;
+          t -= nu;
+        }
+        delta.x -= orth_n.a11;
+      }
+    });
+  }
+
   /// @brief Iterate over grid points in a box around a fractional coordinate.
   /// @tparam UsePbc If true, apply periodic boundary conditions
   /// @tparam Func Callable(T&, double, Position, int, int, int) invoked for each point
@@ -1064,9 +1131,44 @@ struct Grid : GridBase<T> {
   void set_points_around(const Position& ctr, double radius, T value, bool use_pbc=true) {
     Fractional fctr = unit_cell.fractionalize(ctr);
     if (use_pbc)
-      use_points_around<true>(fctr, radius, [&](T& ref, double) { ref = value; }, false);
+      fill_points_around<true>(fctr, radius, value);
     else
-      use_points_around<false>(fctr, radius, [&](T& ref, double) { ref = value; }, false);
+      fill_points_around<false>(fctr, radius, value);
+  }
+
+  /// @brief Internal: set points within a radius to value (see set_points_around()).
+  ///
+  /// Selects the same points as use_points_around(), but the points of a row
+  /// that are inside the sphere are found with sphere_row_range() and filled
+  /// without testing each one (as in SphereBricks::set_points()).
+  /// @tparam UsePbc If true, apply periodic boundary conditions
+  /// @param fctr Fractional center coordinate
+  /// @param radius Spherical radius (in Angstroms)
+  /// @param value Value to assign
+  template <bool UsePbc>
+  void fill_points_around(const Fractional& fctr, double radius, T value) {
+    int du = (int) std::ceil(radius / spacing[0]);
+    int dv = (int) std::ceil(radius / spacing[1]);
+    int dw = (int) std::ceil(radius / spacing[2]);
+    check_size_for_points_in_box<UsePbc>(du, dv, dw, false);
+    double r2 = radius * radius;
+    do_use_rows_in_box<UsePbc>(fctr, du, dv, dw, r2,
+        [&](int len, int u_, int v_, int w_, const Position& delta, double dist_sq0,
+            int, int, int) {
+      int k_lo, k_hi;
+      if (!sphere_row_range(len, delta.x, orth_n.a11, dist_sq0, r2, k_lo, k_hi))
+        return;
+      T* row = &data[this->index_q(0, v_, w_)];
+      // with PBC, the range can wrap around (more than once if 2*du >= nu)
+      for (int u = u_ + k_lo, n = k_hi - k_lo + 1; n > 0;) {
+        if (UsePbc)
+          u %= nu;
+        int m = std::min(n, nu - u);
+        std::fill(row + u, row + u + m, value);
+        u += m;
+        n -= m;
+      }
+    });
   }
 
   /// @brief Replace all occurrences of one value with another.
@@ -4,8 +4,13 @@
 
 #ifndef GEMMI_GZ_HPP_
 #define GEMMI_GZ_HPP_
+#include <memory>       // for unique_ptr
+#include <ostream>
+#include <streambuf>
 #include <string>
+#include <vector>
 #include "fail.hpp"     // GEMMI_DLL
+#include "fstream.hpp"  // Ofstream
 #include "input.hpp"    // BasicInput
 #include "util.hpp"     // iends_with
 
@@ -106,6 +111,62 @@ private:
   void* file_ = nullptr;
 };
 
+/// @brief Output stream buffer that writes a gzip-compressed file.
+/// @details Use it with std::ostream:
+///   GzOutputBuffer gzbuf(path); std::ostream os(&gzbuf); ... gzbuf.close();
+/// Call close() to check for errors; the destructor closes the file silently.
+class GEMMI_DLL GzOutputBuffer : public std::streambuf {
+public:
+  /// @brief Open file for writing.
+  /// @param path output file path
+  /// @param level compression level (1-9)
+  /// @throws std::system_error if the file cannot be opened
+  explicit GzOutputBuffer(const std::string& path, int level=6);
+  ~GzOutputBuffer() override;
+  /// @brief Write buffered data and close the file.
+  /// @throws std::runtime_error on write error
+  void close();
+
+protected:
+  int_type overflow(int_type ch) override;
+  std::streamsize xsputn(const char* s, std::streamsize n) override;
+  int sync() override;
+
+private:
+  void* file_ = nullptr;
+  std::string path_;
+  std::vector<char> buf_;
+  bool write_raw(const char* s, size_t n);
+  bool flush_buffer();
+};
+
+/// @brief Like Ofstream, but the output is gzipped if the filename ends with .gz.
+/// @details Call close() after writing to check for errors in gzipped output.
+struct MaybeGzippedOfstream {
+  /// @param filename UTF-8 file path (or "-" to use dash stream)
+  /// @param dash pointer to stream to use if filename is "-" (typically std::cout)
+  MaybeGzippedOfstream(const std::string& filename, std::ostream* dash=nullptr) {
+    if (iends_with(filename, ".gz")) {
+      gzbuf_.reset(new GzOutputBuffer(filename));
+      gzstream_.reset(new std::ostream(gzbuf_.get()));
+    } else {
+      ofstream_.reset(new Ofstream(filename, dash));
+    }
+  }
+  std::ostream& ref() { return gzstream_ ? *gzstream_ : ofstream_->ref(); }
+  /// @brief Finish gzipped output (no-op for uncompressed files).
+  /// @throws std::runtime_error on write error
+  void close() {
+    if (gzbuf_)
+      gzbuf_->close();
+  }
+
+private:
+  std::unique_ptr<GzOutputBuffer> gzbuf_;
+  std::unique_ptr<std::ostream> gzstream_;
+  std::unique_ptr<Ofstream> ofstream_;
+};
+
 } // namespace gemmi
 
 #endif
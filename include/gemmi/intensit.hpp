@@ -207,33 +207,40 @@ struct GEMMI_DLL Intensities {
   }
 
   /// @brief Sort reflections by (h, k, l, isign) in ascending order.
-  void sort() { std::sort(data.begin(), data.end()); }
+  /// Reflections with the same (h, k, l, isign) keep their relative order.
+  /// @param nthreads Number of threads (0 = all available cores).
+  void sort(int nthreads=1);
 
   /// @brief Merge reflections in-place to a specified data type (mean or anomalous).
   /// @param new_type Target data type for merged intensities.
-  void merge_in_place(DataType new_type);
+  /// @param nthreads Number of threads used for sorting and merging.
+  void merge_in_place(DataType new_type, int nthreads=1);
 
   /// @brief Create a merged copy without modifying this object.
   /// @param new_type Target data type for merged intensities.
+  /// @param nthreads Number of threads used for sorting and merging.
   /// @return New Intensities object with merged data.
-  Intensities merged(DataType new_type) {
+  Intensities merged(DataType new_type, int nthreads=1) {
     Intensities m(*this);
-    m.merge_in_place(new_type);
+    m.merge_in_place(new_type, nthreads);
     return m;
   }
 
   /// @brief Calculate R-merge and related statistics for each resolution shell.
   /// @param binner Resolution shell binning (or nullptr for all data in one shell).
   /// @param use_weights Weighting scheme: 'Y'=Aimless style, 'U'=unweighted, 'X'=XDS style.
+  /// @param nthreads Number of threads.
   /// @return Vector of MergingStats, one per shell.
   std::vector<MergingStats> calculate_merging_stats(const Binner* binner,
-                                                    char use_weights='Y') const;
+                                                    char use_weights='Y',
+                                                    int nthreads=1) const;
 
   /// @brief Prepare data for merging and classify anomalous/mean component.
   /// Call with DataType::Anomalous before calculate_merging_stats() to get I+/I- stats.
   /// @param new_type Target data type.
+  /// @param nthreads Number of threads used for sorting.
   /// @return Classified data type after preparation.
-  DataType prepare_for_merging(DataType new_type);
+  DataType prepare_for_merging(DataType new_type, int nthreads=1);
 
   /// @brief Convert unmerged ISYM indices to ASU indices using stored isym_ops.
   void switch_to_asu_indices();
@@ -278,6 +285,12 @@ struct GEMMI_DLL Intensities {
   /// @param xds XDS_ASCII object to read from.
   void import_xds(const XdsAscii& xds);
 
+  /// @brief Read XDS_ASCII or INTEGRATE.HKL file (possibly gzipped) directly,
+  /// without keeping all XdsAscii::Refl records in memory.
+  /// @param path File path.
+  /// @param nthreads Number of threads used for parsing.
+  void import_xds_file(const std::string& path, int nthreads=1);
+
   /// @brief Extract and store STARANISO B-tensor from MTZ file.
   /// @param mtz MTZ object to read from.
   /// @return STARANISO version string if found, empty string otherwise.
@@ -307,6 +320,124 @@ struct IntensitiesDataProxy {
   double get_num(size_t n) const { return intensities_.data[n].value; }
 };
 
+/// @brief Intensities stored in compact columns, for very large datasets.
+///
+/// Alternative to Intensities for unmerged data with ~10^8 observations
+/// (serial crystallography). Miller indices and isign are packed into
+/// a single 64-bit key, values and sigmas are stored as float, and each
+/// field is a separate array. One observation takes 19 bytes instead of 32.
+/// Sorting, merging and statistics work as in Intensities, except that
+/// results are stored in single precision.
+struct GEMMI_DLL CompactIntensities {
+  /// Miller indices must be in [-key_index_limit, key_index_limit).
+  static constexpr int key_index_limit = 1 << 19;
+
+  std::vector<std::uint64_t> key;          ///< Packed (h, k, l, isign), see make_key()
+  std::vector<float> value;                ///< Intensity values
+  std::vector<float> sigma;                ///< Standard deviations of intensities
+  std::vector<int8_t> isym;                ///< Symmetry operator encoding (ISYM)
+  std::vector<short> nobs;                 ///< Number of observations (set by merging)
+  const SpaceGroup* spacegroup = nullptr;  ///< Space group (not owned by this object)
+  UnitCell unit_cell;                      ///< Crystal unit cell parameters
+  double unit_cell_rmsd[6] = {0., 0., 0., 0., 0., 0.}; ///< RMSDs of unit cell parameters
+  double wavelength = 0.;                  ///< Diffraction wavelength in Angstroms
+  DataType type = DataType::Unknown;       ///< Type of intensity data stored
+  std::vector<Op> isym_ops;                ///< Symmetry operators (for unmerged data)
+
+  /// @brief Check if Miller indices can be packed with make_key().
+  static bool key_fits(const Miller& hkl) {
+    for (int j = 0; j < 3; ++j)
+      if (hkl[j] < -key_index_limit || hkl[j] >= key_index_limit)
+        return false;
+    return true;
+  }
+  /// @brief Pack (h, k, l, isign) into a key; keys sort like Intensities::Refl.
+  /// Indices must satisfy key_fits().
+  static std::uint64_t make_key(const Miller& hkl, int isign) {
+    return std::uint64_t(hkl[0] + key_index_limit) << 42 |
+           std::uint64_t(hkl[1] + key_index_limit) << 22 |
+           std::uint64_t(hkl[2] + key_index_limit) << 2 |
+           std::uint64_t(isign + 1);
+  }
+  /// @brief Extract Miller indices from a key.
+  static Miller key_hkl(std::uint64_t key) {
+    return {{int((key >> 42) & 0xFFFFF) - key_index_limit,
+             int((key >> 22) & 0xFFFFF) - key_index_limit,
+             int((key >> 2) & 0xFFFFF) - key_index_limit}};
+  }
+  /// @brief Extract isign (1, -1 or 0) from a key.
+  static int8_t key_isign(std::uint64_t key) { return int8_t(int(key & 3) - 1); }
+
+  size_t size() const { return key.size(); }
+  bool empty() const { return key.empty(); }
+  Miller get_hkl(size_t i) const { return key_hkl(key[i]); }
+  int8_t get_isign(size_t i) const { return key_isign(key[i]); }
+
+  /// @brief Reserve memory in all columns.
+  void reserve(size_t n);
+  /// @brief Resize all columns.
+  void resize(size_t n);
+
+  /// @brief Add a single reflection if its data is valid (see Intensities::add_if_valid()).
+  /// @throws std::runtime_error if the Miller indices are out of range
+  void add_if_valid(const Miller& hkl, int8_t isign, int8_t isym_, double value_, double sigma_) {
+    if (!std::isnan(value_) && sigma_ > 0) {
+      if (!key_fits(hkl))
+        fail("Miller index too large for CompactIntensities: ",
+             hkl[0], ' ', hkl[1], ' ', hkl[2]);
+      key.push_back(make_key(hkl, isign));
+      value.push_back((float) value_);
+      sigma.push_back((float) sigma_);
+      isym.push_back(isym_);
+      nobs.push_back(0);
+    }
+  }
+
+  /// @brief Copy data and metadata from Intensities.
+  /// @throws std::runtime_error if Miller indices are out of range
+  void copy_from(const Intensities& intensities);
+  /// @brief Convert to Intensities (e.g. to use Intensities::prepare_merged_mtz()).
+  Intensities to_intensities() const;
+
+  /// @brief Get minimum and maximum resolution of reflections.
+  std::array<double,2> resolution_range() const;
+  /// @brief See Intensities::calculate_correlation().
+  Correlation calculate_correlation(const CompactIntensities& other) const;
+  /// @brief Sort reflections by key, i.e. by (h, k, l, isign) (stable sort).
+  void sort(int nthreads=1);
+  /// @brief See Intensities::merge_in_place().
+  void merge_in_place(DataType new_type, int nthreads=1);
+  /// @brief See Intensities::calculate_merging_stats().
+  std::vector<MergingStats> calculate_merging_stats(const Binner* binner,
+                                                    char use_weights='Y',
+                                                    int nthreads=1) const;
+  /// @brief See Intensities::prepare_for_merging().
+  DataType prepare_for_merging(DataType new_type, int nthreads=1);
+  /// @brief See Intensities::switch_to_asu_indices().
+  void switch_to_asu_indices();
+
+  /// @brief Load intensities from MTZ file (see Intensities::import_mtz()).
+  void import_mtz(const Mtz& mtz, DataType data_type=DataType::Unknown);
+  /// @brief Load intensities from mmCIF (see Intensities::import_refln_block()).
+  void import_refln_block(const ReflnBlock& rb, DataType data_type=DataType::Unknown);
+  /// @brief Load intensities from XDS_ASCII file.
+  void import_xds(const XdsAscii& xds);
+  /// @brief See Intensities::import_xds_file().
+  void import_xds_file(const std::string& path, int nthreads=1);
+};
+
+/// @brief Adapter providing DataProxy interface to CompactIntensities.
+struct CompactIntensitiesDataProxy {
+  const CompactIntensities& intensities_; ///< Reference to underlying object
+
+  size_t stride() const { return 1; }
+  size_t size() const { return intensities_.size(); }
+  const SpaceGroup* spacegroup() const { return intensities_.spacegroup; }
+  const UnitCell& unit_cell() const { return intensities_.unit_cell; }
+  Miller get_hkl(size_t offset) const { return intensities_.get_hkl(offset); }
+  double get_num(size_t n) const { return intensities_.value[n]; }
+};
+
 /// @brief Infer intensity data type from reflection data under symmetry.
 ///
 /// Examines unique reflections and detects whether data is unmerged (multiple
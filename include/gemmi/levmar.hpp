@@ -13,6 +13,7 @@
 #include <vector>
 #include "fail.hpp"   // for fail
 #include "math.hpp"   // for sq
+#include "parallel.hpp"  // for parallel_for_chunks
 
 //#define GEMMI_DEBUG_LEVMAR
 
@@ -94,18 +95,37 @@ inline void print_parameters(const std::string& name, std::vector<double> &a) {
   fprintf(stderr, "\n");
 }
 
+/// Points are processed in blocks of this size. Partial sums from blocks
+/// are added in block order, so the results of compute_wssr() and
+/// compute_lm_matrices() don't depend on the number of threads.
+constexpr size_t levmar_block_size = 4096;
+
 /// @brief Compute weighted sum of squared residuals for a target.
 /// @details
 /// Uses long double for accumulation to improve numerical accuracy.
 /// Assumes Target provides: points container, get_weight(), get_y(), compute_value().
 /// @tparam Target Fitting target type.
 /// @param target The fitting target.
+/// @param nthreads number of threads (see resolve_thread_count())
 /// @return Sum of weighted squared residuals.
 template<typename Target>
-double compute_wssr(const Target& target) {
-  long double wssr = 0; // long double here notably increases the accuracy
-  for (const auto& p : target.points)
-    wssr += sq(p.get_weight() * (p.get_y() - target.compute_value(p)));
+double compute_wssr(const Target& target, int nthreads=1) {
+  const auto& points = target.points;
+  size_t n_blocks = (points.size() + levmar_block_size - 1) / levmar_block_size;
+  // long double here notably increases the accuracy
+  std::vector<long double> partial(n_blocks, 0);
+  parallel_for_chunks(n_blocks, 1, nthreads, [&](size_t block, size_t) {
+    size_t end = std::min(points.size(), (block + 1) * levmar_block_size);
+    long double sum = 0;
+    for (size_t i = block * levmar_block_size; i != end; ++i) {
+      const auto& p = points[i];
+      sum += sq(p.get_weight() * (p.get_y() - target.compute_value(p)));
+    }
+    partial[block] = sum;
+  });
+  long double wssr = 0;
+  for (long double x : partial)
+    wssr += x;
   return (double) wssr;
 }
 
@@ -169,32 +189,61 @@ double compute_gradients(const Target& target, unsigned n, double* grad) {
 /// @param target The fitting target.
 /// @param alpha Output: n x n matrix (stored as flat vector) = J^T*J.
 /// @param beta Output: n-element vector = J^T*residual.
+/// @param nthreads number of threads (see resolve_thread_count())
 /// @return Weighted sum of squared residuals.
 template<typename Target>
 double compute_lm_matrices(const Target& target,
                            std::vector<double>& alpha,
-                           std::vector<double>& beta) {
+                           std::vector<double>& beta,
+                           int nthreads=1) {
   assert(!beta.empty());
   assert(alpha.size() == beta.size() * beta.size());
-  long double wssr = 0; // long double here notably increases the accuracy
+  const auto& points = target.points;
   size_t na = beta.size();
+  size_t n_blocks = (points.size() + levmar_block_size - 1) / levmar_block_size;
+  // Each block gets its own alpha and beta (na*na + na numbers) and wssr.
+  // With a single block, alpha and beta are accumulated in place.
+  size_t stride = na * na + na;
+  std::vector<double> partial(n_blocks > 1 ? n_blocks * stride : 0, 0.);
+  std::vector<long double> partial_wssr(n_blocks, 0);
   std::fill(alpha.begin(), alpha.end(), 0.0);
   std::fill(beta.begin(), beta.end(), 0.0);
-  std::vector<double> dy_da(na);
-  for (const auto& p : target.points) {
-    double y = target.compute_value_and_derivatives(p, dy_da);
-    double weight = p.get_weight();
-    double dy_sig = weight * (p.get_y() - y);
-    for (size_t j = 0; j != na; ++j) {
-      if (dy_da[j] != 0) {
-        dy_da[j] *= weight;
-        for (size_t k = j+1; k-- != 0;)
-          alpha[na * j + k] += dy_da[j] * dy_da[k];
-        beta[j] += dy_sig * dy_da[j];
+  parallel_for_chunks(n_blocks, 1, nthreads, [&](size_t block, size_t) {
+    double* a = n_blocks > 1 ? &partial[block * stride] : alpha.data();
+    double* b = n_blocks > 1 ? a + na * na : beta.data();
+    long double wssr = 0; // long double here notably increases the accuracy
+    std::vector<double> dy_da(na);
+    size_t end = std::min(points.size(), (block + 1) * levmar_block_size);
+    for (size_t i = block * levmar_block_size; i != end; ++i) {
+      const auto& p = points[i];
+      double y = target.compute_value_and_derivatives(p, dy_da);
+      double weight = p.get_weight();
+      double dy_sig = weight * (p.get_y() - y);
+      for (size_t j = 0; j != na; ++j) {
+        if (dy_da[j] != 0) {
+          dy_da[j] *= weight;
+          double* a_row = a + na * j;
+          for (size_t k = 0; k <= j; ++k)
+            a_row[k] += dy_da[j] * dy_da[k];
+          b[j] += dy_sig * dy_da[j];
+        }
       }
+      wssr += sq(dy_sig);
     }
-    wssr += sq(dy_sig);
-  }
+    partial_wssr[block] = wssr;
+  });
+  if (n_blocks > 1)
+    for (size_t block = 0; block != n_blocks; ++block) {
+      const double* a = &partial[block * stride];
+      for (size_t j = 0; j != na; ++j)
+        for (size_t k = 0; k <= j; ++k)
+          alpha[na * j + k] += a[na * j + k];
+      for (size_t j = 0; j != na; ++j)
+        beta[j] += a[na * na + j];
+    }
+  long double wssr = 0;
+  for (long double x : partial_wssr)
+    wssr += x;
 
   // Only half of the alpha matrix was filled above. Fill the rest.
   for (size_t j = 1; j < na; j++)
@@ -232,6 +281,8 @@ struct LevMar {
   double lambda_down_factor = 0.1;
   /// @brief Initial damping factor (typically 0.001).
   double lambda_start = 0.001;
+  /// @brief Number of threads used to evaluate the target (0 = all CPUs).
+  int nthreads = 1;
 
   /// @brief Initial weighted sum of squared residuals (set by fit()).
   double initial_wssr = NAN;
@@ -271,7 +322,7 @@ struct LevMar {
     alpha.resize(na * na);
     beta.resize(na);
 
-    initial_wssr = compute_lm_matrices(target, alpha, beta);
+    initial_wssr = compute_lm_matrices(target, alpha, beta, nthreads);
     double wssr = initial_wssr;
 
     int small_change_counter = 0;
@@ -296,7 +347,7 @@ struct LevMar {
         temp_beta[i] += best_a[i];
 
       target.set_parameters(temp_beta);
-      double new_wssr = compute_wssr(target);
+      double new_wssr = compute_wssr(target, nthreads);
       ++eval_count;
 #ifdef GEMMI_DEBUG_LEVMAR
       fprintf(stderr, " #%d WSSR=%.8g %+g%% (%+.4g%%) lambda=%g\n",
@@ -321,7 +372,7 @@ struct LevMar {
         } else {
           small_change_counter = 0;
         }
-        compute_lm_matrices(target, alpha, beta);
+        compute_lm_matrices(target, alpha, beta, nthreads);
         ++eval_count;
         lambda *= lambda_down_factor;
       } else { // worse fitting
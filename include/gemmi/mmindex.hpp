@@ -0,0 +1,92 @@
+// Copyright 2026 Global Phasing Ltd.
+//
+// Index of models in multi-model PDB and mmCIF files, for random access.
+
+/// @file mmindex.hpp
+/// @brief ModelFileIndex: byte ranges of models in a coordinate file,
+/// and read_model() that reads only one model from the file.
+///
+/// Reading one model from an NMR or MD ensemble with read_structure()
+/// requires parsing all the models. ModelFileIndex is built in one pass
+/// over the file and records:
+///  - in PDB files: the byte range of each MODEL ... ENDMDL block,
+///  - in mmCIF files: the byte range of the _atom_site rows of each
+///    pdbx_PDB_model_num (rows of one model must be contiguous),
+///
+/// together with the header (everything before the first model) and
+/// the tail (everything after the last model). read_model() reads the
+/// header, one model and the tail, and parses only this text.
+/// The index can be saved to a small text file next to the coordinate
+/// file (write_model_file_index()) and read back later.
+///
+/// Offsets refer to the uncompressed content. Gzipped files can be indexed,
+/// but read_model() must then decompress the whole file; only in
+/// uncompressed files are models read directly with fseek().
+
+#ifndef GEMMI_MMINDEX_HPP_
+#define GEMMI_MMINDEX_HPP_
+
+#include <string>
+#include <vector>
+#include "fail.hpp"   // for GEMMI_DLL
+#include "model.hpp"  // for Structure, CoorFormat
+
+namespace gemmi {
+
+struct ModelFileIndex {
+  /// Half-open range of bytes [begin, end).
+  struct Range {
+    size_t begin = 0;
+    size_t end = 0;
+    size_t size() const { return end - begin; }
+  };
+  struct Entry {
+    int num;      ///< model number (MODEL serial or pdbx_PDB_model_num)
+    Range range;  ///< bytes of the model
+  };
+
+  CoorFormat format = CoorFormat::Unknown;  ///< Pdb or Mmcif
+  size_t file_size = 0;  ///< size of the uncompressed file, to detect changes
+  Range head;            ///< everything before the first model
+  Range tail;            ///< everything after the last model
+  std::vector<Entry> models;
+
+  /// @brief Find model by number; returns nullptr if not found.
+  const Entry* find(int num) const {
+    for (const Entry& e : models)
+      if (e.num == num)
+        return &e;
+    return nullptr;
+  }
+};
+
+/// @brief Build the index from the content of a PDB or mmCIF file.
+/// @param format Pdb, Mmcif or Unknown (detected from the content)
+/// @param name used in error messages
+/// @throws std::runtime_error if the format is not supported, if _atom_site
+///         is not found, or if rows of one model are not contiguous.
+GEMMI_DLL ModelFileIndex make_model_file_index(const char* data, size_t size,
+                                               const std::string& name,
+                                               CoorFormat format=CoorFormat::Unknown);
+
+/// @brief Build the index of a (possibly gzipped) PDB or mmCIF file.
+/// The format is determined from the file extension or, if that fails,
+/// from the content.
+GEMMI_DLL ModelFileIndex make_model_file_index(const std::string& path);
+
+/// @brief Save the index as a small text file (for example, path + ".idx").
+GEMMI_DLL void write_model_file_index(const ModelFileIndex& index, const std::string& path);
+
+/// @brief Read the index saved with write_model_file_index().
+GEMMI_DLL ModelFileIndex read_model_file_index(const std::string& path);
+
+/// @brief Read one model from a file indexed with make_model_file_index().
+/// Returns Structure with metadata from the file and a single model.
+/// @param model_num model number, as in ModelFileIndex::Entry::num
+/// @throws std::runtime_error if the model is not in the index or if the file
+///         size differs from ModelFileIndex::file_size (the index is stale).
+GEMMI_DLL Structure read_model(const std::string& path, const ModelFileIndex& index,
+                               int model_num);
+
+} // namespace gemmi
+#endif
@@ -145,6 +145,7 @@ struct PdbReadOptions {
   bool ignore_ter = false;      ///< Ignore TER records completely
   bool split_chain_on_ter = false; ///< Split chain at each TER record
   bool skip_remarks = false;    ///< Skip REMARK records entirely
+  int nthreads = 1;             ///< Threads for parsing coordinates (0 = all CPUs)
 };
 // end of PdbReadOptions for mol.rst
 
@@ -0,0 +1,234 @@
+// Copyright 2026 Global Phasing Ltd.
+//
+// ModelIndex - hash-based lookup of residues and atoms in a Model.
+
+/// @file modelindex.hpp
+/// @brief ModelIndex: hash tables for finding residues by chain name and
+/// SeqId, and atoms by residue, name and altloc.
+///
+/// Model::find_cra(), Model::find_residue_group() and Residue::find_atom()
+/// are linear searches. When many lookups are done (for example, for each
+/// connection in a large complex), building ModelIndex once makes each
+/// lookup O(1). The index stores pointers into the Model; it must be
+/// rebuilt (or cleared) after residues or atoms are added, removed or
+/// reordered. Changing coordinates and other atom properties is fine.
+
+#ifndef GEMMI_MODELINDEX_HPP_
+#define GEMMI_MODELINDEX_HPP_
+
+#include <algorithm>  // for min
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "model.hpp"   // for Model, Chain, Residue, Atom, CRA
+
+namespace gemmi {
+
+struct ModelIndex {
+  /// Residues with more atoms than this get hashed atom lookup;
+  /// smaller residues are searched with Residue::find_atom().
+  static constexpr size_t min_atoms_to_index = 32;
+
+  ModelIndex() = default;
+  explicit ModelIndex(Model& model) { build(model); }
+
+  /// @brief (Re)build the index for all residues in the model.
+  void build(Model& model) {
+    clear();
+    model_ = &model;
+    for (Chain& chain : model.chains) {
+      NameId chain_id = intern_name(chain.name);
+      for (Residue& res : chain.residues) {
+        uint32_t idx = (uint32_t) entries_.size();
+        entries_.push_back({&chain, &res, no_entry});
+        auto r = residues_.emplace(make_key(chain_id, res.seqid), std::make_pair(idx, idx));
+        if (!r.second) {
+          entries_[r.first->second.second].next = idx;
+          r.first->second.second = idx;
+        }
+        if (res.atoms.size() > min_atoms_to_index)
+          index_atoms(res);
+      }
+    }
+  }
+
+  /// @brief Invalidate the index (e.g. after removing residues).
+  void clear() {
+    model_ = nullptr;
+    long_names_.clear();
+    entries_.clear();
+    residues_.clear();
+    atoms_.clear();
+  }
+
+  bool empty() const { return model_ == nullptr; }
+
+  /// @brief Equivalent of Model::find_cra(), but using the index.
+  CRA find_cra(const AtomAddress& address, bool ignore_segment=false) const {
+    for (uint32_t i = first_entry(address.chain_name, address.res_id.seqid);
+         i != no_entry; i = entries_[i].next) {
+      const Entry& e = entries_[i];
+      if (address.res_id.matches_noseg(*e.res) &&
+          (ignore_segment || address.res_id.segment == e.res->segment)) {
+        Atom* at = nullptr;
+        if (!address.atom_name.empty())
+          at = find_atom(*e.res, address.atom_name, address.altloc);
+        return {e.chain, e.res, at};
+      }
+    }
+    return {nullptr, nullptr, nullptr};
+  }
+
+  /// @brief Equivalent of Model::find_residue(), but using the index.
+  Residue* find_residue(const std::string& chain_name, const ResidueId& rid) const {
+    for (uint32_t i = first_entry(chain_name, rid.seqid); i != no_entry; i = entries_[i].next)
+      if (entries_[i].res->matches(rid))
+        return entries_[i].res;
+    return nullptr;
+  }
+
+  /// @brief Equivalent of Model::find_residue_group(), but using the index.
+  /// @throws fail() if chain or residue not found
+  ResidueGroup find_residue_group(const std::string& chain_name, SeqId seqid) const {
+    uint32_t i = first_entry(chain_name, seqid);
+    if (i == no_entry)
+      fail("No such chain or residue: " + chain_name + " " + seqid.str());
+    const Entry& e = entries_[i];
+    std::vector<Residue>& residues = e.chain->residues;
+    Residue* end = e.res;
+    while (end != residues.data() + residues.size() && end->seqid == seqid)
+      ++end;
+    return ResidueSpan(residues, e.res, end - e.res);
+  }
+
+  /// @brief Equivalent of Residue::find_atom(name, altloc), with hashed
+  /// lookup for large residues.
+  Atom* find_atom(Residue& res, const std::string& atom_name, char altloc) const {
+    if (res.atoms.size() <= min_atoms_to_index)
+      return res.find_atom(atom_name, altloc);
+    NameId name_id = find_name(atom_name);
+    if (name_id == no_name)
+      return nullptr;
+    // Atom::altloc_matches(): '*' matches all, atoms without altloc match
+    // any request; we want the first matching atom in the residue.
+    uint32_t k = first_atom(&res, name_id, altloc);
+    if (altloc != '*' && altloc != '\0')
+      k = std::min(k, first_atom(&res, name_id, '\0'));
+    return k != no_entry ? &res.atoms[k] : nullptr;
+  }
+
+private:
+  static constexpr uint32_t no_entry = 0xFFFFFFFFu;
+
+  // Chain and atom names are used in keys as integers. Names with up to
+  // 4 ASCII characters (nearly all of them) are packed into the integer;
+  // longer names get sequential ids with the top bit set.
+  using NameId = uint32_t;
+  static constexpr NameId long_name_bit = 0x80000000u;
+  static constexpr NameId no_name = 0xFFFFFFFFu;
+
+  struct Entry {
+    Chain* chain;
+    Residue* res;
+    uint32_t next;  // next residue with the same key
+  };
+  struct ResKey {
+    NameId chain;
+    int num;
+    char icode;
+    bool operator==(const ResKey& o) const {
+      return chain == o.chain && num == o.num && icode == o.icode;
+    }
+  };
+  struct ResKeyHash {
+    size_t operator()(const ResKey& k) const {
+      return std::hash<uint64_t>()((uint64_t(k.chain) << 32) ^
+                                   (uint64_t(uint32_t(k.num)) << 8) ^ (unsigned char) k.icode);
+    }
+  };
+  struct AtomKey {
+    const Residue* res;
+    NameId name;
+    char altloc;
+    bool operator==(const AtomKey& o) const {
+      return res == o.res && name == o.name && altloc == o.altloc;
+    }
+  };
+  struct AtomKeyHash {
+    size_t operator()(const AtomKey& k) const {
+      return std::hash<const void*>()(k.res) ^
+             std::hash<uint64_t>()((uint64_t(k.name) << 8) | (unsigned char) k.altloc);
+    }
+  };
+
+  Model* model_ = nullptr;
+  std::unordered_map<std::string, NameId> long_names_;
+  std::vector<Entry> entries_;
+  // key -> (first, last) entry with this key
+  std::unordered_map<ResKey, std::pair<uint32_t, uint32_t>, ResKeyHash> residues_;
+  // (residue, name, altloc) -> index of the first such atom in the residue;
+  // altloc '*' stands for any altloc.
+  std::unordered_map<AtomKey, uint32_t, AtomKeyHash> atoms_;
+
+  static bool is_packable(const std::string& name) {
+    if (name.size() > 4)
+      return false;
+    for (char c : name)
+      if (c == '\0' || (unsigned char) c >= 0x80)
+        return false;
+    return true;
+  }
+
+  static NameId pack_name(const std::string& name) {
+    NameId id = 0;
+    for (size_t i = 0; i != name.size(); ++i)
+      id |= NameId((unsigned char) name[i]) << (8 * i);
+    return id;
+  }
+
+  NameId find_name(const std::string& name) const {
+    if (is_packable(name))
+      return pack_name(name);
+    auto it = long_names_.find(name);
+    return it != long_names_.end() ? it->second : no_name;
+  }
+
+  NameId intern_name(const std::string& name) {
+    if (is_packable(name))
+      return pack_name(name);
+    NameId id = long_name_bit | NameId(long_names_.size());
+    return long_names_.emplace(name, id).first->second;
+  }
+
+  // SeqId::operator== ignores the case of icode and treats ' ' and '\0' as equal
+  static ResKey make_key(NameId chain_id, const SeqId& seqid) {
+    return ResKey{chain_id, seqid.num.value, char(seqid.icode | 0x20)};
+  }
+
+  uint32_t first_entry(const std::string& chain_name, SeqId seqid) const {
+    NameId chain_id = find_name(chain_name);
+    if (chain_id == no_name)
+      return no_entry;
+    auto it = residues_.find(make_key(chain_id, seqid));
+    return it != residues_.end() ? it->second.first : no_entry;
+  }
+
+  uint32_t first_atom(const Residue* res, NameId name_id, char altloc) const {
+    auto it = atoms_.find(AtomKey{res, name_id, altloc});
+    return it != atoms_.end() ? it->second : no_entry;
+  }
+
+  void index_atoms(const Residue& res) {
+    for (uint32_t k = 0; k != (uint32_t) res.atoms.size(); ++k) {
+      const Atom& a = res.atoms[k];
+      NameId name_id = intern_name(a.name);
+      // emplace() doesn't overwrite, so the first atom is kept
+      atoms_.emplace(AtomKey{&res, name_id, a.altloc}, k);
+      atoms_.emplace(AtomKey{&res, name_id, '*'}, k);
+    }
+  }
+};
+
+} // namespace gemmi
+#endif
@@ -29,26 +29,94 @@ namespace gemmi {
 
 /// Helper for writing unmerged MTZ files with correct M/ISYM column values.
 /// Converts Miller indices to ASU-equivalent and encodes the symmetry operation.
+/// For each symmetry operation, the index transformation is precomputed
+/// as an integer matrix. move_to_asu() is const and can be called
+/// concurrently from multiple threads.
 struct UnmergedHklMover {
   /// Initialize with spacegroup information.
   /// @param spacegroup The space group (may be null).
-  UnmergedHklMover(const SpaceGroup* spacegroup) : asu_(spacegroup) {
-    if (spacegroup)
+  /// @param tnt_asu If true, use TNT ASU setting; if false, use default ASU.
+  UnmergedHklMover(const SpaceGroup* spacegroup, bool tnt_asu=false)
+    : asu_(spacegroup, tnt_asu) {
+    if (spacegroup) {
       group_ops_ = spacegroup->operations();
+      prepare_transforms();
+    }
   }
 
   /// Move HKL indices to ASU and return the encoded ISYM value.
   /// @param hkl [in,out] Miller indices; modified to ASU-equivalent values.
   /// @return ISYM value for the M/ISYM column (encodes symmetry operation).
-  int move_to_asu(std::array<int, 3>& hkl) {
-    std::pair<Miller, int> hkl_isym = asu_.to_asu(hkl, group_ops_);
-    hkl = hkl_isym.first;
-    return hkl_isym.second;
+  int move_to_asu(std::array<int, 3>& hkl) const {
+    if (transforms_.empty()) {
+      std::pair<Miller, int> hkl_isym = asu_.to_asu(hkl, group_ops_);
+      hkl = hkl_isym.first;
+      return hkl_isym.second;
+    }
+    int isym = 1;
+    for (const IndexTransform& t : transforms_) {
+      Miller r = multiply(t.ref, hkl);
+      if (asu_.is_in_reference_setting(r[0], r[1], r[2])) {
+        hkl = multiply(t.hkl, hkl);
+        return isym;
+      }
+      if (asu_.is_in_reference_setting(-r[0], -r[1], -r[2])) {
+        Miller m = multiply(t.hkl, hkl);
+        hkl = {{-m[0], -m[1], -m[2]}};
+        return isym + 1;
+      }
+      isym += 2;
+    }
+    fail("Oops, maybe inconsistent GroupOps?");
   }
 
 private:
+  // For one symmetry operation: hkl maps Miller indices to the equivalent
+  // indices, ref gives the same indices in the reference setting (scaled
+  // by a positive factor), as needed by ReciprocalAsu::is_in_reference_setting().
+  struct IndexTransform {
+    Op::Rot hkl;
+    Op::Rot ref;
+  };
+
   ReciprocalAsu asu_;
   GroupOps group_ops_;
+  std::vector<IndexTransform> transforms_;
+
+  static Miller multiply(const Op::Rot& m, const Miller& v) {
+    Miller r;
+    for (int i = 0; i != 3; ++i)
+      r[i] = m[i][0] * v[0] + m[i][1] * v[1] + m[i][2] * v[2];
+    return r;
+  }
+
+  // Leaves transforms_ empty (ReciprocalAsu::to_asu() is used then)
+  // if any operation has non-integer rotation in this setting.
+  void prepare_transforms() {
+    std::vector<IndexTransform> transforms;
+    transforms.reserve(group_ops_.sym_ops.size());
+    for (const Op& op : group_ops_.sym_ops) {
+      IndexTransform t;
+      // the same as Op::apply_to_hkl_without_division(), divided by DEN
+      for (int i = 0; i != 3; ++i)
+        for (int j = 0; j != 3; ++j) {
+          if (op.rot[j][i] % Op::DEN != 0)
+            return;
+          t.hkl[i][j] = op.rot[j][i] / Op::DEN;
+        }
+      if (asu_.is_ref) {
+        t.ref = t.hkl;
+      } else {
+        // the same as in ReciprocalAsu::is_in()
+        for (int i = 0; i != 3; ++i)
+          for (int j = 0; j != 3; ++j)
+            t.ref[i][j] = asu_.rot[0][i] * t.hkl[0][j] + asu_.rot[1][i] * t.hkl[1][j] +
+                          asu_.rot[2][i] * t.hkl[2][j];
+      }
+      transforms.push_back(t);
+    }
+    transforms_.swap(transforms);
+  }
 };
 
 /// MTZ file metadata: crystallographic parameters, symmetry, and file structure.
@@ -686,14 +754,20 @@ struct GEMMI_DLL Mtz : public MtzMetadata {
   /// @{
 
   /// Get sorted row indices based on the first N columns (HKL by default).
+  /// If these columns contain only integers (H, K, L, M/ISYM, BATCH),
+  /// their values are packed into 64-bit keys that are sorted in parallel.
+  /// Otherwise, rows are compared column by column.
+  /// The sort is stable in both cases.
   /// @param use_first Number of columns to use for sorting (default 3 = h, k, l).
+  /// @param nthreads Number of threads (0 = all CPUs).
   /// @return Vector of indices [0..nreflections-1] sorted by the first N columns.
-  std::vector<int> sorted_row_indices(int use_first=3) const;
+  std::vector<int> sorted_row_indices(int use_first=3, int nthreads=1) const;
 
   /// Sort reflections in-place using the first N columns.
   /// @param use_first Number of columns to use for sorting (default 3).
+  /// @param nthreads Number of threads (0 = all CPUs).
   /// @return True if any sorting was done; false if already sorted.
-  bool sort(int use_first=3);
+  bool sort(int use_first=3, int nthreads=1);
 
   /// Extract Miller indices from a reflection at a given offset in the data array.
   /// @param offset Offset to the first element of the reflection (H, K, L at offsets 0, 1, 2).
@@ -720,13 +794,15 @@ struct GEMMI_DLL Mtz : public MtzMetadata {
   /// Move all reflections to ASU and adjust phases/anomalous data accordingly.
   /// For merged MTZ only. Transforms F(+), F(-), phases, and Hendrickson-Lattman coefficients.
   /// @param tnt_asu If true, use TNT ASU setting; if false, use default ASU.
-  void ensure_asu(bool tnt_asu=false);
+  /// @param nthreads Number of threads (0 = all CPUs).
+  void ensure_asu(bool tnt_asu=false, int nthreads=1);
 
   /// Reindex reflections using a new basis and update space group accordingly.
   /// Applies symmetry operation to HKL, removes fractional indices, adjusts cell and space group.
   /// Outputs messages to logger.
   /// @param op Reindexing operation (must have no translation and determinant > 0).
-  void reindex(const Op& op);
+  /// @param nthreads Number of threads used for moving unmerged data to/from ASU.
+  void reindex(const Op& op, int nthreads=1);
 
   /// Expand reflections to P1 using all symmetry operations.
   /// Duplicate reflections under symmetry, adjust phases if present.
@@ -736,12 +812,14 @@ struct GEMMI_DLL Mtz : public MtzMetadata {
 
   /// For unmerged MTZ: convert HKL from ASU to original (observer) indices.
   /// Reads M/ISYM column and applies inverse symmetry operations.
+  /// @param nthreads Number of threads (0 = all CPUs).
   /// @return True if M/ISYM column was found and data was modified.
-  bool switch_to_original_hkl();
+  bool switch_to_original_hkl(int nthreads=1);
 
   /// For unmerged MTZ: convert HKL to ASU and set M/ISYM column accordingly.
+  /// @param nthreads Number of threads (0 = all CPUs).
   /// @return True if M/ISYM column was found and data was modified.
-  bool switch_to_asu_hkl();
+  bool switch_to_asu_hkl(int nthreads=1);
 
   /// @}
   /// @name Data construction
@@ -860,9 +938,57 @@ struct GEMMI_DLL Mtz : public MtzMetadata {
   size_t write_to_buffer(char* buf, size_t maxlen) const;
 
 private:
+  friend struct MtzStreamWriter;
+
   /// Generic write implementation (template to support FILE*, string, buffer).
   /// @tparam Write Function type (size_t write(const void*, size_t, size_t)).
   template<typename Write> void write_to_stream(Write write) const;
+  /// Write the first 80 bytes, with the offset of headers that follow nrefl rows.
+  template<typename Write> void write_first_record(Write write, size_t nrefl) const;
+  /// Write headers that follow the data (from VERS to MTZENDOFHEADERS).
+  template<typename Write>
+  void write_headers(Write write, int nrefl, const std::array<double,2>& reso,
+                     const std::vector<std::array<float,2>>& column_ranges) const;
+};
+
+/// Writes MTZ file incrementally, without keeping reflections in memory.
+///
+/// Metadata (cell, space group, datasets, columns, batches, history, etc.)
+/// is taken from an Mtz object; its data array is not used. Rows are appended
+/// in blocks, while the column ranges and resolution limits are accumulated.
+/// In MTZ files the headers come after the data; finish() writes them and then
+/// updates the header offset at the beginning of the file.
+/// The output is byte-identical to Mtz::write_to_file() for the same data.
+struct GEMMI_DLL MtzStreamWriter {
+  /// Open the output file.
+  /// @param mtz Metadata. Must outlive the writer. Columns and unit cells must
+  ///            not be changed afterwards; other metadata (e.g. history,
+  ///            batches) can be changed until finish().
+  /// @param path Output file path.
+  MtzStreamWriter(const Mtz& mtz, const std::string& path);
+
+  /// Append rows to the file.
+  /// @param rows nrows * mtz.columns.size() values, row after row.
+  /// @param nrows Number of rows.
+  void append_rows(const float* rows, size_t nrows);
+
+  /// Write headers, patch the header offset and close the file.
+  void finish();
+
+  /// Number of rows appended so far.
+  size_t nreflections() const { return nreflections_; }
+
+  /// Metadata passed to the constructor.
+  const Mtz& mtz() const { return mtz_; }
+
+private:
+  const Mtz& mtz_;
+  std::string path_;
+  fileptr_t file_;
+  size_t nreflections_ = 0;
+  std::vector<UnitCell> cells_;  // cells used for the resolution range
+  std::array<double,2> reso_ = {{INFINITY, 0.}};
+  std::vector<std::array<float,2>> column_ranges_;
 };
 
 /// @}
@@ -62,6 +62,9 @@ public:
   std::string staraniso_version;
   /// Description string appended to gemmi software entry.
   std::string gemmi_run_from;
+  /// Number of threads used to format reflection rows (0 = all CPUs).
+  /// The output doesn't depend on it.
+  int nthreads = 1;
 
   /// @brief Get default column specification for merged or unmerged data.
   ///
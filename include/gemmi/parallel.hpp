@@ -0,0 +1,297 @@
+// Copyright 2026 Global Phasing Ltd.
+//
+// Simple thread-based parallel loops and pipelines.
+
+/// @file parallel.hpp
+/// @brief Minimal helpers for running independent loop iterations
+/// (or processing a stream of items) on threads.
+///
+/// Gemmi does not depend on OpenMP or TBB. These helpers use std::thread
+/// and are meant for coarse-grained work (bricks of a grid, chunks of rows,
+/// files).
+
+#ifndef GEMMI_PARALLEL_HPP_
+#define GEMMI_PARALLEL_HPP_
+
+#include <algorithm>  // for min, max, sort
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>    // for size_t
+#include <cstdint>    // for uint64_t
+#include <deque>
+#include <exception>  // for exception_ptr
+#include <memory>     // for unique_ptr
+#include <mutex>
+#include <thread>
+#include <utility>    // for pair, declval
+#include <vector>
+
+namespace gemmi {
+
+/// @brief Translate the user-facing thread count to an actual number.
+/// @param nthreads requested number of threads; 0 or negative means
+///        "as many as std::thread::hardware_concurrency() reports"
+/// @return number of threads >= 1
+inline int resolve_thread_count(int nthreads) {
+  if (nthreads <= 0) {
+    unsigned hc = std::thread::hardware_concurrency();
+    nthreads = hc != 0 ? (int) hc : 1;
+  }
+  return nthreads;
+}
+
+/// @brief Call func(begin, end) for consecutive chunks of [0, n) on multiple threads.
+///
+/// Chunks are handed out dynamically, so the work doesn't need to be balanced.
+/// The calling thread takes part in the work. If func throws, chunks that
+/// were not started yet are skipped, and the exception from the lowest failing
+/// chunk is re-thrown in the calling thread -- the same exception as with
+/// a single thread (chunks before it are always started, because they are
+/// handed out in order).
+/// @param n number of items
+/// @param chunk_size number of items passed to a single call of func
+/// @param nthreads number of threads (see resolve_thread_count())
+/// @param func callable(size_t begin, size_t end)
+template<typename Func>
+void parallel_for_chunks(size_t n, size_t chunk_size, int nthreads, Func&& func) {
+  if (chunk_size == 0)
+    chunk_size = 1;
+  size_t n_chunks = (n + chunk_size - 1) / chunk_size;
+  nthreads = (int) std::min(size_t(resolve_thread_count(nthreads)), n_chunks);
+  if (nthreads <= 1) {
+    for (size_t start = 0; start < n; start += chunk_size)
+      func(start, std::min(start + chunk_size, n));
+    return;
+  }
+  std::atomic<size_t> next_chunk{0};
+  std::exception_ptr first_exception;
+  size_t failed_chunk = n_chunks;
+  std::mutex exception_mutex;
+  auto worker = [&]() {
+    for (;;) {
+      size_t k = next_chunk.fetch_add(1);
+      if (k >= n_chunks)
+        break;
+      try {
+        size_t start = k * chunk_size;
+        func(start, std::min(start + chunk_size, n));
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(exception_mutex);
+        if (k < failed_chunk) {
+          failed_chunk = k;
+          first_exception = std::current_exception();
+        }
+        next_chunk = n_chunks;
+      }
+    }
+  };
+  std::vector<std::thread> threads;
+  threads.reserve(nthreads - 1);
+  for (int i = 1; i < nthreads; ++i)
+    threads.emplace_back(worker);
+  worker();
+  for (std::thread& t : threads)
+    t.join();
+  if (first_exception)
+    std::rethrow_exception(first_exception);
+}
+
+/// @brief Call func(i) for each i in [0, n) on multiple threads.
+/// @param n number of items
+/// @param nthreads number of threads (see resolve_thread_count())
+/// @param func callable(size_t i)
+template<typename Func>
+void parallel_for(size_t n, int nthreads, Func&& func) {
+  parallel_for_chunks(n, 1, nthreads, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i)
+      func(i);
+  });
+}
+
+/// @brief Sort (key, index) pairs by key on multiple threads.
+///
+/// Sorting 16-byte pairs is much faster than sorting large records;
+/// the records can be permuted afterwards using the indices.
+/// The pairs are first distributed into buckets by the top bits of the key,
+/// then the buckets are sorted in parallel. Pairs with equal keys are ordered
+/// by index, so if the indices were increasing the sort is stable.
+/// @param keys pairs to be sorted in place
+/// @param nthreads number of threads (see resolve_thread_count())
+inline void parallel_sort_keys(std::vector<std::pair<std::uint64_t, size_t>>& keys,
+                               int nthreads) {
+  using KeyIdx = std::pair<std::uint64_t, size_t>;
+  size_t n = keys.size();
+  if (n < 2)
+    return;
+  std::uint64_t min_key = UINT64_MAX, max_key = 0;
+  for (const KeyIdx& ki : keys) {
+    min_key = std::min(min_key, ki.first);
+    max_key = std::max(max_key, ki.first);
+  }
+  int range_bits = 0;
+  while (range_bits < 64 && ((max_key - min_key) >> range_bits) != 0)
+    ++range_bits;
+  int bucket_bits = 1;
+  while (bucket_bits < 16 && (size_t(1) << (bucket_bits + 6)) < n)
+    ++bucket_bits;
+  int shift = std::max(0, range_bits - bucket_bits);
+  std::vector<size_t> offsets((size_t(1) << bucket_bits) + 1, 0);
+  for (const KeyIdx& ki : keys)
+    ++offsets[((ki.first - min_key) >> shift) + 1];
+  for (size_t b = 1; b < offsets.size(); ++b)
+    offsets[b] += offsets[b-1];
+  std::vector<KeyIdx> bucketed(n);
+  {
+    std::vector<size_t> pos(offsets.begin(), offsets.end() - 1);
+    for (const KeyIdx& ki : keys)
+      bucketed[pos[(ki.first - min_key) >> shift]++] = ki;
+  }
+  keys = std::vector<KeyIdx>();
+  parallel_for(offsets.size() - 1, nthreads, [&](size_t b) {
+    std::sort(bucketed.begin() + offsets[b], bucketed.begin() + offsets[b+1]);
+  });
+  keys.swap(bucketed);
+}
+
+/// @brief Process a stream of items on worker threads, with the items
+/// produced and the results consumed sequentially.
+///
+/// generate(emit) is run in the calling thread and calls emit(item) for
+/// each item (for example, for each file found when walking a directory).
+/// emit() blocks when too many items are waiting or being processed,
+/// and it returns false if the pipeline was stopped by an exception.
+/// process(item) is called on worker threads and returns a result.
+/// consume(item, result) is called for each item, by one thread at a time,
+/// either in the order in which items were emitted (if ordered is true)
+/// or in the order in which they were processed.
+/// If process or consume throws, the pipeline stops and the first
+/// exception is re-thrown in the calling thread. If generate throws, items
+/// emitted before are still processed and consumed (as with one thread),
+/// and then the exception is re-thrown.
+/// @tparam Item type of items passed to emit()
+/// @param nthreads number of worker threads (see resolve_thread_count());
+///        if 1, all functions are called in the calling thread
+/// @param ordered whether to consume results in the original order
+/// @param generate callable(Emit emit), Emit is callable(Item) -> bool
+/// @param process callable(const Item&) -> Result
+/// @param consume callable(Item&, Result&)
+template<typename Item, typename Generate, typename Process, typename Consume>
+void parallel_pipeline(int nthreads, bool ordered,
+                       Generate&& generate, Process&& process, Consume&& consume) {
+  using Result = decltype(process(std::declval<const Item&>()));
+  nthreads = resolve_thread_count(nthreads);
+  if (nthreads <= 1) {
+    generate([&](Item item) {
+      Result result = process(static_cast<const Item&>(item));
+      consume(item, result);
+      return true;
+    });
+    return;
+  }
+  struct Done {
+    Item item;
+    Result result;
+  };
+  // Limits the number of items that are queued, processed, or processed
+  // but waiting to be consumed. Each item gets a slot for the result.
+  const size_t capacity = 4 * (size_t) nthreads;
+  std::vector<std::unique_ptr<Done>> slots(capacity);
+  std::deque<std::pair<size_t, Item>> queue;
+  size_t n_emitted = 0;
+  size_t n_processed = 0;
+  size_t n_consumed = 0;
+  bool finished = false;   // all items were emitted
+  bool stopped = false;    // an exception was thrown
+  bool consuming = false;  // one of the workers is calling consume()
+  std::exception_ptr first_exception;
+  std::mutex mutex;
+  std::condition_variable cv_work;   // workers wait for items
+  std::condition_variable cv_space;  // generate() waits for free slots
+
+  // must be called with the mutex locked
+  auto stop = [&](std::exception_ptr e) {
+    if (!first_exception)
+      first_exception = e;
+    stopped = true;
+    cv_work.notify_all();
+    cv_space.notify_all();
+  };
+
+  auto worker = [&]() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+      cv_work.wait(lock, [&]() { return !queue.empty() || finished || stopped; });
+      if (stopped || queue.empty())
+        break;
+      std::pair<size_t, Item> job = std::move(queue.front());
+      queue.pop_front();
+      lock.unlock();
+      std::unique_ptr<Done> done;
+      try {
+        Result result = process(static_cast<const Item&>(job.second));
+        done.reset(new Done{std::move(job.second), std::move(result)});
+      } catch (...) {
+        lock.lock();
+        stop(std::current_exception());
+        continue;
+      }
+      lock.lock();
+      slots[(ordered ? job.first : n_processed) % capacity] = std::move(done);
+      ++n_processed;
+      // consume all ready results, unless another worker is doing it
+      if (consuming)
+        continue;
+      consuming = true;
+      while (!stopped && slots[n_consumed % capacity]) {
+        std::unique_ptr<Done> ready = std::move(slots[n_consumed % capacity]);
+        lock.unlock();
+        try {
+          consume(ready->item, ready->result);
+        } catch (...) {
+          lock.lock();
+          stop(std::current_exception());
+          break;
+        }
+        lock.lock();
+        ++n_consumed;
+        cv_space.notify_one();
+      }
+      consuming = false;
+    }
+  };
+
+  auto emit = [&](Item item) {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv_space.wait(lock, [&]() { return n_emitted - n_consumed < capacity || stopped; });
+    if (stopped)
+      return false;
+    queue.emplace_back(n_emitted++, std::move(item));
+    cv_work.notify_one();
+    return true;
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(nthreads);
+  for (int i = 0; i < nthreads; ++i)
+    threads.emplace_back(worker);
+  std::exception_ptr generate_exception;
+  try {
+    generate(emit);
+  } catch (...) {
+    generate_exception = std::current_exception();
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    finished = true;
+    cv_work.notify_all();
+  }
+  for (std::thread& t : threads)
+    t.join();
+  if (first_exception)
+    std::rethrow_exception(first_exception);
+  if (generate_exception)
+    std::rethrow_exception(generate_exception);
+}
+
+} // namespace gemmi
+#endif
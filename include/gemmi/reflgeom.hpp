@@ -0,0 +1,125 @@
+// Copyright 2026 Global Phasing Ltd.
+//
+// ReflectionGeometry - per-reflection quantities that depend only on
+// the unit cell, space group and Miller indices.
+
+/// @file reflgeom.hpp
+/// @brief ReflectionGeometry: 1/d², resolution bin, epsilon factor, centric
+/// flag and ASU operator for each reflection, computed once and shared.
+///
+/// Binning, scaling, normalization and statistics functions each compute
+/// 1/d² and symmetry-related factors from Miller indices. When several such
+/// functions are run on the same reflections, the table can be computed once
+/// (on multiple threads) and reused.
+
+#ifndef GEMMI_REFLGEOM_HPP_
+#define GEMMI_REFLGEOM_HPP_
+
+#include <memory>        // for unique_ptr
+#include <vector>
+#include "binner.hpp"    // for Binner
+#include "mtz.hpp"       // for UnmergedHklMover
+#include "parallel.hpp"  // for parallel_for_chunks
+#include "symmetry.hpp"  // for SpaceGroup, GroupOps
+#include "unitcell.hpp"  // for UnitCell, Miller
+
+namespace gemmi {
+
+struct ReflectionGeometry {
+  UnitCell cell;
+  const SpaceGroup* spacegroup = nullptr;
+  GroupOps gops;                 ///< operations of spacegroup
+  std::vector<double> inv_d2;    ///< 1/d² (= 4 (sin θ/λ)²)
+  std::vector<int> bin;          ///< resolution bin, set by assign_bins()
+  /// The vectors below are filled only if spacegroup is set.
+  std::vector<int> epsilon;      ///< epsilon factor (including centering)
+  std::vector<char> centric;     ///< 1 for centric reflections, 0 otherwise
+  /// MTZ-style ISYM of the operation that moves hkl to the ASU
+  /// (1 = already in ASU, even numbers = Friedel mate), see asu_op().
+  std::vector<int> isym;
+
+  ReflectionGeometry() = default;
+  ReflectionGeometry(const UnitCell& cell_, const SpaceGroup* sg,
+                     const std::vector<Miller>& hkls, int nthreads=1) {
+    compute(cell_, sg, hkls.data(), hkls.size(), nthreads);
+  }
+  /// @tparam DataProxy type with size(), stride(), unit_cell(),
+  ///         spacegroup() and get_hkl() (e.g. MtzDataProxy)
+  template<typename DataProxy>
+  explicit ReflectionGeometry(const DataProxy& proxy, int nthreads=1) {
+    std::vector<Miller> hkls(proxy.size() / proxy.stride());
+    for (size_t i = 0, offset = 0; i < hkls.size(); ++i, offset += proxy.stride())
+      hkls[i] = proxy.get_hkl(offset);
+    compute(proxy.unit_cell(), proxy.spacegroup(), hkls.data(), hkls.size(), nthreads);
+  }
+
+  size_t size() const { return inv_d2.size(); }
+
+  /// (sin θ/λ)², the same as UnitCell::calculate_stol_sq().
+  double stol2(size_t i) const { return 0.25 * inv_d2[i]; }
+
+  /// Symmetry operation that (possibly with Friedel's law) moves
+  /// reflection i to the ASU. Use Op::phase_shift() to adjust phases.
+  const Op& asu_op(size_t i) const { return gops.sym_ops[(isym[i] - 1) / 2]; }
+
+  void compute(const UnitCell& cell_, const SpaceGroup* sg,
+               const Miller* hkls, size_t n, int nthreads=1) {
+    cell = cell_;
+    spacegroup = sg;
+    inv_d2.resize(n);
+    bin.clear();
+    epsilon.clear();
+    centric.clear();
+    isym.clear();
+    if (sg) {
+      gops = sg->operations();
+      epsilon.resize(n);
+      centric.resize(n);
+      isym.resize(n);
+    } else {
+      gops = GroupOps();
+    }
+    std::unique_ptr<UnmergedHklMover> hkl_mover;
+    if (sg)
+      hkl_mover.reset(new UnmergedHklMover(sg));
+    int n_cen = (int) gops.cen_ops.size();
+    parallel_for_chunks(n, 1 << 14, nthreads, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i != end; ++i) {
+        const Miller& hkl = hkls[i];
+        inv_d2[i] = cell.calculate_1_d2(hkl);
+        if (!hkl_mover)
+          continue;
+        // epsilon and centric flag in one pass over operations,
+        // cf. GroupOps::epsilon_factor() and is_reflection_centric()
+        Miller denh = {{Op::DEN * hkl[0], Op::DEN * hkl[1], Op::DEN * hkl[2]}};
+        Miller mdenh = {{-denh[0], -denh[1], -denh[2]}};
+        int eps = 0;
+        bool cen = false;
+        for (const Op& op : gops.sym_ops) {
+          Miller r = op.apply_to_hkl_without_division(hkl);
+          if (r == denh)
+            ++eps;
+          if (r == mdenh)
+            cen = true;
+        }
+        epsilon[i] = eps * n_cen;
+        centric[i] = cen;
+        Miller asu_hkl = hkl;
+        isym[i] = hkl_mover->move_to_asu(asu_hkl);
+      }
+    });
+  }
+
+  /// Set up the binner using 1/d² values from this table.
+  void setup_binner(Binner& binner, int nbins, Binner::Method method) const {
+    binner.setup_from_1_d2(nbins, method, std::vector<double>(inv_d2), &cell);
+  }
+
+  /// Fill the bin vector. The binner must be already set up.
+  void assign_bins(const Binner& binner, int nthreads=1) {
+    bin = binner.get_bins_from_1_d2(inv_d2, nthreads);
+  }
+};
+
+} // namespace gemmi
+#endif
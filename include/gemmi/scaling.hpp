@@ -355,9 +355,12 @@ struct Scaling {
   }
 
   /// @brief Full Levenberg-Marquardt optimization of all parameters.
-  /// @return Final R factor.
-  double fit_parameters() {
+  /// @param nthreads number of threads used for evaluating points (0 = all CPUs);
+  ///        the result doesn't depend on the number of threads.
+  /// @return Final weighted sum of squared residuals.
+  double fit_parameters(int nthreads=1) {
     LevMar levmar;
+    levmar.nthreads = nthreads;
     return levmar.fit(*this);
   }
 
@@ -377,7 +380,8 @@ struct Scaling {
   /// @param p Reflection point.
   /// @return Scaled calculated structure factor amplitude.
   double compute_value(const Point& p) const {
-    return std::abs(get_fcalc(p)) * (Real) get_overall_scale_factor(p.hkl);
+    double solv_scale = use_solvent ? get_solvent_scale(p.stol2) : 0.;
+    return abs_in_double(p.fcmol, p.fmask, solv_scale) * get_overall_scale_factor(p.hkl);
   }
 
   /// @brief Compute Fcalc and its derivatives with respect to all parameters.
@@ -392,32 +396,40 @@ struct Scaling {
     if (use_solvent) {
       double solv_b = std::exp(-b_sol * p.stol2);
       double solv_scale = k_sol * solv_b;
-      auto fcalc = p.fcmol + (Real)solv_scale * p.fmask;
-      fcalc_abs = std::abs(fcalc);
-      double dy_dsol = (fcalc.real() * p.fmask.real() +
-                        fcalc.imag() * p.fmask.imag()) / fcalc_abs * k_overall * kaniso;
+      double re = p.fcmol.real() + solv_scale * p.fmask.real();
+      double im = p.fcmol.imag() + solv_scale * p.fmask.imag();
+      fcalc_abs = std::sqrt(re * re + im * im);
+      double dy_dsol = (re * p.fmask.real() + im * p.fmask.imag())
+                       / fcalc_abs * k_overall * kaniso;
       if (!fix_k_sol)
         dy_da[n++] = solv_b * dy_dsol;
       if (!fix_b_sol)
         dy_da[n++] = -p.stol2 * solv_scale * dy_dsol;
     } else {
-      fcalc_abs = std::abs(p.fcmol);
+      fcalc_abs = abs_in_double(p.fcmol, p.fmask, 0.);
     }
     double fe = fcalc_abs * kaniso;
     double y = k_overall * fe;
     dy_da[0] = fe; // dy/d k_overall
-    SMat33<double> du = {
-      -0.25 * y * (h.x * h.x),
-      -0.25 * y * (h.y * h.y),
-      -0.25 * y * (h.z * h.z),
-      -0.5 * y * (h.x * h.y),
-      -0.5 * y * (h.x * h.z),
-      -0.5 * y * (h.y * h.z),
-    };
+    // dy/d b_star = -1/4 y hh, where hh = {h^2, k^2, l^2, 2hk, 2hl, 2kl},
+    // projected onto the constraint vectors
+    SMat33<double> hh{h.x * h.x, h.y * h.y, h.z * h.z,
+                      2 * h.x * h.y, 2 * h.x * h.z, 2 * h.y * h.z};
+    double minus_quarter_y = -0.25 * y;
     for (size_t j = 0; j < constraint_matrix.size(); ++j)
-      dy_da[n+j] = vec6_dot(constraint_matrix[j], du);
+      dy_da[n+j] = minus_quarter_y * vec6_dot(constraint_matrix[j], hh);
     return y;
   }
+
+private:
+  // |fcmol + scale * fmask| computed in double precision;
+  // faster than std::abs(std::complex), which calls hypot().
+  static double abs_in_double(std::complex<Real> fcmol, std::complex<Real> fmask,
+                              double scale) {
+    double re = fcmol.real() + scale * fmask.real();
+    double im = fcmol.imag() + scale * fmask.imag();
+    return std::sqrt(re * re + im * im);
+  }
 };
 
 /// @brief Fit scaling parameters using NLopt with the named optimizer.
@@ -13,6 +13,7 @@
 #include <complex>
 #include "addends.hpp" // for Addends
 #include "model.hpp"   // for Structure, ...
+#include "atomtable.hpp" // for AtomTable
 #include "small.hpp"   // for SmallStructure
 
 namespace gemmi {
@@ -84,6 +85,10 @@ public:
   double dwf_iso(const Atom& atom) const {
     return std::exp(-stol2_ * atom.b_iso);
   }
+  /// @brief Isotropic Debye-Waller factor for AtomTable::Site.
+  double dwf_iso(const AtomTable::Site& site) const {
+    return std::exp(-stol2_ * site.b_iso);
+  }
 
   /// @brief Anisotropic Debye-Waller factor exp(-2π²·s·U·s) for a small-molecule site.
   /// Uses site.aniso, where the anisotropic U tensor is in crystallographic coordinates.
@@ -104,6 +109,11 @@ public:
     return std::exp(-2 * pi() * pi() *
                     atom.aniso.transformed_by<>(cell_.frac.mat).r_u_r(hkl));
   }
+  /// @brief Anisotropic Debye-Waller factor for AtomTable::Site.
+  double dwf_aniso(const AtomTable::Site& site, const Vec3& hkl) const {
+    return std::exp(-2 * pi() * pi() *
+                    site.aniso.transformed_by<>(cell_.frac.mat).r_u_r(hkl));
+  }
 
   /// @brief Contribution of one atom to structure factor, given its scattering factor.
   /// Accounts for Debye-Waller factor, occupancy, and phase.
@@ -162,6 +172,18 @@ public:
     return sf;
   }
 
+  /// @brief Sum contributions from all atoms in an AtomTable for the given reflection.
+  /// @param table AtomTable built from a model.
+  /// @param hkl Miller indices of the reflection.
+  /// @return Total structure factor.
+  std::complex<double> calculate_sf_from_model(const AtomTable& table, const Miller& hkl) {
+    std::complex<double> sf = 0.;
+    set_stol2_and_scattering_factors(hkl);
+    for (size_t i = 0; i != table.size(); ++i)
+      sf += calculate_sf_from_atom(cell_.fractionalize(table.pos[i]), table.site(i), hkl);
+    return sf;
+  }
+
   /// @brief Compute Z (atomic number sum) component for Mott-Bethe conversion.
   /// Used when a different model is needed for the Z calculation.
   /// @param model The macromolecular model.
@@ -9,6 +9,7 @@
 #define GEMMI_SOLMASK_HPP_
 
 #include "grid.hpp"      // for Grid
+#include "bricks.hpp"    // for SphereBricks
 #include "floodfill.hpp" // for FloodFill
 #include "model.hpp"     // for Model, Atom, ...
 
@@ -118,8 +119,48 @@ inline float refmac_radius_for_bulk_solvent(El el) {
 #endif
 }
 
+/// Returns the radius of the sphere masked around an atom.
+/// @param elem Chemical element of the atom
+/// @param atomic_radii_set Which atomic radii library to use
+/// @param r_probe Probe radius (in Angstroms) added to the atomic radius
+inline double mask_radius(El elem, AtomicRadiiSet atomic_radii_set, double r_probe) {
+  double r = r_probe;
+  switch (atomic_radii_set) {
+    case AtomicRadiiSet::VanDerWaals: r += vdw_radius(elem); break;
+    case AtomicRadiiSet::Cctbx: r += cctbx_vdw_radius(elem); break;
+    case AtomicRadiiSet::Refmac: r += refmac_radius_for_bulk_solvent(elem); break;
+    case AtomicRadiiSet::Constant: /* r is included in r_probe */ break;
+  }
+  return r;
+}
+
+/// Collects spheres (fractional center, radius) around atoms for masking.
+/// @param cell Unit cell used to fractionalize atom positions
+/// @param model Molecular model
+/// @param atomic_radii_set Which atomic radii library to use
+/// @param r_probe Probe radius (in Angstroms) added to each atomic radius
+/// @param ignore_hydrogen If true, skip hydrogen atoms
+/// @param ignore_zero_occupancy_atoms If true, skip atoms with zero occupancy
+inline std::vector<GridSphere> mask_spheres(const UnitCell& cell, const Model& model,
+                                            AtomicRadiiSet atomic_radii_set,
+                                            double r_probe, bool ignore_hydrogen,
+                                            bool ignore_zero_occupancy_atoms) {
+  std::vector<GridSphere> spheres;
+  for (const Chain& chain : model.chains)
+    for (const Residue& res : chain.residues)
+      for (const Atom& atom : res.atoms) {
+        if ((ignore_hydrogen && atom.is_hydrogen()) ||
+            (ignore_zero_occupancy_atoms && atom.occ <= 0))
+          continue;
+        double r = mask_radius(atom.element.elem, atomic_radii_set, r_probe);
+        spheres.push_back({cell.fractionalize(atom.pos), r});
+      }
+  return spheres;
+}
+
 /// Marks grid points within a radius around atoms as masked.
 /// Sets all grid points within (atomic radius + probe radius) of each atom to the given value.
+/// Atoms are first sorted into bricks of the grid (see SphereBricks).
 /// @tparam T Grid value type (typically int8_t for binary masks or float for weighted masks)
 /// @param mask Grid to modify in-place
 /// @param model Molecular model containing atoms to mask around
@@ -128,28 +169,18 @@ inline float refmac_radius_for_bulk_solvent(El el) {
 /// @param value Value to set for masked grid points
 /// @param ignore_hydrogen If true, skip hydrogen atoms
 /// @param ignore_zero_occupancy_atoms If true, skip atoms with zero occupancy
+/// @param nthreads Number of threads (0 = all available)
 template<typename T>
 void mask_points_in_radius(Grid<T>& mask, const Model& model,
                            AtomicRadiiSet atomic_radii_set,
                            double r_probe, T value,
                            bool ignore_hydrogen,
-                           bool ignore_zero_occupancy_atoms) {
-  for (const Chain& chain : model.chains)
-    for (const Residue& res : chain.residues)
-      for (const Atom& atom : res.atoms) {
-        if ((ignore_hydrogen && atom.is_hydrogen()) ||
-            (ignore_zero_occupancy_atoms && atom.occ <= 0))
-          continue;
-        El elem = atom.element.elem;
-        double r = r_probe;
-        switch (atomic_radii_set) {
-          case AtomicRadiiSet::VanDerWaals: r += vdw_radius(elem); break;
-          case AtomicRadiiSet::Cctbx: r += cctbx_vdw_radius(elem); break;
-          case AtomicRadiiSet::Refmac: r += refmac_radius_for_bulk_solvent(elem); break;
-          case AtomicRadiiSet::Constant: /* r is included in r_probe */ break;
-        }
-        mask.set_points_around(atom.pos, r, value);
-      }
+                           bool ignore_zero_occupancy_atoms,
+                           int nthreads=1) {
+  SphereBricks bricks;
+  bricks.prepare(mask, mask_spheres(mask.unit_cell, model, atomic_radii_set, r_probe,
+                                    ignore_hydrogen, ignore_zero_occupancy_atoms));
+  bricks.set_points(mask, value, nthreads);
 }
 
 /// @deprecated Use mask_points_in_radius with AtomicRadiiSet::Constant instead.
@@ -161,13 +192,15 @@ void mask_points_in_radius(Grid<T>& mask, const Model& model,
 /// @param value Value to set for masked grid points
 /// @param ignore_hydrogen If true, skip hydrogen atoms
 /// @param ignore_zero_occupancy_atoms If true, skip atoms with zero occupancy
+/// @param nthreads Number of threads (0 = all available)
 template<typename T>
 void mask_points_in_constant_radius(Grid<T>& mask, const Model& model,
                                     double radius, T value,
                                     bool ignore_hydrogen,
-                                    bool ignore_zero_occupancy_atoms) {
+                                    bool ignore_zero_occupancy_atoms,
+                                    int nthreads=1) {
   mask_points_in_radius(mask, model, AtomicRadiiSet::Constant, radius, value,
-                        ignore_hydrogen, ignore_zero_occupancy_atoms);
+                        ignore_hydrogen, ignore_zero_occupancy_atoms, nthreads);
 }
 
 
@@ -191,42 +224,42 @@ inline std::string distinct_altlocs(const Model& model) {
 /// @param r_probe Probe radius (in Angstroms) added to each atomic radius
 /// @param ignore_hydrogen If true, skip hydrogen atoms
 /// @param ignore_zero_occupancy_atoms If true, skip atoms with zero occupancy
+/// @param nthreads Number of threads (0 = all available)
 inline
 void mask_points_using_occupancy(Grid<float>& mask, const Model& model,
                                   AtomicRadiiSet atomic_radii_set, double r_probe,
                                   bool ignore_hydrogen,
-                                  bool ignore_zero_occupancy_atoms) {
+                                  bool ignore_zero_occupancy_atoms,
+                                  int nthreads=1) {
 
   std::string altlocs = distinct_altlocs(model);
   altlocs += '\0';  // no altloc
 
   gemmi::Grid<float> m;
   m.copy_metadata_from(mask);
+  std::vector<GridSphere> spheres;
+  std::vector<float> occupancies;
   for (char& altloc : altlocs) {
     m.fill(0.0);
-    for (const Chain& chain : model.chains) {
-      for (const Residue& res : chain.residues) {
+    spheres.clear();
+    occupancies.clear();
+    for (const Chain& chain : model.chains)
+      for (const Residue& res : chain.residues)
         for (const Atom& atom : res.atoms) {
           if ((ignore_hydrogen && atom.is_hydrogen()) ||
               (ignore_zero_occupancy_atoms && atom.occ <= 0))
             continue;
           if (atom.altloc == altloc) {
-            El elem = atom.element.elem;
-            double r = r_probe;
-            switch (atomic_radii_set) {
-              case AtomicRadiiSet::VanDerWaals: r += vdw_radius(elem); break;
-              case AtomicRadiiSet::Cctbx: r += cctbx_vdw_radius(elem); break;
-              case AtomicRadiiSet::Refmac: r += refmac_radius_for_bulk_solvent(elem); break;
-              case AtomicRadiiSet::Constant: /* r is included in r_probe */ break;
-            }
-            Fractional fpos = m.unit_cell.fractionalize(atom.pos);
-            m.use_points_around<true>(fpos, r, [&](float& ref, double) {
-                ref = std::min(ref, -atom.occ);
-            }, false);
+            double r = mask_radius(atom.element.elem, atomic_radii_set, r_probe);
+            spheres.push_back({m.unit_cell.fractionalize(atom.pos), r});
+            occupancies.push_back(atom.occ);
           }
         }
-      }
-    }
+    SphereBricks bricks;
+    bricks.prepare(m, spheres);
+    bricks.use_points(m, [&](float& ref, double, size_t n, int, int, int) {
+        ref = std::min(ref, -occupancies[n]);
+    }, nthreads);
 
     // reduce starting mask
     for (size_t i = 0; i < m.data.size(); ++i) {
@@ -333,6 +366,7 @@ struct SolventMasker {
   double island_min_volume;          ///< Minimum volume (as fraction) of protein islands to retain
   double constant_r;                 ///< Constant radius (for AtomicRadiiSet::Constant)
   double requested_spacing = 0.;     ///< Requested grid spacing (0 = auto)
+  int nthreads = 1;                  ///< Number of threads used for masking (0 = all)
 
   /// Initialize SolventMasker with a radii set and optional constant radius.
   /// Automatically sets default parameters (rprobe, rshrink) for the chosen set.
@@ -386,7 +420,7 @@ struct SolventMasker {
   /// @param model Molecular model
   template<typename T> void mask_points(Grid<T>& grid, const Model& model) const {
     mask_points_in_radius(grid, model, atomic_radii_set, constant_r + rprobe, (T)0,
-                          ignore_hydrogen, ignore_zero_occupancy_atoms);
+                          ignore_hydrogen, ignore_zero_occupancy_atoms, nthreads);
   }
 
   /// Sets grid points around atoms to 0, with optional occupancy weighting.
@@ -396,7 +430,7 @@ struct SolventMasker {
   void mask_points(Grid<float>& grid, const Model& model) const {
     if (use_atom_occupancy)
       mask_points_using_occupancy(grid, model, atomic_radii_set, constant_r + rprobe,
-                                  ignore_hydrogen, ignore_zero_occupancy_atoms);
+                                  ignore_hydrogen, ignore_zero_occupancy_atoms, nthreads);
     else
       mask_points<float>(grid, model);
   }
@@ -543,33 +577,28 @@ struct NodeInfo {
 /// @param mask NodeInfo grid to populate
 /// @param model Molecular model to search
 /// @param radius Search radius in Angstroms
-inline void mask_with_node_info(Grid<NodeInfo>& mask, const Model& model, double radius) {
+/// @param nthreads Number of threads (0 = all available)
+inline void mask_with_node_info(Grid<NodeInfo>& mask, const Model& model, double radius,
+                                int nthreads=1) {
   NodeInfo default_ni;
   default_ni.dist_sq = radius * radius;
   mask.fill(default_ni);
-  // cf. use_points_around()
-  int du = (int) std::ceil(radius / mask.spacing[0]);
-  int dv = (int) std::ceil(radius / mask.spacing[1]);
-  int dw = (int) std::ceil(radius / mask.spacing[2]);
-  mask.template check_size_for_points_in_box<true>(du, dv, dw, false);
+  std::vector<GridSphere> spheres;
   for (const Chain& chain : model.chains)
     for (const Residue& res : chain.residues)
-      for (const Atom& atom : res.atoms) {
-        Fractional frac0 = mask.unit_cell.fractionalize(atom.pos);
-        mask.template do_use_points_in_box<true>(
-            frac0, du, dv, dw,
-            [&](NodeInfo& ni, double d2, const Position&, int u, int v, int w) {
-              if (d2 < ni.dist_sq) {
-                ni.dist_sq = d2;
-                ni.found = true;
-                //ni.elem = atom.element;
-                ni.u = u;
-                ni.v = v;
-                ni.w = w;
-              }
-            },
-            radius);
-      }
+      for (const Atom& atom : res.atoms)
+        spheres.push_back({mask.unit_cell.fractionalize(atom.pos), radius});
+  SphereBricks bricks;
+  bricks.prepare(mask, spheres);
+  bricks.use_points(mask, [&](NodeInfo& ni, double d2, size_t, int u, int v, int w) {
+    if (d2 < ni.dist_sq) {
+      ni.dist_sq = d2;
+      ni.found = true;
+      ni.u = u;
+      ni.v = v;
+      ni.w = w;
+    }
+  }, nthreads);
 }
 
 /// Removes grid points that are closer to a symmetry mate than to the original model.
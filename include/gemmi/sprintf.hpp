@@ -1,6 +1,7 @@
 // Copyright 2017 Global Phasing Ltd.
 //
-// interface to stb_sprintf: snprintf_z, to_str(float|double)
+// interface to stb_sprintf: snprintf_z, to_str(float|double),
+// and faster functions for formatting numbers (fixed_to_chars_z, etc).
 
 #ifndef GEMMI_SPRINTF_HPP_
 #define GEMMI_SPRINTF_HPP_
@@ -14,6 +15,7 @@
 
 #if __cpp_lib_to_chars < 201611L
 # include <algorithm> // for min
+# include <cstring>   // for memcpy
 #endif
 
 #include "fail.hpp"  // for GEMMI_DLL
@@ -44,13 +46,44 @@ GEMMI_DLL int snprintf_z(char *buf, int count, char const *fmt, ...)
 /// @return number of characters written (not including the terminator), or negative on error
 GEMMI_DLL int sprintf_z(char *buf, char const *fmt, ...) GEMMI_ATTRIBUTE_FORMAT(2,3);
 
+/// @brief Format number as printf "%*.*f" with given width and precision.
+/// @details Gives the same result as snprintf_z(), but is several times faster
+///          for typical numbers (|d| < 1e15); other numbers and exact ties
+///          in rounding (such as 0.125 with 2 digits) are passed to snprintf_z.
+///          The output is truncated if it doesn't fit and always zero-terminated.
+/// @param first pointer to start of output buffer
+/// @param last pointer to one-past-end of output buffer
+/// @param d number to format
+/// @param prec number of digits after the decimal point
+/// @param width minimum width (output is padded with spaces on the left)
+/// @return pointer to the zero terminator in the output buffer
+GEMMI_DLL char* fixed_to_chars_z(char* first, char* last, double d, int prec, int width=0);
+
+/// @brief Format number as printf "%*.*g" with given width and precision.
+/// @details Like fixed_to_chars_z(), gives the same result as snprintf_z()
+///          and uses the slower snprintf_z() only for unusual numbers.
+/// @param prec number of significant digits (0 is treated as 1)
+/// @return pointer to the zero terminator in the output buffer
+GEMMI_DLL char* general_to_chars_z(char* first, char* last, double d, int prec, int width=0);
+
+/// @brief Format number so that it reads back as the same double.
+/// @details Uses std::to_chars without precision (the shortest representation)
+///          if it is available, otherwise snprintf_z() with "%.17g".
+///          The output is truncated if it doesn't fit and always zero-terminated.
+/// @return pointer to the zero terminator in the output buffer
+GEMMI_DLL char* shortest_to_chars_z(char* first, char* last, double d);
+
+/// @brief Format number so that it reads back as the same float.
+/// @details As above, with "%.9g" as the fallback.
+/// @return pointer to the zero terminator in the output buffer
+GEMMI_DLL char* shortest_to_chars_z(char* first, char* last, float f);
+
 /// @brief Convert a double to a string with default precision
 /// @param d the double value to convert
 /// @return string representation using format "%.9g"
 inline std::string to_str(double d) {
   char buf[24];
-  int len = sprintf_z(buf, "%.9g", d);
-  return std::string(buf, len > 0 ? len : 0);
+  return std::string(buf, general_to_chars_z(buf, buf + sizeof(buf), d, 9));
 }
 
 /// @brief Convert a float to a string with default precision
@@ -58,8 +91,7 @@ inline std::string to_str(double d) {
 /// @return string representation using format "%.6g"
 inline std::string to_str(float d) {
   char buf[16];
-  int len = sprintf_z(buf, "%.6g", d);
-  return std::string(buf, len > 0 ? len : 0);
+  return std::string(buf, general_to_chars_z(buf, buf + sizeof(buf), d, 6));
 }
 
 /// @brief Convert a double to a string with specified decimal precision
@@ -71,44 +103,54 @@ template<int Prec>
 std::string to_str_prec(double d) {
   static_assert(Prec >= 0 && Prec < 7, "unsupported precision");
   char buf[16];
-  int len = d > -1e8 && d < 1e8 ? sprintf_z(buf, "%.*f", Prec, d)
-                                : sprintf_z(buf, "%g", d);
-  return std::string(buf, len > 0 ? len : 0);
+  char* end = d > -1e8 && d < 1e8 ? fixed_to_chars_z(buf, buf + sizeof(buf), d, Prec)
+                                  : general_to_chars_z(buf, buf + sizeof(buf), d, 6);
+  return std::string(buf, end);
 }
 
-/// @brief Convert an integer to a zero-terminated C-string
-/// @details Uses std::to_chars if available (C++17), otherwise snprintf_z.
+/// @brief Convert a size_t to a zero-terminated C-string
+/// @details Uses std::to_chars if available (C++17), otherwise a simple loop.
 ///          Guarantees zero-termination within the output range.
 /// @param first pointer to start of output buffer
 /// @param last pointer to one-past-end of output buffer
-/// @param value the integer value to convert
+/// @param value the size_t value to convert
 /// @return pointer to the zero terminator in the output buffer
-inline char* to_chars_z(char* first, char* last, int value) {
+inline char* to_chars_z(char* first, char* last, size_t value) {
 #if __cpp_lib_to_chars >= 201611L
   auto result = std::to_chars(first, last-1, value);
   *result.ptr = '\0';
   return result.ptr;
 #else
-  int n = snprintf_z(first, int(last - first), "%d", value);
-  return std::min(first + n, last - 1);
+  char digits[20];
+  char* d = digits + sizeof(digits);
+  do {
+    *--d = char('0' + value % 10);
+    value /= 10;
+  } while (value != 0);
+  size_t len = std::min(size_t(digits + sizeof(digits) - d), size_t(last - first - 1));
+  std::memcpy(first, d, len);
+  first[len] = '\0';
+  return first + len;
 #endif
 }
 
-/// @brief Convert a size_t to a zero-terminated C-string
-/// @details Uses std::to_chars if available (C++17), otherwise snprintf_z.
+/// @brief Convert an integer to a zero-terminated C-string
+/// @details Uses std::to_chars if available (C++17), otherwise a simple loop.
 ///          Guarantees zero-termination within the output range.
 /// @param first pointer to start of output buffer
 /// @param last pointer to one-past-end of output buffer
-/// @param value the size_t value to convert
+/// @param value the integer value to convert
 /// @return pointer to the zero terminator in the output buffer
-inline char* to_chars_z(char* first, char* last, size_t value) {
+inline char* to_chars_z(char* first, char* last, int value) {
 #if __cpp_lib_to_chars >= 201611L
   auto result = std::to_chars(first, last-1, value);
   *result.ptr = '\0';
   return result.ptr;
 #else
-  int n = snprintf_z(first, int(last - first), "%zu", value);
-  return std::min(first + n, last - 1);
+  unsigned n = value < 0 ? 0u - (unsigned) value : (unsigned) value;
+  if (value < 0 && first + 1 < last)
+    *first++ = '-';
+  return to_chars_z(first, last, (size_t) n);
 #endif
 }
 
@@ -191,39 +191,34 @@ inline void write_out_pair(BufOstream& os, const std::string& name,
   os.put('\n');
 }
 
-inline void write_out_loop(BufOstream& os, const Loop& loop, WriteOptions options) {
-  if (loop.values.empty())
-    return;
-  if (options.prefer_pairs && loop.length() == 1) {
-    for (size_t i = 0; i != loop.tags.size(); ++i)
-      write_out_pair(os, loop.tags[i], loop.values[i], options);
-    return;
-  }
-  // tags
+/// Write "loop_" and tags (the first part of a loop).
+inline void write_out_loop_tags_(BufOstream& os, const std::vector<std::string>& tags) {
   os.write("loop_", 5);
-  for (const std::string& tag : loop.tags) {
+  for (const std::string& tag : tags) {
     os.put('\n');
     os << tag;
   }
-  // values
-  size_t ncol = loop.tags.size();
+}
 
-  std::vector<size_t> col_width(ncol, 0);
-  if (options.align_loops > 0) {
-    size_t col = 0;
-    for (const std::string& val : loop.values) {
-      if (!is_text_field(val))
-        col_width[col] = std::max(col_width[col], val.size());
-      if (++col == ncol)
-        col = 0;
-    }
-    for (size_t& w : col_width)
-      w = std::min(w, (size_t)options.align_loops);
-  }
+/// Widen columns (for WriteOptions::align_loops) to fit values in the row.
+/// @param col_width Column widths, one per tag
+/// @param row       Pointer to the first of col_width.size() values
+inline void update_col_width_(std::vector<size_t>& col_width, const std::string* row) {
+  for (size_t i = 0; i != col_width.size(); ++i)
+    if (!is_text_field(row[i]))
+      col_width[i] = std::max(col_width[i], row[i].size());
+}
 
-  size_t col = 0;
+/// Write one row of loop values, starting with a new line.
+/// @param os        Buffered output stream
+/// @param row       Pointer to the first of col_width.size() values
+/// @param col_width Column widths from update_col_width_() (or zeros)
+inline void write_out_loop_row_(BufOstream& os, const std::string* row,
+                                const std::vector<size_t>& col_width) {
+  size_t ncol = col_width.size();
   bool need_new_line = true;
-  for (const std::string& val : loop.values) {
+  for (size_t i = 0; i != ncol; ++i) {
+    const std::string& val = row[i];
     bool text_field = is_text_field(val);
     os.put(need_new_line || text_field ? '\n' : ' ');
     need_new_line = text_field;
@@ -231,18 +226,66 @@ inline void write_out_loop(BufOstream& os, const Loop& loop, WriteOptions option
       write_text_field(os, val);
     else
       os << val;
-    if (col != ncol - 1) {
-      if (val.size() < col_width[col])
-        os.pad(col_width[col] - val.size());
-      ++col;
-    } else {
-      col = 0;
-      need_new_line = true;
-    }
+    if (i != ncol - 1 && val.size() < col_width[i])
+      os.pad(col_width[i] - val.size());
   }
+}
+
+/// Write a loop with nrows rows; for_each_row(func) must call func(row)
+/// for each row, where row points to the first of tags.size() values.
+/// Used by write_out_loop() and write_out_generated_loop().
+template<typename ForEachRow>
+void write_out_loop_rows_(BufOstream& os, const std::vector<std::string>& tags,
+                          size_t nrows, ForEachRow&& for_each_row, WriteOptions options) {
+  if (nrows == 0 || tags.empty())
+    return;
+  if (options.prefer_pairs && nrows == 1) {
+    for_each_row([&](const std::string* row) {
+      for (size_t i = 0; i != tags.size(); ++i)
+        write_out_pair(os, tags[i], row[i], options);
+    });
+    return;
+  }
+  write_out_loop_tags_(os, tags);
+  std::vector<size_t> col_width(tags.size(), 0);
+  if (options.align_loops > 0) {
+    for_each_row([&](const std::string* row) { update_col_width_(col_width, row); });
+    for (size_t& w : col_width)
+      w = std::min(w, (size_t)options.align_loops);
+  }
+  for_each_row([&](const std::string* row) { write_out_loop_row_(os, row, col_width); });
   os.put('\n');
 }
 
+inline void write_out_loop(BufOstream& os, const Loop& loop, WriteOptions options) {
+  size_t ncol = loop.tags.size();
+  size_t nrows = ncol != 0 ? loop.length() : 0;
+  write_out_loop_rows_(os, loop.tags, nrows, [&](auto&& func) {
+    for (size_t i = 0; i < loop.values.size(); i += ncol)
+      func(&loop.values[i]);
+  }, options);
+}
+
+/// Write a loop with values produced row by row, without storing them.
+///
+/// The output is the same as from write_out_loop() for a Loop with the same
+/// tags and values. If options.align_loops is set, the rows are produced
+/// twice: first to determine column widths, then to write them.
+/// @param os           Buffered output stream
+/// @param tags         Loop tags
+/// @param nrows        Number of rows (must match the number of calls below)
+/// @param for_each_row Callable taking a callback; it calls the callback
+///                     with each row as const std::vector<std::string>&
+/// @param options      Formatting options
+template<typename ForEachRow>
+void write_out_generated_loop(BufOstream& os, const std::vector<std::string>& tags,
+                              size_t nrows, ForEachRow&& for_each_row,
+                              WriteOptions options) {
+  write_out_loop_rows_(os, tags, nrows, [&](auto&& func) {
+    for_each_row([&](const std::vector<std::string>& row) { func(row.data()); });
+  }, options);
+}
+
 inline void write_out_item(BufOstream& os, const Item& item, WriteOptions options) {
   switch (item.type) {
     case ItemType::Pair:
@@ -281,16 +324,10 @@ inline bool should_be_separated_(const Item& a, const Item& b) {
   return adot != bdot || a.pair[0].compare(0, adot, b.pair[0], 0, adot) != 0;
 }
 
-/// Write a single CIF block to an output stream.
-///
-/// Writes a CIF data block with the specified formatting options.
-///
-/// @param os_     Output stream to write to
-/// @param block   The CIF block to write
-/// @param options Formatting options (see WriteOptions documentation)
-inline void write_cif_block_to_stream(std::ostream& os_, const Block& block,
-                                      WriteOptions options=WriteOptions()) {
-  BufOstream os(os_);
+/// Write block header and items; write_item(item) writes a single item.
+template<typename WriteItem>
+void write_cif_block_items_(BufOstream& os, const Block& block,
+                            WriteOptions options, WriteItem&& write_item) {
   os.write("data_", 5);
   os << block.name;
   os.put('\n');
@@ -305,13 +342,28 @@ inline void write_cif_block_to_stream(std::ostream& os_, const Block& block,
         os.put('#');
       os.put('\n');
     }
-    write_out_item(os, item, options);
+    write_item(item);
     prev = &item;
   }
   if (options.misuse_hash)
     os.write("#\n", 2);
 }
 
+/// Write a single CIF block to an output stream.
+///
+/// Writes a CIF data block with the specified formatting options.
+///
+/// @param os_     Output stream to write to
+/// @param block   The CIF block to write
+/// @param options Formatting options (see WriteOptions documentation)
+inline void write_cif_block_to_stream(std::ostream& os_, const Block& block,
+                                      WriteOptions options=WriteOptions()) {
+  BufOstream os(os_);
+  write_cif_block_items_(os, block, options, [&](const Item& item) {
+    write_out_item(os, item, options);
+  });
+}
+
 /// Write a CIF document to an output stream.
 ///
 /// Writes a complete CIF document with all its blocks, using the specified
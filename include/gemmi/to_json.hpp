@@ -91,11 +91,16 @@ struct JsonWriteOptions {
 /// Serializes a CIF document in JSON format according to the specified options.
 /// See JsonWriteOptions for details on supported formats and customization.
 ///
-/// @param os      Output stream to write to
-/// @param doc     The CIF document to write
-/// @param options Formatting and format selection options
+/// The output is formatted into a buffer and written in large chunks.
+/// Columns of large loops can be formatted on multiple threads.
+///
+/// @param os       Output stream to write to
+/// @param doc      The CIF document to write
+/// @param options  Formatting and format selection options
+/// @param nthreads number of threads (0 = all CPUs)
 GEMMI_DLL void write_json_to_stream(std::ostream& os, const Document& doc,
-                                    const JsonWriteOptions& options);
+                                    const JsonWriteOptions& options,
+                                    int nthreads=1);
 
 /// Write a CIF document as mmJSON (PDBj macromolecular JSON) to an output stream.
 ///
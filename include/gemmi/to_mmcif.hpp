@@ -10,6 +10,7 @@
 
 #include "model.hpp"
 #include "cifdoc.hpp"
+#include "to_cif.hpp"  // for WriteOptions
 
 namespace gemmi {
 
@@ -116,6 +117,23 @@ GEMMI_DLL void update_mmcif_block(const Structure& st, cif::Block& block,
 GEMMI_DLL cif::Document make_mmcif_document(const Structure& st,
                                             MmcifOutputGroups groups=MmcifOutputGroups(true));
 
+/// @brief Write a Structure as mmCIF without creating cif::Document.
+/// @details The output is the same as from
+/// cif::write_cif_to_stream(os, make_mmcif_document(st, groups), options),
+/// but values of _atom_site and _atom_site_anisotrop are formatted one row
+/// at a time and written directly to the stream. For large structures this
+/// avoids storing a string for each value.
+/// @param os Output stream.
+/// @param st The Structure to serialize.
+/// @param groups Selectively enable/disable categories to write.
+/// @param options CIF formatting options.
+/// @param nthreads Number of threads used to format atoms (0 = all CPUs).
+///        The output doesn't depend on it.
+GEMMI_DLL void write_mmcif_to_stream(std::ostream& os, const Structure& st,
+                                     MmcifOutputGroups groups=MmcifOutputGroups(true),
+                                     cif::WriteOptions options=cif::WriteOptions(),
+                                     int nthreads=1);
+
 /// @brief Create an mmCIF/PDBx block from a Structure.
 /// @param st The Structure to serialize.
 /// @param groups Selectively enable/disable categories to write.
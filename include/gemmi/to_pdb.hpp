@@ -90,7 +90,10 @@ GEMMI_DLL bool use_hetatm(const Residue& res);
 /// @param st The Structure to serialize.
 /// @param os The output stream to write to.
 /// @param opt Options controlling record types and formatting.
-GEMMI_DLL void write_pdb(const Structure& st, std::ostream& os, PdbWriteOptions opt={});
+/// @param nthreads Number of threads used to format atom records (0 = all CPUs).
+///        The output doesn't depend on it.
+GEMMI_DLL void write_pdb(const Structure& st, std::ostream& os, PdbWriteOptions opt={},
+                         int nthreads=1);
 
 /// @brief Serialize a Structure to a PDB format string.
 /// @param st The Structure to serialize.
@@ -5,6 +5,7 @@
 #ifndef GEMMI_TOPO_HPP_
 #define GEMMI_TOPO_HPP_
 
+#include <functional>    // for less
 #include <map>           // for multimap
 #include <memory>        // for unique_ptr
 #include <unordered_map> // for unordered_map
@@ -16,6 +17,8 @@
 
 namespace gemmi {
 
+struct ModelIndex;
+
 /// @brief Specification for how to modify hydrogen atoms during topology preparation.
 enum class HydrogenChange {
   NoChange,         ///< Leave hydrogen atoms as they are in the input model.
@@ -395,6 +398,19 @@ struct GEMMI_DLL Topo {
   /// @param res The residue to search for.
   /// @return Pointer to the ResInfo, or nullptr if not found.
   ResInfo* find_resinfo(const Residue* res) {
+    // normally, res_infos correspond to consecutive residues in a subchain
+    std::less<const Residue*> less;
+    for (ChainInfo& ci : chain_infos)
+      if (!ci.res_infos.empty()) {
+        // first and last are in the same Chain::residues, so res is also there
+        const Residue* first = ci.res_infos.front().res;
+        const Residue* last = ci.res_infos.back().res;
+        if (!less(res, first) && !less(last, res)) {
+          size_t idx = res - first;
+          if (idx < ci.res_infos.size() && ci.res_infos[idx].res == res)
+            return &ci.res_infos[idx];
+        }
+      }
     for (ChainInfo& ci : chain_infos)
       for (ResInfo& ri : ci.res_infos)
         if (ri.res == res)
@@ -529,7 +545,7 @@ private:
   // storage for ad-hoc ChemComps (placeholders for those missing in MonLib)
   std::vector<std::unique_ptr<ChemComp>> cc_storage;
 
-  void setup_connection(Connection& conn, Model& model0, MonLib& monlib,
+  void setup_connection(Connection& conn, const ModelIndex& index, MonLib& monlib,
                         bool ignore_unknown_links);
 };
 
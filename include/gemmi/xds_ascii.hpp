@@ -5,6 +5,7 @@
 #ifndef GEMMI_XDS_ASCII_HPP_
 #define GEMMI_XDS_ASCII_HPP_
 
+#include <functional>
 #include "input.hpp"     // for AnyStream, FileStream
 #include "unitcell.hpp"  // for UnitCell
 #include "util.hpp"      // for starts_with
@@ -153,14 +154,39 @@ struct GEMMI_DLL XdsAscii : XdsAsciiMetadata {
   /// @brief Read XDS file from stream.
   /// @param reader Input stream handler.
   /// @param source File path (for error messages).
-  void read_stream(AnyStream& reader, const std::string& source);
+  /// @param nthreads Number of threads used to parse data lines.
+  void read_stream(AnyStream& reader, const std::string& source, int nthreads=1);
+
+  /// @brief Read XDS file from stream, passing reflections to a callback
+  /// in batches instead of storing them in data.
+  ///
+  /// The header is parsed before the first batch, so metadata (cell,
+  /// space group, read_columns, etc.) can be used in the callback.
+  /// Data lines are read in blocks of a few thousand lines and each block
+  /// is parsed on nthreads threads. Only one block is kept in memory.
+  /// @param reader Input stream handler.
+  /// @param source File path (for error messages).
+  /// @param func Callback taking std::vector<Refl>& (it may modify or swap it).
+  /// @param nthreads Number of threads used to parse data lines.
+  void read_stream(AnyStream& reader, const std::string& source,
+                   const std::function<void(std::vector<Refl>&)>& func,
+                   int nthreads=1);
 
   /// @brief Read XDS file from input object (file or stdin).
   /// @tparam T Input object with create_stream() and path() methods.
   /// @param input Input object.
+  /// @param nthreads Number of threads used to parse data lines.
+  template<typename T>
+  void read_input(T&& input, int nthreads=1) {
+    read_stream(*input.create_stream(), input.path(), nthreads);
+  }
+
+  /// @brief Read XDS file from input object, passing reflections
+  /// to func in batches (see read_stream()).
   template<typename T>
-  void read_input(T&& input) {
-    read_stream(*input.create_stream(), input.path());
+  void read_input(T&& input, const std::function<void(std::vector<Refl>&)>& func,
+                  int nthreads=1) {
+    read_stream(*input.create_stream(), input.path(), func, nthreads);
   }
 
   /// @brief Check if data is merged (few columns in XDS file).
@@ -276,8 +302,9 @@ inline XdsAscii read_xds_ascii_file(const std::string& path) {
 
 /// @brief Read XDS_ASCII file, handling gzip compression.
 /// @param path File path (may be .gz).
+/// @param nthreads Number of threads used to parse data lines.
 /// @return Populated XdsAscii object.
-GEMMI_DLL XdsAscii read_xds_ascii(const std::string& path);
+GEMMI_DLL XdsAscii read_xds_ascii(const std::string& path, int nthreads=1);
 
 } // namespace gemmi
 #endif
@@ -4,6 +4,7 @@
 #include <algorithm>  // count
 #include <stdexcept>
 #include "gemmi/blob.hpp"
+#include "gemmi/bricks.hpp"    // for SphereBricks
 #include "gemmi/assembly.hpp"  // for expand_ncs
 #include "gemmi/polyheur.hpp"  // for remove_waters
 #include "gemmi/modify.hpp"    // for remove_hydrogens
@@ -166,10 +167,14 @@ int run(OptParser& p) {
     double radius = 2.0;
     if (p.options[MaskRadius])
       radius = std::strtod(p.options[MaskRadius].arg, nullptr);
+    std::vector<gemmi::GridSphere> spheres;
     for (const gemmi::Chain& chain : model.chains)
       for (const gemmi::Residue& res : chain.residues)
         for (const gemmi::Atom& atom : res.atoms)
-          grid.set_points_around(atom.pos, radius, -INFINITY);
+          spheres.push_back({grid.unit_cell.fractionalize(atom.pos), radius});
+    gemmi::SphereBricks bricks;
+    bricks.prepare(grid, spheres);
+    bricks.set_points(grid, -INFINITY);
     grid.symmetrize_min();
     if (p.options[Verbose]) {
       size_t n = std::count(grid.data.begin(), grid.data.end(), -INFINITY);
@@ -19,7 +19,7 @@ struct ConvArg: public Arg {
   }
 };
 
-enum OptionIndex { Comcifs=AfterCifModOptions, Mmjson, Bare, Numb, CifDot, };
+enum OptionIndex { Comcifs=AfterCifModOptions, Mmjson, Bare, Numb, CifDot, Jobs };
 const option::Descriptor Usage[] = {
   { NoOp, 0, "", "", Arg::None,
     "Usage:"
@@ -46,6 +46,8 @@ const option::Descriptor Usage[] = {
                              "\v  mix (default) - quote only numbs with s.u." },
   { CifDot, 0, "", "dot", Arg::Required,
     "  --dot=STRING  \tJSON representation of CIF's '.' (default: null)." },
+  { Jobs, 0, "j", "jobs", Arg::Int,
+    "  -j, --jobs=N  \tUse N threads to format loops (default: 1, 0 = all CPUs)." },
 
   { NoOp, 0, "", "", Arg::None, "\nModifications:" },
   CifModUsage[SkipCat],
@@ -58,7 +60,7 @@ const option::Descriptor Usage[] = {
 
 
 void convert(const std::string& input, const std::string& output,
-             const std::vector<option::Option>& options) {
+             const std::vector<option::Option>& options, int nthreads) {
   cif::Document doc = gemmi::read_cif_gz(input);
   apply_cif_doc_modifications(doc, options);
   gemmi::Ofstream os(output, &std::cout);
@@ -78,7 +80,7 @@ void convert(const std::string& input, const std::string& output,
   }
   if (options[CifDot])
     json_options.cif_dot = options[CifDot].arg;
-  cif::write_json_to_stream(os.ref(), doc, json_options);
+  cif::write_json_to_stream(os.ref(), doc, json_options, nthreads);
 }
 
 } // anonymous namespace
@@ -95,7 +97,7 @@ int GEMMI_MAIN(int argc, char **argv) {
   if (p.options[Verbose])
     std::cerr << "Transcribing " << input << " to json ..." << std::endl;
   try {
-    convert(input, output, p.options);
+    convert(input, output, p.options, p.integer_or(Jobs, 1));
   } catch (std::runtime_error& e) {
     std::cerr << "ERROR: " << e.what() << std::endl;
     return 2;
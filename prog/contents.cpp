@@ -13,6 +13,7 @@
 #include <gemmi/select.hpp>    // for Selection
 #include <gemmi/stats.hpp>     // for DataStats
 #include <gemmi/calculate.hpp> // for expand_box, calculate_omega
+#include <gemmi/parallel.hpp>  // for parallel_pipeline
 #include "histogram.h"         // for print_histogram
 #define GEMMI_PROG contents
 #include "options.h"
@@ -22,7 +23,7 @@ using std::printf;
 
 namespace {
 
-enum OptionIndex { Select=4, Bfactors, Dihedrals, NoContentInfo };
+enum OptionIndex { Select=4, Bfactors, Dihedrals, NoContentInfo, Jobs };
 
 const option::Descriptor Usage[] = {
   { NoOp, 0, "", "", Arg::None,
@@ -39,6 +40,8 @@ const option::Descriptor Usage[] = {
     "  --dihedrals  \tPrint peptide dihedral angles." },
   { NoContentInfo, 0, "n", "", Arg::None,
     "  -n  \tDo not print content (for use with other options)." },
+  { Jobs, 0, "j", "jobs", Arg::Int,
+    "  -j, --jobs=N  \tRead N files in parallel (default: 1, 0 = all CPUs)." },
   { 0, 0, 0, 0, 0, 0 }
 };
 
@@ -238,6 +241,12 @@ void print_bfactor_info(const gemmi::Model& model) {
     print_histogram(bfactors, stats.dmin, stats.dmax);
 }
 
+// Structure read in a worker thread, or the error message.
+struct ReadResult {
+  Structure st;
+  std::string error;
+};
+
 } // anonymous namespace
 
 int GEMMI_MAIN(int argc, char **argv) {
@@ -245,28 +254,49 @@ int GEMMI_MAIN(int argc, char **argv) {
   p.simple_parse(argc, argv, Usage);
   p.require_input_files_as_args();
   bool verbose = p.options[Verbose];
-  try {
-    for (int i = 0; i < p.nonOptionsCount(); ++i) {
-      std::string input = p.coordinate_input_file(i);
-      if (i > 0)
-        std::printf("\n");
-      if (verbose || p.nonOptionsCount() > 1)
-        std::printf("File: %s\n", input.c_str());
-      Structure st = read_structure_gz(input);
-      setup_entities(st);
+  // Files are read on worker threads and printed in the order of arguments.
+  // An error is reported when its file is consumed, so that the output
+  // before it is the same as with one thread.
+  auto generate = [&](const auto& emit) {
+    for (int i = 0; i < p.nonOptionsCount(); ++i)
+      if (!emit(p.coordinate_input_file(i)))
+        break;
+  };
+  auto process = [&](const std::string& input) {
+    ReadResult r;
+    try {
+      r.st = read_structure_gz(input);
+      setup_entities(r.st);
       if (p.options[Select])
-        gemmi::Selection(p.options[Select].arg).remove_not_selected(st);
-      if (st.models.size() > 1)
-        std::fprintf(stderr,
-                     "Warning: using only the first model out of %zu.\n",
-                     st.models.size());
-      if (!p.options[NoContentInfo])
-        print_content_info(st, verbose);
-      if (p.options[Bfactors])
-        print_bfactor_info(st.first_model());
-      if (p.options[Dihedrals])
-        print_dihedrals(st);
+        gemmi::Selection(p.options[Select].arg).remove_not_selected(r.st);
+    } catch (std::runtime_error& e) {
+      r.error = e.what();
     }
+    return r;
+  };
+  int counter = 0;
+  auto consume = [&](const std::string& input, ReadResult& r) {
+    if (counter++ > 0)
+      std::printf("\n");
+    if (verbose || p.nonOptionsCount() > 1)
+      std::printf("File: %s\n", input.c_str());
+    if (!r.error.empty())
+      gemmi::fail(r.error);
+    const Structure& st = r.st;
+    if (st.models.size() > 1)
+      std::fprintf(stderr,
+                   "Warning: using only the first model out of %zu.\n",
+                   st.models.size());
+    if (!p.options[NoContentInfo])
+      print_content_info(st, verbose);
+    if (p.options[Bfactors])
+      print_bfactor_info(st.first_model());
+    if (p.options[Dihedrals])
+      print_dihedrals(st);
+  };
+  try {
+    gemmi::parallel_pipeline<std::string>(p.integer_or(Jobs, 1), true,
+                                          generate, process, consume);
   } catch (std::runtime_error& e) {
     std::fprintf(stderr, "ERROR: %s\n", e.what());
     return 1;
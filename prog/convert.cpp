@@ -6,8 +6,9 @@
 #include "gemmi/modify.hpp"    // for remove_hydrogens, remove_anisou
 #include "gemmi/align.hpp"     // for assign_label_seq_id
 #include "gemmi/to_pdb.hpp"    // for write_pdb, ...
-#include "gemmi/fstream.hpp"   // for Ofstream, Ifstream
-#include "gemmi/to_mmcif.hpp"  // for update_mmcif_block
+#include "gemmi/fstream.hpp"   // for Ifstream
+#include "gemmi/gz.hpp"        // for MaybeGzippedOfstream
+#include "gemmi/to_mmcif.hpp"  // for update_mmcif_block, write_mmcif_to_stream
 #include "gemmi/assembly.hpp"  // for ChainNameGenerator, transform_to_assembly
 #include "gemmi/pirfasta.hpp"  // for read_pir_or_fasta
 #include "gemmi/mmread_gz.hpp" // for read_structure_gz
@@ -16,6 +17,7 @@
 #include "gemmi/enumstr.hpp"   // for polymer_type_to_string
 #include "gemmi/calculate.hpp" // for parse_triplet_as_ftransform
 
+#include <cstdlib>             // for atof
 #include <cstring>
 #include <iostream>
 #include <algorithm>           // for sort
@@ -67,7 +69,7 @@ enum OptionIndex {
   Reframe, ShortTer, Linkid, Linkr, CopyRemarks, Minimal, ShortenCN, RenameChain,
   ShortenTLC, ChangeCcdCode, SetSeq, SiftsNum,
   Biso, BisoScale, AddTls, Anisou, AssignRecords,
-  SetCis, SegmentAsChain, OldPdb, ForceLabel
+  SetCis, SegmentAsChain, OldPdb, ForceLabel, Jobs
 };
 
 const option::Descriptor Usage[] = {
@@ -83,6 +85,9 @@ const option::Descriptor Usage[] = {
     "  --from=FORMAT  \tInput format (default: inferred from file extension)." },
   { FormatOut, 0, "", "to", Arg::CoorFormat,
     "  --to=FORMAT  \tOutput format (default: inferred from file extension)." },
+  { Jobs, 0, "j", "jobs", Arg::Int,
+    "  -j, --jobs=N  \tUse N threads to parse atoms, expand assemblies and NCS,"
+    " and format atoms (default: 1, 0 = all CPUs)." },
 
   { NoOp, 0, "", "", Arg::None, "\nmmCIF output options:" },
   { CifStyle, 0, "", "style", Arg::CifStyle,
@@ -174,7 +179,8 @@ const option::Descriptor Usage[] = {
   { NoOp, 0, "", "", Arg::None,
     "\nFORMAT can be specified as one of: mmcif, mmjson, pdb. chemcomp (read-only)."
     "\nchemcomp = coordinates of a component from CCD or monomer library (see docs)."
-    "\nWhen output file is -, write to standard output (default format: pdb)." },
+    "\nWhen output file is -, write to standard output (default format: pdb)."
+    "\nPDB, mmCIF and mmJSON output is gzipped if the output filename ends with .gz." },
   { 0, 0, 0, 0, 0, 0 }
 };
 
@@ -306,7 +312,9 @@ get_tls_group_by_id(const std::vector<gemmi::TlsGroup>& tls_groups, short num_id
 
 void convert(gemmi::Structure& st,
              const std::string& output, CoorFormat output_type,
-             const std::vector<option::Option>& options) {
+             const OptParser& p) {
+  const std::vector<option::Option>& options = p.options;
+  int nthreads = p.integer_or(Jobs, 1);
   if (st.models.empty())
     gemmi::fail("No atoms in the input (", format_as_string(st.input_format), ") file. "
                 "Wrong file format?");
@@ -485,7 +493,8 @@ void convert(gemmi::Structure& st,
     how = HowToNameCopiedChain::Short;
   if (options[AsAssembly]) {
     gemmi::Logger logger{&gemmi::Logger::to_stderr, options[Verbose] ? 6 : 3};
-    gemmi::transform_to_assembly(st, options[AsAssembly].arg, how, logger);
+    gemmi::transform_to_assembly(st, options[AsAssembly].arg, how, logger,
+                                 false, 0.2, nthreads);
   }
 
   if (options[ExpandNcs]) {
@@ -495,7 +504,7 @@ void convert(gemmi::Structure& st,
       case 'x': how_ncs = HowToNameCopiedChain::Short; break;
       default: how_ncs = HowToNameCopiedChain::AddNumber; break;
     }
-    gemmi::expand_ncs(st, how_ncs);
+    gemmi::expand_ncs(st, how_ncs, 0.2, nthreads);
     for (gemmi::Model& model : st.models)
       gemmi::merge_atoms_in_expanded_model(model, st.cell);
   }
@@ -526,11 +535,21 @@ void convert(gemmi::Structure& st,
   if (options[ShortenTLC] || output_type == CoorFormat::Pdb)
     shorten_ccd_codes(st);
 
-  gemmi::Ofstream os(output, &std::cout);
+  gemmi::MaybeGzippedOfstream os(output, &std::cout);
 
   if (output_type == CoorFormat::Mmcif || output_type == CoorFormat::Mmjson) {
     if (options[BlockName])
       st.name = options[BlockName].arg;
+    if (output_type == CoorFormat::Mmcif && !options[Minimal] &&
+        !options[SkipCat] && !options[SortCif]) {
+      // write atoms directly, without cif::Document
+      gemmi::MmcifOutputGroups groups(true);
+      groups.auth_all = options[AllAuth];
+      gemmi::write_mmcif_to_stream(os.ref(), st, groups,
+                                   cif_write_options(options[CifStyle]), nthreads);
+      os.close();
+      return;
+    }
     cif::Document doc;
     doc.blocks.resize(1);
     if (options[Minimal]) {
@@ -545,7 +564,7 @@ void convert(gemmi::Structure& st,
     if (output_type == CoorFormat::Mmcif) {
       write_cif_to_stream(os.ref(), doc, cif_write_options(options[CifStyle]));
     } else /*output_type == CoorFormat::Mmjson*/ {
-      cif::write_mmjson_to_stream(os.ref(), doc);
+      cif::write_json_to_stream(os.ref(), doc, cif::JsonWriteOptions::mmjson(), nthreads);
     }
   } else if (output_type == CoorFormat::Pdb) {
     gemmi::PdbWriteOptions opt;
@@ -557,8 +576,9 @@ void convert(gemmi::Structure& st,
       opt.use_link_id = true;
     if (options[Linkr])
       opt.use_linkr = true;
-    gemmi::write_pdb(st, os.ref(), opt);
+    gemmi::write_pdb(st, os.ref(), opt, nthreads);
   }
+  os.close();
 }
 
 } // anonymous namespace
@@ -611,11 +631,12 @@ int GEMMI_MAIN(int argc, char **argv) {
       options.check_non_ascii = true;
       if (p.options[OldPdb])
         options.max_line_length = 72;
+      options.nthreads = p.integer_or(Jobs, 1);
       st = gemmi::read_pdb_gz(input, options);
     } else {
       st = gemmi::read_structure_gz(input, in_type);
     }
-    convert(st, output, out_type, p.options);
+    convert(st, output, out_type, p);
   } catch (std::runtime_error& e) {
     std::cerr << "ERROR: " << e.what() << std::endl;
     return 2;
@@ -3,7 +3,8 @@
 #include <cstdio>   // for printf, fprintf
 #include "gemmi/binner.hpp"  // for Binner
 #include "gemmi/mtz.hpp"     // for Mtz
-#include "gemmi/ecalc.hpp"   // for Mean
+#include "gemmi/ecalc.hpp"   // for calculate_amplitude_normalizers
+#include "gemmi/reflgeom.hpp"  // for ReflectionGeometry
 
 #define GEMMI_PROG ecalc
 #include "options.h"
@@ -11,7 +12,7 @@
 namespace {
 
 enum OptionIndex {
-  LabelF=4, LabelE, NoSigma, Method, BinSize, MaxBins
+  LabelF=4, LabelE, NoSigma, Method, BinSize, MaxBins, Jobs
 };
 
 struct EcalcArg: public Arg {
@@ -44,6 +45,8 @@ const option::Descriptor Usage[] = {
     "(default: 200)." },
   { MaxBins, 0, "", "maxbins", Arg::Int,
     "  --maxbins=N  \tMaximum number of bins (default: 100)." },
+  { Jobs, 0, "j", "jobs", Arg::Int,
+    "  -j, --jobs=N  \tUse N threads (default: 1, 0 = all CPUs)." },
   { NoOp, 0, "", "", Arg::None,
     "\nColumn for SIGF is always the next column after F (the type must be Q)."
     "\nIf INPUT.mtz has column E, it is replaced in OUTPUT.mtz."
@@ -119,11 +122,19 @@ int GEMMI_MAIN(int argc, char **argv) {
       }
     if (verbose > 0)
       std::fprintf(stderr, "Calculating E ...\n");
-    gemmi::Binner binner;
     gemmi::MtzDataProxy data_proxy{mtz};
-    binner.setup(nbins, method, data_proxy, nullptr, fcol_idx);
+    gemmi::ReflectionGeometry geom(data_proxy, p.integer_or(Jobs, 1));
+    // the same as Binner::setup() with col_idx=fcol_idx
+    std::vector<double> f_inv_d2;
+    f_inv_d2.reserve(f_count);
+    for (size_t i = 0, n = 0; n < mtz.data.size(); n += mtz.columns.size(), ++i)
+      if (!std::isnan(mtz.data[n + fcol_idx]))
+        f_inv_d2.push_back(geom.inv_d2[i]);
+    gemmi::Binner binner;
+    binner.setup_from_1_d2(nbins, method, std::move(f_inv_d2), &mtz.cell);
+    geom.assign_bins(binner, p.integer_or(Jobs, 1));
     std::vector<double> multipliers
-      = gemmi::calculate_amplitude_normalizers(data_proxy, fcol_idx, binner);
+      = gemmi::calculate_amplitude_normalizers(data_proxy, fcol_idx, binner, geom);
 
     if (verbose > 0)
       std::fprintf(stderr, "Writing %s ...\n", output);
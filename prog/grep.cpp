@@ -5,10 +5,13 @@
 #include "gemmi/cif.hpp"
 #include "gemmi/gz.hpp"
 #include "gemmi/dirwalk.hpp"
+#include "gemmi/fileutil.hpp"  // for file_open
+#include "gemmi/parallel.hpp"  // for parallel_pipeline
 #include "gemmi/pdb_id.hpp"    // for is_pdb_code, expand_if_pdb_code
 #include "gemmi/util.hpp"      // for replace_all
 #include <cstdio>
 #include <cstring>
+#include <memory>    // for unique_ptr
 #include <regex>
 #include <stdexcept>
 #include <string>
@@ -26,7 +29,7 @@ namespace {
 
 enum OptionIndex {
   FromFile=4, NamePattern, PdbDirSf, Recurse, MaxCount, OneBlock,
-  ExtRegexp, And,
+  ExtRegexp, And, Jobs, Unordered, Fast,
   Delim, WithFileName, NoBlockName, WithLineNumbers, WithTag,
   OnlyTags, Summarize, MatchingFiles, NonMatchingFiles, Count, Raw
 };
@@ -85,6 +88,15 @@ const option::Descriptor Usage[] = {
     "  -w, --raw  \tinclude '?', '.', and string quotes" },
   { Summarize, 0, "s", "summarize", Arg::None,
     "  -s, --summarize  \tdisplay joint statistics for all files" },
+  { Fast, 0, "", "fast", Arg::None,
+    "  --fast  \tuse a line-based scanner instead of the full CIF parser;"
+    " on syntax errors, the file is re-read with the full parser" },
+  { Jobs, 0, "j", "jobs", Arg::Int,
+    "  -j, --jobs=N  \tread and search N files in parallel"
+    " (default: 1, 0 = all CPUs)" },
+  { Unordered, 0, "", "unordered", Arg::None,
+    "  --unordered  \twith -j, print results of each file as soon as"
+    " it is searched, not in the order of files" },
   { 0, 0, 0, 0, 0, 0 }
 };
 
@@ -103,11 +115,13 @@ struct GrepParams {
   bool inverse = false;  // for now it refers to only_filenames only
   bool print_count = false;
   bool raw = false;
+  bool fast = false;
   std::string delim;
   std::vector<std::string> multi_tags;
   char globbing = '\0';  // g = globbing, r = regexp
   // working parameters
   const char* path = "";
+  std::string out;  // output for the current file
   std::string block_name;
   int match_value = 0;
   int match_column = -1;
@@ -132,28 +146,27 @@ void process_match(const Input& in, GrepParams& par, int n) {
     return;
   const char* sep = par.delim.empty() ? ":" : par.delim.c_str();
   if (par.with_filename)
-    printf("%s%s", par.path, sep);
+    par.out.append(par.path).append(sep);
   if (par.with_blockname)
-    printf("%s%s", par.block_name.c_str(), sep);
+    par.out.append(par.block_name).append(sep);
   if (par.with_line_numbers)
-    printf("%zu%s", in.iterator().line, sep);
+    par.out.append(std::to_string(in.iterator().line)).append(sep);
   if (par.with_tag) {
     const std::string& tag = n < 0 ? par.search_tag : par.multi_tags[n];
     if (par.only_tags) {
-      printf("%s\n", tag.c_str());
+      par.out.append(tag) += '\n';
       if (n == -1)
         par.match_column = -1;
-      else
+      else if (par.match_column != -1)  // in loop
         par.multi_match_columns[n] = -1;
       return;
     }
     if (par.delim.empty())
-      printf("[%s] ", tag.c_str());
+      par.out.append("[").append(tag).append("] ");
     else
-      printf("%s%s", tag.c_str(), sep);
+      par.out.append(tag).append(sep);
   }
-  std::string value = par.raw ? in.string() : cif::as_string(in.string());
-  printf("%s\n", value.c_str());
+  par.out.append(par.raw ? in.string() : cif::as_string(in.string())) += '\n';
   if (par.counters[0] == par.max_count)
     throw true;
 }
@@ -189,28 +202,28 @@ void process_multi_match(GrepParams& par) {
       continue;
     const char* sep = par.delim.empty() ? ":" : par.delim.c_str();
     if (par.with_filename)
-      printf("%s%s", par.path, sep);
+      par.out.append(par.path).append(sep);
     if (par.with_blockname)
-      printf("%s%s", par.block_name.c_str(), sep);
+      par.out.append(par.block_name).append(sep);
     if (par.with_tag) {
       if (par.delim.empty())
-        printf("[%s] ", par.multi_tags[0].c_str());
+        par.out.append("[").append(par.multi_tags[0]).append("] ");
       else
-        printf("%s%s", par.multi_tags[0].c_str(), sep);
+        par.out.append(par.multi_tags[0]).append(sep);
     }
     for (size_t j = 0; j != par.multi_values.size(); ++j) {
       if (j != 0)
-        std::fputs(par.delim.empty() ? ";" : par.delim.c_str(), stdout);
+        par.out.append(par.delim.empty() ? ";" : par.delim.c_str());
       const auto& v = par.multi_values[j];
       if (!v.empty()) {
         const std::string& raw_str = v[i < v.size() ? i : 0];
         std::string s = par.raw ? raw_str : cif::as_string(raw_str);
         if (s.find_first_of(need_escaping) != std::string::npos)
           s = escape(s, need_escaping[2]);
-        printf("%s", s.c_str());
+        par.out += s;
       }
     }
-    std::putc('\n', stdout);
+    par.out += '\n';
     if (par.counters[0] == par.max_count)
       break;
   }
@@ -218,20 +231,20 @@ void process_multi_match(GrepParams& par) {
     mv.clear();
 }
 
-void print_count(const GrepParams& par) {
+void print_count(GrepParams& par) {
   const char* sep = par.delim.empty() ? ":" : par.delim.c_str();
   if (par.with_filename)
-    printf("%s%s", par.path, sep);
+    par.out.append(par.path).append(sep);
   if (par.with_blockname)
-    printf("%s%s", par.block_name.c_str(), sep);
+    par.out.append(par.block_name).append(sep);
   bool first = true;
   for (int c : par.counters) {
     if (!first)
-      std::fputs(par.delim.empty() ? ";" : par.delim.c_str(), stdout);
-    printf("%d", c);
+      par.out.append(par.delim.empty() ? ";" : par.delim.c_str());
+    par.out += std::to_string(c);
     first = false;
   }
-  std::putc('\n', stdout);
+  par.out += '\n';
 }
 
 bool tag_matches(const GrepParams& p, const std::string& str) {
@@ -430,10 +443,297 @@ void run_parse(Input&& in, GrepParams& par) {
     pegtl::parse<rules::file, MultiSearch, cif::Errors>(in, par);
 }
 
-void grep_file(const std::string& path, GrepParams& par, int& err_count) {
-  if (par.verbose)
-    fprintf(stderr, "Reading %s ...\n", path.c_str());
-  par.path = path.c_str();
+// **** Line-based scanner used with option --fast ****
+//
+// The file is read in chunks (so a gzipped file is decompressed only until
+// the search is done) and split into lines with memchr. Lines are split
+// into tokens that are passed to the same actions (Search or MultiSearch)
+// as are used with the PEGTL grammar. A line without '_' can't contain tags
+// or reserved words (data_, loop_, save_, ...), so unless values are being
+// collected, its tokens are only checked and counted as values.
+// If the scanner finds anything unexpected, it throws FastScanFallback
+// and the file is parsed again with the grammar, which reports the error.
+
+struct FastScanFallback {};
+
+// Substitute for the PEGTL input passed to the actions.
+struct Token {
+  struct Position { size_t line; };
+  const char* ptr;
+  size_t len;
+  size_t line;
+  std::string string() const { return std::string(ptr, len); }
+  size_t size() const { return len; }
+  Position iterator() const { return {line}; }
+};
+
+inline bool is_blank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+template<size_t N>
+bool is_keyword(const char* p, size_t len, const char (&kw)[N], bool prefix=false) {
+  if (prefix ? len < N - 1 : len != N - 1)
+    return false;
+  for (size_t i = 0; i != N - 1; ++i)
+    if (gemmi::lower(p[i]) != kw[i])
+      return false;
+  return true;
+}
+
+template<template<typename> class Action>
+class FastScanner {
+public:
+  explicit FastScanner(GrepParams& par) : par_(par) {}
+
+  // Process one line, [b, e) doesn't include the '\n'.
+  void line(const char* b, const char* e) {
+    ++line_no_;
+    if (in_textfield_) {
+      if (b != e && *b == ';') {
+        in_textfield_ = false;
+        if (capture_) {
+          capture_ = false;
+          text_ += ';';
+          value(Token{text_.data(), text_.size(), text_line_});
+        }
+        tokens(b + 1, e);
+      } else if (capture_) {
+        text_.append(b, e) += '\n';
+      }
+      return;
+    }
+    if (b != e && *b == ';') {
+      if (state_ == State::Start || state_ == State::Block)
+        throw FastScanFallback();
+      in_textfield_ = true;
+      if (need_values()) {
+        capture_ = true;
+        text_line_ = line_no_;
+        text_.assign(b, e) += '\n';
+      } else {
+        skip_value();
+      }
+      return;
+    }
+    tokens(b, e);
+  }
+
+  void finish() {
+    if (in_textfield_ || state_ == State::Start)
+      throw FastScanFallback();
+    close();
+  }
+
+private:
+  enum class State { Start, Block, ItemValue, LoopTags, LoopValues };
+  GrepParams& par_;
+  State state_ = State::Start;
+  size_t line_no_ = 0;
+  int loop_tags_ = 0;
+  bool in_frame_ = false;
+  bool in_textfield_ = false;
+  bool capture_ = false;  // text field is a value that is passed to actions
+  size_t text_line_ = 0;
+  std::string text_;
+
+  bool need_values() const { return par_.match_value != 0 || par_.match_column != -1; }
+
+  void tokens(const char* p, const char* e) {
+    // A line without '_' has no tags or reserved words, only values.
+    // If values are not needed, they are checked but not passed to actions.
+    bool skip = !need_values() && !std::memchr(p, '_', e - p);
+    for (;;) {
+      while (p != e && is_blank(*p))
+        ++p;
+      if (p == e || *p == '#')
+        return;
+      const char* start = p;
+      if (*p == '\'' || *p == '"') {
+        char q = *p;
+        for (++p; ; ++p) {
+          if (p == e)
+            throw FastScanFallback();  // unterminated string
+          if (*p == q && (p + 1 == e || is_blank(p[1]) || p[1] == '#'))
+            break;
+        }
+        ++p;
+        if (skip)
+          skip_value();
+        else
+          value(Token{start, size_t(p - start), line_no_});
+        continue;
+      }
+      while (p != e && *p >= '!' && *p <= '~')
+        ++p;
+      if (p == start || (p != e && !is_blank(*p)))
+        throw FastScanFallback();  // non-ASCII or control character
+      if (!skip)
+        word(Token{start, size_t(p - start), line_no_});
+      else if (*start == '$')
+        throw FastScanFallback();
+      else
+        skip_value();
+    }
+  }
+
+  void word(const Token& t) {
+    if (*t.ptr == '_')
+      return tag(t);
+    if (*t.ptr == '$')
+      throw FastScanFallback();
+    if (is_keyword(t.ptr, t.len, "data_", true)) {
+      close();
+      state_ = State::Block;
+      in_frame_ = false;
+      Action<rules::datablockname>::apply(Token{t.ptr + 5, t.len - 5, t.line}, par_);
+    } else if (is_keyword(t.ptr, t.len, "save_", true)) {
+      if (state_ == State::Start || in_frame_ == (t.len != 5))
+        throw FastScanFallback();
+      close();
+      in_frame_ = !in_frame_;
+      if (in_frame_)
+        Action<rules::framename>::apply(Token{t.ptr + 5, t.len - 5, t.line}, par_);
+      else
+        Action<rules::endframe>::apply(t, par_);
+    } else if (is_keyword(t.ptr, t.len, "loop_")) {
+      if (state_ == State::Start)
+        throw FastScanFallback();
+      close();
+      state_ = State::LoopTags;
+      loop_tags_ = 0;
+      Action<rules::str_loop>::apply(t, par_);
+    } else if (is_keyword(t.ptr, t.len, "global_")) {
+      close();
+      state_ = State::Block;
+      in_frame_ = false;
+      Action<rules::str_global>::apply(t, par_);
+    } else if (is_keyword(t.ptr, t.len, "stop_")) {
+      if (state_ != State::LoopTags && state_ != State::LoopValues)
+        throw FastScanFallback();
+      close();
+    } else {
+      value(t);
+    }
+  }
+
+  void tag(const Token& t) {
+    switch (state_) {
+      case State::Start:
+        throw FastScanFallback();
+      case State::ItemValue:  // tag without value
+      case State::LoopValues:
+        close();
+        /* fallthrough */
+      case State::Block:
+        Action<rules::item_tag>::apply(t, par_);
+        state_ = State::ItemValue;
+        break;
+      case State::LoopTags:
+        Action<rules::loop_tag>::apply(t, par_);
+        ++loop_tags_;
+        break;
+    }
+  }
+
+  void value(const Token& t) {
+    switch (state_) {
+      case State::Start:
+      case State::Block:
+        throw FastScanFallback();
+      case State::ItemValue:
+        state_ = State::Block;
+        Action<rules::item_value>::apply(t, par_);
+        break;
+      case State::LoopTags:
+        if (loop_tags_ == 0)
+          throw FastScanFallback();
+        state_ = State::LoopValues;
+        /* fallthrough */
+      case State::LoopValues:
+        Action<rules::loop_value>::apply(t, par_);
+        break;
+    }
+  }
+
+  // Update the state for a value that doesn't need to be passed to actions.
+  void skip_value() {
+    if (state_ == State::ItemValue)
+      state_ = State::Block;
+    else if (state_ == State::LoopTags && loop_tags_ != 0)
+      state_ = State::LoopValues;
+    else if (state_ != State::LoopValues)
+      throw FastScanFallback();
+  }
+
+  // Called before keywords, at the end of a loop or item.
+  void close() {
+    if (state_ == State::LoopTags && loop_tags_ == 0)
+      throw FastScanFallback();
+    if (state_ == State::LoopTags || state_ == State::LoopValues)
+      Action<rules::loop_end>::apply(Token{"", 0, line_no_}, par_);
+    if (state_ != State::Start)
+      state_ = State::Block;
+  }
+};
+
+// Read the file in chunks and pass lines to the scanner.
+template<template<typename> class Action>
+void fast_scan(const std::string& path, GrepParams& par) {
+  FastScanner<Action> scanner(par);
+  gemmi::MaybeGzipped input(path);
+  std::unique_ptr<gemmi::AnyStream> gz_stream;
+  gemmi::fileptr_t f;
+  if (input.is_compressed())
+    gz_stream = input.create_stream();  // opens the file for gzread_checked()
+  else
+    f = gemmi::file_open(path.c_str(), "rb");
+  std::vector<char> buf(256 * 1024);
+  size_t filled = 0;
+  for (;;) {
+    size_t n;
+    if (gz_stream) {
+      n = input.gzread_checked(buf.data() + filled, buf.size() - filled);
+    } else {
+      n = std::fread(buf.data() + filled, 1, buf.size() - filled, f.get());
+      if (n == 0 && std::ferror(f.get()))
+        gemmi::sys_fail("failed to read " + path);
+    }
+    filled += n;
+    const char* p = buf.data();
+    const char* end = p + filled;
+    while (const char* nl = (const char*) std::memchr(p, '\n', end - p)) {
+      scanner.line(p, nl);
+      p = nl + 1;
+    }
+    if (n == 0) {
+      if (p != end)
+        scanner.line(p, end);
+      scanner.finish();
+      return;
+    }
+    filled = end - p;
+    std::memmove(buf.data(), p, filled);
+    if (filled == buf.size())  // very long line
+      buf.resize(2 * buf.size());
+  }
+}
+
+void parse_file(const std::string& path, GrepParams& par) {
+  gemmi::MaybeGzipped input(path);
+  if (input.is_stdin()) {
+    pegtl::cstream_input<> in(stdin, 16*1024, "stdin");
+    run_parse(in, par);
+  } else if (gemmi::CharArray mem = input.uncompress_into_buffer()) {
+    pegtl::memory_input<> in(mem.data(), mem.size(), path);
+    run_parse(in, par);
+  } else {
+    GEMMI_CIF_FILE_INPUT(in, path);
+    run_parse(in, par);
+  }
+}
+
+void reset_file_state(GrepParams& par) {
+  par.out.clear();
+  par.total_count = 0;
   par.block_name.clear();
   par.counters.clear();
   if (par.globbing != '\0')
@@ -446,36 +746,67 @@ void grep_file(const std::string& path, GrepParams& par, int& err_count) {
   par.multi_match_columns.resize(n_multi, -1);
   par.multi_values.clear();
   par.multi_values.resize(n_multi);
+}
+
+// File to be searched. PDB code implies -O (last_block).
+struct GrepJob {
+  std::string path;
+  bool last_block;
+};
+
+// Output from one file, printed after the file is searched.
+struct GrepResult {
+  std::string out;
+  std::string error;
+  size_t count = 0;
+};
+
+GrepResult grep_file(const GrepJob& job, GrepParams& par) {
+  const std::string& path = job.path;
+  if (par.verbose)
+    fprintf(stderr, "Reading %s ...\n", path.c_str());
+  par.path = path.c_str();
+  par.last_block = job.last_block;
+  reset_file_state(par);
   try {
-    gemmi::MaybeGzipped input(path);
-    if (input.is_stdin()) {
-      pegtl::cstream_input<> in(stdin, 16*1024, "stdin");
-      run_parse(in, par);
-    } else if (gemmi::CharArray mem = input.uncompress_into_buffer()) {
-      pegtl::memory_input<> in(mem.data(), mem.size(), path);
-      run_parse(in, par);
-    } else {
-      GEMMI_CIF_FILE_INPUT(in, path);
-      run_parse(in, par);
+    bool done = false;
+    if (par.fast && path != "-") {
+      try {
+        if (par.multi_values.empty())
+          fast_scan<Search>(path, par);
+        else
+          fast_scan<MultiSearch>(path, par);
+        done = true;
+      } catch (FastScanFallback&) {
+        if (par.verbose)
+          fprintf(stderr, "Using full parser for %s\n", path.c_str());
+        reset_file_state(par);
+      }
     }
+    if (!done)
+      parse_file(path, par);
   } catch (bool) {
     // ok, "throw true" is used as goto in this file
   } catch (std::runtime_error& e) {
-    std::fflush(stdout);
-    fprintf(stderr, "Error when parsing %s:\n\t%s\n", path.c_str(), e.what());
-    err_count++;
-    return;
+    GrepResult result;
+    result.out.swap(par.out);
+    result.error = e.what();
+    result.count = par.total_count;
+    return result;
   }
   if (par.print_count) {
     print_count(par);
   } else if (par.only_filenames) {
     if (par.inverse == (par.counters[0] == 0))
-      printf("%s\n", par.path);
+      par.out.append(par.path) += '\n';
   } else {
     process_multi_match(par);
   }
   par.total_count += par.counters[0];
-  std::fflush(stdout);
+  GrepResult result;
+  result.out.swap(par.out);
+  result.count = par.total_count;
+  return result;
 }
 
 } // anonymous namespace
@@ -487,8 +818,6 @@ int GEMMI_MAIN(int argc, char **argv) {
   GrepParams params;
   if (p.options[MaxCount])
     params.max_count = std::strtol(p.options[MaxCount].arg, nullptr, 10);
-  if (p.options[OneBlock])
-    params.last_block = true;
   if (p.options[Verbose])
     params.verbose = true;
   if (p.options[WithFileName])
@@ -518,6 +847,8 @@ int GEMMI_MAIN(int argc, char **argv) {
     params.print_count = true;
   if (p.options[Raw])
     params.raw = true;
+  if (p.options[Fast])
+    params.fast = true;
   if (p.options[Delim]) {
     params.delim = p.options[Delim].arg;
     gemmi::replace_all(params.delim, "\\t", "\t");
@@ -552,53 +883,73 @@ int GEMMI_MAIN(int argc, char **argv) {
   }
 
   size_t file_count = 0;
+  size_t total_count = 0;
   int err_count = 0;
-  try {
+  bool one_block = p.options[OneBlock];
+  // The directories are walked in this thread; files are read and searched
+  // in worker threads (if -j is used) and the output is printed per file.
+  // emit() returns false when the pipeline was stopped; then we stop walking.
+  auto generate = [&](const auto& emit) {
     auto paths = p.paths_from_args_or_file(FromFile, 1);
     char expand_type = p.options[PdbDirSf] ? 'S' : 'M';
     for (const std::string& path : paths) {
       if (path == "-") {
-        grep_file(path, params, err_count);
-        file_count++;
+        if (!emit(GrepJob{path, one_block}))
+          return;
       } else if (p.options[FromFile] ? starts_with_pdb_code(path)
                                      : gemmi::is_pdb_code(path)) {
         std::string real_path = gemmi::expand_if_pdb_code(path.substr(0, 4), expand_type);
-        params.last_block = true;  // PDB code implies -O
-        grep_file(real_path, params, err_count);
-        params.last_block = p.options[OneBlock];
-        file_count++;
+        if (!emit(GrepJob{real_path, true}))
+          return;
       } else {
         if (p.options[NamePattern]) {
           std::string pattern = p.options[NamePattern].arg;
-          for (const std::string& file : gemmi::GlobWalk(path, pattern)) {
-            grep_file(file, params, err_count);
-            file_count++;
-          }
+          for (const std::string& file : gemmi::GlobWalk(path, pattern))
+            if (!emit(GrepJob{file, one_block}))
+              return;
         } else if (!p.options[Recurse] && (gemmi::giends_with(path, ".cif") ||
                                            gemmi::giends_with(path, ".mmcif"))) {
           // Avoid tinydir_file_open (used by CifWalk) when not necessary.
           // It was reported to fail on a Mac with files on network drive.
           // Probably reading the parent directory failed, no idea why.
-          grep_file(path, params, err_count);
-          file_count++;
+          if (!emit(GrepJob{path, one_block}))
+            return;
         } else {
-          for (const std::string& file : gemmi::CifWalk(path)) {
-            grep_file(file, params, err_count);
-            file_count++;
-          }
+          for (const std::string& file : gemmi::CifWalk(path))
+            if (!emit(GrepJob{file, one_block}))
+              return;
         }
       }
     }
+  };
+  auto process = [&](const GrepJob& job) {
+    GrepParams par = params;
+    return grep_file(job, par);
+  };
+  auto consume = [&](GrepJob& job, GrepResult& result) {
+    std::fwrite(result.out.data(), 1, result.out.size(), stdout);
+    std::fflush(stdout);
+    if (!result.error.empty()) {
+      fprintf(stderr, "Error when parsing %s:\n\t%s\n",
+              job.path.c_str(), result.error.c_str());
+      err_count++;
+    }
+    total_count += result.count;
+    file_count++;
+  };
+  try {
+    gemmi::parallel_pipeline<GrepJob>(p.integer_or(Jobs, 1), !p.options[Unordered],
+                                      generate, process, consume);
   } catch (std::runtime_error &e) {
     fprintf(stderr, "Error: %s\n", e.what());
     return 2;
   }
   if (p.options[Summarize]) {
-    printf("Total count in %zu files: %zu\n", file_count, params.total_count);
+    printf("Total count in %zu files: %zu\n", file_count, total_count);
     if (err_count > 0)
       printf("Errors encountered when reading %d files.\n", err_count);
   }
   if (err_count > 0)
     return 2;
-  return params.total_count != 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+  return total_count != 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -16,7 +16,7 @@ namespace {
 enum OptionIndex {
   Timing=4, GridSpac, GridDims, Radius, RProbe, RShrink,
   IslandLimit, Hydrogens, AnyOccupancy, CctbxCompat, RefmacCompat, Invert,
-  SetOccupancy
+  SetOccupancy, Jobs
 };
 
 struct MaskArg {
@@ -59,6 +59,8 @@ const option::Descriptor Usage[] = {
     "  --refmac-compat  \tUse radii compatible with Refmac." },
   { Invert, 0, "I", "invert", Arg::None,
     "  -I, --invert  \t0 for solvent, 1 for molecule." },
+  { Jobs, 0, "j", "jobs", Arg::Int,
+    "  -j, --jobs=N  \tUse N threads for masking (default: 1, 0 = all CPUs)." },
   { 0, 0, 0, 0, 0, 0 }
 };
 
@@ -137,6 +139,7 @@ int GEMMI_MAIN(int argc, char **argv) {
       masker.ignore_zero_occupancy_atoms = false;
     if (p.options[SetOccupancy])
       masker.use_atom_occupancy = true;
+    masker.nthreads = p.integer_or(Jobs, 1);
 
     timer.start();
     masker.clear(mask.grid);
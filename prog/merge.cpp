@@ -19,7 +19,8 @@
 namespace {
 
 enum OptionIndex {
-  WriteAnom=4, NoSysAbs, BatchCell, NumObs, InputBlock, OutputBlock, Stats, Compare, PrintAll
+  WriteAnom=4, NoSysAbs, BatchCell, NumObs, InputBlock, OutputBlock, Stats, Compare, PrintAll,
+  Jobs
 };
 
 const option::Descriptor Usage[] = {
@@ -53,6 +54,8 @@ const option::Descriptor Usage[] = {
     "  --compare  \tCompare unmerged and merged data (no output file)." },
   { PrintAll, 0, "", "print-all", Arg::None,
     "  --print-all  \tPrint all compared reflections." },
+  { Jobs, 0, "j", "jobs", Arg::Int,
+    "  -j, --jobs=N  \tUse N threads for reading and merging (default: 1, 0 = all CPUs)." },
   { NoOp, 0, "", "", Arg::None,
     "\nThe input file can be SF-mmCIF with _diffrn_refln, MTZ or XDS_ASCII.HKL."
     "\nThe output file can be either SF-mmCIF or MTZ."
@@ -79,7 +82,7 @@ void output_intensity_statistics(const Intensities& intensities) {
 
 void read_intensities(Intensities& intensities, DataType data_type,
                       const std::string& input_path, const char* block_name,
-                      bool verbose, bool batch_cell) {
+                      bool verbose, bool batch_cell, int nthreads) {
   try {
     if (gemmi::giends_with(input_path, ".mtz")) {
       gemmi::Mtz mtz;
@@ -105,8 +108,7 @@ void read_intensities(Intensities& intensities, DataType data_type,
         }
       }
     } else if (gemmi::giends_with(input_path, "hkl")) {  // .hkl or .ahkl
-      gemmi::XdsAscii xds_ascii = gemmi::read_xds_ascii(input_path);
-      intensities.import_xds(xds_ascii);
+      intensities.import_xds_file(input_path, nthreads);
 
     } else {  // mmCIF
       auto rblocks = gemmi::as_refln_blocks(gemmi::read_cif_gz(input_path).blocks);
@@ -333,6 +335,7 @@ int GEMMI_MAIN(int argc, char **argv) {
   const char* input_block = p.options[InputBlock].arg;  // nullptr if option not given
   const char* output_block = p.options[OutputBlock].arg;
   bool to_anom = p.options[WriteAnom];
+  int nthreads = p.integer_or(Jobs, 1);
 
   if (p.options[Compare] && !two_files && gemmi::giends_with(input_path, "hkl")) {
     fprintf(stderr, "ERROR. Option --compare doesn't work with one XDS file.\n");
@@ -342,7 +345,8 @@ int GEMMI_MAIN(int argc, char **argv) {
   Intensities intensities;
   if (verbose)
     std::fprintf(stderr, "Reading %s ...\n", input_path.c_str());
-  read_intensities(intensities, DataType::UAM, input_path, input_block, verbose, batch_cell);
+  read_intensities(intensities, DataType::UAM, input_path, input_block, verbose, batch_cell,
+                   nthreads);
   if (intensities.type != DataType::Unmerged)
     std::fprintf(stderr, "NOTE: Got merged %s instead of unmerged data.\n",
                  intensities.type_str());
@@ -394,9 +398,9 @@ int GEMMI_MAIN(int argc, char **argv) {
     }
     try {
       if (to_anom)
-        intensities.prepare_for_merging(DataType::Anomalous);
+        intensities.prepare_for_merging(DataType::Anomalous, nthreads);
       else
-        intensities.sort();
+        intensities.sort(nthreads);
       gemmi::Binner binner;
       const gemmi::Binner* binner_ptr = nullptr;
       if (nbins > 1) {
@@ -411,7 +415,7 @@ int GEMMI_MAIN(int argc, char **argv) {
         binner.setup(nbins, binning_method, gemmi::IntensitiesDataProxy{intensities});
         binner_ptr = &binner;
       }
-      auto stats = intensities.calculate_merging_stats(binner_ptr, use_weights);
+      auto stats = intensities.calculate_merging_stats(binner_ptr, use_weights, nthreads);
       print_merging_statistics(stats, binner_ptr);
     } catch (std::exception& e) {
       std::fprintf(stderr, "ERROR: %s\n", e.what());
@@ -424,18 +428,18 @@ int GEMMI_MAIN(int argc, char **argv) {
       std::fprintf(stderr, "Reading merged reflections from %s ...\n", output_path);
     auto type_we_want = to_anom ? DataType::Anomalous : DataType::MergedMA;
     Intensities ref;  // for --compare
-    read_intensities(ref, type_we_want, output_path, output_block, verbose, false);
+    read_intensities(ref, type_we_want, output_path, output_block, verbose, false, nthreads);
     if (!to_anom && ref.type == DataType::Anomalous)
       std::fprintf(stderr, "Using I(+)/I(-) because <I> is absent.\n");
     if (intensities.type != ref.type)
-      intensities.merge_in_place(ref.type);
+      intensities.merge_in_place(ref.type, nthreads);
     printf("Comparing %s ...%s\n", intensities.type_str(),
            verbose ? "" : "   (use -v for more details)");
     compare_intensities(intensities, ref, p.options[PrintAll]);
   }
 
   if (two_files) {
-    intensities.merge_in_place(to_anom ? DataType::Anomalous : DataType::Mean);
+    intensities.merge_in_place(to_anom ? DataType::Anomalous : DataType::Mean, nthreads);
     if (verbose)
       std::fprintf(stderr, "Writing %zu reflections to %s ...\n",
                    intensities.data.size(), output_path);
@@ -6,7 +6,7 @@
 #include <cstdlib>            // for strtod
 #include <iostream>           // for cout
 #include <gemmi/mtz2cif.hpp>
-#include <gemmi/gz.hpp>       // for MaybeGzipped
+#include <gemmi/gz.hpp>       // for MaybeGzipped, MaybeGzippedOfstream
 #include <gemmi/fstream.hpp>  // for Ofstream
 #include <gemmi/util.hpp>     // for giends_with
 #include <gemmi/intensit.hpp> // for Intensities
@@ -21,7 +21,7 @@ namespace {
 enum OptionIndex {
   Spec=4, PrintSpec, BlockName, EntryId, SkipEmpty, SkipNegativeSigI,
   NoComments, NoHistory, NoStaranisoTensor, RunFrom, Wavelength, Validate,
-  LessAnomalous, Separate, Deposition, NoIntensityCheck, Nfree, Trim
+  LessAnomalous, Separate, Deposition, NoIntensityCheck, Nfree, Trim, Jobs
 };
 
 const option::Descriptor Usage[] = {
@@ -67,6 +67,8 @@ const option::Descriptor Usage[] = {
     "  --depo  \tPrepare merged+unmerged mmCIF file for deposition." },
   { Nfree, 0, "", "nfree", Arg::Int,
     "  --nfree=N  \tFlag value used for the free set (default: auto)" },
+  { Jobs, 0, "j", "jobs", Arg::Int,
+    "  -j, --jobs=N  \tUse N threads (default: 1, 0 = all CPUs)." },
   { Trim, 0, "", "trim", Arg::Int,
     "  --trim=N  \t(for testing) output only reflections -N <= h,k,l <=N." },
   { NoIntensityCheck, 0, "", "no-intensity-check", Arg::None, 0 },
@@ -78,6 +80,7 @@ const option::Descriptor Usage[] = {
     "\nXDS_ASCII.HKL file can be used instead of unmerged MTZ file (also when"
     "\nconverting a single file), but then the spec file is ignored."
     "\nIf CIF_FILE is -, the output is printed to stdout."
+    "\nIf CIF_FILE ends with .gz, the output is gzipped."
     "\nIf spec is -, it is read from stdin."
     "\n"
     "\nLines in the spec file have format:"
@@ -100,7 +103,7 @@ const option::Descriptor Usage[] = {
     "\nTAG does not include category name, it is only the part after _refln."
     "\nFORMAT (optional) is printf-like floating-point format:"
     "\n - one of e, f, g with optional flag, width and precision"
-    "\n - flag is one of + - # _; '_' stands for ' ', for example '_.4f'"
+    "\n - flag is one of + - # _ 0; '_' stands for ' ', for example '_.4f'"
     "\n - since all numbers in MTZ are stored as float, the integer columns use"
     "\n   the same format as float. The format of _refln.status is ignored."
     "\n$SPECIAL is $counter, $dataset, $image, $. or $?, as appropriate for"
@@ -251,6 +254,7 @@ int GEMMI_MAIN(int argc, char **argv) {
     mtz_to_cif.entry_id = p.options[EntryId].arg;
   if (p.options[Wavelength])
     mtz_to_cif.wavelength = std::strtod(p.options[Wavelength].arg, nullptr);
+  mtz_to_cif.nthreads = p.integer_or(Jobs, 1);
 
   gemmi::CharArray cif_buf;
   if (cif_input) {
@@ -325,7 +329,8 @@ int GEMMI_MAIN(int argc, char **argv) {
   if (verbose)
     std::fprintf(stderr, "Opening output file %s ...\n", cif_output);
   try {
-    gemmi::Ofstream os(cif_output, &std::cout);
+    gemmi::MaybeGzippedOfstream output(cif_output, &std::cout);
+    std::ostream& os = output.ref();
     for (int i = 0; i < 2; ++i)
       if (mtz[i] && !mtz[i]->is_merged())
         mtz[i]->switch_to_original_hkl();
@@ -333,30 +338,31 @@ int GEMMI_MAIN(int argc, char **argv) {
     if (mtz[0] && mtz[1] && !separate_blocks) {
       if (verbose)
         std::fprintf(stderr, "Writing merged and unmerged MTZ data as mmCIF block...\n");
-      mtz_to_cif.write_cif(*mtz[0], mtz[1].get(), staraniso_b, os.ref());
+      mtz_to_cif.write_cif(*mtz[0], mtz[1].get(), staraniso_b, os);
     } else {
       if (cif_input) {
         if (verbose)
           std::fprintf(stderr, "Copying input mmCIF file to output...\n");
-        os.ref().write(cif_buf.data(), cif_buf.size());
+        os.write(cif_buf.data(), cif_buf.size());
       } else if (mtz[0]) {
         if (verbose)
           std::fprintf(stderr, "Writing merged MTZ data as mmCIF block...\n");
-        mtz_to_cif.write_cif(*mtz[0], nullptr, staraniso_b, os.ref());
+        mtz_to_cif.write_cif(*mtz[0], nullptr, staraniso_b, os);
       }
       if ((cif_input || mtz[0]) && (mtz[1] || xds_ascii))
-        os.ref() << "\n\n";
+        os << "\n\n";
       mtz_to_cif.block_name = "unmerged";
       if (mtz[1]) {
         if (verbose)
           std::fprintf(stderr, "Writing unmerged MTZ data as mmCIF block...\n");
-        mtz_to_cif.write_cif(*mtz[1], nullptr, nullptr, os.ref());
+        mtz_to_cif.write_cif(*mtz[1], nullptr, nullptr, os);
       } else if (xds_ascii) {
         if (verbose)
           std::fprintf(stderr, "Writing unmerged XDS data as mmCIF block...\n");
-        mtz_to_cif.write_cif_from_xds(*xds_ascii, os.ref());
+        mtz_to_cif.write_cif_from_xds(*xds_ascii, os);
       }
     }
+    output.close();
   } catch (std::runtime_error& e) {
     std::fprintf(stderr, "ERROR writing %s: %s\n", cif_output, e.what());
     return 3;
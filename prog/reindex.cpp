@@ -14,7 +14,7 @@ using std::fprintf;
 
 namespace {
 
-enum OptionIndex { Hkl=4, NoHistory, NoSort, Asu };
+enum OptionIndex { Hkl=4, NoHistory, NoSort, Asu, Jobs };
 
 const option::Descriptor Usage[] = {
   { NoOp, 0, "", "", Arg::None,
@@ -31,6 +31,8 @@ const option::Descriptor Usage[] = {
     "  --no-sort  \tDo not reorder reflections." },
   { Asu, 0, "", "asu", Arg::AsuChoice,
     "  --asu=ccp4|tnt  \tWrite merged data in CCP4 (default) or TNT ASU." },
+  { Jobs, 0, "j", "jobs", Arg::Int,
+    "  -j, --jobs=N  \tUse N threads (default: 1, 0 = all CPUs)." },
   { NoOp, 0, "", "", Arg::None,
     "\nInput file can be gzipped." },
   { 0, 0, 0, 0, 0, 0 }
@@ -45,6 +47,7 @@ int GEMMI_MAIN(int argc, char **argv) {
   bool verbose = p.options[Verbose];
   const char* input_path = p.nonOption(0);
   const char* output_path = p.nonOption(1);
+  int nthreads = p.integer_or(Jobs, 1);
   if (!p.options[Hkl] && !p.options[Asu]) {
     fprintf(stderr, "Specify transform with option --hkl\n");
     return 1;
@@ -65,17 +68,17 @@ int GEMMI_MAIN(int argc, char **argv) {
     mtz.read_input(gemmi::MaybeGzipped(input_path), true);
 
     if (p.options[Hkl])
-      mtz.reindex(op);
+      mtz.reindex(op, nthreads);
 
     if (mtz.is_merged()) {
       bool tnt_asu = false;
       if (p.options[Asu] && p.options[Asu].arg[0] == 't')
         tnt_asu = true;
-      mtz.ensure_asu(tnt_asu);
+      mtz.ensure_asu(tnt_asu, nthreads);
     }
 
     if (!p.options[NoSort])
-      mtz.sort();
+      mtz.sort(3, nthreads);
     if (!p.options[NoHistory])
       mtz.history.emplace(mtz.history.begin(), from_line);
     if (verbose)
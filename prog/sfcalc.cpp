@@ -35,7 +35,7 @@ enum OptionIndex {
   Test, WriteMap, ToMtz, Compare, FLabel, PhiLabel, Anomalous,
   CifFp, Wavelength, Unknown, NoAniso, Margin, ScaleTo, SigmaCutoff,
   MaskSpacing, RadiiSet, Rprobe, Rshrink, MaskFile, Ksolv, Bsolv, Kov, Baniso,
-  FCanomLabel, PHICanomLabel
+  FCanomLabel, PHICanomLabel, Jobs
 };
 
 struct SfCalcArg: public Arg {
@@ -101,6 +101,9 @@ const option::Descriptor Usage[] = {
     "  --noaniso  \tIgnore anisotropic ADPs." },
   { Margin, 0, "", "margin", Arg::Float,
     "  --margin=NUM  \tFor non-crystal use bounding box w/ margin (default: 10)." },
+  { Jobs, 0, "j", "jobs", Arg::Int,
+    "  -j, --jobs=N  \tUse N threads for solvent masking and scaling"
+    " (default: 1, 0 = all CPUs)." },
 
   { NoOp, 0, "", "", Arg::None,
     "\nOptions for density and FFT calculations (with --dmin):" },
@@ -274,7 +277,8 @@ void process_with_fft(const gemmi::Structure& st,
                       const gemmi::AsuData<gemmi::ValueSigma<Real>>& scale_to,
                       const char* map_file,
                       bool calc_anomalous = false,
-                      double wavelength = 0) {
+                      double wavelength = 0,
+                      int nthreads = 1) {
   // prepare electron density map
   if (verbose) {
     fprintf(stderr, "Preparing electron density on a grid...\n");
@@ -335,7 +339,7 @@ void process_with_fft(const gemmi::Structure& st,
       //fprintf(stderr, "initial k_ov=%g\n", scaling.k_overall);
     }
     //scaling.fit_b_star_approximately();
-    scaling.fit_parameters();
+    scaling.fit_parameters(nthreads);
     if (scaling.use_solvent)
       fprintf(stderr, "Bulk solvent parameters: k_sol=%g B_sol=%g\n",
               scaling.k_sol, scaling.b_sol);
@@ -772,6 +776,8 @@ void process_with_table(bool use_st, gemmi::Structure& st, const gemmi::SmallStr
         masker.rshrink = std::atof(p.options[Rshrink].arg);
       if (p.options[MaskSpacing])
         masker.requested_spacing = std::atof(p.options[MaskSpacing].arg);
+      int nthreads = p.integer_or(Jobs, 1);
+      masker.nthreads = nthreads;
 
       gemmi::Scaling<Real> scaling(cell, st.find_spacegroup());
       if (p.options[Ksolv] || p.options[Bsolv] || scale_to.size() != 0) {
@@ -829,7 +835,8 @@ void process_with_table(bool use_st, gemmi::Structure& st, const gemmi::SmallStr
         gemmi::fail("Wavelength must be specified (>0) for anomalous calculations with --to-mtz");
       }
       process_with_fft(st, dencalc, mott_bethe, mask_data_ptr, scaling,
-                       p.options[Verbose], file, scale_to, map_file, calc_anom, wavelength);
+                       p.options[Verbose], file, scale_to, map_file, calc_anom, wavelength,
+                       nthreads);
     } else {
       if (p.options[Rate] || p.options[RCut] || p.options[Blur] ||
           p.options[Test])
@@ -59,10 +59,10 @@ void add_ccp4(nb::module_& m) {
   add_ccp4_common<float>(m, "Ccp4Map");
   add_ccp4_common<int8_t>(m, "Ccp4Mask");
   m.def("read_ccp4_map", &read_ccp4_map,
-        nb::arg("path"), nb::arg("setup")=false, nb::rv_policy::move,
+        nb::arg("path"), nb::arg("setup")=false, nb::rv_policy::move, release_gil(),
         "Reads a CCP4 file, mode 2 (floating-point data).");
   m.def("read_ccp4_mask", &read_ccp4_mask,
-        nb::arg("path"), nb::arg("setup")=false, nb::rv_policy::move,
+        nb::arg("path"), nb::arg("setup")=false, nb::rv_policy::move, release_gil(),
         "Reads a CCP4 file, mode 0 (int8_t data, usually 0/1 masks).");
   m.def("read_ccp4_header", &read_ccp4_header,
         nb::arg("path"), nb::rv_policy::move);
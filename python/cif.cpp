@@ -167,7 +167,7 @@ void add_cif(nb::module_& cif) {
         write_cif_to_stream(os, d, opt);
         return os.str();
     }, nb::arg("options")=WriteOptions(), "Returns a string in CIF format.")
-    .def("as_json", [](const Document& d, bool mmjson, bool lowercase_names) {
+    .def("as_json", [](const Document& d, bool mmjson, bool lowercase_names, int nthreads) {
         std::ostringstream os;
         JsonWriteOptions options;
         if (mmjson) {
@@ -176,9 +176,9 @@ void add_cif(nb::module_& cif) {
           // in C++17 std::optional<bool> would be used
           options.lowercase_names = lowercase_names;
         }
-        write_json_to_stream(os, d, options);
+        write_json_to_stream(os, d, options, nthreads);
         return os.str();
-    }, nb::arg("mmjson")=false, nb::arg("lowercase_names")=true,
+    }, nb::arg("mmjson")=false, nb::arg("lowercase_names")=true, nb::arg("nthreads")=1,
     "Returns JSON representation in a string.")
     .def("__getstate__", &getstate<Document>)
     .def("__setstate__", &setstate<Document>)
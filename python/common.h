@@ -8,6 +8,7 @@
   #pragma GCC diagnostic ignored "-Wpedantic"
 #endif
 
+#include <memory>               // for shared_ptr
 #include <nanobind/nanobind.h>  // IWYU pragma: export
 #include <gemmi/logger.hpp>     // for Logger
 
@@ -23,6 +24,9 @@
 
 namespace nb = nanobind;
 constexpr auto rv_ri = nb::rv_policy::reference_internal;
+// For functions that do heavy work on C++ objects and don't touch Python
+// objects, so other Python threads can run in the meantime.
+using release_gil = nb::call_guard<nb::gil_scoped_release>;
 
 void add_elem(nb::module_& m); // elem.cpp
 void add_xds(nb::module_& m); // elem.cpp
@@ -114,6 +118,17 @@ inline nb::object handle_numpy_array_args(const nb::object& o, nb::handle dtype,
   return o.attr("astype")(dtype);
 }
 
+// Python object that can be copied, called and destroyed without holding
+// the GIL, so that it can be used in functions that release the GIL.
+struct GilSafeObject {
+  std::shared_ptr<nb::object> obj;
+  explicit GilSafeObject(nb::handle h)
+    : obj(new nb::object(nb::borrow(h)), [](nb::object* o) {
+        nb::gil_scoped_acquire gil;
+        delete o;
+      }) {}
+};
+
 namespace nanobind { namespace detail {
 template <> struct type_caster<gemmi::Logger> {
   NB_TYPE_CASTER(gemmi::Logger, const_name("object"))
@@ -128,12 +143,16 @@ template <> struct type_caster<gemmi::Logger> {
     if (src.is_none()) {
       // nothing
     } else if (nb::hasattr(src, "write") && nb::hasattr(src, "flush")) {
-      value.callback = {[obj=nb::borrow(src)](const std::string& s) {
-        obj.attr("write")(s + "\n");
-        obj.attr("flush")();
+      value.callback = {[h=GilSafeObject(src)](const std::string& s) {
+        nb::gil_scoped_acquire gil;
+        h.obj->attr("write")(s + "\n");
+        h.obj->attr("flush")();
       }};
     } else if (PyCallable_Check(src.ptr())) {
-      value.callback = {[obj=nb::borrow(src)](const std::string& s) { obj(s); }};
+      value.callback = {[h=GilSafeObject(src)](const std::string& s) {
+        nb::gil_scoped_acquire gil;
+        (*h.obj)(s);
+      }};
     } else {
       return false;
     }
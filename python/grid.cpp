@@ -128,7 +128,8 @@ nb::class_<Grid<T>, GridBase<T>> add_grid_common(nb::module_& m, const std::stri
     .def("masked_asu", &masked_asu<T>, nb::keep_alive<0, 1>())
     .def("mask_points_in_constant_radius", &mask_points_in_constant_radius<T>,
          nb::arg("model"), nb::arg("radius"), nb::arg("value"),
-         nb::arg("ignore_hydrogen")=false, nb::arg("ignore_zero_occupancy_atoms")=false)
+         nb::arg("ignore_hydrogen")=false, nb::arg("ignore_zero_occupancy_atoms")=false,
+         nb::arg("nthreads")=1)
     .def("get_subarray",
          [](const Gr& self, std::array<int,3> start, std::array<int,3> shape) {
         auto arr = make_numpy_array<T>(
@@ -325,10 +326,11 @@ void add_grid(nb::module_& m) {
     .def_rw("ignore_hydrogen", &SolventMasker::ignore_hydrogen)
     .def_rw("ignore_zero_occupancy_atoms", &SolventMasker::ignore_zero_occupancy_atoms)
     .def_rw("use_atom_occupancy", &SolventMasker::use_atom_occupancy)
+    .def_rw("nthreads", &SolventMasker::nthreads)
     .def("set_radii", &SolventMasker::set_radii,
          nb::arg("choice"), nb::arg("constant_r")=0.)
-    .def("put_mask_on_int8_grid", &SolventMasker::put_mask_on_grid<int8_t>)
-    .def("put_mask_on_float_grid", &SolventMasker::put_mask_on_grid<float>)
+    .def("put_mask_on_int8_grid", &SolventMasker::put_mask_on_grid<int8_t>, release_gil())
+    .def("put_mask_on_float_grid", &SolventMasker::put_mask_on_grid<float>, release_gil())
     .def("set_to_zero", &SolventMasker::set_to_zero)
     ;
   m.def("interpolate_grid", &interpolate_grid<float>,
@@ -9,6 +9,7 @@
 #include <nanobind/ndarray.h>
 
 #include "gemmi/unitcell.hpp"
+#include "gemmi/asudata.hpp"  // for HklIndex
 #include "gemmi/refln.hpp"
 #include "gemmi/fourier.hpp"  // for get_size_for_hkl, get_f_phi_on_grid, ...
 #include "gemmi/fprime.hpp"   // for cromer_liberman
@@ -18,6 +19,7 @@
 #include "gemmi/intensit.hpp" // for Intensities
 #include "gemmi/binner.hpp"   // for Binner
 #include "gemmi/ecalc.hpp"    // for calculate_amplitude_normalizers
+#include "gemmi/reflgeom.hpp"  // for ReflectionGeometry
 
 using namespace gemmi;
 
@@ -47,14 +49,9 @@ struct HklMatch {
           ++b;
       }
     } else {
-      std::unordered_map<Miller, int, MillerHash> hkl_index;
-      for (int i = 0; i != (int)hkl_size; ++i)
-        hkl_index.emplace(hkl[i], i);
-      for (size_t i = 0; i != ref_size; ++i) {
-        auto it = hkl_index.find(ref[i]);
-        if (it != hkl_index.end())
-          pos[i] = it->second;
-      }
+      HklIndex hkl_index(hkl, hkl_size);
+      for (size_t i = 0; i != ref_size; ++i)
+        pos[i] = hkl_index.find(ref[i]);
     }
   }
 
@@ -148,7 +145,7 @@ void add_hkl(nb::module_& m) {
        nb::arg("min_size")=std::array<int,3>{{0,0,0}},
        nb::arg("exact_size")=std::array<int,3>{{0,0,0}},
        nb::arg("sample_rate")=0.,
-       nb::arg("order")=AxisOrder::XYZ)
+       nb::arg("order")=AxisOrder::XYZ, release_gil())
     .def("get_float", &make_asu_data<float, ReflnBlock>,
          nb::arg("col"), nb::arg("as_is")=false)
     .def("get_int", &make_asu_data<int, ReflnBlock>,
@@ -216,6 +213,7 @@ void add_hkl(nb::module_& m) {
     .def_rw("skip_negative_sigi", &MtzToCif::skip_negative_sigi)
     .def_rw("wavelength", &MtzToCif::wavelength)
     .def_rw("free_flag_value", &MtzToCif::free_flag_value)
+    .def_rw("nthreads", &MtzToCif::nthreads)
     .def("write_cif_to_string", [](MtzToCif& self, const Mtz& mtz, const Mtz* mtz2) {
         std::ostringstream out;
         self.write_cif(mtz, mtz2, nullptr, out);
@@ -263,16 +261,20 @@ void add_hkl(nb::module_& m) {
     .def_rw("type", &Intensities::type)
     .def("resolution_range", &Intensities::resolution_range)
     .def("remove_systematic_absences", &Intensities::remove_systematic_absences)
-    .def("sort", &Intensities::sort)
-    .def("merge_in_place", &Intensities::merge_in_place, nb::arg("new_type"))
-    .def("merged", &Intensities::merged, nb::arg("new_type"))
+    .def("sort", &Intensities::sort, nb::arg("nthreads")=1)
+    .def("merge_in_place", &Intensities::merge_in_place,
+         nb::arg("new_type"), nb::arg("nthreads")=1)
+    .def("merged", &Intensities::merged, nb::arg("new_type"), nb::arg("nthreads")=1)
     .def("calculate_merging_stats", &Intensities::calculate_merging_stats,
-         nb::arg("binner").none(), nb::arg("use_weights")='Y')
-    .def("prepare_for_merging", &Intensities::prepare_for_merging)
+         nb::arg("binner").none(), nb::arg("use_weights")='Y', nb::arg("nthreads")=1)
+    .def("prepare_for_merging", &Intensities::prepare_for_merging,
+         nb::arg("new_type"), nb::arg("nthreads")=1)
     .def("calculate_correlation", &Intensities::calculate_correlation)
     .def("import_mtz", &Intensities::import_mtz,
          nb::arg(), nb::arg("type")=DataType::Unknown)
     .def("import_xds", &Intensities::import_xds)
+    .def("import_xds_file", &Intensities::import_xds_file,
+         nb::arg("path"), nb::arg("nthreads")=1)
     .def("import_refln_block", &Intensities::import_refln_block,
          nb::arg(), nb::arg("type")=DataType::Unknown)
     .def("prepare_merged_mtz", &Intensities::prepare_merged_mtz,
@@ -322,6 +324,50 @@ void add_hkl(nb::module_& m) {
        nb::arg("miller_array"), nb::arg("value_array"), nb::arg("sigma_array"))
     ;
 
+  nb::class_<CompactIntensities>(m, "CompactIntensities")
+    .def(nb::init<>())
+    .def("__len__", &CompactIntensities::size)
+    .def_rw("spacegroup", &CompactIntensities::spacegroup)
+    .def_rw("unit_cell", &CompactIntensities::unit_cell)
+    .def_rw("type", &CompactIntensities::type)
+    .def("copy_from", &CompactIntensities::copy_from)
+    .def("to_intensities", &CompactIntensities::to_intensities)
+    .def("resolution_range", &CompactIntensities::resolution_range)
+    .def("sort", &CompactIntensities::sort, nb::arg("nthreads")=1)
+    .def("merge_in_place", &CompactIntensities::merge_in_place,
+         nb::arg("new_type"), nb::arg("nthreads")=1)
+    .def("calculate_merging_stats", &CompactIntensities::calculate_merging_stats,
+         nb::arg("binner").none(), nb::arg("use_weights")='Y', nb::arg("nthreads")=1)
+    .def("prepare_for_merging", &CompactIntensities::prepare_for_merging,
+         nb::arg("new_type"), nb::arg("nthreads")=1)
+    .def("calculate_correlation", &CompactIntensities::calculate_correlation)
+    .def("import_mtz", &CompactIntensities::import_mtz,
+         nb::arg(), nb::arg("type")=DataType::Unknown)
+    .def("import_xds", &CompactIntensities::import_xds)
+    .def("import_xds_file", &CompactIntensities::import_xds_file,
+         nb::arg("path"), nb::arg("nthreads")=1)
+    .def("import_refln_block", &CompactIntensities::import_refln_block,
+         nb::arg(), nb::arg("type")=DataType::Unknown)
+    .def_prop_ro("miller_array", [](const CompactIntensities& self) {
+      std::vector<Miller> hkl(self.size());
+      for (size_t i = 0; i != hkl.size(); ++i)
+        hkl[i] = self.get_hkl(i);
+      return py_array2d_from_vector(std::move(hkl));
+    })
+    .def_prop_ro("value_array", [](CompactIntensities& self) {
+      return nb::ndarray<nb::numpy, float, nb::shape<-1>>(
+          self.value.data(), {self.size()}, nb::handle());
+    }, nb::rv_policy::reference_internal)
+    .def_prop_ro("sigma_array", [](CompactIntensities& self) {
+      return nb::ndarray<nb::numpy, float, nb::shape<-1>>(
+          self.sigma.data(), {self.size()}, nb::handle());
+    }, nb::rv_policy::reference_internal)
+    .def_prop_ro("nobs_array", [](CompactIntensities& self) {
+      return nb::ndarray<nb::numpy, short, nb::shape<-1>>(
+          self.nobs.data(), {self.size()}, nb::handle());
+    }, nb::rv_policy::reference_internal)
+    ;
+
   nb::class_<Binner> binner(m, "Binner");
   nb::enum_<Binner::Method>(binner, "Method")
       .value("EqualCount", Binner::Method::EqualCount)
@@ -343,6 +389,10 @@ void add_hkl(nb::module_& m) {
                      const Intensities& intensities) {
         self.setup(nbins, method, gemmi::IntensitiesDataProxy{intensities});
     }, nb::arg("nbins"), nb::arg("method"), nb::arg("intensities"))
+    .def("setup", [](Binner& self, int nbins, Binner::Method method,
+                     const CompactIntensities& intensities) {
+        self.setup(nbins, method, gemmi::CompactIntensitiesDataProxy{intensities});
+    }, nb::arg("nbins"), nb::arg("method"), nb::arg("intensities"))
     .def("setup", [](Binner& self, int nbins, Binner::Method method,
                      const cpu_miller_array& hkl, const UnitCell* cell) {
         auto h = hkl.view();
@@ -359,13 +409,13 @@ void add_hkl(nb::module_& m) {
         self.setup_from_1_d2(nbins, method, std::vector<double>(ptr, ptr+len), cell);
     }, nb::arg("nbins"), nb::arg("method"), nb::arg("inv_d2"), nb::arg("cell"))
     .def("get_bin", &Binner::get_bin)
-    .def("get_bins", [](Binner& self, const Mtz& mtz) {
-        return numpy_array_from_vector(self.get_bins(MtzDataProxy{mtz}));
-    })
-    .def("get_bins", [](Binner& self, const ReflnBlock& r) {
-        return numpy_array_from_vector(self.get_bins(ReflnDataProxy(r)));
-    })
-    .def("get_bins", [](Binner& self, const cpu_miller_array& hkl) {
+    .def("get_bins", [](Binner& self, const Mtz& mtz, int nthreads) {
+        return numpy_array_from_vector(self.get_bins(MtzDataProxy{mtz}, nthreads));
+    }, nb::arg("mtz"), nb::arg("nthreads")=1)
+    .def("get_bins", [](Binner& self, const ReflnBlock& r, int nthreads) {
+        return numpy_array_from_vector(self.get_bins(ReflnDataProxy(r), nthreads));
+    }, nb::arg("refln"), nb::arg("nthreads")=1)
+    .def("get_bins", [](Binner& self, const cpu_miller_array& hkl, int nthreads) {
         if (hkl.stride(1) != 1 || hkl.stride(0) < 3)
           throw std::domain_error("hkl array must be contiguous");
         struct {  // cf. MtzDataProxy
@@ -378,11 +428,13 @@ void add_hkl(nb::module_& m) {
             return {data_[offset], data_[offset+1], data_[offset+2]};
           }
         } proxy{hkl.size(), (size_t) hkl.stride(0), hkl.data()};
-        return numpy_array_from_vector(self.get_bins(proxy));
-    })
-    .def("get_bins_from_1_d2", [](Binner& self, const cpu_c_array<double>& inv_d2) {
-        return numpy_array_from_vector(self.get_bins_from_1_d2(inv_d2.data(), inv_d2.shape(0)));
-    })
+        return numpy_array_from_vector(self.get_bins(proxy, nthreads));
+    }, nb::arg("hkl"), nb::arg("nthreads")=1)
+    .def("get_bins_from_1_d2", [](Binner& self, const cpu_c_array<double>& inv_d2,
+                                  int nthreads) {
+        return numpy_array_from_vector(self.get_bins_from_1_d2(inv_d2.data(), inv_d2.shape(0),
+                                                               nthreads));
+    }, nb::arg("inv_d2"), nb::arg("nthreads")=1)
     .def("dmin_of_bin", &Binner::dmin_of_bin)
     .def("dmax_of_bin", &Binner::dmax_of_bin)
     .def_prop_ro("size", &Binner::size)
@@ -400,6 +452,54 @@ void add_hkl(nb::module_& m) {
       return numpy_array_from_vector(
           calculate_amplitude_normalizers(MtzDataProxy{mtz}, f.idx, binner));
   });
+  m.def("calculate_amplitude_normalizers",
+        [](const Mtz& mtz, const std::string& f_col, const Binner& binner,
+           const ReflectionGeometry& geom) {
+      const Mtz::Column& f = mtz.get_column_with_label(f_col);
+      return numpy_array_from_vector(
+          calculate_amplitude_normalizers(MtzDataProxy{mtz}, f.idx, binner, geom));
+  }, nb::arg("mtz"), nb::arg("f_col"), nb::arg("binner"), nb::arg("geom"));
+
+  nb::class_<ReflectionGeometry>(m, "ReflectionGeometry")
+    .def("__init__", [](ReflectionGeometry* p, const UnitCell& cell, const SpaceGroup* sg,
+                        const cpu_miller_array& hkl, int nthreads) {
+        auto h = hkl.view();
+        std::vector<Miller> hkls(h.shape(0));
+        for (size_t i = 0; i < hkls.size(); ++i)
+          hkls[i] = {h(i, 0), h(i, 1), h(i, 2)};
+        new(p) ReflectionGeometry(cell, sg, hkls, nthreads);
+    }, nb::arg("cell"), nb::arg("sg").none(), nb::arg("hkl"), nb::arg("nthreads")=1)
+    .def("__init__", [](ReflectionGeometry* p, const Mtz& mtz, int nthreads) {
+        new(p) ReflectionGeometry(MtzDataProxy{mtz}, nthreads);
+    }, nb::arg("mtz"), nb::arg("nthreads")=1)
+    .def("__len__", &ReflectionGeometry::size)
+    .def_ro("cell", &ReflectionGeometry::cell)
+    .def_ro("spacegroup", &ReflectionGeometry::spacegroup)
+    .def("setup_binner", &ReflectionGeometry::setup_binner,
+         nb::arg("binner"), nb::arg("nbins"), nb::arg("method"))
+    .def("assign_bins", &ReflectionGeometry::assign_bins,
+         nb::arg("binner"), nb::arg("nthreads")=1)
+    .def_prop_ro("inv_d2_array", [](ReflectionGeometry& self) {
+      return nb::ndarray<nb::numpy, double, nb::shape<-1>>(
+          self.inv_d2.data(), {self.inv_d2.size()}, nb::handle());
+    }, nb::rv_policy::reference_internal)
+    .def_prop_ro("bin_array", [](ReflectionGeometry& self) {
+      return nb::ndarray<nb::numpy, int, nb::shape<-1>>(
+          self.bin.data(), {self.bin.size()}, nb::handle());
+    }, nb::rv_policy::reference_internal)
+    .def_prop_ro("epsilon_array", [](ReflectionGeometry& self) {
+      return nb::ndarray<nb::numpy, int, nb::shape<-1>>(
+          self.epsilon.data(), {self.epsilon.size()}, nb::handle());
+    }, nb::rv_policy::reference_internal)
+    .def_prop_ro("centric_array", [](ReflectionGeometry& self) {
+      return nb::ndarray<nb::numpy, bool, nb::shape<-1>>(
+          (bool*) self.centric.data(), {self.centric.size()}, nb::handle());
+    }, nb::rv_policy::reference_internal)
+    .def_prop_ro("isym_array", [](ReflectionGeometry& self) {
+      return nb::ndarray<nb::numpy, int, nb::shape<-1>>(
+          self.isym.data(), {self.isym.size()}, nb::handle());
+    }, nb::rv_policy::reference_internal)
+    ;
 
   nb::class_<HklMatch>(m, "HklMatch")
     .def("__init__", [](HklMatch* p, const cpu_c_miller_array& hkl,
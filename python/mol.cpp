@@ -7,10 +7,12 @@
 #include "gemmi/assembly.hpp"   // for expand_ncs, HowToNameCopiedChain
 #include "gemmi/select.hpp"     // for Selection
 #include "gemmi/sprintf.hpp"    // for snprintf_z
+#include "gemmi/atomtable.hpp"  // for copy_atom_values, set_atom_values
 
 #include "common.h"
 #include "serial.h"  // for getstate, setstate
 #include "make_iterator.h"
+#include "array.h"
 #include <nanobind/stl/bind_map.h>
 #include <nanobind/stl/array.h>  // for calculate_phi_psi, find_best_plane, ...
 #include <nanobind/stl/map.h>
@@ -62,6 +64,23 @@ template<typename P, typename C> void set_child(P& parent, int index, C& child)
   children[normalize_index(index, children)] = child;
 }
 
+// Model.get_positions(), get_b_iso(), get_occ()
+template<typename T>
+auto get_atom_values(const Model& model, T Atom::*member) {
+  auto arr = make_numpy_array<T>({count_atom_sites(model)});
+  copy_atom_values(model, member, arr.data());
+  return arr;
+}
+
+// Model.set_positions(), set_b_iso(), set_occ()
+template<typename T>
+void set_atom_values_checked(Model& model, T Atom::*member, const T* data, size_t n) {
+  size_t expected = count_atom_sites(model);
+  if (n != expected)
+    fail("expected array of length ", std::to_string(expected), ", got ", std::to_string(n));
+  set_atom_values(model, member, data);
+}
+
 template<typename P> void remove_child(P& parent, int index) {
   auto& children = parent.children();
   children.erase(children.begin() + normalize_index(index, children));
@@ -222,10 +241,12 @@ void add_mol(nb::module_& m) {
     .def("rename_residues", &rename_residues)
     // assembly.hpp
     .def("shorten_chain_names", &shorten_chain_names)
-    .def("expand_ncs", &expand_ncs, nb::arg("how"), nb::arg("merge_dist")=0.2)
+    .def("expand_ncs", &expand_ncs, nb::arg("how"), nb::arg("merge_dist")=0.2,
+         nb::arg("nthreads")=1)
     .def("transform_to_assembly", &transform_to_assembly,
        nb::arg("assembly_name"), nb::arg("how"), nb::arg("logging")=nb::none(),
-       nb::arg("keep_spacegroup")=false, nb::arg("merge_dist")=0.2)
+       nb::arg("keep_spacegroup")=false, nb::arg("merge_dist")=0.2,
+       nb::arg("nthreads")=1)
     // calculate.hpp
     .def("calculate_box", &calculate_box, nb::arg("margin")=0.)
     .def("calculate_fractional_box", &calculate_fractional_box, nb::arg("margin")=0.)
@@ -303,6 +324,30 @@ void add_mol(nb::module_& m) {
     })
     .def("calculate_b_iso_range", &calculate_b_iso_range<Model>)
     .def("calculate_b_aniso_range", &calculate_b_aniso_range)
+    .def("get_positions", [](const Model& self) {
+        size_t n = count_atom_sites(self);
+        auto arr = make_numpy_array<double>({n, 3});
+        copy_atom_values(self, &Atom::pos, reinterpret_cast<Position*>(arr.data()));
+        return arr;
+    }, "Positions of all atoms as a new (N, 3) array")
+    .def("set_positions",
+         [](Model& self, const nb::ndarray<const double, nb::shape<-1,3>,
+                                           nb::device::cpu, nb::c_contig>& arr) {
+        set_atom_values_checked(self, &Atom::pos,
+                                reinterpret_cast<const Position*>(arr.data()), arr.shape(0));
+    }, nb::arg("array"))
+    .def("get_b_iso", [](const Model& self) {
+        return get_atom_values(self, &Atom::b_iso);
+    })
+    .def("set_b_iso", [](Model& self, const cpu_c_array<const float>& arr) {
+        set_atom_values_checked(self, &Atom::b_iso, arr.data(), arr.shape(0));
+    }, nb::arg("array"))
+    .def("get_occ", [](const Model& self) {
+        return get_atom_values(self, &Atom::occ);
+    })
+    .def("set_occ", [](Model& self, const cpu_c_array<const float>& arr) {
+        set_atom_values_checked(self, &Atom::occ, arr.data(), arr.shape(0));
+    }, nb::arg("array"))
     .def("transform_pos_and_adp", transform_pos_and_adp<Model>, nb::arg("tr"))
     .def("split_chains_by_segments", &split_chains_by_segments)
     .def("clone", [](const Model& self) { return new Model(self); })
@@ -592,8 +637,10 @@ void add_mol(nb::module_& m) {
   m.def("parse_triplet_as_ftransform", &parse_triplet_as_ftransform);
   m.def("calculate_u_from_tls", &calculate_u_from_tls);
   m.def("make_assembly", &make_assembly,
-        nb::arg("assembly"), nb::arg("model"), nb::arg("how"), nb::arg("logging")=nb::none());
-  m.def("expand_ncs_model", &expand_ncs_model);
+        nb::arg("assembly"), nb::arg("model"), nb::arg("how"), nb::arg("logging")=nb::none(),
+        nb::arg("nthreads")=1);
+  m.def("expand_ncs_model", &expand_ncs_model,
+        nb::arg("model"), nb::arg("ncs"), nb::arg("how"), nb::arg("nthreads")=1);
   m.def("merge_atoms_in_expanded_model", &merge_atoms_in_expanded_model,
         nb::arg("model"), nb::arg("cell"), nb::arg("max_dist")=0.2,
         nb::arg("compare_serial")=true);
@@ -206,7 +206,7 @@ void add_mtz(nb::module_& m) {
        nb::arg("min_size")=std::array<int,3>{{0,0,0}},
        nb::arg("exact_size")=std::array<int,3>{{0,0,0}},
        nb::arg("sample_rate")=0.,
-       nb::arg("order")=AxisOrder::XYZ)
+       nb::arg("order")=AxisOrder::XYZ, release_gil())
     .def("get_float", &make_asu_data<float, Mtz>,
          nb::arg("col"), nb::arg("as_is")=false)
     .def("get_int", &make_asu_data<int, Mtz>,
@@ -288,11 +288,11 @@ void add_mtz(nb::module_& m) {
         return ret;
     })
     .def("update_reso", &Mtz::update_reso)
-    .def("sort", &Mtz::sort, nb::arg("use_first")=3)
-    .def("ensure_asu", &Mtz::ensure_asu, nb::arg("tnt_asu")=false)
-    .def("switch_to_original_hkl", &Mtz::switch_to_original_hkl)
-    .def("switch_to_asu_hkl", &Mtz::switch_to_asu_hkl)
-    .def("write_to_file", &Mtz::write_to_file, nb::arg("path"))
+    .def("sort", &Mtz::sort, nb::arg("use_first")=3, nb::arg("nthreads")=1)
+    .def("ensure_asu", &Mtz::ensure_asu, nb::arg("tnt_asu")=false, nb::arg("nthreads")=1)
+    .def("switch_to_original_hkl", &Mtz::switch_to_original_hkl, nb::arg("nthreads")=1)
+    .def("switch_to_asu_hkl", &Mtz::switch_to_asu_hkl, nb::arg("nthreads")=1)
+    .def("write_to_file", &Mtz::write_to_file, nb::arg("path"), release_gil())
     .def("write_to_bytes", [](const Mtz& self) {
         size_t nbytes = self.size_to_write();
         nb::bytes obj(nullptr, nbytes);
@@ -300,7 +300,7 @@ void add_mtz(nb::module_& m) {
         self.write_to_buffer(data, nbytes);
         return obj;
     })
-    .def("reindex", &Mtz::reindex, nb::arg("op"))
+    .def("reindex", &Mtz::reindex, nb::arg("op"), nb::arg("nthreads")=1)
     .def("expand_to_p1", &Mtz::expand_to_p1)
     // handy for testing, but slow and can't handle duplicated column names
     .def("row_as_dict", [](const Mtz& self, const Miller& hkl) {
@@ -373,10 +373,26 @@ void add_mtz(nb::module_& m) {
     .def("clone", [](const Mtz::Batch& self) { return new Mtz::Batch(self); })
     ;
 
+  nb::class_<MtzStreamWriter>(m, "MtzStreamWriter")
+    .def(nb::init<const Mtz&, const std::string&>(), nb::arg("mtz"), nb::arg("path"),
+         nb::keep_alive<1, 2>())
+    .def("append_rows", [](MtzStreamWriter& self,
+                           const nb::ndarray<const float, nb::ndim<2>, nb::c_contig,
+                                             nb::device::cpu>& arr) {
+        if (arr.shape(1) != self.mtz().columns.size())
+          fail("MtzStreamWriter.append_rows(): expected " +
+               std::to_string(self.mtz().columns.size()) + " columns.");
+        self.append_rows(arr.data(), arr.shape(0));
+    }, nb::arg("array"))
+    .def("finish", &MtzStreamWriter::finish)
+    .def_prop_ro("nreflections", &MtzStreamWriter::nreflections)
+    ;
+
   m.def("read_mtz_file", [](const std::string& path, Logger&& logging, bool with_data) {
     std::unique_ptr<Mtz> mtz(new Mtz);
     mtz->logger = std::move(logging);
     mtz->read_file_gz(path, with_data);
     return mtz.release();
-  }, nb::arg("path"), nb::arg("logging")=nb::none(), nb::arg("with_data")=true);
+  }, nb::arg("path"), nb::arg("logging")=nb::none(), nb::arg("with_data")=true,
+     release_gil());
 }
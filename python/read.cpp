@@ -12,6 +12,7 @@
 #include "gemmi/read_cif.hpp"      // for read_cif_gz, read_mmjson_gz
 #include "gemmi/mmread_gz.hpp"     // for read_structure_gz
 #include "gemmi/mmread.hpp"        // for read_structure_from_memory
+#include "gemmi/mmindex.hpp"       // for ModelFileIndex, read_model
 #include "gemmi/json.hpp"          // for read_mmjson_insitu
 
 
@@ -19,19 +20,24 @@ using namespace gemmi;
 
 void add_cif_read(nb::module_& cif) {
   cif.def("read_file", &read_cif_gz, nb::arg("filename"), nb::arg("check_level")=1,
-          "Reads a CIF file copying data into Document.");
+          release_gil(), "Reads a CIF file copying data into Document.");
   cif.def("read", &read_cif_or_mmjson_gz,
-          nb::arg("filename"), "Reads normal or gzipped CIF file.");
+          nb::arg("filename"), release_gil(), "Reads normal or gzipped CIF file.");
   cif.def("read_string", [](const std::string& str, int check_level) {
             return read_cif_from_memory(str.c_str(), str.size(), "string", check_level);
-          }, nb::arg("string"), nb::arg("check_level")=1,
+          }, nb::arg("string"), nb::arg("check_level")=1, release_gil(),
           "Reads a string as a CIF file.");
+  // Accessing nb::bytes requires the GIL. Bytes are immutable and kept
+  // alive by the caller, so the buffer can be read after releasing it.
   cif.def("read_string", [](const nb::bytes& data, int check_level) {
-            return read_cif_from_memory(data.c_str(), data.size(), "data", check_level);
+            const char* ptr = data.c_str();
+            size_t size = data.size();
+            nb::gil_scoped_release release;
+            return read_cif_from_memory(ptr, size, "data", check_level);
           }, nb::arg("data"), nb::arg("check_level")=1,
           "Reads bytes as a CIF file.");
   cif.def("read_mmjson", &read_mmjson_gz,
-          nb::arg("filename"), "Reads normal or gzipped mmJSON file.");
+          nb::arg("filename"), release_gil(), "Reads normal or gzipped mmJSON file.");
   cif.def("read_mmjson_string", [](std::string data) {
       return cif::read_mmjson_insitu(data.data(), data.size());
   });
@@ -68,11 +74,14 @@ void add_read_structure(nb::module_& m) {
           return st;
         }, nb::arg("path"), nb::arg("merge_chain_parts")=true,
            nb::arg("format")=CoorFormat::Unknown,
-           nb::arg("save_doc")=nb::none(),
+           nb::arg("save_doc")=nb::none(), release_gil(),
         "Reads a coordinate file into Structure.");
-  m.def("read_structure_string", [](nb::bytes& s, bool merge,
+  m.def("read_structure_string", [](const nb::bytes& s, bool merge,
                                     CoorFormat format, cif::Document* save_doc) {
-          Structure* st = new Structure(read_structure_from_memory((char*)s.c_str(), s.size(), "string",
+          // mmJSON is parsed in place, so it can't be read from bytes directly
+          std::string str(s.c_str(), s.size());
+          nb::gil_scoped_release release;
+          Structure* st = new Structure(read_structure_from_memory(&str[0], str.size(), "string",
                                                                    format, save_doc));
           if (merge)
             st->merge_chain_parts();
@@ -89,7 +98,7 @@ void add_read_structure(nb::module_& m) {
           return st;
         }, nb::arg("path"), nb::arg("merge_chain_parts")=true,
            nb::arg("format")=CoorFormat::Unknown,
-           nb::arg("save_doc")=nb::none(),
+           nb::arg("save_doc")=nb::none(), release_gil(),
         "Reads a coordinate file into Structure.");
   m.def("make_structure_from_block", &make_structure_from_block,
         nb::arg("block"), "Takes mmCIF block and returns Structure.");
@@ -104,17 +113,57 @@ void add_read_structure(nb::module_& m) {
           PdbReadOptions options{max_line_length, check_non_ascii, ignore_ter, split_chain_on_ter, false};
           return new Structure(read_pdb_string(s, "string", options));
         }, nb::arg("s"), nb::arg("max_line_length")=0, nb::arg("check_non_ascii")=false,
-           nb::arg("ignore_ter")=false, nb::arg("split_chain_on_ter")=false, "Reads a string as PDB file.");
+           nb::arg("ignore_ter")=false, nb::arg("split_chain_on_ter")=false, release_gil(),
+        "Reads a string as PDB file.");
   m.def("read_pdb_string", [](const nb::bytes& s, int max_line_length,
                               bool check_non_ascii, bool ignore_ter, bool split_chain_on_ter) {
           PdbReadOptions options{max_line_length, check_non_ascii, ignore_ter, split_chain_on_ter, false};
-          return new Structure(read_pdb_from_memory(s.c_str(), s.size(), "string", options));
+          const char* ptr = s.c_str();
+          size_t size = s.size();
+          nb::gil_scoped_release release;
+          return new Structure(read_pdb_from_memory(ptr, size, "string", options));
         }, nb::arg("s"), nb::arg("max_line_length")=0, nb::arg("check_non_ascii")=false,
-           nb::arg("ignore_ter")=false, nb::arg("split_chain_on_ter")=false, "Reads a string as PDB file.");
+           nb::arg("ignore_ter")=false, nb::arg("split_chain_on_ter")=false,
+        "Reads a string as PDB file.");
   m.def("read_pdb", [](const std::string& path, int max_line_length,
                        bool check_non_ascii, bool ignore_ter, bool split_chain_on_ter) {
           PdbReadOptions options{max_line_length, check_non_ascii, ignore_ter, split_chain_on_ter, false};
           return new Structure(read_pdb_gz(path, options));
         }, nb::arg("filename"), nb::arg("max_line_length")=0, nb::arg("check_non_ascii")=false,
-           nb::arg("ignore_ter")=false, nb::arg("split_chain_on_ter")=false);
+           nb::arg("ignore_ter")=false, nb::arg("split_chain_on_ter")=false, release_gil());
+
+  nb::class_<ModelFileIndex> model_file_index(m, "ModelFileIndex");
+  nb::class_<ModelFileIndex::Range>(model_file_index, "Range")
+    .def_ro("begin", &ModelFileIndex::Range::begin)
+    .def_ro("end", &ModelFileIndex::Range::end)
+    .def("__repr__", [](const ModelFileIndex::Range& self) {
+        return cat("<gemmi.ModelFileIndex.Range ", self.begin, '-', self.end, '>');
+    });
+  nb::class_<ModelFileIndex::Entry>(model_file_index, "Entry")
+    .def_ro("num", &ModelFileIndex::Entry::num)
+    .def_ro("range", &ModelFileIndex::Entry::range);
+  model_file_index
+    .def_ro("format", &ModelFileIndex::format)
+    .def_ro("file_size", &ModelFileIndex::file_size)
+    .def_ro("head", &ModelFileIndex::head)
+    .def_ro("tail", &ModelFileIndex::tail)
+    .def_ro("models", &ModelFileIndex::models)
+    .def("__repr__", [](const ModelFileIndex& self) {
+        return cat("<gemmi.ModelFileIndex with ", self.models.size(), " models>");
+    });
+  m.def("make_model_file_index",
+        (ModelFileIndex(*)(const std::string&)) &make_model_file_index,
+        nb::arg("path"), release_gil());
+  m.def("write_model_file_index", &write_model_file_index,
+        nb::arg("index"), nb::arg("path"));
+  m.def("read_model_file_index", &read_model_file_index, nb::arg("path"));
+  m.def("read_model", [](const std::string& path, const ModelFileIndex& index,
+                         int model_num, bool merge) {
+          Structure* st = new Structure(read_model(path, index, model_num));
+          if (merge)
+            st->merge_chain_parts();
+          return st;
+        }, nb::arg("path"), nb::arg("index"), nb::arg("model_num"),
+           nb::arg("merge_chain_parts")=true, release_gil(),
+        "Reads one model from a file indexed with make_model_file_index().");
 }
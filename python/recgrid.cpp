@@ -37,7 +37,7 @@ template<> void add_to_asu_data(nb::class_<AsuData<std::complex<float>>>& cl) {
          nb::arg("min_size")=std::array<int,3>{{0,0,0}},
          nb::arg("sample_rate")=0.,
          nb::arg("exact_size")=std::array<int,3>{{0,0,0}},
-         nb::arg("order")=AxisOrder::XYZ);
+         nb::arg("order")=AxisOrder::XYZ, release_gil());
   cl.def("calculate_correlation", [](const AsuData& self, const AsuData& other) {
       return calculate_hkl_complex_correlation(self.v, other.v);
   });
@@ -45,8 +45,12 @@ void add_search(nb::module_& m) {
     .def(nb::init<SmallStructure&, double>(),
          nb::arg("small_structure"), nb::arg("max_radius"),
          nb::keep_alive<1, 2>())
-    .def("populate", &NeighborSearch::populate, nb::arg("include_h")=true,
+    .def("populate", (NeighborSearch& (NeighborSearch::*)(bool)) &NeighborSearch::populate,
+         nb::arg("include_h")=true, release_gil(),
          "Usually run after constructing NeighborSearch.")
+    .def("populate",
+         (NeighborSearch& (NeighborSearch::*)(const AtomTable&, bool)) &NeighborSearch::populate,
+         nb::arg("table"), nb::arg("include_h")=true, release_gil())
     .def("add_chain", &NeighborSearch::add_chain,
          nb::arg("chain"), nb::arg("include_h")=true)
     .def("add_atom", &NeighborSearch::add_atom,
@@ -95,7 +99,7 @@ void add_search(nb::module_& m) {
     .def("set_radius", [](ContactSearch& self, Element el, float r) {
         self.set_radius(el.elem, r);
     })
-    .def("find_contacts", &ContactSearch::find_contacts)
+    .def("find_contacts", &ContactSearch::find_contacts, release_gil())
     ;
 
   csignore
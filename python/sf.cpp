@@ -19,7 +19,12 @@ void add_sfcalc(nb::module_& m, const char* name, bool with_mb) {
   sfc
     .def(nb::init<const gemmi::UnitCell&>())
     .def_rw("addends", &SFC::addends)
-    .def("calculate_sf_from_model", &SFC::calculate_sf_from_model)
+    .def("calculate_sf_from_model",
+         (std::complex<double> (SFC::*)(const gemmi::Model&, const gemmi::Miller&))
+         &SFC::calculate_sf_from_model)
+    .def("calculate_sf_from_model",
+         (std::complex<double> (SFC::*)(const gemmi::AtomTable&, const gemmi::Miller&))
+         &SFC::calculate_sf_from_model)
     .def("calculate_sf_from_small_structure", &SFC::calculate_sf_from_small_structure);
   if (with_mb)
     sfc
@@ -41,9 +46,19 @@ void add_dencalc(nb::module_& m, const char* name) {
     .def_rw("addends", &DenCalc::addends)
     .def("set_refmac_compatible_blur", &DenCalc::set_refmac_compatible_blur,
          nb::arg("model"), nb::arg("allow_negative")=false)
-    .def("put_model_density_on_grid", &DenCalc::put_model_density_on_grid)
+    .def("put_model_density_on_grid",
+         (void (DenCalc::*)(const gemmi::Model&)) &DenCalc::put_model_density_on_grid,
+         release_gil())
+    .def("put_model_density_on_grid",
+         (void (DenCalc::*)(const gemmi::AtomTable&)) &DenCalc::put_model_density_on_grid,
+         release_gil())
     .def("initialize_grid", &DenCalc::initialize_grid)
-    .def("add_model_density_to_grid", &DenCalc::add_model_density_to_grid)
+    .def("add_model_density_to_grid",
+         (void (DenCalc::*)(const gemmi::Model&)) &DenCalc::add_model_density_to_grid,
+         release_gil())
+    .def("add_model_density_to_grid",
+         (void (DenCalc::*)(const gemmi::AtomTable&)) &DenCalc::add_model_density_to_grid,
+         release_gil())
     .def("add_atom_density_to_grid", &DenCalc::add_atom_density_to_grid)
     .def("add_c_contribution_to_grid", &DenCalc::add_c_contribution_to_grid)
     // deprecated
@@ -11,6 +11,7 @@
 #include "gemmi/gz.hpp"            // for estimate_uncompressed_size
 #include "gemmi/interop.hpp"       // for atom_to_site, mx_to_sx_structure
 #include "gemmi/flat.hpp"          // for FlatStructure, FlatAtom
+#include "gemmi/atomtable.hpp"     // for AtomTable
 #include "gemmi/pymol_select.hpp"  // for select_atoms
 
 using namespace gemmi;
@@ -249,4 +250,49 @@ void add_small(nb::module_& m) {
           return nb::cast(raw);
         return nb::cast(raw).attr("view")("S8").attr("ravel")();
     }, nb::rv_policy::reference_internal, "Entity IDs as (N, 8) char array");
+
+  nb::class_<AtomTable>(m, "AtomTable")
+    .def(nb::init<>())
+    .def(nb::init<const Model&>(), nb::arg("model"))
+    .def("build", &AtomTable::build, nb::arg("model"))
+    .def("matches", &AtomTable::matches, nb::arg("model"))
+    .def("update_from", &AtomTable::update_from, nb::arg("model"))
+    .def("copy_to", &AtomTable::copy_to, nb::arg("model"))
+    .def("to_cra", (CRA (AtomTable::*)(Model&, size_t) const) &AtomTable::to_cra,
+         nb::arg("model"), nb::arg("index"), nb::keep_alive<0, 2>())
+    .def("__len__", &AtomTable::size)
+    .def("__repr__", [](const AtomTable& self) {
+        return "<gemmi.AtomTable with " + std::to_string(self.size()) + " atoms>";
+    })
+    .def_prop_ro("pos", [](AtomTable& self) {
+        return nb::ndarray<nb::numpy, double, nb::shape<-1, 3>>(
+            &self.pos.data()->x, {self.size(), 3}, nb::handle());
+    }, nb::rv_policy::reference_internal, "Positions as (N, 3) array")
+    .def_prop_ro("b_iso", [](AtomTable& self) {
+        return nb::ndarray<nb::numpy, float, nb::shape<-1>>(
+            self.b_iso.data(), {self.size()}, nb::handle());
+    }, nb::rv_policy::reference_internal)
+    .def_prop_ro("occ", [](AtomTable& self) {
+        return nb::ndarray<nb::numpy, float, nb::shape<-1>>(
+            self.occ.data(), {self.size()}, nb::handle());
+    }, nb::rv_policy::reference_internal)
+    .def_prop_ro("aniso", [](AtomTable& self) {
+        return nb::ndarray<nb::numpy, float, nb::shape<-1, 6>>(
+            &self.aniso.data()->u11, {self.size(), 6}, nb::handle());
+    }, nb::rv_policy::reference_internal, "ADPs (u11, u22, u33, u12, u13, u23) as (N, 6) array")
+    .def_prop_ro("elements", [](AtomTable& self) {
+        return nb::ndarray<nb::numpy, uint8_t, nb::shape<-1>>(
+            reinterpret_cast<uint8_t*>(self.element.data()), {self.size()}, nb::handle());
+    }, nb::rv_policy::reference_internal, "Element types as numpy array")
+    .def_prop_ro("serials", [](AtomTable& self) {
+        return nb::ndarray<nb::numpy, int, nb::shape<-1>>(
+            self.serial.data(), {self.size()}, nb::handle());
+    }, nb::rv_policy::reference_internal)
+    .def("calculate_center_of_mass", [](const AtomTable& self) {
+        return calculate_center_of_mass(self).get();
+    })
+    .def("transform_pos_and_adp", [](AtomTable& self, const Transform& tr) {
+        transform_pos_and_adp(self, tr);
+    }, nb::arg("tr"))
+    ;
 }
@@ -98,10 +98,12 @@ void add_write(nb::module_& m, nb::class_<Structure>& structure) {
   structure
     .def("make_pdb_string", &make_pdb_string,
          nb::arg("options").sig("PdbWriteOptions()")=PdbWriteOptions())
-    .def("write_pdb", [](const Structure& st, const std::string& path, PdbWriteOptions options) {
+    .def("write_pdb", [](const Structure& st, const std::string& path,
+                         PdbWriteOptions options, int nthreads) {
         Ofstream f(path);
-        write_pdb(st, f.ref(), options);
-    })
+        write_pdb(st, f.ref(), options, nthreads);
+    }, nb::arg("path"), nb::arg("options").sig("PdbWriteOptions()")=PdbWriteOptions(),
+       nb::arg("nthreads")=1, release_gil())
     // deprecated - kept for compatibility
     .def("write_pdb", [](const Structure& st, const std::string& path, const nb::kwargs& kwargs) {
         Ofstream f(path);
@@ -121,6 +123,15 @@ void add_write(nb::module_& m, nb::class_<Structure>& structure) {
        write_minimal_pdb(st, os);
        return os.str();
     })
+    .def("write_mmcif", [](const Structure& st, const std::string& path,
+                           MmcifOutputGroups groups, cif::WriteOptions options,
+                           int nthreads) {
+        Ofstream f(path);
+        write_mmcif_to_stream(f.ref(), st, groups, options, nthreads);
+    }, nb::arg("path"),
+       nb::arg("groups").sig("MmcifOutputGroups(True)")=MmcifOutputGroups(true),
+       nb::arg("options").sig("cif.WriteOptions()")=cif::WriteOptions(),
+       nb::arg("nthreads")=1, release_gil())
     .def("make_mmcif_document", &make_mmcif_document,
          nb::arg("groups").sig("MmcifOutputGroups(True)")=MmcifOutputGroups(true))
     .def("make_mmcif_block", &make_mmcif_block,
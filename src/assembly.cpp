@@ -2,9 +2,11 @@
 
 #include "gemmi/assembly.hpp"
 
-#include <memory>             // unique_ptr
-#include "gemmi/modify.hpp"   // transform_pos_and_adp
-#include "gemmi/neighbor.hpp" // NeighborSearch
+#include <memory>               // unique_ptr
+#include "gemmi/modify.hpp"     // transform_pos_and_adp
+#include "gemmi/modelindex.hpp" // ModelIndex
+#include "gemmi/neighbor.hpp"   // NeighborSearch
+#include "gemmi/parallel.hpp"   // parallel_for
 
 namespace gemmi {
 
@@ -84,10 +86,13 @@ void remove_cras(Model& model, std::vector<CRA>& vec) {
   }
 }
 
-Model make_assembly_(const Assembly& assembly, const Model& model,
-                     HowToNameCopiedChain how, const Logger& logger,
-                     AssemblyMapping* mapping) {
-  Model new_model(model.num);
+// Determines names of the new chains and what goes where.
+// If chain_maps is not null, a ChainMap is added for each operator.
+InstancedAssembly plan_assembly(const Assembly& assembly, const Model& model,
+                                HowToNameCopiedChain how, const Logger& logger,
+                                std::vector<ChainMap>* chain_maps) {
+  InstancedAssembly view;
+  view.how = how;
   ChainNameGenerator namegen(how);
   std::map<std::string, std::string> subs = model.subchain_to_chain();
   int counter = 0;
@@ -124,43 +129,83 @@ Model make_assembly_(const Assembly& assembly, const Model& model,
         bool whole_chain = (all_chains || in_vector(chain.name, gen.chains));
         if (whole_chain ||
             (!gen.subchains.empty() && any_subchain_matches(chain, gen))) {
-          // try add a new empty chain, but first figure out the name for it
+          // figure out the name for the new chain
           auto result = chain_map.names.emplace(chain.name, "");
           if (result.second)  // insertion happened - generate a new chain name
             result.first->second = namegen.make_new_name(chain.name, counter+1);
-          new_model.chains.emplace_back(result.first->second);
-          Chain& new_chain = new_model.chains.back();
-          // add residues to the chain
-          for (const Residue& res : chain.residues)
-            if (whole_chain || in_vector(res.subchain, gen.subchains)) {
-              new_chain.residues.push_back(res);
-              Residue& new_res = new_chain.residues.back();
-              transform_pos_and_adp(new_res, oper.transform);
-              if (!new_res.subchain.empty()) {
-                // change subchain name for the residue
-                if (how == HowToNameCopiedChain::Short)
-                  new_res.subchain = new_chain.name + ":" + new_res.subchain;
-                else if (how == HowToNameCopiedChain::AddNumber)
-                  new_res.subchain += new_chain.name.substr(chain.name.size());
-                if (mapping)
-                  mapping->sub.emplace(new_res.subchain, res.subchain);
-              }
-              if (chain_map.uses_segments)
-                new_res.segment = chain_map.id;
-            }
+          view.instances.push_back({&chain, result.first->second,
+                                    chain_map.uses_segments ? chain_map.id : "",
+                                    oper.transform, whole_chain,
+                                    whole_chain ? std::vector<std::string>() : gen.subchains});
         }
       }
-      if (mapping)
-        mapping->chain_maps.push_back(std::move(chain_map));
+      if (chain_maps)
+        chain_maps->push_back(std::move(chain_map));
       ++counter;
     }
   }
+  return view;
+}
+
+Model make_assembly_(const Assembly& assembly, const Model& model,
+                     HowToNameCopiedChain how, const Logger& logger,
+                     AssemblyMapping* mapping, int nthreads) {
+  InstancedAssembly view = plan_assembly(assembly, model, how, logger,
+                                         mapping ? &mapping->chain_maps : nullptr);
+  Model new_model(model.num);
+  new_model.chains.reserve(view.instances.size());
+  for (const AssemblyInstance& inst : view.instances)
+    new_model.chains.emplace_back(inst.name);
+
+  // Copy and transform residues, possibly in parallel.
+  parallel_for(view.instances.size(), nthreads, [&](size_t i) {
+    const AssemblyInstance& inst = view.instances[i];
+    Chain& new_chain = new_model.chains[i];
+    const std::vector<Residue>& residues = inst.chain->residues;
+    if (inst.whole_chain)
+      new_chain.residues.reserve(residues.size());
+    for (const Residue& res : residues)
+      if (inst.includes(res)) {
+        new_chain.residues.push_back(res);
+        Residue& new_res = new_chain.residues.back();
+        transform_pos_and_adp(new_res, inst.transform);
+        if (!new_res.subchain.empty()) {
+          // change subchain name for the residue
+          if (how == HowToNameCopiedChain::Short)
+            new_res.subchain = new_chain.name + ":" + new_res.subchain;
+          else if (how == HowToNameCopiedChain::AddNumber)
+            new_res.subchain += new_chain.name.substr(inst.chain->name.size());
+        }
+        if (!inst.segment.empty())
+          new_res.segment = inst.segment;
+      }
+  });
+
+  if (mapping) {
+    // record subchain names (new->old)
+    for (size_t i = 0; i != view.instances.size(); ++i) {
+      const AssemblyInstance& inst = view.instances[i];
+      const std::string* prev_subchain = nullptr;
+      auto src_res = inst.chain->residues.begin();
+      for (const Residue& new_res : new_model.chains[i].residues) {
+        while (!inst.includes(*src_res))
+          ++src_res;
+        if (!new_res.subchain.empty() &&
+            (prev_subchain == nullptr || new_res.subchain != *prev_subchain)) {
+          mapping->sub.emplace(new_res.subchain, src_res->subchain);
+          prev_subchain = &new_res.subchain;
+        }
+        ++src_res;
+      }
+    }
+  }
   return new_model;
 }
 
 
 void expand_ncs_model_(Model& model, const std::vector<NcsOp>& ncs,
-                       HowToNameCopiedChain how, AssemblyMapping* mapping) {
+                       HowToNameCopiedChain how, AssemblyMapping* mapping,
+                       int nthreads) {
   // For HowToNameCopiedChain::Dup we used to set segment="0" for original
   // residues. Now it's left blank. Not sure which is better.
   size_t orig_size = model.chains.size();
@@ -177,38 +222,57 @@ void expand_ncs_model_(Model& model, const std::vector<NcsOp>& ncs,
       }
     }
   }
-  int counter = 0;
+  // First, only determine names of the new chains.
+  std::vector<const NcsOp*> ops;
   for (const NcsOp& op : ncs)
-    if (!op.given) {
-      ChainMap chain_map;
-      chain_map.uses_segments = (how == HowToNameCopiedChain::Dup);
-      chain_map.id = op.id;
-      ++counter;
-      for (size_t i = 0; i != orig_size; ++i) {
-        model.chains.push_back(model.chains[i]);
-        Chain& new_chain = model.chains.back();
-        const std::string& old_name = model.chains[i].name;
-        auto result = chain_map.names.emplace(old_name, "");
-        if (how != HowToNameCopiedChain::Dup) {
-          if (result.second) // if insertion happened - generate a new chain name
-            result.first->second = namegen.make_new_name(old_name, counter);
-          new_chain.name = result.first->second;
-        }
-        for (Residue& new_res : new_chain.residues) {
-          transform_pos_and_adp(new_res, op.tr);
-          if (!new_res.subchain.empty()) {
-            std::string old_subchain = new_res.subchain;
-            new_res.subchain = new_chain.name + ":" + new_res.subchain;
-            if (mapping)
-              mapping->sub.emplace(new_res.subchain, old_subchain);
-          }
-          if (chain_map.uses_segments)
-            new_res.segment = chain_map.id;
-        }
+    if (!op.given)
+      ops.push_back(&op);
+  std::vector<ChainMap> chain_maps(ops.size());
+  std::vector<std::string> new_names(ops.size() * orig_size);
+  for (size_t k = 0; k != ops.size(); ++k) {
+    ChainMap& chain_map = chain_maps[k];
+    chain_map.uses_segments = (how == HowToNameCopiedChain::Dup);
+    chain_map.id = ops[k]->id;
+    for (size_t i = 0; i != orig_size; ++i) {
+      const std::string& old_name = model.chains[i].name;
+      auto result = chain_map.names.emplace(old_name, "");
+      if (how != HowToNameCopiedChain::Dup) {
+        if (result.second) // if insertion happened - generate a new chain name
+          result.first->second = namegen.make_new_name(old_name, int(k + 1));
+        new_names[k * orig_size + i] = result.first->second;
+      }
+    }
+  }
+
+  // Then copy and transform chains, possibly in parallel.
+  model.chains.resize(orig_size * (1 + ops.size()));
+  parallel_for(new_names.size(), nthreads, [&](size_t n) {
+    size_t k = n / orig_size;
+    Chain& new_chain = model.chains[orig_size + n];
+    new_chain = model.chains[n % orig_size];
+    if (how != HowToNameCopiedChain::Dup)
+      new_chain.name = new_names[n];
+    for (Residue& new_res : new_chain.residues) {
+      transform_pos_and_adp(new_res, ops[k]->tr);
+      if (!new_res.subchain.empty())
+        new_res.subchain = new_chain.name + ":" + new_res.subchain;
+      if (chain_maps[k].uses_segments)
+        new_res.segment = chain_maps[k].id;
+    }
+  });
+
+  if (mapping) {
+    for (size_t n = 0; n != new_names.size(); ++n) {
+      const Chain& new_chain = model.chains[orig_size + n];
+      size_t prefix_len = new_chain.name.size() + 1;
+      for (const ConstResidueSpan& span : new_chain.subchains()) {
+        const std::string& sub_id = span.subchain_id();
+        if (!sub_id.empty())
+          mapping->sub.emplace(sub_id, sub_id.substr(prefix_len));
       }
-      if (mapping)
-        mapping->chain_maps.push_back(std::move(chain_map));
     }
+    vector_move_extend(mapping->chain_maps, std::move(chain_maps));
+  }
 }
 
 
@@ -233,6 +297,9 @@ void finalize_expansion(Structure& st, const AssemblyMapping& mapping,
 
   // connections
   std::vector<Connection> new_connections;
+  ModelIndex index;
+  if (!st.connections.empty())
+    index.build(st.models[0]);
   for (const Connection& conn : st.connections)
     if (expanding_ncs || conn.asu == Asu::Same) {
       bool first = true;
@@ -247,8 +314,8 @@ void finalize_expansion(Structure& st, const AssemblyMapping& mapping,
           if (chain_map.uses_segments)
             new_conn.partner1.res_id.segment =
             new_conn.partner2.res_id.segment = chain_map.id;
-          if (st.models[0].find_atom(new_conn.partner1) &&
-              st.models[0].find_atom(new_conn.partner2)) {
+          if (index.find_cra(new_conn.partner1).atom &&
+              index.find_cra(new_conn.partner2).atom) {
             if (!first) {
               cat_to(new_conn.name, '.', chain_map.id);
               first = false;
@@ -325,13 +392,18 @@ void finalize_expansion(Structure& st, const AssemblyMapping& mapping,
 } // anonymous namespace
 
 Model make_assembly(const Assembly& assembly, const Model& model,
-                    HowToNameCopiedChain how, const Logger& logging) {
-  return make_assembly_(assembly, model, how, logging, nullptr);
+                    HowToNameCopiedChain how, const Logger& logging, int nthreads) {
+  return make_assembly_(assembly, model, how, logging, nullptr, nthreads);
+}
+
+InstancedAssembly make_instanced_assembly(const Assembly& assembly, const Model& model,
+                                          HowToNameCopiedChain how, const Logger& logging) {
+  return plan_assembly(assembly, model, how, logging, nullptr);
 }
 
 void transform_to_assembly(Structure& st, const std::string& assembly_name,
                            HowToNameCopiedChain how, const Logger& logging,
-                           bool keep_spacegroup, double merge_dist) {
+                           bool keep_spacegroup, double merge_dist, int nthreads) {
   const Assembly* assembly = st.find_assembly(assembly_name);
   std::unique_ptr<Assembly> p1_assembly;
   if (!assembly) {
@@ -350,7 +422,7 @@ void transform_to_assembly(Structure& st, const std::string& assembly_name,
   mapping.how = how;
   AssemblyMapping* mapping_ptr = &mapping;
   for (Model& model : st.models) {
-    model = make_assembly_(*assembly, model, how, logging, mapping_ptr);
+    model = make_assembly_(*assembly, model, how, logging, mapping_ptr, nthreads);
     mapping_ptr = nullptr;  // AssemblyMapping is based only on the first model
   }
   finalize_expansion(st, mapping, merge_dist, false);
@@ -368,18 +440,18 @@ void transform_to_assembly(Structure& st, const std::string& assembly_name,
 }
 
 Model expand_ncs_model(const Model& model, const std::vector<NcsOp>& ncs,
-                       HowToNameCopiedChain how) {
+                       HowToNameCopiedChain how, int nthreads) {
   Model model_copy = model;
-  expand_ncs_model_(model_copy, ncs, how, nullptr);
+  expand_ncs_model_(model_copy, ncs, how, nullptr, nthreads);
   return model_copy;
 }
 
-void expand_ncs(Structure& st, HowToNameCopiedChain how, double merge_dist) {
+void expand_ncs(Structure& st, HowToNameCopiedChain how, double merge_dist, int nthreads) {
   AssemblyMapping mapping;
   mapping.how = how;
   AssemblyMapping* mapping_ptr = &mapping;
   for (Model& model : st.models) {
-    expand_ncs_model_(model, st.ncs, how, mapping_ptr);
+    expand_ncs_model_(model, st.ncs, how, mapping_ptr, nthreads);
     mapping_ptr = nullptr;  // AssemblyMapping is based only on the first model
   }
   finalize_expansion(st, mapping, merge_dist, true);
@@ -4,6 +4,7 @@
 #include <cassert>
 #include <cstdio>       // fseek, ftell, fread
 #include <climits>      // INT_MAX
+#include <algorithm>    // for min
 #if USE_ZLIB_NG
 # define WITH_GZFILEOP 1
 # include <zlib-ng.h>
@@ -186,4 +187,73 @@ std::unique_ptr<AnyStream> MaybeGzipped::create_stream() {
   return BasicInput::create_stream();
 }
 
+GzOutputBuffer::GzOutputBuffer(const std::string& path, int level)
+    : path_(path), buf_(64*1024) {
+  char mode[] = "wb6";
+  if (level >= 1 && level <= 9)
+    mode[2] = char('0' + level);
+  file_ = GG(gzopen)(path.c_str(), mode);
+  if (!file_)
+    sys_fail("Failed to gzopen " + path + " for writing");
+  GG(gzbuffer)((gzFile)file_, 128*1024);
+  setp(buf_.data(), buf_.data() + buf_.size());
+}
+
+GzOutputBuffer::~GzOutputBuffer() {
+  if (file_) {
+    flush_buffer();
+    GG(gzclose)((gzFile)file_);
+  }
+}
+
+void GzOutputBuffer::close() {
+  if (!file_)
+    return;
+  bool ok = flush_buffer();
+  int ret = GG(gzclose)((gzFile)file_);
+  file_ = nullptr;
+  if (!ok || ret != Z_OK)
+    fail("Failed to write " + path_);
+}
+
+bool GzOutputBuffer::write_raw(const char* s, size_t n) {
+  while (n != 0) {
+    unsigned len = (unsigned) std::min(n, size_t(INT_MAX));
+    if (GG(gzwrite)((gzFile)file_, s, len) != (int) len)
+      return false;
+    s += len;
+    n -= len;
+  }
+  return true;
+}
+
+bool GzOutputBuffer::flush_buffer() {
+  bool ok = file_ && write_raw(pbase(), pptr() - pbase());
+  setp(buf_.data(), buf_.data() + buf_.size());
+  return ok;
+}
+
+GzOutputBuffer::int_type GzOutputBuffer::overflow(int_type ch) {
+  if (!flush_buffer())
+    return traits_type::eof();
+  if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+    *pptr() = traits_type::to_char_type(ch);
+    pbump(1);
+  }
+  return traits_type::not_eof(ch);
+}
+
+std::streamsize GzOutputBuffer::xsputn(const char* s, std::streamsize n) {
+  if (n < epptr() - pptr())
+    return std::streambuf::xsputn(s, n);
+  // large writes go directly to zlib
+  if (!flush_buffer() || !write_raw(s, (size_t) n))
+    return 0;
+  return n;
+}
+
+int GzOutputBuffer::sync() {
+  return flush_buffer() ? 0 : -1;
+}
+
 } // namespace gemmi
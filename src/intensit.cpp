@@ -3,7 +3,9 @@
 #include <gemmi/intensit.hpp>
 #include <gemmi/atof.hpp>       // for fast_from_chars
 #include <gemmi/binner.hpp>     // for Binner
+#include <gemmi/gz.hpp>         // for MaybeGzipped
 #include <gemmi/mtz.hpp>        // for Mtz
+#include <gemmi/parallel.hpp>   // for parallel_for
 #include <gemmi/refln.hpp>      // for ReflnBlock
 #include <gemmi/xds_ascii.hpp>  // for XdsAscii
 
@@ -25,16 +27,203 @@ bool parse_voigt_notation(const char* start, const char* end, SMat33<double>& b)
   return *start == ')';
 }
 
-template<typename Source>
-void copy_metadata(const Source& source, Intensities& intensities) {
+using Refl = Intensities::Refl;
+using KeyIdx = std::pair<uint64_t, size_t>;
+
+// (h,k,l,isign) packed into 64 bits in a way that preserves Refl::operator<.
+// Returns false if a Miller index doesn't fit into the key.
+bool pack_refl_key(const Refl& r, uint64_t& key) {
+  if (!CompactIntensities::key_fits(r.hkl))
+    return false;
+  key = CompactIntensities::make_key(r.hkl, r.isign);
+  return true;
+}
+
+// Row accessors used to share merging code between Intensities
+// and CompactIntensities.
+struct ReflRows {
+  Refl* r;
+  bool same_group(size_t a, size_t b) const {
+    return r[a].hkl == r[b].hkl && r[a].isign == r[b].isign;
+  }
+  Miller hkl(size_t i) const { return r[i].hkl; }
+  double value(size_t i) const { return r[i].value; }
+  double sigma(size_t i) const { return r[i].sigma; }
+  void set_merged(size_t out, size_t in, double value, double sigma, int nobs) const {
+    r[out].hkl = r[in].hkl;
+    r[out].isign = r[in].isign;
+    r[out].value = value;
+    r[out].sigma = sigma;
+    r[out].nobs = (short) nobs;
+  }
+  void move(size_t from, size_t to) const { r[to] = r[from]; }
+};
+
+struct CompactRows {
+  CompactIntensities* c;
+  bool same_group(size_t a, size_t b) const { return c->key[a] == c->key[b]; }
+  Miller hkl(size_t i) const { return CompactIntensities::key_hkl(c->key[i]); }
+  double value(size_t i) const { return c->value[i]; }
+  double sigma(size_t i) const { return c->sigma[i]; }
+  void set_merged(size_t out, size_t in, double value, double sigma, int nobs) const {
+    c->key[out] = c->key[in];
+    c->value[out] = (float) value;
+    c->sigma[out] = (float) sigma;
+    c->nobs[out] = (short) nobs;
+  }
+  void move(size_t from, size_t to) const {
+    c->key[to] = c->key[from];
+    c->value[to] = c->value[from];
+    c->sigma[to] = c->sigma[from];
+    c->isym[to] = c->isym[from];
+    c->nobs[to] = c->nobs[from];
+  }
+};
+
+// Approximate number of rows in a chunk. Chunks don't depend on the number
+// of threads, so sums over chunks are added in the same order for any -j.
+constexpr size_t merge_chunk_size = 16384;
+
+// Split sorted rows into ranges that don't break groups of equivalent
+// reflections, so that the ranges can be processed independently.
+template<typename Rows>
+std::vector<size_t> group_aligned_chunks(const Rows& rows, size_t size) {
+  size_t n_chunks = (size + merge_chunk_size - 1) / merge_chunk_size;
+  std::vector<size_t> bounds(1, 0);
+  for (size_t i = 1; i < n_chunks; ++i) {
+    size_t pos = std::max(bounds.back(), i * merge_chunk_size);
+    while (pos != 0 && pos < size && rows.same_group(pos-1, pos))
+      ++pos;
+    if (pos > bounds.back() && pos < size)
+      bounds.push_back(pos);
+  }
+  bounds.push_back(size);
+  return bounds;
+}
+
+// Merges each group of equivalent reflections in [begin, end) into one
+// reflection. Returns the end of merged reflections.
+template<typename Rows>
+size_t merge_range(const Rows& rows, size_t begin, size_t end) {
+  size_t out = begin;
+  size_t group = begin;
+  double sum_wI = 0.;
+  double sum_w = 0.;
+  for (size_t in = begin; in != end; ++in) {
+    if (!rows.same_group(group, in)) {
+      rows.set_merged(out++, group, sum_wI / sum_w, 1.0 / std::sqrt(sum_w), int(in - group));
+      sum_wI = sum_w = 0.;
+      group = in;
+    }
+    double w = 1. / (rows.sigma(in) * rows.sigma(in));
+    sum_wI += w * rows.value(in);
+    sum_w += w;
+  }
+  rows.set_merged(out++, group, sum_wI / sum_w, 1.0 / std::sqrt(sum_w), int(end - group));
+  return out;
+}
+
+// Merges sorted rows in-place. Returns the number of merged reflections.
+template<typename Rows>
+size_t merge_rows(const Rows& rows, size_t size, int nthreads) {
+  std::vector<size_t> bounds = group_aligned_chunks(rows, size);
+  size_t n_chunks = bounds.size() - 1;
+  std::vector<size_t> merged_end(n_chunks);
+  parallel_for(n_chunks, nthreads, [&](size_t i) {
+    merged_end[i] = merge_range(rows, bounds[i], bounds[i+1]);
+  });
+  // move merged ranges together
+  size_t out = merged_end[0];
+  for (size_t i = 1; i < n_chunks; ++i)
+    for (size_t j = bounds[i]; j != merged_end[i]; ++j)
+      rows.move(j, out++);
+  return out;
+}
+
+// Adds statistics from the groups of equivalent reflections in [begin, end)
+template<typename Rows>
+void add_merging_stats(const Rows& rows, size_t begin, size_t end, const Binner* binner,
+                       char use_weights, std::vector<MergingStats>& stats) {
+  int bin_hint = (int)stats.size() - 1;
+  size_t group = begin;
+  double sum_I = 0;
+  double sum_wI = 0;
+  double sum_wIsq = 0;
+  double sum_w = 0;
+
+  auto process_equivalent_refl = [&](size_t group_end) {
+    int nobs = int(group_end - group);
+    MergingStats& ms = stats[binner ? binner->get_bin_hinted(rows.hkl(group), bin_hint) : 0];
+    ms.all_refl += nobs;
+    ms.unique_refl++;
+    if (nobs <= 1)
+      return;
+    ms.stats_refl++;
+    double abs_diff_sum = 0;
+    double imean = sum_wI / sum_w;
+    for (size_t i = group; i != group_end; ++i)
+      abs_diff_sum += std::fabs(rows.value(i) - imean);
+    ms.r_denom += use_weights == 'Y' ? nobs * imean : sum_I;
+    ms.r_merge_num += abs_diff_sum;
+    double t = abs_diff_sum / std::sqrt(nobs - 1);
+    ms.r_pim_num += t;
+    ms.r_meas_num += std::sqrt(nobs) * t;
+    // based on https://wiki.uni-konstanz.de/xds/index.php?title=CC1/2
+    ms.sum_sig2_eps += (sum_wIsq / sum_w - sq(imean)) * 2 / (nobs - 1);
+    ms.sum_ibar += imean;
+    ms.sum_ibar2 += sq(imean);
+  };
+
+  // hkl indices in data are in-asu and sorted, process consecutive groups
+  for (size_t i = begin; i != end; ++i) {
+    if (!rows.same_group(group, i)) {
+      process_equivalent_refl(i);
+      group = i;
+      sum_I = 0;
+      sum_wI = 0;
+      sum_wIsq = 0;
+      sum_w = 0;
+    }
+    double value = rows.value(i);
+    sum_I += value;
+    double w = use_weights == 'U' ? 1. : 1 / sq(rows.sigma(i));
+    sum_wI += w * value;
+    sum_wIsq += w * sq(value);
+    sum_w += w;
+  }
+  process_equivalent_refl(end);
+}
+
+template<typename Rows>
+std::vector<MergingStats> merging_stats(const Rows& rows, size_t size, const Binner* binner,
+                                        char use_weights, int nthreads) {
+  if (binner)
+    binner->ensure_limits_are_set();  // asserts size() > 0
+  size_t nbins = binner ? binner->size() : 1;
+  std::vector<size_t> bounds = group_aligned_chunks(rows, size);
+  size_t n_chunks = bounds.size() - 1;
+  std::vector<std::vector<MergingStats>> chunk_stats(n_chunks,
+                                                     std::vector<MergingStats>(nbins));
+  parallel_for(n_chunks, nthreads, [&](size_t i) {
+    add_merging_stats(rows, bounds[i], bounds[i+1], binner, use_weights, chunk_stats[i]);
+  });
+  std::vector<MergingStats>& stats = chunk_stats[0];
+  for (size_t i = 1; i < n_chunks; ++i)
+    for (size_t j = 0; j != nbins; ++j)
+      stats[j].add_other(chunk_stats[i][j]);
+  return std::move(stats);
+}
+
+template<typename Source, typename Target>
+void copy_metadata(const Source& source, Target& intensities) {
   intensities.unit_cell = source.cell;
   intensities.spacegroup = source.spacegroup;
   if (!intensities.spacegroup)
     fail("unknown space group");
 }
 
-template<typename DataProxy>
-void read_data(Intensities& intensities, const DataProxy& proxy,
+template<typename Target, typename DataProxy>
+void read_data(Target& intensities, const DataProxy& proxy,
                size_t value_idx, size_t sigma_idx) {
   for (size_t i = 0; i < proxy.size(); i += proxy.stride())
     intensities.add_if_valid(proxy.get_hkl(i), 0, 0,
@@ -42,8 +231,8 @@ void read_data(Intensities& intensities, const DataProxy& proxy,
                              proxy.get_num(i + sigma_idx));
 }
 
-template<typename DataProxy>
-void read_anomalous_data(Intensities& intensities, const DataProxy& proxy,
+template<typename Target, typename DataProxy>
+void read_anomalous_data(Target& intensities, const DataProxy& proxy,
                          int mean_idx, size_t (&value_idx)[2], size_t (&sigma_idx)[2]) {
   GroupOps gops = intensities.spacegroup->operations();
   for (size_t i = 0; i < proxy.size(); i += proxy.stride()) {
@@ -159,7 +348,33 @@ Correlation Intensities::calculate_correlation(const Intensities& other) const {
   return corr;
 }
 
-DataType Intensities::prepare_for_merging(DataType new_type) {
+void Intensities::sort(int nthreads) {
+  size_t n = data.size();
+  if (n < 2)
+    return;
+  std::vector<KeyIdx> keys(n);
+  std::atomic<bool> fits{true};
+  parallel_for_chunks(n, 1 << 16, nthreads, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i != end; ++i) {
+      keys[i].second = i;
+      if (!pack_refl_key(data[i], keys[i].first))
+        fits = false;
+    }
+  });
+  if (!fits) {
+    std::stable_sort(data.begin(), data.end());
+    return;
+  }
+  parallel_sort_keys(keys, nthreads);
+  std::vector<Refl> sorted(n);
+  parallel_for_chunks(n, 1 << 16, nthreads, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i != end; ++i)
+      sorted[i] = data[keys[i].second];
+  });
+  data.swap(sorted);
+}
+
+DataType Intensities::prepare_for_merging(DataType new_type, int nthreads) {
   if (new_type == DataType::Mean || new_type == DataType::MergedMA ||
       (spacegroup && spacegroup->is_centrosymmetric())) {
     // discard signs so that merging produces Imean
@@ -174,42 +389,20 @@ DataType Intensities::prepare_for_merging(DataType new_type) {
       refl.isign = refl.isym % 2 != 0 || gops.is_reflection_centric(refl.hkl) ? 1 : -1;
     new_type = DataType::Anomalous;
   }
-  sort();
+  sort(nthreads);
   return new_type;
 }
 
-void Intensities::merge_in_place(DataType new_type) {
+void Intensities::merge_in_place(DataType new_type, int nthreads) {
   if (data.empty() || new_type == type || type == DataType::Mean || new_type == DataType::Unmerged)
     return;
-  type = prepare_for_merging(new_type);
-  std::vector<Refl>::iterator out = data.begin();
-  double sum_wI = 0.;
-  double sum_w = 0.;
-  int nobs = 0;
-  for (auto in = data.begin(); in != data.end(); ++in) {
-    if (out->hkl != in->hkl || out->isign != in->isign) {
-      out->value = sum_wI / sum_w;
-      out->sigma = 1.0 / std::sqrt(sum_w);
-      out->nobs = nobs;
-      sum_wI = sum_w = 0.;
-      nobs = 0;
-      ++out;
-      out->hkl = in->hkl;
-      out->isign = in->isign;
-    }
-    double w = 1. / (in->sigma * in->sigma);
-    sum_wI += w * in->value;
-    sum_w += w;
-    ++nobs;
-  }
-  out->value = sum_wI / sum_w;
-  out->sigma = 1.0 / std::sqrt(sum_w);
-  out->nobs = nobs;
-  data.erase(++out, data.end());
+  type = prepare_for_merging(new_type, nthreads);
+  data.resize(merge_rows(ReflRows{data.data()}, data.size(), nthreads));
 }
 
 std::vector<MergingStats>
-Intensities::calculate_merging_stats(const Binner* binner, char use_weights) const {
+Intensities::calculate_merging_stats(const Binner* binner, char use_weights,
+                                     int nthreads) const {
   if (data.empty())
     fail("no data");
   if (type != DataType::Unmerged)
@@ -217,63 +410,9 @@ Intensities::calculate_merging_stats(const Binner* binner, char use_weights) con
   if (!std::is_sorted(data.begin(), data.end()))
     fail("call Intensities.sort() before calculating merging statistics");
 
-  if (binner)
-    binner->ensure_limits_are_set();  // asserts size() > 0
-  size_t nbins = binner ? binner->size() : 1;
-
-  std::vector<MergingStats> stats(nbins);
-  int bin_hint = (int)nbins - 1;
-  Miller hkl = data[0].hkl;
-  int8_t isign = data[0].isign;
-  double sum_I = 0;
-  double sum_wI = 0;
-  double sum_wIsq = 0;
-  double sum_w = 0;
-  int nobs = 0;
-
-  auto process_equivalent_refl = [&](const Refl* end) {
-    MergingStats& ms = stats[binner ? binner->get_bin_hinted(hkl, bin_hint) : 0];
-    ms.all_refl += nobs;
-    ms.unique_refl++;
-    if (nobs <= 1)
-      return;
-    ms.stats_refl++;
-    double abs_diff_sum = 0;
-    double imean = sum_wI / sum_w;
-    for (const Refl* r = end - nobs; r != end; ++r)
-      abs_diff_sum += std::fabs(r->value - imean);
-    ms.r_denom += use_weights == 'Y' ? nobs * imean : sum_I;
-    ms.r_merge_num += abs_diff_sum;
-    double t = abs_diff_sum / std::sqrt(nobs - 1);
-    ms.r_pim_num += t;
-    ms.r_meas_num += std::sqrt(nobs) * t;
-    // based on https://wiki.uni-konstanz.de/xds/index.php?title=CC1/2
-    ms.sum_sig2_eps += (sum_wIsq / sum_w - sq(imean)) * 2 / (nobs - 1);
-    ms.sum_ibar += imean;
-    ms.sum_ibar2 += sq(imean);
-  };
-
-  // hkl indices in data are in-asu and sorted, process consecutive groups
-  for (const Refl& refl : data) {
-    if (refl.hkl != hkl || refl.isign != isign) {
-      process_equivalent_refl(&refl);
-      hkl = refl.hkl;
-      isign = refl.isign;
-      sum_I = 0;
-      sum_wI = 0;
-      sum_wIsq = 0;
-      sum_w = 0;
-      nobs = 0;
-    }
-    sum_I += refl.value;
-    double w = use_weights == 'U' ? 1. : 1 / sq(refl.sigma);
-    sum_wI += w * refl.value;
-    sum_wIsq += w * sq(refl.value);
-    sum_w += w;
-    ++nobs;
-  }
-  process_equivalent_refl(data.data() + data.size());
-  return stats;
+  // rows are only read
+  ReflRows rows{const_cast<Refl*>(data.data())};
+  return merging_stats(rows, data.size(), binner, use_weights, nthreads);
 }
 
 // based on https://wiki.uni-konstanz.de/xds/index.php?title=CC1/2 (sigma-tau method)
@@ -308,9 +447,22 @@ void Intensities::switch_to_asu_indices() {
   }
 }
 
-// Takes average of parameters from batch headers Mtz::cell as the unit cell.
-// To use Mtz::cell instead, set it afterwards: intensities.unit_cell = mtz.cell
-void Intensities::import_unmerged_intensities_from_mtz(const Mtz& mtz) {
+namespace {
+
+// The import functions below are shared by Intensities and CompactIntensities.
+
+void reserve_rows(Intensities& intensities, size_t n) { intensities.data.reserve(n); }
+void reserve_rows(CompactIntensities& intensities, size_t n) { intensities.reserve(n); }
+
+IntensitiesDataProxy data_proxy(const Intensities& intensities) {
+  return IntensitiesDataProxy{intensities};
+}
+CompactIntensitiesDataProxy data_proxy(const CompactIntensities& intensities) {
+  return CompactIntensitiesDataProxy{intensities};
+}
+
+template<typename Target>
+void import_unmerged_from_mtz(Target& self, const Mtz& mtz) {
   if (mtz.batches.empty())
     fail("expected unmerged file");
   const Mtz::Column* isym_col = mtz.column_with_label("M/ISYM");
@@ -319,40 +471,44 @@ void Intensities::import_unmerged_intensities_from_mtz(const Mtz& mtz) {
   const Mtz::Column& col = mtz.get_column_with_label("I");
   size_t value_idx = col.idx;
   size_t sigma_idx = mtz.get_column_with_label("SIGI").idx;
-  unit_cell.set_from_parameters(mtz.get_average_cell_from_batch_headers(unit_cell_rmsd));
-  spacegroup = mtz.spacegroup;
-  if (!spacegroup)
+  self.unit_cell.set_from_parameters(
+      mtz.get_average_cell_from_batch_headers(self.unit_cell_rmsd));
+  self.spacegroup = mtz.spacegroup;
+  if (!self.spacegroup)
     fail("unknown space group");
-  wavelength = mtz.dataset(col.dataset_id).wavelength;
+  self.wavelength = mtz.dataset(col.dataset_id).wavelength;
   // In unmerged MTZ files it's common that dataset from the COLUMN header is 0,
   // probably because dataset is set in BATCH headers.
-  if (col.dataset_id == 0 && wavelength == 0 && mtz.datasets.size() > 1)
-    wavelength = mtz.datasets[1].wavelength;
+  if (col.dataset_id == 0 && self.wavelength == 0 && mtz.datasets.size() > 1)
+    self.wavelength = mtz.datasets[1].wavelength;
+  reserve_rows(self, mtz.nreflections);
   for (size_t i = 0; i < mtz.data.size(); i += mtz.columns.size()) {
-    add_if_valid(mtz.get_hkl(i), 0, (int8_t)mtz.data[i + 3],
-                 mtz.data[i + value_idx], mtz.data[i + sigma_idx]);
+    self.add_if_valid(mtz.get_hkl(i), 0, (int8_t)mtz.data[i + 3],
+                      mtz.data[i + value_idx], mtz.data[i + sigma_idx]);
   }
-  type = DataType::Unmerged;
+  self.type = DataType::Unmerged;
   // Aimless >=0.7.6 (from 2021) has an option to output unmerged file
   // with original indices instead of reduced indices, with all ISYM = 1.
   // Then it needs switch_to_asu_indices(), which is called in read_mtz().
 }
 
-void Intensities::import_mean_intensities_from_mtz(const Mtz& mtz) {
+template<typename Target>
+void import_mean_from_mtz(Target& self, const Mtz& mtz) {
   if (!mtz.batches.empty())
     fail("expected merged file");
   const Mtz::Column* col = mtz.imean_column();
   if (!col)
     fail("Mean intensities (IMEAN, I, IOBS or I-obs) not found");
   size_t sigma_idx = mtz.get_column_with_label("SIG" + col->label).idx;
-  copy_metadata(mtz, *this);
-  wavelength = mtz.dataset(col->dataset_id).wavelength;
-  read_data(*this, MtzDataProxy{mtz}, col->idx, sigma_idx);
-  isym_ops = mtz.symops;
-  type = DataType::Mean;
+  copy_metadata(mtz, self);
+  self.wavelength = mtz.dataset(col->dataset_id).wavelength;
+  read_data(self, MtzDataProxy{mtz}, col->idx, sigma_idx);
+  self.isym_ops = mtz.symops;
+  self.type = DataType::Mean;
 }
 
-void Intensities::import_anomalous_intensities_from_mtz(const Mtz& mtz, bool check_complete) {
+template<typename Target>
+void import_anomalous_from_mtz(Target& self, const Mtz& mtz, bool check_complete) {
   if (!mtz.batches.empty())
     fail("expected merged file");
   const Mtz::Column* colp = mtz.iplus_column();
@@ -366,13 +522,14 @@ void Intensities::import_anomalous_intensities_from_mtz(const Mtz& mtz, bool che
   if (check_complete)
     if (const Mtz::Column* mean_col = mtz.imean_column())
       mean_idx = (int) mean_col->idx;
-  copy_metadata(mtz, *this);
-  wavelength = mtz.dataset(colp->dataset_id).wavelength;
-  read_anomalous_data(*this, MtzDataProxy{mtz}, mean_idx, value_idx, sigma_idx);
-  type = DataType::Anomalous;
+  copy_metadata(mtz, self);
+  self.wavelength = mtz.dataset(colp->dataset_id).wavelength;
+  read_anomalous_data(self, MtzDataProxy{mtz}, mean_idx, value_idx, sigma_idx);
+  self.type = DataType::Anomalous;
 }
 
-void Intensities::import_mtz(const Mtz& mtz, DataType data_type) {
+template<typename Target>
+void import_mtz_(Target& self, const Mtz& mtz, DataType data_type) {
   bool check_anom_complete = false;
   if (data_type == DataType::Unknown)
     data_type = mtz.is_merged() ? DataType::MergedMA : DataType::Unmerged;
@@ -394,41 +551,43 @@ void Intensities::import_mtz(const Mtz& mtz, DataType data_type) {
   }
 
   if (data_type == DataType::Unmerged)
-    import_unmerged_intensities_from_mtz(mtz);
+    import_unmerged_from_mtz(self, mtz);
   else if (data_type == DataType::Mean)
-    import_mean_intensities_from_mtz(mtz);
+    import_mean_from_mtz(self, mtz);
   else  // (data_type == DataType::Anomalous)
-    import_anomalous_intensities_from_mtz(mtz, check_anom_complete);
-  switch_to_asu_indices();
+    import_anomalous_from_mtz(self, mtz, check_anom_complete);
+  self.switch_to_asu_indices();
 }
 
-static
-void read_simple_intensities_from_mmcif(Intensities& intensities, const ReflnBlock& rb,
+template<typename Target>
+void read_simple_intensities_from_mmcif(Target& self, const ReflnBlock& rb,
                                         const char* inten, const char* sigma) {
   size_t value_idx = rb.get_column_index(inten);
   size_t sigma_idx = rb.get_column_index(sigma);
-  copy_metadata(rb, intensities);
-  intensities.wavelength = rb.wavelength;
-  read_data(intensities, ReflnDataProxy(rb), value_idx, sigma_idx);
+  copy_metadata(rb, self);
+  self.wavelength = rb.wavelength;
+  read_data(self, ReflnDataProxy(rb), value_idx, sigma_idx);
 }
 
-void Intensities::import_unmerged_intensities_from_mmcif(const ReflnBlock& rb) {
+template<typename Target>
+void import_unmerged_from_mmcif(Target& self, const ReflnBlock& rb) {
   const char* intensity_tag = "intensity_net";
   // When the PDB software didn't support diffrn_refln,
   // unmerged data was deposited using the refln category.
   if (rb.default_loop == rb.refln_loop)
     intensity_tag = "intensity_meas";
-  read_simple_intensities_from_mmcif(*this, rb, intensity_tag, "intensity_sigma");
-  type = DataType::Unmerged;
+  read_simple_intensities_from_mmcif(self, rb, intensity_tag, "intensity_sigma");
+  self.type = DataType::Unmerged;
 }
 
-void Intensities::import_mean_intensities_from_mmcif(const ReflnBlock& rb) {
-  read_simple_intensities_from_mmcif(*this, rb, "intensity_meas", "intensity_sigma");
-  type = DataType::Mean;
+template<typename Target>
+void import_mean_from_mmcif(Target& self, const ReflnBlock& rb) {
+  read_simple_intensities_from_mmcif(self, rb, "intensity_meas", "intensity_sigma");
+  self.type = DataType::Mean;
 }
 
-void Intensities::import_anomalous_intensities_from_mmcif(const ReflnBlock& rb,
-                                                        bool check_complete) {
+template<typename Target>
+void import_anomalous_from_mmcif(Target& self, const ReflnBlock& rb, bool check_complete) {
   size_t value_idx[2] = {rb.get_column_index("pdbx_I_plus"),
                          rb.get_column_index("pdbx_I_minus")};
   size_t sigma_idx[2] = {rb.get_column_index("pdbx_I_plus_sigma"),
@@ -436,13 +595,14 @@ void Intensities::import_anomalous_intensities_from_mmcif(const ReflnBlock& rb,
   int mean_idx = -1;
   if (check_complete)
     mean_idx = rb.find_column_index("intensity_meas");
-  copy_metadata(rb, *this);
-  wavelength = rb.wavelength;
-  read_anomalous_data(*this, ReflnDataProxy(rb), mean_idx, value_idx, sigma_idx);
-  type = DataType::Anomalous;
+  copy_metadata(rb, self);
+  self.wavelength = rb.wavelength;
+  read_anomalous_data(self, ReflnDataProxy(rb), mean_idx, value_idx, sigma_idx);
+  self.type = DataType::Anomalous;
 }
 
-void Intensities::import_refln_block(const ReflnBlock& rb, DataType data_type) {
+template<typename Target>
+void import_refln_block_(Target& self, const ReflnBlock& rb, DataType data_type) {
   DataType save_data_type = data_type;
   bool check_anom_complete = false;
   if (data_type == DataType::Unknown)
@@ -466,17 +626,102 @@ void Intensities::import_refln_block(const ReflnBlock& rb, DataType data_type) {
       data_type = has_mean ? DataType::Mean : DataType::Anomalous;
   }
   if (data_type == DataType::Unmerged)
-    import_unmerged_intensities_from_mmcif(rb);
+    import_unmerged_from_mmcif(self, rb);
   else if (data_type == DataType::Mean)
-    import_mean_intensities_from_mmcif(rb);
+    import_mean_from_mmcif(self, rb);
   else  // (data_type == DataType::Anomalous)
-    import_anomalous_intensities_from_mmcif(rb, check_anom_complete);
-  if (save_data_type == DataType::UAM && type == DataType::Mean) {
-    DataType actual = check_data_type_under_symmetry(IntensitiesDataProxy{*this}).first;
+    import_anomalous_from_mmcif(self, rb, check_anom_complete);
+  if (save_data_type == DataType::UAM && self.type == DataType::Mean) {
+    DataType actual = check_data_type_under_symmetry(data_proxy(self)).first;
     if (actual == DataType::Unmerged)
-      type = DataType::Unmerged;
+      self.type = DataType::Unmerged;
   }
-  switch_to_asu_indices();
+  self.switch_to_asu_indices();
+}
+
+template<typename Target>
+void import_xds_metadata(Target& self, const XdsAscii& xds) {
+  self.unit_cell.set_from_array(xds.cell_constants);
+  self.spacegroup = find_spacegroup_by_number(xds.spacegroup_number);
+  self.wavelength = xds.wavelength;
+  if (self.wavelength == 0) {
+    int n = 0;
+    for (const XdsAscii::Iset& iset : xds.isets)
+      if (iset.wavelength > 0) {
+        self.wavelength += iset.wavelength;
+        ++n;
+      }
+    if (n != 0)
+      self.wavelength /= n;
+  }
+  if (xds.is_merged())
+    self.type = (xds.friedels_law == 'F' ? DataType::Anomalous : DataType::Mean);
+  else
+    self.type = DataType::Unmerged;
+}
+
+template<typename Target>
+void add_xds_reflections(Target& self, const XdsAscii& xds,
+                         const std::vector<XdsAscii::Refl>& refls) {
+  // the same as self.type set in import_xds_metadata()
+  int8_t isign = (xds.is_merged() && xds.friedels_law == 'F' ? 1 : 0);
+  for (const XdsAscii::Refl& in : refls)
+    self.add_if_valid(in.hkl, isign, 0, in.iobs, in.sigma);
+}
+
+template<typename Target>
+void import_xds_(Target& self, const XdsAscii& xds) {
+  import_xds_metadata(self, xds);
+  reserve_rows(self, xds.data.size());
+  add_xds_reflections(self, xds, xds.data);
+  self.switch_to_asu_indices();
+}
+
+template<typename Target>
+void import_xds_file_(Target& self, const std::string& path, int nthreads) {
+  XdsAscii xds;
+  xds.read_input(MaybeGzipped(path), [&](std::vector<XdsAscii::Refl>& batch) {
+    add_xds_reflections(self, xds, batch);
+  }, nthreads);
+  import_xds_metadata(self, xds);
+  self.switch_to_asu_indices();
+}
+
+} // anonymous namespace
+
+// Takes average of parameters from batch headers Mtz::cell as the unit cell.
+// To use Mtz::cell instead, set it afterwards: intensities.unit_cell = mtz.cell
+void Intensities::import_unmerged_intensities_from_mtz(const Mtz& mtz) {
+  import_unmerged_from_mtz(*this, mtz);
+}
+
+void Intensities::import_mean_intensities_from_mtz(const Mtz& mtz) {
+  import_mean_from_mtz(*this, mtz);
+}
+
+void Intensities::import_anomalous_intensities_from_mtz(const Mtz& mtz, bool check_complete) {
+  import_anomalous_from_mtz(*this, mtz, check_complete);
+}
+
+void Intensities::import_mtz(const Mtz& mtz, DataType data_type) {
+  import_mtz_(*this, mtz, data_type);
+}
+
+void Intensities::import_unmerged_intensities_from_mmcif(const ReflnBlock& rb) {
+  import_unmerged_from_mmcif(*this, rb);
+}
+
+void Intensities::import_mean_intensities_from_mmcif(const ReflnBlock& rb) {
+  import_mean_from_mmcif(*this, rb);
+}
+
+void Intensities::import_anomalous_intensities_from_mmcif(const ReflnBlock& rb,
+                                                        bool check_complete) {
+  import_anomalous_from_mmcif(*this, rb, check_complete);
+}
+
+void Intensities::import_refln_block(const ReflnBlock& rb, DataType data_type) {
+  import_refln_block_(*this, rb, data_type);
 }
 
 void Intensities::import_f_squared_from_mmcif(const ReflnBlock& rb) {
@@ -501,28 +746,11 @@ void Intensities::import_f_squared_from_mmcif(const ReflnBlock& rb) {
 }
 
 void Intensities::import_xds(const XdsAscii& xds) {
-  unit_cell.set_from_array(xds.cell_constants);
-  spacegroup = find_spacegroup_by_number(xds.spacegroup_number);
-  wavelength = xds.wavelength;
-  if (wavelength == 0) {
-    int n = 0;
-    for (const XdsAscii::Iset& iset : xds.isets)
-      if (iset.wavelength > 0) {
-        wavelength += iset.wavelength;
-        ++n;
-      }
-    if (n != 0)
-      wavelength /= n;
-  }
-  data.reserve(xds.data.size());
-  if (xds.is_merged())
-    type = (xds.friedels_law == 'F' ? DataType::Anomalous : DataType::Mean);
-  else
-    type = DataType::Unmerged;
-  int8_t isign = (type == DataType::Anomalous ? 1 : 0);
-  for (const XdsAscii::Refl& in : xds.data)
-    add_if_valid(in.hkl, isign, 0, in.iobs, in.sigma);
-  switch_to_asu_indices();
+  import_xds_(*this, xds);
+}
+
+void Intensities::import_xds_file(const std::string& path, int nthreads) {
+  import_xds_file_(*this, path, nthreads);
 }
 
 std::string Intensities::take_staraniso_b_from_mtz(const Mtz& mtz) {
@@ -583,6 +811,201 @@ Mtz Intensities::prepare_merged_mtz(bool with_nobs) {
   return mtz;
 }
 
+void CompactIntensities::reserve(size_t n) {
+  key.reserve(n);
+  value.reserve(n);
+  sigma.reserve(n);
+  isym.reserve(n);
+  nobs.reserve(n);
+}
+
+void CompactIntensities::resize(size_t n) {
+  key.resize(n);
+  value.resize(n);
+  sigma.resize(n);
+  isym.resize(n);
+  nobs.resize(n);
+}
+
+void CompactIntensities::copy_from(const Intensities& intensities) {
+  resize(intensities.data.size());
+  for (size_t i = 0; i != intensities.data.size(); ++i) {
+    const Refl& r = intensities.data[i];
+    if (!key_fits(r.hkl))
+      fail("Miller index too large for CompactIntensities: ", r.hkl_label());
+    key[i] = make_key(r.hkl, r.isign);
+    value[i] = (float) r.value;
+    sigma[i] = (float) r.sigma;
+    isym[i] = r.isym;
+    nobs[i] = r.nobs;
+  }
+  spacegroup = intensities.spacegroup;
+  unit_cell = intensities.unit_cell;
+  std::copy(intensities.unit_cell_rmsd, intensities.unit_cell_rmsd + 6, unit_cell_rmsd);
+  wavelength = intensities.wavelength;
+  type = intensities.type;
+  isym_ops = intensities.isym_ops;
+}
+
+Intensities CompactIntensities::to_intensities() const {
+  Intensities intensities;
+  intensities.data.resize(size());
+  for (size_t i = 0; i != size(); ++i)
+    intensities.data[i] = {get_hkl(i), get_isign(i), isym[i], nobs[i], value[i], sigma[i]};
+  intensities.spacegroup = spacegroup;
+  intensities.unit_cell = unit_cell;
+  std::copy(unit_cell_rmsd, unit_cell_rmsd + 6, intensities.unit_cell_rmsd);
+  intensities.wavelength = wavelength;
+  intensities.type = type;
+  intensities.isym_ops = isym_ops;
+  return intensities;
+}
+
+std::array<double,2> CompactIntensities::resolution_range() const {
+  double min_1_d2 = INFINITY;
+  double max_1_d2 = 0;
+  for (uint64_t k : key) {
+    double a_1_d2 = unit_cell.calculate_1_d2(key_hkl(k));
+    min_1_d2 = std::min(min_1_d2, a_1_d2);
+    max_1_d2 = std::max(max_1_d2, a_1_d2);
+  }
+  return {{ 1 / std::sqrt(min_1_d2), 1 / std::sqrt(max_1_d2) }};
+}
+
+Correlation CompactIntensities::calculate_correlation(const CompactIntensities& other) const {
+  if (type == DataType::Unmerged)
+    fail("calculate_correlation() of CompactIntensities is for merged data");
+  if (!std::is_sorted(key.begin(), key.end()))
+    fail("calculate_correlation(): this data is not sorted, call sort() first");
+  if (!std::is_sorted(other.key.begin(), other.key.end()))
+    fail("calculate_correlation(): other data is not sorted, call sort() first");
+  Correlation corr;
+  size_t i1 = 0;
+  size_t i2 = 0;
+  while (i1 != size() && i2 != other.size()) {
+    if (key[i1] == other.key[i2])
+      corr.add_point(value[i1++], other.value[i2++]);
+    else if (key[i1] < other.key[i2])
+      ++i1;
+    else
+      ++i2;
+  }
+  return corr;
+}
+
+void CompactIntensities::sort(int nthreads) {
+  size_t n = size();
+  if (n < 2 || std::is_sorted(key.begin(), key.end()))
+    return;
+  std::vector<KeyIdx> keys(n);
+  parallel_for_chunks(n, 1 << 16, nthreads, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i != end; ++i)
+      keys[i] = {key[i], i};
+  });
+  parallel_sort_keys(keys, nthreads);
+  // permuting one column at a time limits the memory overhead
+  auto permute = [&](auto& column) {
+    typename std::remove_reference<decltype(column)>::type sorted(n);
+    parallel_for_chunks(n, 1 << 16, nthreads, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i != end; ++i)
+        sorted[i] = column[keys[i].second];
+    });
+    column.swap(sorted);
+  };
+  for (size_t i = 0; i != n; ++i)
+    key[i] = keys[i].first;
+  permute(value);
+  permute(sigma);
+  permute(isym);
+  permute(nobs);
+}
+
+DataType CompactIntensities::prepare_for_merging(DataType new_type, int nthreads) {
+  if (new_type == DataType::Mean || new_type == DataType::MergedMA ||
+      (spacegroup && spacegroup->is_centrosymmetric())) {
+    // discard signs so that merging produces Imean
+    for (uint64_t& k : key)
+      k = (k & ~uint64_t(3)) | 1;
+    new_type = DataType::Mean;
+  } else if (type == DataType::Unmerged) {
+    if (!spacegroup)
+      fail("unknown space group");
+    GroupOps gops = spacegroup->operations();
+    for (size_t i = 0; i != size(); ++i) {
+      int isign = isym[i] % 2 != 0 || gops.is_reflection_centric(get_hkl(i)) ? 1 : -1;
+      key[i] = (key[i] & ~uint64_t(3)) | uint64_t(isign + 1);
+    }
+    new_type = DataType::Anomalous;
+  }
+  sort(nthreads);
+  return new_type;
+}
+
+void CompactIntensities::merge_in_place(DataType new_type, int nthreads) {
+  if (empty() || new_type == type || type == DataType::Mean || new_type == DataType::Unmerged)
+    return;
+  type = prepare_for_merging(new_type, nthreads);
+  resize(merge_rows(CompactRows{this}, size(), nthreads));
+}
+
+std::vector<MergingStats>
+CompactIntensities::calculate_merging_stats(const Binner* binner, char use_weights,
+                                            int nthreads) const {
+  if (empty())
+    fail("no data");
+  if (type != DataType::Unmerged)
+    fail("merging statistics can be calculated only from unmerged data");
+  if (!std::is_sorted(key.begin(), key.end()))
+    fail("call sort() before calculating merging statistics");
+  // rows are only read
+  CompactRows rows{const_cast<CompactIntensities*>(this)};
+  return merging_stats(rows, size(), binner, use_weights, nthreads);
+}
+
+void CompactIntensities::switch_to_asu_indices() {
+  if (!spacegroup)
+    return;
+  GroupOps gops = spacegroup->operations();
+  if (isym_ops.empty())
+    isym_ops = gops.sym_ops;
+  ReciprocalAsu asu(spacegroup);
+  for (size_t i = 0; i != size(); ++i) {
+    Miller hkl = get_hkl(i);
+    if (asu.is_in(hkl)) {
+      if (isym[i] == 0)
+        isym[i] = 1;
+    } else {
+      assert(isym[i] == 0);
+      int isign = get_isign(i);
+      std::tie(hkl, isym[i]) = asu.to_asu(hkl, isym_ops);
+      if (type == DataType::Anomalous && isym[i] % 2 == 0) {
+        if (isign == 1 && gops.is_reflection_centric(hkl)) {
+          // leave it as 1
+        } else {
+          isign = -isign;
+        }
+      }
+      key[i] = make_key(hkl, isign);
+    }
+  }
+}
+
+void CompactIntensities::import_mtz(const Mtz& mtz, DataType data_type) {
+  import_mtz_(*this, mtz, data_type);
+}
+
+void CompactIntensities::import_refln_block(const ReflnBlock& rb, DataType data_type) {
+  import_refln_block_(*this, rb, data_type);
+}
+
+void CompactIntensities::import_xds(const XdsAscii& xds) {
+  import_xds_(*this, xds);
+}
+
+void CompactIntensities::import_xds_file(const std::string& path, int nthreads) {
+  import_xds_file_(*this, path, nthreads);
+}
+
 }  // namespace gemmi
 
 #if WITH_TEST
@@ -1,128 +1,359 @@
 // Copyright Global Phasing Ltd.
 
 #include <gemmi/json.hpp>
+#include <cstring>  // for memcmp
 #include <utility>  // for move
 
-#define SAJSON_UNSORTED_OBJECT_KEYS
-#define SAJSON_NUMBERS_AS_STRINGS
-#include "../third_party/sajson.h"
-
 namespace gemmi {
 namespace cif {
 using std::size_t;
 
-static std::string json_type_as_string(sajson::type t) {
-  switch (t) {
-    case sajson::TYPE_INTEGER: return "<integer>";
-    case sajson::TYPE_DOUBLE:  return "<double>";
-    case sajson::TYPE_NULL:    return "<null>";
-    case sajson::TYPE_FALSE:   return "<false>";
-    case sajson::TYPE_TRUE:    return "<true>";
-    case sajson::TYPE_STRING:  return "<string>";
-    case sajson::TYPE_ARRAY:   return "<array>";
-    case sajson::TYPE_OBJECT:  return "<object>";
-    default:           return "<unknown type>";
+namespace {
+
+// Single-pass, in-situ parser of mmJSON. Instead of building a DOM,
+// it converts JSON values to CIF strings as they are read and puts them
+// directly into the Document. Strings are unescaped in place.
+class MmJsonParser {
+public:
+  MmJsonParser(char* buffer, size_t size, const std::string& name)
+    : begin_(buffer), p_(buffer), end_(buffer + size), name_(name) {}
+
+  void parse(Document& doc) {
+    skip_ws();
+    if (p_ == end_ || *p_ != '{') {
+      if (p_ != end_ && (*p_ == '[' || *p_ == '"'))
+        fail("not mmJSON - the root is not of type object");
+      error("expected object");
+    }
+    ++p_;
+    if (!at_end_of('}')) {
+      do {
+        std::string block_name = parse_key();
+        if (!starts_with(block_name, "data_"))
+          fail("not mmJSON - top level key should start with data_\n"
+               "(if you use gemmi-cif2json to write JSON, use -m for mmJSON)");
+        doc.blocks.emplace_back(block_name.substr(5));
+        parse_block(doc.blocks.back().items);
+      } while (next_member('}'));
+    }
+    skip_ws();
+    if (p_ != end_)
+      error("unexpected text after the root object");
+  }
+
+private:
+  char* const begin_;
+  char* p_;
+  char* const end_;
+  const std::string& name_;
+  // buffers reused for each category
+  std::vector<std::string> tags_;
+  std::vector<std::vector<std::string>> columns_;
+
+  [[noreturn]] void error(const std::string& msg) const {
+    size_t line = 1;
+    for (const char* c = begin_; c < p_ && c < end_; ++c)
+      if (*c == '\n')
+        ++line;
+    fail(name_ + ":", std::to_string(line), " error: ", msg);
+  }
+
+  void skip_ws() {
+    while (p_ != end_ && (*p_ == ' ' || *p_ == '\n' || *p_ == '\r' || *p_ == '\t'))
+      ++p_;
+  }
+
+  void expect(char c) {
+    skip_ws();
+    if (p_ == end_ || *p_ != c)
+      error(std::string("expected '") + c + "'");
+    ++p_;
   }
-}
 
-static std::string as_cif_value(const sajson::value& val) {
-  switch (val.get_type()) {
-    case sajson::TYPE_DOUBLE:
-      return val.as_string();
-    case sajson::TYPE_NULL:
-      return "?";
-    // mmJSON files from PDBj (this format has no spec) have special support
-    // for boolean YES|NO, which is used only in category _em_specimen.
-    // IMO it's a bad idea, but we must handle it if we want to read mmJSON.
-    case sajson::TYPE_FALSE:
-      return "NO";  // "." in CIF-JSON
-    case sajson::TYPE_TRUE:
-      return "YES";
-    case sajson::TYPE_STRING:
-      return quote(val.as_string());
-    // Another undocumented feature of mmJSON: arrays as values.
-    // It seems that obscure types int-range and float-range are converted to
-    // 2-element arrays. But not only. link_entity_pdbjplus.db_accession has
-    // arrays with strings.
-    case sajson::TYPE_ARRAY: {
-      std::string s;
-      for (size_t i = 0; i < val.get_length(); ++i) {
-        if (i != 0)
-          s += ' ';
-        s += val.get_array_element(0).as_string();
+  // Called after '{' or '['. Returns true if the object/array is empty.
+  bool at_end_of(char close) {
+    skip_ws();
+    if (p_ != end_ && *p_ == close) {
+      ++p_;
+      return true;
+    }
+    return false;
+  }
+
+  // Called after a member or element. Returns true if another one follows.
+  bool next_member(char close) {
+    skip_ws();
+    if (p_ != end_) {
+      if (*p_ == ',') {
+        ++p_;
+        return true;
+      }
+      if (*p_ == close) {
+        ++p_;
+        return false;
       }
-      return quote(s);
     }
-    default:
-      fail("Unexpected ", json_type_as_string(val.get_type()), " as value in JSON.");
-      return "";
+    error(close == '}' ? "expected ',' or '}'" : "expected ',' or ']'");
+  }
+
+  std::string parse_key() {
+    skip_ws();
+    if (p_ == end_ || *p_ != '"')
+      error("expected string as object key");
+    std::pair<char*, char*> s = parse_string();
+    expect(':');
+    return std::string(s.first, s.second);
+  }
+
+  static void append_utf8(char*& out, unsigned cp) {
+    if (cp < 0x80) {
+      *out++ = (char) cp;
+    } else if (cp < 0x800) {
+      *out++ = (char) (0xC0 | (cp >> 6));
+      *out++ = (char) (0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+      *out++ = (char) (0xE0 | (cp >> 12));
+      *out++ = (char) (0x80 | ((cp >> 6) & 0x3F));
+      *out++ = (char) (0x80 | (cp & 0x3F));
+    } else {
+      *out++ = (char) (0xF0 | (cp >> 18));
+      *out++ = (char) (0x80 | ((cp >> 12) & 0x3F));
+      *out++ = (char) (0x80 | ((cp >> 6) & 0x3F));
+      *out++ = (char) (0x80 | (cp & 0x3F));
+    }
+  }
+
+  unsigned parse_hex4() {
+    if (end_ - p_ < 4)
+      error("unexpected end of input");
+    unsigned cp = 0;
+    for (int i = 0; i < 4; ++i, ++p_) {
+      char c = *p_;
+      cp <<= 4;
+      if (c >= '0' && c <= '9')
+        cp |= c - '0';
+      else if (c >= 'a' && c <= 'f')
+        cp |= c - 'a' + 10;
+      else if (c >= 'A' && c <= 'F')
+        cp |= c - 'A' + 10;
+      else
+        error("invalid \\u escape");
+    }
+    return cp;
   }
-}
 
-static void fill_document_from_sajson(Document& d, const sajson::document& s) {
-  // assuming mmJSON here, we'll add handling of CIF-JSON later on
-  sajson::value root = s.get_root();
-  if (root.get_type() != sajson::TYPE_OBJECT)
-    fail("not mmJSON - the root is not of type object");
-  for (size_t block_index = 0; block_index < root.get_length(); ++block_index) {
-    std::string block_name = root.get_object_key(block_index).as_string();
-    if (!starts_with(block_name, "data_"))
-      fail("not mmJSON - top level key should start with data_\n"
-           "(if you use gemmi-cif2json to write JSON, use -m for mmJSON)");
-    d.blocks.emplace_back(block_name.substr(5));
-    std::vector<Item>& items = d.blocks[block_index].items;
-    sajson::value top = root.get_object_value(block_index);
-    if (top.get_type() != sajson::TYPE_OBJECT)
-      fail("");
-    for (size_t i = 0; i != top.get_length(); ++i) {
-      std::string category_name = "_" + top.get_object_key(i).as_string() + ".";
-      sajson::value category = top.get_object_value(i);
-      if (category.get_type() != sajson::TYPE_OBJECT ||
-          category.get_length() == 0 ||
-          category.get_object_value(0).get_type() != sajson::TYPE_ARRAY)
-        fail("");
-      size_t cif_cols = category.get_length();
-      size_t cif_rows = category.get_object_value(0).get_length();
-      if (cif_rows > 1) {
-        items.emplace_back(LoopArg{});
-        Loop& loop = items.back().loop;
-        loop.tags.reserve(cif_cols);
-        loop.values.resize(cif_cols * cif_rows);
+  // p_ points to the opening quote. Returns the unescaped string
+  // (written in place, in the buffer).
+  std::pair<char*, char*> parse_string() {
+    char* start = ++p_;
+    // fast path: no escapes
+    while (p_ != end_ && *p_ != '"' && *p_ != '\\' && (unsigned char) *p_ >= 0x20)
+      ++p_;
+    char* out = p_;
+    while (p_ != end_) {
+      unsigned char c = *p_;
+      if (c == '"') {
+        ++p_;
+        return {start, out};
       }
-      for (size_t j = 0; j != cif_cols; ++j) {
-        std::string tag = category_name + category.get_object_key(j).as_string();
-        sajson::value arr = category.get_object_value(j);
-        if (arr.get_type() != sajson::TYPE_ARRAY)
-          fail("Expected array, got " + json_type_as_string(arr.get_type()));
-        if (arr.get_length() != cif_rows)
-          fail("Expected array of length ", std::to_string(cif_rows), " not ",
-               std::to_string(arr.get_length()));
-        if (cif_rows == 1) {
-          items.emplace_back(tag, as_cif_value(arr.get_array_element(0)));
-        } else if (cif_rows != 0) {
-          Loop& loop = items.back().loop;
-          loop.tags.emplace_back(std::move(tag));
-          for (size_t k = 0; k != cif_rows; ++k)
-            loop.values[j + k*cif_cols] = as_cif_value(arr.get_array_element(k));
+      if (c < 0x20)
+        error("illegal unprintable codepoint in string");
+      if (c != '\\') {
+        *out++ = *p_++;
+        continue;
+      }
+      if (++p_ == end_)
+        break;
+      switch (*p_++) {
+        case '"': *out++ = '"'; break;
+        case '\\': *out++ = '\\'; break;
+        case '/': *out++ = '/'; break;
+        case 'b': *out++ = '\b'; break;
+        case 'f': *out++ = '\f'; break;
+        case 'n': *out++ = '\n'; break;
+        case 'r': *out++ = '\r'; break;
+        case 't': *out++ = '\t'; break;
+        case 'u': {
+          unsigned cp = parse_hex4();
+          if (cp >= 0xD800 && cp < 0xDC00) {
+            if (end_ - p_ < 2 || p_[0] != '\\' || p_[1] != 'u')
+              error("unpaired surrogate in \\u escape");
+            p_ += 2;
+            unsigned low = parse_hex4();
+            if (low < 0xDC00 || low >= 0xE000)
+              error("invalid surrogate pair in \\u escape");
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+          }
+          append_utf8(out, cp);
+          break;
         }
+        default:
+          error("unknown escape");
       }
     }
+    error("unterminated string");
   }
-}
+
+  // p_ points to '-' or a digit. Returns the number as written in JSON.
+  std::string parse_number() {
+    char* start = p_;
+    auto digits = [&]() {
+      const char* d = p_;
+      while (p_ != end_ && *p_ >= '0' && *p_ <= '9')
+        ++p_;
+      if (p_ == d)
+        error("invalid number");
+    };
+    if (*p_ == '-')
+      ++p_;
+    if (p_ != end_ && *p_ == '0')
+      ++p_;
+    else
+      digits();
+    if (p_ != end_ && *p_ == '.') {
+      ++p_;
+      digits();
+    }
+    if (p_ != end_ && (*p_ == 'e' || *p_ == 'E')) {
+      ++p_;
+      if (p_ != end_ && (*p_ == '+' || *p_ == '-'))
+        ++p_;
+      digits();
+    }
+    return std::string(start, p_);
+  }
+
+  bool parse_literal(const char* word, size_t len) {
+    if ((size_t)(end_ - p_) < len || std::memcmp(p_, word, len) != 0)
+      error("expected value");
+    p_ += len;
+    return true;
+  }
+
+  // Value of a CIF item. mmJSON files from PDBj (this format has no spec)
+  // have special support for boolean YES|NO, which is used only in category
+  // _em_specimen, and (in a few categories) arrays as values.
+  std::string parse_value() {
+    skip_ws();
+    if (p_ == end_)
+      error("unexpected end of input");
+    switch (*p_) {
+      case '"': {
+        std::pair<char*, char*> s = parse_string();
+        return quote(std::string(s.first, s.second));
+      }
+      case 'n':
+        parse_literal("null", 4);
+        return "?";
+      case 'f':
+        parse_literal("false", 5);
+        return "NO";  // "." in CIF-JSON
+      case 't':
+        parse_literal("true", 4);
+        return "YES";
+      case '[': {
+        // It seems that obscure types int-range and float-range are converted
+        // to 2-element arrays. But not only. link_entity_pdbjplus.db_accession
+        // has arrays with strings.
+        ++p_;
+        std::string s;
+        if (!at_end_of(']')) {
+          do {
+            skip_ws();
+            if (!s.empty())
+              s += ' ';
+            if (p_ != end_ && *p_ == '"') {
+              std::pair<char*, char*> str = parse_string();
+              s.append(str.first, str.second);
+            } else if (p_ != end_ && (*p_ == '-' || (*p_ >= '0' && *p_ <= '9'))) {
+              s += parse_number();
+            } else {
+              error("expected string or number in array value");
+            }
+          } while (next_member(']'));
+        }
+        return quote(s);
+      }
+      case '{':
+        fail("Unexpected <object> as value in JSON.");
+      default:
+        if (*p_ == '-' || (*p_ >= '0' && *p_ <= '9'))
+          return parse_number();
+        error("expected value");
+    }
+  }
+
+  void parse_block(std::vector<Item>& items) {
+    skip_ws();
+    if (p_ == end_ || *p_ != '{')
+      error("expected object with categories");
+    ++p_;
+    if (at_end_of('}'))
+      return;
+    do {
+      std::string category_name = "_" + parse_key() + ".";
+      parse_category(category_name, items);
+    } while (next_member('}'));
+  }
+
+  void parse_category(const std::string& category_name, std::vector<Item>& items) {
+    skip_ws();
+    if (p_ == end_ || *p_ != '{')
+      error("expected object with tags");
+    ++p_;
+    if (at_end_of('}'))
+      error("empty category");
+    size_t ncol = 0;
+    do {
+      std::string tag = category_name + parse_key();
+      skip_ws();
+      if (p_ == end_ || *p_ != '[')
+        error("expected array of values");
+      ++p_;
+      if (ncol == tags_.size()) {
+        tags_.emplace_back();
+        columns_.emplace_back();
+      }
+      tags_[ncol] = std::move(tag);
+      std::vector<std::string>& column = columns_[ncol];
+      column.clear();
+      if (ncol != 0)
+        column.reserve(columns_[0].size());
+      if (!at_end_of(']')) {
+        do
+          column.push_back(parse_value());
+        while (next_member(']'));
+      }
+      if (ncol != 0 && column.size() != columns_[0].size())
+        fail("Expected array of length ", std::to_string(columns_[0].size()),
+             " not ", std::to_string(column.size()));
+      ++ncol;
+    } while (next_member('}'));
+
+    size_t nrow = columns_[0].size();
+    if (nrow == 1) {
+      for (size_t j = 0; j != ncol; ++j)
+        items.emplace_back(tags_[j], std::move(columns_[j][0]));
+    } else if (nrow > 1) {
+      items.emplace_back(LoopArg{});
+      Loop& loop = items.back().loop;
+      loop.tags.assign(tags_.begin(), tags_.begin() + ncol);
+      loop.values.reserve(ncol * nrow);
+      for (size_t k = 0; k != nrow; ++k)
+        for (size_t j = 0; j != ncol; ++j)
+          loop.values.push_back(std::move(columns_[j][k]));
+    }
+  }
+};
+
+} // anonymous namespace
 
 Document read_mmjson_insitu(char* buffer, size_t size, const std::string& name) {
   Document doc;
-  sajson::document json = sajson::parse(sajson::dynamic_allocation(),
-                                    sajson::mutable_string_view(size, buffer));
-  if (!json.is_valid())
-    fail(name + ":", std::to_string(json.get_error_line()), " error: ",
-         json.get_error_message_as_string());
-  fill_document_from_sajson(doc, json);
+  MmJsonParser(buffer, size, name).parse(doc);
   doc.source = name;
   return doc;
 }
 
-
-
 } // namespace cif
 } // namespace gemmi
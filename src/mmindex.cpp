@@ -0,0 +1,314 @@
+// Copyright 2026 Global Phasing Ltd.
+
+#include <gemmi/mmindex.hpp>
+#include <cstdint>             // for int64_t
+#include <cstdio>              // for FILE, fseek, fread
+#include <cstdlib>             // for strtoull
+#include <cstring>             // for memchr, memcpy
+#include <algorithm>           // for min
+#include <unordered_set>
+#include <gemmi/cif.hpp>       // for cif::rules, cif::pegtl
+#include <gemmi/fileutil.hpp>  // for file_open, file_size, CharArray
+#include <gemmi/gz.hpp>        // for MaybeGzipped
+#include <gemmi/mmcif.hpp>     // for make_structure
+#include <gemmi/mmread.hpp>    // for coor_format_from_ext, coor_format_from_content
+#include <gemmi/numb.hpp>      // for as_int
+#include <gemmi/pdb.hpp>       // for read_pdb_from_memory, is_record_type4
+#include <gemmi/read_cif.hpp>  // for read_cif_from_memory
+
+namespace gemmi {
+
+namespace {
+
+void index_pdb(const char* data, size_t size, ModelFileIndex& index) {
+  const char* end = data + size;
+  size_t stop = size;
+  bool in_model = false;
+  for (const char* line = data; line < end; ) {
+    const char* eol = (const char*) std::memchr(line, '\n', end - line);
+    const char* next = eol ? eol + 1 : end;
+    size_t len = next - line;
+    // copy the start of the line to avoid reading past the end of data
+    char rec[16] = {0};
+    std::memcpy(rec, line, std::min(len, sizeof(rec) - 1));
+    size_t offset = line - data;
+    if (is_record_type4(rec, "MODEL")) {
+      if (in_model)
+        index.models.back().range.end = offset;
+      int num = string_to_int(rec + 6, false, 8);
+      index.models.push_back({num, {offset, 0}});
+      in_model = true;
+    } else if (is_record_type4(rec, "ENDMDL")) {
+      if (in_model)
+        index.models.back().range.end = next - data;
+      in_model = false;
+    } else if (is_record_type3(rec, "END")) {
+      stop = offset;
+      break;
+    }
+    line = next;
+  }
+  if (in_model)
+    index.models.back().range.end = stop;
+  if (index.models.empty()) {
+    // no MODEL records - the whole file is model 1
+    index.models.push_back({1, {0, size}});
+    index.head = index.tail = {0, 0};
+  } else {
+    index.head = {0, index.models[0].range.begin};
+    index.tail = {index.models.back().range.end, size};
+  }
+}
+
+// PEGTL actions that find byte ranges of models in the first _atom_site loop
+struct CifIndexState {
+  CifIndexState(const char* data_, const std::string& name_, ModelFileIndex& index_)
+    : data(data_), name(name_), index(index_) {}
+  const char* data;
+  const std::string& name;
+  ModelFileIndex& index;
+  int nblocks = 0;
+  bool atom_site = false;
+  int width = 0;
+  int model_column = -1;
+  int column = 0;
+  size_t row_start = 0;
+  size_t values_begin = (size_t)-1;
+  size_t values_end = 0;
+  std::string model_num;
+  std::unordered_set<std::string> seen;
+};
+
+template<typename Rule> struct CifIndexAction : cif::pegtl::nothing<Rule> {};
+
+template<> struct CifIndexAction<cif::rules::datablockname> {
+  template<typename Input> static void apply(const Input&, CifIndexState& s) {
+    // like make_structure(), use only the first block
+    if (++s.nblocks > 1)
+      throw true;
+  }
+};
+template<> struct CifIndexAction<cif::rules::str_loop> {
+  template<typename Input> static void apply(const Input&, CifIndexState& s) {
+    s.width = 0;
+    s.model_column = -1;
+  }
+};
+template<> struct CifIndexAction<cif::rules::loop_tag> {
+  template<typename Input> static void apply(const Input& in, CifIndexState& s) {
+    std::string tag = in.string();
+    if (s.width == 0)
+      s.atom_site = istarts_with(tag, "_atom_site.");
+    if (s.atom_site && iequal(tag, "_atom_site.pdbx_pdb_model_num"))
+      s.model_column = s.width;
+    s.width++;
+  }
+};
+template<> struct CifIndexAction<cif::rules::loop_value> {
+  template<typename Input> static void apply(const Input& in, CifIndexState& s) {
+    if (!s.atom_site)
+      return;
+    size_t offset = in.begin() - s.data;
+    std::vector<ModelFileIndex::Entry>& models = s.index.models;
+    if (s.column == 0) {
+      s.row_start = offset;
+      if (s.values_begin == (size_t)-1) {
+        s.values_begin = offset;
+        if (s.model_column == -1)
+          models.push_back({1, {offset, 0}});
+      }
+    }
+    if (s.column == s.model_column && (models.empty() || in.string() != s.model_num)) {
+      s.model_num = in.string();
+      if (!s.seen.insert(s.model_num).second)
+        fail(s.name + ": rows of model ", s.model_num, " in _atom_site are not contiguous");
+      if (!models.empty())
+        models.back().range.end = s.row_start;
+      models.push_back({cif::as_int(s.model_num, 0), {s.row_start, 0}});
+    }
+    s.values_end = offset + in.size();
+    if (++s.column == s.width)
+      s.column = 0;
+  }
+};
+template<> struct CifIndexAction<cif::rules::loop_end> {
+  template<typename Input> static void apply(const Input&, CifIndexState& s) {
+    if (s.atom_site) {
+      if (s.column != 0)
+        fail(s.name + ": wrong number of values in loop _atom_site.*");
+      throw true;
+    }
+  }
+};
+
+void index_mmcif(const char* data, size_t size, const std::string& name,
+                 ModelFileIndex& index) {
+  CifIndexState state(data, name, index);
+  cif::pegtl::memory_input<> in(data, size, name);
+  try {
+    cif::pegtl::parse<cif::rules::file, CifIndexAction, cif::Errors>(in, state);
+  } catch (bool) {}
+  if (state.values_begin == (size_t)-1)
+    fail(name + ": _atom_site loop not found");
+  index.models.back().range.end = state.values_end;
+  index.head = {0, state.values_begin};
+  index.tail = {state.values_end, size};
+}
+
+// fseek() to an absolute position, for offsets above 2GB also on Windows
+int fseek_set(std::FILE* f, size_t offset) {
+#if defined(_MSC_VER)
+  return _fseeki64(f, (std::int64_t)offset, SEEK_SET);
+#elif defined(__MINGW32__)
+  return fseeko64(f, (off64_t)offset, SEEK_SET);
+#else
+  return std::fseek(f, (long)offset, SEEK_SET);
+#endif
+}
+
+} // anonymous namespace
+
+ModelFileIndex make_model_file_index(const char* data, size_t size,
+                                     const std::string& name, CoorFormat format) {
+  if (format == CoorFormat::Unknown)
+    format = coor_format_from_content(data, data + size);
+  ModelFileIndex index;
+  index.format = format;
+  index.file_size = size;
+  if (format == CoorFormat::Pdb)
+    index_pdb(data, size, index);
+  else if (format == CoorFormat::Mmcif)
+    index_mmcif(data, size, name, index);
+  else
+    fail(name + ": model index can be made only for PDB and mmCIF files");
+  return index;
+}
+
+ModelFileIndex make_model_file_index(const std::string& path) {
+  MaybeGzipped input(path);
+  CharArray mem = read_into_buffer(input);
+  CoorFormat format = coor_format_from_ext(input.basepath());
+  if (format == CoorFormat::Mmjson)
+    format = CoorFormat::Unknown;  // fails below with a clear message
+  return make_model_file_index(mem.data(), mem.size(), path, format);
+}
+
+void write_model_file_index(const ModelFileIndex& index, const std::string& path) {
+  std::string out = "# gemmi model index\nformat ";
+  out += index.format == CoorFormat::Pdb ? "pdb" : "mmcif";
+  auto add_range = [&out](const ModelFileIndex::Range& r) {
+    out += ' ';
+    out += std::to_string(r.begin);
+    out += ' ';
+    out += std::to_string(r.end);
+    out += '\n';
+  };
+  out += "\nfile_size ";
+  out += std::to_string(index.file_size);
+  out += "\nhead";
+  add_range(index.head);
+  out += "tail";
+  add_range(index.tail);
+  for (const ModelFileIndex::Entry& e : index.models) {
+    out += "model ";
+    out += std::to_string(e.num);
+    add_range(e.range);
+  }
+  fileptr_t f = file_open(path.c_str(), "wb");
+  if (std::fwrite(out.data(), out.size(), 1, f.get()) != 1)
+    sys_fail("Failed to write " + path);
+}
+
+ModelFileIndex read_model_file_index(const std::string& path) {
+  CharArray mem = read_file_into_buffer(path);
+  const char* end = mem.data() + mem.size();
+  ModelFileIndex index;
+  auto read_size = [&](const char*& p) {
+    char* endptr;
+    size_t n = std::strtoull(p, &endptr, 10);
+    if (endptr == p)
+      fail(path + ": expected number");
+    p = endptr;
+    return n;
+  };
+  for (const char* line = mem.data(); line < end; ) {
+    const char* eol = (const char*) std::memchr(line, '\n', end - line);
+    if (!eol)
+      fail(path + ": missing newline at the end");
+    std::string key(line, std::find(line, eol, ' '));
+    const char* p = line + key.size();
+    if (key.empty() || key[0] == '#') {
+      // comment
+    } else if (key == "format") {
+      std::string value = trim_str(std::string(p, eol));
+      if (value == "pdb")
+        index.format = CoorFormat::Pdb;
+      else if (value == "mmcif")
+        index.format = CoorFormat::Mmcif;
+      else
+        fail(path + ": unknown format: ", value);
+    } else if (key == "file_size") {
+      index.file_size = read_size(p);
+    } else if (key == "head" || key == "tail") {
+      ModelFileIndex::Range& r = key == "head" ? index.head : index.tail;
+      r.begin = read_size(p);
+      r.end = read_size(p);
+    } else if (key == "model") {
+      char* endptr;
+      int num = (int) std::strtol(p, &endptr, 10);
+      if (endptr == p)
+        fail(path + ": expected model number");
+      p = endptr;
+      size_t begin = read_size(p);
+      size_t end_ = read_size(p);
+      index.models.push_back({num, {begin, end_}});
+    } else {
+      fail(path + ": unexpected line: ", key);
+    }
+    line = eol + 1;
+  }
+  if (index.format == CoorFormat::Unknown || index.models.empty())
+    fail(path + ": not a model index");
+  return index;
+}
+
+Structure read_model(const std::string& path, const ModelFileIndex& index,
+                     int model_num) {
+  const ModelFileIndex::Entry* entry = index.find(model_num);
+  if (!entry)
+    fail(path + ": model ", std::to_string(model_num), " not in the index");
+  const ModelFileIndex::Range ranges[3] = {index.head, entry->range, index.tail};
+  for (const ModelFileIndex::Range& r : ranges)
+    if (r.begin > r.end || r.end > index.file_size)
+      fail(path + ": invalid range in the model index");
+  std::string text;
+  text.reserve(ranges[0].size() + ranges[1].size() + ranges[2].size());
+  auto check_size = [&](size_t size) {
+    if (size != index.file_size)
+      fail(path + ": file size differs from the index (file modified?)");
+  };
+  MaybeGzipped input(path);
+  if (input.is_compressed()) {
+    CharArray mem = input.uncompress_into_buffer();
+    check_size(mem.size());
+    for (const ModelFileIndex::Range& r : ranges)
+      text.append(mem.data() + r.begin, r.size());
+  } else {
+    fileptr_t f = file_open(path.c_str(), "rb");
+    check_size(file_size(f.get(), path));
+    for (const ModelFileIndex::Range& r : ranges) {
+      if (r.size() == 0)
+        continue;
+      size_t pos = text.size();
+      text.resize(pos + r.size());
+      if (fseek_set(f.get(), r.begin) != 0 ||
+          std::fread(&text[pos], r.size(), 1, f.get()) != 1)
+        sys_fail(path + ": failed to read model " + std::to_string(model_num));
+    }
+  }
+  if (index.format == CoorFormat::Pdb)
+    return read_pdb_from_memory(text.data(), text.size(), path);
+  return make_structure(read_cif_from_memory(text.data(), text.size(), path.c_str()));
+}
+
+} // namespace gemmi
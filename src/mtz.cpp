@@ -1,11 +1,13 @@
 // Copyright 2019-2023 Global Phasing Ltd.
 
 #include <gemmi/mtz.hpp>
+#include <cmath>              // for trunc
 #include <cstring>            // for memcpy
 #include <algorithm>          // for stable_sort
 #include <gemmi/atof.hpp>     // for fast_atof
 #include <gemmi/atox.hpp>     // for simple_atoi, read_word
 #include <gemmi/gz.hpp>
+#include <gemmi/parallel.hpp> // for parallel_for_chunks, parallel_sort_keys
 #include <gemmi/sprintf.hpp>
 
 namespace gemmi {
@@ -426,13 +428,13 @@ size_t Mtz::find_offset_of_hkl(const Miller& hkl, size_t start) const {
   return (size_t)-1;
 }
 
-void Mtz::ensure_asu(bool tnt_asu) {
+void Mtz::ensure_asu(bool tnt_asu, int nthreads) {
   if (!is_merged())
     fail("Mtz::ensure_asu() is for merged MTZ only");
   if (!spacegroup)
     return;
   GroupOps gops = spacegroup->operations();
-  ReciprocalAsu asu(spacegroup, tnt_asu);
+  UnmergedHklMover hkl_mover(spacegroup, tnt_asu);
   std::vector<int> phase_columns = positions_of_columns_with_type('P');
   std::vector<int> abcd_columns = positions_of_columns_with_type('A');
   std::vector<int> dano_columns = positions_of_columns_with_type('D');
@@ -440,45 +442,48 @@ void Mtz::ensure_asu(bool tnt_asu) {
   bool no_special_columns = phase_columns.empty() && abcd_columns.empty() &&
                             plus_minus_columns.empty() && dano_columns.empty();
   bool centric = no_special_columns || gops.is_centrosymmetric();
-  for (size_t n = 0; n < data.size(); n += columns.size()) {
-    Miller hkl = get_hkl(n);
-    if (asu.is_in(hkl))
-      continue;
-    auto result = asu.to_asu(hkl, gops);
-    // cf. impl::move_to_asu() in asudata.hpp
-    set_hkl(n, result.first);
-    if (no_special_columns)
-      continue;
-    int isym = result.second;
-    if (!phase_columns.empty() || !abcd_columns.empty()) {
-      const Op& op = gops.sym_ops[(isym - 1) / 2];
-      double shift = op.phase_shift(hkl);
-      bool negate = (isym % 2 == 0);
-      for (int col : phase_columns)
-        shift_phase(data[n + col], shift, negate);
-      for (auto i = abcd_columns.begin(); i+3 < abcd_columns.end(); i += 4)
-        // we expect coefficients HLA, HLB, HLC and HLD - in this order
-        shift_hl_coefficients(data[n + *(i+0)], data[n + *(i+1)],
-                              data[n + *(i+2)], data[n + *(i+3)],
-                              shift, negate);
-    }
-    if (isym % 2 == 0 && !centric &&
-        // usually, centric reflections have empty F(-), so avoid swapping it
-        !gops.is_reflection_centric(hkl)) {
-      for (std::pair<int,int> cols : plus_minus_columns)
-        std::swap(data[n + cols.first], data[n + cols.second]);
-      for (int col : dano_columns)
-        data[n + col] = -data[n + col];
+  size_t w = columns.size();
+  parallel_for_chunks(data.size() / w, 1 << 14, nthreads, [&](size_t begin, size_t end) {
+    for (size_t n = begin * w; n < end * w; n += w) {
+      Miller hkl = get_hkl(n);
+      Miller asu_hkl = hkl;
+      int isym = hkl_mover.move_to_asu(asu_hkl);
+      if (isym == 1)  // identity - already in ASU
+        continue;
+      // cf. impl::move_to_asu() in asudata.hpp
+      set_hkl(n, asu_hkl);
+      if (no_special_columns)
+        continue;
+      if (!phase_columns.empty() || !abcd_columns.empty()) {
+        const Op& op = gops.sym_ops[(isym - 1) / 2];
+        double shift = op.phase_shift(hkl);
+        bool negate = (isym % 2 == 0);
+        for (int col : phase_columns)
+          shift_phase(data[n + col], shift, negate);
+        for (auto i = abcd_columns.begin(); i+3 < abcd_columns.end(); i += 4)
+          // we expect coefficients HLA, HLB, HLC and HLD - in this order
+          shift_hl_coefficients(data[n + *(i+0)], data[n + *(i+1)],
+                                data[n + *(i+2)], data[n + *(i+3)],
+                                shift, negate);
+      }
+      if (isym % 2 == 0 && !centric &&
+          // usually, centric reflections have empty F(-), so avoid swapping it
+          !gops.is_reflection_centric(hkl)) {
+        for (std::pair<int,int> cols : plus_minus_columns)
+          std::swap(data[n + cols.first], data[n + cols.second]);
+        for (int col : dano_columns)
+          data[n + col] = -data[n + col];
+      }
     }
-  }
+  });
 }
 
-void Mtz::reindex(const Op& op) {
+void Mtz::reindex(const Op& op, int nthreads) {
   if (op.tran != Op::Tran{0, 0, 0})
     gemmi::fail("reindexing operator must not have a translation");
   if (op.det_rot() < 0)
     gemmi::fail("reindexing operator must preserve the hand of the axes");
-  switch_to_original_hkl();  // changes hkl for unmerged data only
+  switch_to_original_hkl(nthreads);  // changes hkl for unmerged data only
   Op xyz_op = op.as_xyz();
   logger.mesg("Real space transformation: ", op.as_xyz().triplet());
   bool row_removal = false;
@@ -503,7 +508,7 @@ void Mtz::reindex(const Op& op) {
     logger.mesg("Reflections removed (because of fractional indices): ", n_before - nreflections);
   }
 
-  switch_to_asu_hkl();  // revert switch_to_original_hkl() for unmerged data
+  switch_to_asu_hkl(nthreads);  // revert switch_to_original_hkl() for unmerged data
 
   // change space group
   if (spacegroup) {
@@ -571,7 +576,7 @@ void Mtz::expand_to_p1() {
   set_spacegroup(&get_spacegroup_p1());
 }
 
-bool Mtz::switch_to_original_hkl() {
+bool Mtz::switch_to_original_hkl(int nthreads) {
   if (indices_switched_to_original)
     return false;
   if (!has_data())
@@ -589,19 +594,23 @@ bool Mtz::switch_to_original_hkl() {
   inv_symops.reserve(symops.size());
   for (const Op& op : symops)
     inv_symops.push_back(op.inverse());
-  for (size_t n = 0; n + col->idx < data.size(); n += columns.size()) {
-    int isym = static_cast<int>(data[n + col->idx]) & 0xFF;
-    const Op& op = inv_symops.at((isym - 1) / 2);
-    Miller hkl = op.apply_to_hkl(get_hkl(n));
-    int sign = (isym & 1) ? 1 : -1;
-    for (int i = 0; i < 3; ++i)
-      data[n+i] = static_cast<float>(sign * hkl[i]);
-  }
+  size_t w = columns.size();
+  size_t misym_idx = col->idx;
+  parallel_for_chunks(data.size() / w, 1 << 14, nthreads, [&](size_t begin, size_t end) {
+    for (size_t n = begin * w; n < end * w; n += w) {
+      int isym = static_cast<int>(data[n + misym_idx]) & 0xFF;
+      const Op& op = inv_symops.at((isym - 1) / 2);
+      Miller hkl = op.apply_to_hkl(get_hkl(n));
+      int sign = (isym & 1) ? 1 : -1;
+      for (int i = 0; i < 3; ++i)
+        data[n+i] = static_cast<float>(sign * hkl[i]);
+    }
+  });
   indices_switched_to_original = true;
   return true;
 }
 
-bool Mtz::switch_to_asu_hkl() {
+bool Mtz::switch_to_asu_hkl(int nthreads) {
   if (!indices_switched_to_original)
     return false;
   if (!has_data())
@@ -611,13 +620,16 @@ bool Mtz::switch_to_asu_hkl() {
     return false;
   size_t misym_idx = col->idx;
   UnmergedHklMover hkl_mover(spacegroup);
-  for (size_t n = 0; n + col->idx < data.size(); n += columns.size()) {
-    Miller hkl = get_hkl(n);
-    int isym = hkl_mover.move_to_asu(hkl);  // modifies hkl
-    set_hkl(n, hkl);
-    float& misym = data[n + misym_idx];
-    misym = float(((int)misym & ~0xff) | isym);
-  }
+  size_t w = columns.size();
+  parallel_for_chunks(data.size() / w, 1 << 14, nthreads, [&](size_t begin, size_t end) {
+    for (size_t n = begin * w; n < end * w; n += w) {
+      Miller hkl = get_hkl(n);
+      int isym = hkl_mover.move_to_asu(hkl);  // modifies hkl
+      set_hkl(n, hkl);
+      float& misym = data[n + misym_idx];
+      misym = float(((int)misym & ~0xff) | isym);
+    }
+  });
   indices_switched_to_original = false;
   return true;
 }
@@ -631,12 +643,88 @@ void Mtz::read_file_gz(const std::string& path, bool with_data) {
   }
 }
 
-std::vector<int> Mtz::sorted_row_indices(int use_first) const {
+namespace {
+
+// If the first ncol values in each row are integers (as in H, K, L, M/ISYM
+// and BATCH columns) and their ranges fit together into 64 bits, packs them
+// into keys that sort in the same order as rows compared column by column.
+bool pack_row_keys(const Mtz& mtz, int ncol, int nthreads,
+                   std::vector<std::pair<std::uint64_t, size_t>>& keys) {
+  const size_t w = mtz.columns.size();
+  const size_t n = mtz.nreflections;
+  if (n < 2)
+    return false;
+  const size_t chunk_size = 1 << 16;
+  const size_t n_chunks = (n + chunk_size - 1) / chunk_size;
+  // min and max for each chunk and column
+  std::vector<float> lo(n_chunks * ncol, INFINITY);
+  std::vector<float> hi(n_chunks * ncol, -INFINITY);
+  std::vector<char> ok(n_chunks, 1);
+  parallel_for_chunks(n, chunk_size, nthreads, [&](size_t begin, size_t end) {
+    size_t k = begin / chunk_size;
+    float* chunk_lo = &lo[k * ncol];
+    float* chunk_hi = &hi[k * ncol];
+    for (size_t i = begin; i != end; ++i) {
+      const float* row = &mtz.data[i * w];
+      for (int c = 0; c != ncol; ++c) {
+        float v = row[c];
+        // also rejects NaN
+        if (!(std::fabs(v) < 1e9f) || v != std::trunc(v)) {
+          ok[k] = 0;
+          return;
+        }
+        chunk_lo[c] = std::min(chunk_lo[c], v);
+        chunk_hi[c] = std::max(chunk_hi[c], v);
+      }
+    }
+  });
+  if (std::find(ok.begin(), ok.end(), 0) != ok.end())
+    return false;
+  std::vector<std::int64_t> col_min(ncol);
+  std::vector<int> col_bits(ncol, 0);
+  int total_bits = 0;
+  for (int c = 0; c != ncol; ++c) {
+    float min_v = INFINITY, max_v = -INFINITY;
+    for (size_t k = 0; k != n_chunks; ++k) {
+      min_v = std::min(min_v, lo[k * ncol + c]);
+      max_v = std::max(max_v, hi[k * ncol + c]);
+    }
+    col_min[c] = (std::int64_t) min_v;
+    std::uint64_t range = std::uint64_t((std::int64_t) max_v - col_min[c]);
+    while ((range >> col_bits[c]) != 0)
+      ++col_bits[c];
+    total_bits += col_bits[c];
+  }
+  if (total_bits > 64)
+    return false;
+  keys.resize(n);
+  parallel_for_chunks(n, chunk_size, nthreads, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i != end; ++i) {
+      const float* row = &mtz.data[i * w];
+      std::uint64_t key = 0;
+      for (int c = 0; c != ncol; ++c)
+        key = (key << col_bits[c]) | std::uint64_t((std::int64_t) row[c] - col_min[c]);
+      keys[i] = {key, i};
+    }
+  });
+  return true;
+}
+
+} // anonymous namespace
+
+std::vector<int> Mtz::sorted_row_indices(int use_first, int nthreads) const {
   if (!has_data())
     fail("No data.");
   if (use_first <= 0 || use_first >= (int) columns.size())
     fail("Wrong use_first arg in Mtz::sort.");
   std::vector<int> indices(nreflections);
+  std::vector<std::pair<std::uint64_t, size_t>> keys;
+  if (pack_row_keys(*this, use_first, nthreads, keys)) {
+    parallel_sort_keys(keys, nthreads);
+    for (int i = 0; i != nreflections; ++i)
+      indices[i] = (int) keys[i].second;
+    return indices;
+  }
   for (int i = 0; i != nreflections; ++i)
     indices[i] = i;
   std::stable_sort(indices.begin(), indices.end(), [&](int i, int j) {
@@ -650,8 +738,8 @@ std::vector<int> Mtz::sorted_row_indices(int use_first) const {
   return indices;
 }
 
-bool Mtz::sort(int use_first) {
-  std::vector<int> indices = sorted_row_indices(use_first);
+bool Mtz::sort(int use_first, int nthreads) {
+  std::vector<int> indices = sorted_row_indices(use_first, nthreads);
   sort_order = {{0, 0, 0, 0, 0}};
   for (int i = 0; i < use_first; ++i)
     sort_order[i] = i + 1;
@@ -659,8 +747,10 @@ bool Mtz::sort(int use_first) {
     return false;
   std::vector<float> new_data(data.size());
   size_t w = columns.size();
-  for (size_t i = 0; i != indices.size(); ++i)
-    std::memcpy(&new_data[i * w], &data[indices[i] * w], w * sizeof(float));
+  parallel_for_chunks(indices.size(), 1 << 14, nthreads, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i != end; ++i)
+      std::memcpy(&new_data[i * w], &data[indices[i] * w], w * sizeof(float));
+  });
   data.swap(new_data);
   return true;
 }
@@ -814,15 +904,9 @@ void Mtz::remove_column(size_t idx) {
   } while(0)
 
 template<typename Write>
-void Mtz::write_to_stream(Write write) const {
-  // uses: data, spacegroup, nreflections, batches, cell, sort_order,
-  //       valm, columns, datasets, history
-  if (!has_data())
-    fail("Cannot write Mtz which has no data");
-  if (!spacegroup)
-    fail("Cannot write Mtz which has no space group");
-  char buf[81] = {'M', 'T', 'Z', ' ', '\0'};
-  std::int64_t real_header_start = (int64_t) columns.size() * nreflections + 21;
+void Mtz::write_first_record(Write write, size_t nrefl) const {
+  char buf[80] = {'M', 'T', 'Z', ' ', '\0'};
+  std::int64_t real_header_start = (int64_t) (columns.size() * nrefl) + 21;
   std::int32_t header_start = (int32_t) real_header_start;
   if (real_header_start > std::numeric_limits<int32_t>::max()) {
     header_start = -1;
@@ -833,12 +917,35 @@ void Mtz::write_to_stream(Write write) const {
   std::int32_t machst = is_little_endian() ? 0x00004144 : 0x11110000;
   std::memcpy(buf + 8, &machst, 4);
   std::memcpy(buf + 12, &real_header_start, 8);
-  if (write(buf, 80, 1) != 1 ||
-      write(data.data(), 4, data.size()) != data.size())
+  if (write(buf, 80, 1) != 1)
+    fail("Writing MTZ file failed");
+}
+
+template<typename Write>
+void Mtz::write_to_stream(Write write) const {
+  // uses: data, spacegroup, nreflections, batches, cell, sort_order,
+  //       valm, columns, datasets, history
+  if (!has_data())
+    fail("Cannot write Mtz which has no data");
+  if (!spacegroup)
+    fail("Cannot write Mtz which has no space group");
+  write_first_record(write, nreflections);
+  if (write(data.data(), 4, data.size()) != data.size())
     fail("Writing MTZ file failed");
+  std::vector<std::array<float,2>> column_ranges;
+  column_ranges.reserve(columns.size());
+  for (const Column& col : columns)
+    column_ranges.push_back(calculate_min_max_disregarding_nans(col.begin(), col.end()));
+  write_headers(write, nreflections, calculate_min_max_1_d2(), column_ranges);
+}
+
+template<typename Write>
+void Mtz::write_headers(Write write, int nrefl, const std::array<double,2>& reso,
+                        const std::vector<std::array<float,2>>& column_ranges) const {
+  char buf[81];
   WRITE("VERS MTZ:V1.1");
   WRITE("TITLE %s", title.c_str());
-  WRITE("NCOL %8zu %12d %8zu", columns.size(), nreflections, batches.size());
+  WRITE("NCOL %8zu %12d %8zu", columns.size(), nrefl, batches.size());
   if (cell.is_crystal())
     WRITE("CELL  %9.4f %9.4f %9.4f %9.4f %9.4f %9.4f",
           cell.a, cell.b, cell.c, cell.alpha, cell.beta, cell.gamma);
@@ -863,7 +970,6 @@ void Mtz::write_to_stream(Write write) const {
   else
     for (Op op : ops)
       WRITE("SYMM %s", to_upper(op.triplet()).c_str());
-  auto reso = calculate_min_max_1_d2();
   WRITE("RESO %-20.12f %-20.12f", reso[0], reso[1]);
   if (std::isnan(valm))
     WRITE("VALM NAN");
@@ -874,8 +980,9 @@ void Mtz::write_to_stream(Write write) const {
     int len = snprintf_z(buffer, 18, "%.9f", f);
     return std::string(buffer, len > 0 ? std::min(len, 17) : 0);
   };
-  for (const Column& col : columns) {
-    auto minmax = calculate_min_max_disregarding_nans(col.begin(), col.end());
+  for (size_t i = 0; i != columns.size(); ++i) {
+    const Column& col = columns[i];
+    const std::array<float,2>& minmax = column_ranges.at(i);
     const char* label = !col.label.empty() ? col.label.c_str() : "_";
     WRITE("COLUMN %-30s %c %17s %17s %4d",
           label, col.type,
@@ -990,4 +1097,85 @@ size_t Mtz::write_to_buffer(char* buf, size_t maxlen) const {
   return len;
 }
 
+MtzStreamWriter::MtzStreamWriter(const Mtz& mtz, const std::string& path)
+    : mtz_(mtz), path_(path) {
+  if (!mtz.spacegroup)
+    fail("Cannot write Mtz which has no space group");
+  if (mtz.columns.size() < 3)
+    fail("MtzStreamWriter: H, K, L columns must be defined first");
+  // the same cells as in Mtz::calculate_min_max_1_d2()
+  const UnitCell& cell = mtz.cell;
+  if (cell.is_crystal() && cell.a > 0)
+    cells_.push_back(cell);
+  const UnitCell* prev_cell = nullptr;
+  for (const Mtz::Dataset& ds : mtz.datasets)
+    if (ds.cell.is_crystal() && ds.cell.a > 0 && ds.cell != cell &&
+        (!prev_cell || ds.cell != *prev_cell)) {
+      cells_.push_back(ds.cell);
+      prev_cell = &ds.cell;
+    }
+  column_ranges_.resize(mtz.columns.size(), {{NAN, NAN}});
+  file_ = file_open(path.c_str(), "wb");
+  // placeholder; the header offset is known only at the end
+  char zeros[80] = {};
+  if (std::fwrite(zeros, 80, 1, file_.get()) != 1)
+    sys_fail("Writing MTZ file failed: " + path_);
+}
+
+void MtzStreamWriter::append_rows(const float* rows, size_t nrows) {
+  if (!file_)
+    fail("MtzStreamWriter: already finished");
+  size_t ncol = column_ranges_.size();
+  for (size_t i = 0; i != nrows; ++i) {
+    const float* row = rows + i * ncol;
+    for (size_t j = 0; j != ncol; ++j) {
+      float v = row[j];
+      std::array<float,2>& range = column_ranges_[j];
+      // the same as calculate_min_max_disregarding_nans()
+      if (std::isnan(v))
+        continue;
+      if (std::isnan(range[0]))
+        range[0] = range[1] = v;
+      else if (v < range[0])
+        range[0] = v;
+      else if (v > range[1])
+        range[1] = v;
+    }
+    for (const UnitCell& uc : cells_) {
+      double res = uc.calculate_1_d2_double(row[0], row[1], row[2]);
+      if (res < reso_[0])
+        reso_[0] = res;
+      if (res > reso_[1])
+        reso_[1] = res;
+    }
+  }
+  if (std::fwrite(rows, 4, nrows * ncol, file_.get()) != nrows * ncol)
+    sys_fail("Writing MTZ file failed: " + path_);
+  nreflections_ += nrows;
+}
+
+void MtzStreamWriter::finish() {
+  if (!file_)
+    fail("MtzStreamWriter: already finished");
+  if (nreflections_ > (size_t) std::numeric_limits<int>::max())
+    fail("MtzStreamWriter: too many reflections for MTZ format");
+  std::FILE* f = file_.get();
+  auto write = [&](const void *ptr, size_t size, size_t nmemb) {
+    return std::fwrite(ptr, size, nmemb, f);
+  };
+  std::array<double,2> reso = reso_;
+  if (reso[0] == INFINITY)
+    reso[0] = 0;
+  try {
+    mtz_.write_headers(write, (int) nreflections_, reso, column_ranges_);
+    if (std::fseek(f, 0, SEEK_SET) != 0)
+      sys_fail("Seeking in MTZ file failed");
+    mtz_.write_first_record(write, nreflections_);
+  } catch (std::runtime_error& e) {
+    fail(std::string(e.what()) + ": " + path_);
+  }
+  if (std::fclose(file_.release()) != 0)
+    sys_fail("Closing MTZ file failed: " + path_);
+}
+
 } // namespace gemmi
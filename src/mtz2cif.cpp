@@ -3,14 +3,16 @@
 #include <gemmi/mtz2cif.hpp>
 
 #include <climits>       // for INT_MIN
+#include <cstring>       // for memcpy
 #include <algorithm>     // for all_of
 #include <set>
 #include <unordered_map>
 
 #include <gemmi/asudata.hpp>   // for calculate_hkl_value_correlation
 #include <gemmi/eig3.hpp>      // for eigen_decomposition
-#include <gemmi/sprintf.hpp>   // for snprintf_z, to_str
+#include <gemmi/sprintf.hpp>   // for snprintf_z, to_str, fixed_to_chars_z, ...
 #include <gemmi/atox.hpp>      // for read_word
+#include <gemmi/parallel.hpp>  // for parallel_for
 #include <gemmi/version.hpp>   // for GEMMI_VERSION
 
 namespace gemmi {
@@ -35,12 +37,12 @@ int find_column_index(const std::string& column, const Mtz& mtz) {
 }
 
 int check_format(const std::string& fmt) {
-  // expected format: [#_+-]?\d*(\.\d+)?[fFgGeEc]
+  // expected format: [#_+-0]?\d*(\.\d+)?[fFgGeEc]
   int min_width = 0;
   if (fmt.find('%') != std::string::npos)
     fail("Specify format without %. Got: " + fmt);
   const char* p = fmt.c_str();
-  if (*p == '_' || *p == '+' || *p == '-' || *p == '#')
+  if (*p == '_' || *p == '+' || *p == '-' || *p == '#' || *p == '0')
    ++p;
   if (is_digit(*p)) {
     min_width = *p++ - '0';
@@ -62,6 +64,24 @@ int check_format(const std::string& fmt) {
   return min_width;
 }
 
+// Returns 'f' or 'g' for formats (already checked) without flags,
+// which can be written with fixed_to_chars_z() or general_to_chars_z().
+// Leading 0 in the width (e.g. 08.3f) is the zero-padding flag.
+char simple_conversion(const std::string& fmt, int& prec) {
+  const char* p = fmt.c_str();
+  if (*p == '0')
+    return 0;
+  while (is_digit(*p))
+    ++p;
+  prec = 6;
+  if (*p == '.') {
+    prec = 0;
+    for (++p; is_digit(*p); ++p)
+      prec = prec * 10 + (*p - '0');
+  }
+  return *p == 'f' || *p == 'g' ? *p : 0;
+}
+
 #define WRITE(...) os.write(buf, snprintf_z(buf, 255, __VA_ARGS__))
 
 void write_cell_and_symmetry(const std::string& entry_id,
@@ -104,6 +124,8 @@ struct Trans {
   std::string tag;  // excluding category
   std::string format = "%g";
   int min_width = 0;
+  char conv = 'g';  // 'f' or 'g' if the format has no flags, 0 otherwise
+  int prec = 6;
 };
 
 // state for parse_spec_line
@@ -193,6 +215,7 @@ void parse_spec_line(const MtzToCif& m2c,
       tr.is_status = true;
     } else {
       tr.min_width = check_format(fmt);
+      tr.conv = simple_conversion(fmt, tr.prec);
       tr.format = "%" + fmt;
       if (tr.format[1] == '_')
         tr.format[1] = ' ';
@@ -378,9 +401,14 @@ const Trans* get_status_translation(const std::vector<Trans>& recipe) {
   return nullptr;
 }
 
+// Integers that %g prints without exponent (and not -0).
+bool is_small_integer(float v) {
+  return std::fabs(v) < 1e6f && v == float(int(v)) && !(v == 0.f && std::signbit(v));
+}
+
 void write_main_loop(const MtzToCif& m2c, const SweepInfo& sweep_info,
                      const Mtz& mtz, const std::vector<Trans>& recipe,
-                     char (&buf)[256], std::ostream& os) {
+                     std::ostream& os) {
   // prepare indices
   std::vector<int> value_indices;  // used for --skip_empty
   std::vector<int> sigma_indices;  // used for status 'x' and --skip-negative-sigi
@@ -440,91 +468,149 @@ void write_main_loop(const MtzToCif& m2c, const SweepInfo& sweep_info,
     }
   }
 
-  auto write_int = [](char* p, int num) {
-    //return snprintf_z(p, 32, "%d", num);
-    std::string s = std::to_string(num);
-    std::memcpy(p, s.data(), s.size());  // NOLINT(bugprone-not-null-terminated-result)
-    return s.size();
-  };
-
-  char* ptr = buf;
-  for (int i = 0, idx = 0; i != mtz.nreflections; ++i) {
-    const float* row = &mtz.data[i * mtz.columns.size()];
+  const size_t ncol = mtz.columns.size();
+  // true if the row is not filtered out by --trim, --skip-empty, etc
+  auto is_written = [&](const float* row) {
     if (m2c.trim > 0) {
       if (row[0] < -m2c.trim || row[0] > m2c.trim ||
           row[1] < -m2c.trim || row[1] > m2c.trim ||
           row[2] < -m2c.trim || row[2] > m2c.trim) {
-        continue;
+        return false;
       }
     }
     if (!value_indices.empty())
       if (std::all_of(value_indices.begin(), value_indices.end(),
                       [&](int n) { return std::isnan(row[n]); }))
+        return false;
+    if (unmerged && m2c.skip_negative_sigi &&
+        std::any_of(sigma_indices.begin(), sigma_indices.end(),
+                    [&](int n) { return row[n] < 0; }))
+      return false;
+    return true;
+  };
+  const bool filtered = m2c.trim > 0 || !value_indices.empty() ||
+                        (unmerged && m2c.skip_negative_sigi);
+  const bool has_counter = std::any_of(recipe.begin(), recipe.end(),
+                                       [](const Trans& tr) { return tr.col_idx == Var::Counter; });
+
+  // Formats rows [begin, end) into out; idx is the last counter value used.
+  auto format_rows = [&](size_t begin, size_t end, int idx, std::vector<char>& out) {
+    // each item takes at most 33 bytes: separator + snprintf_z(ptr, 32, ...)
+    const size_t max_row_len = 36 * recipe.size() + 1;
+    size_t used = 0;
+    for (size_t i = begin; i != end; ++i) {
+      const float* row = &mtz.data[i * ncol];
+      if (!is_written(row))
         continue;
-    int batch_number = 0;
-    const SweepData* sweep = nullptr;
-    if (unmerged) {
-      if (m2c.skip_negative_sigi &&
-          std::any_of(sigma_indices.begin(), sigma_indices.end(),
-                      [&](int n) { return row[n] < 0; }))
-        continue;
-      if (batch_idx == -1)
-        fail("BATCH column not found");
-      batch_number = (int) row[batch_idx];
-      auto it = batch_by_number.find(batch_number);
-      if (it == batch_by_number.end())
-        fail("unexpected values in column BATCH");
-      const Mtz::Batch& batch = *it->second;
-      sweep = sweep_info.get_sweep_data(batch.number);
-    }
-    bool first = true;
-    for (const Trans& tr : recipe) {
-      if (first)
-        first = false;
-      else
-        *ptr++ = ' ';
-      static_assert(sizeof(buf) == 256, "sizeof buf");
-      if (ptr - buf > 256 - 36) {
-        os.write(buf, ptr - buf);
-        ptr = buf;
+      int batch_number = 0;
+      const SweepData* sweep = nullptr;
+      if (unmerged) {
+        if (batch_idx == -1)
+          fail("BATCH column not found");
+        batch_number = (int) row[batch_idx];
+        auto it = batch_by_number.find(batch_number);
+        if (it == batch_by_number.end())
+          fail("unexpected values in column BATCH");
+        const Mtz::Batch& batch = *it->second;
+        sweep = sweep_info.get_sweep_data(batch.number);
       }
-      if (tr.col_idx < 0) {
-        switch (tr.col_idx) {
-          case Var::Dot: *ptr++ = '.'; break;
-          case Var::Qmark: *ptr++ = '?'; break;
-          case Var::Counter: ptr += write_int(ptr, ++idx); break;
-          case Var::DatasetId: ptr += write_int(ptr, sweep->id); break;
-          case Var::Image: ptr += write_int(ptr, batch_number - sweep->offset); break;
-        }
-      } else {
-        float v = row[tr.col_idx];
-        if (tr.is_status) {
-          char status = 'x';
-          if (sigma_indices.empty() ||
-              !std::all_of(sigma_indices.begin(), sigma_indices.end(),
-                           [&](int n) { return std::isnan(row[n]); }))
-            status = int(v) == free_flag_value ? 'f' : 'o';
-          *ptr++ = status;
-        } else if (std::isnan(v)) {
-          // we checked that min_width <= 32
-          for (int j = 1; j < tr.min_width; ++j)
-            *ptr++ = ' ';
-          *ptr++ = '?';
+      if (out.size() - used < max_row_len)
+        out.resize(std::max(2 * out.size(), used + max_row_len));
+      char* const line = out.data() + used;
+      char* ptr = line;
+      bool first = true;
+      for (const Trans& tr : recipe) {
+        if (first)
+          first = false;
+        else
+          *ptr++ = ' ';
+        if (tr.col_idx < 0) {
+          switch (tr.col_idx) {
+            case Var::Dot: *ptr++ = '.'; break;
+            case Var::Qmark: *ptr++ = '?'; break;
+            case Var::Counter: ptr = to_chars_z(ptr, ptr + 32, ++idx); break;
+            case Var::DatasetId: ptr = to_chars_z(ptr, ptr + 32, sweep->id); break;
+            case Var::Image:
+              ptr = to_chars_z(ptr, ptr + 32, batch_number - sweep->offset);
+              break;
+          }
         } else {
+          float v = row[tr.col_idx];
+          if (tr.is_status) {
+            char status = 'x';
+            if (sigma_indices.empty() ||
+                !std::all_of(sigma_indices.begin(), sigma_indices.end(),
+                             [&](int n) { return std::isnan(row[n]); }))
+              status = int(v) == free_flag_value ? 'f' : 'o';
+            *ptr++ = status;
+          } else if (std::isnan(v)) {
+            // we checked that min_width <= 32
+            for (int j = 1; j < tr.min_width; ++j)
+              *ptr++ = ' ';
+            *ptr++ = '?';
+          } else if (tr.conv == 'g' && tr.prec == 6 && tr.min_width == 0 &&
+                     is_small_integer(v)) {
+            // the same as %g, for integers (Miller indices, flags, batches)
+            ptr = to_chars_z(ptr, ptr + 32, (int) v);
+          } else if (tr.conv == 'f') {
+            ptr = fixed_to_chars_z(ptr, ptr + 32, v, tr.prec, tr.min_width);
+          } else if (tr.conv == 'g') {
+            ptr = general_to_chars_z(ptr, ptr + 32, v, tr.prec, tr.min_width);
+          } else {
 #if defined(__GNUC__)
 # pragma GCC diagnostic push
 # pragma GCC diagnostic ignored "-Wformat-nonliteral"
 #endif
-          ptr += snprintf_z(ptr, 32, tr.format.c_str(), v);
+            ptr += snprintf_z(ptr, 32, tr.format.c_str(), v);
 #if defined(__GNUC__)
 # pragma GCC diagnostic pop
 #endif
+          }
         }
       }
+      *ptr++ = '\n';
+      used += ptr - line;
     }
-    *ptr++ = '\n';
+    out.resize(used);
+  };
+
+  // Rows are formatted in blocks, a few blocks per thread at a time,
+  // and the blocks are written in order.
+  const size_t block_size = 4096;
+  const size_t nrows = mtz.nreflections;
+  const size_t nblocks = (nrows + block_size - 1) / block_size;
+  const int nthreads = resolve_thread_count(m2c.nthreads);
+  const size_t window = std::min(size_t(4 * nthreads), nblocks);
+  std::vector<std::vector<char>> outputs(window);
+  std::vector<int> counter_start(window);
+  int idx = 0;
+  for (size_t w = 0; w < nblocks; w += window) {
+    size_t nb = std::min(window, nblocks - w);
+    auto block_end = [&](size_t k) { return std::min((w + k + 1) * block_size, nrows); };
+    if (has_counter) {
+      // the counter value at the start of each block must be known in advance
+      if (filtered)
+        parallel_for(nb, nthreads, [&](size_t k) {
+          int count = 0;
+          for (size_t i = (w + k) * block_size; i != block_end(k); ++i)
+            count += (int) is_written(&mtz.data[i * ncol]);
+          counter_start[k] = count;
+        });
+      else
+        for (size_t k = 0; k != nb; ++k)
+          counter_start[k] = int(block_end(k) - (w + k) * block_size);
+      for (size_t k = 0; k != nb; ++k) {
+        int count = counter_start[k];
+        counter_start[k] = idx;
+        idx += count;
+      }
+    }
+    parallel_for(nb, nthreads, [&](size_t k) {
+      format_rows((w + k) * block_size, block_end(k), counter_start[k], outputs[k]);
+    });
+    for (size_t k = 0; k != nb; ++k)
+      os.write(outputs[k].data(), outputs[k].size());
   }
-  os.write(buf, ptr - buf);
 }
 
 }  // anonymous namespace
@@ -697,13 +783,13 @@ void MtzToCif::write_cif(const Mtz& mtz, const Mtz* mtz2,
     write_staraniso_b_in_mmcif(*staraniso_b, entry_id, buf, os);
 
   if (merged)
-    write_main_loop(*this, sweep_info, *merged, recipe, buf, os);
+    write_main_loop(*this, sweep_info, *merged, recipe, os);
   if (unmerged) {
     // if --depo flag is used, the spec file is for the merged data only
     if (write_special_marker_for_pdb)
       spec_lines.clear();
     prepare_recipe(*this, *unmerged, recipe);
-    write_main_loop(*this, sweep_info, *unmerged, recipe, buf, os);
+    write_main_loop(*this, sweep_info, *unmerged, recipe, os);
   }
 }
 
@@ -819,14 +905,21 @@ void MtzToCif::write_cif_from_xds(const XdsAscii& xds, std::ostream& os) const {
     if (refl.sigma < 0 && skip_negative_sigi)  // misfit
       continue;
     char* ptr = buf;
-    ptr += snprintf_z(ptr, 128, "%d %d %d %d %d %g %.5g ",
-                      refl.iset, ++idx, refl.hkl[0], refl.hkl[1], refl.hkl[2],
-                      refl.iobs, refl.sigma);
+    for (int n : {refl.iset, ++idx, refl.hkl[0], refl.hkl[1], refl.hkl[2]}) {
+      ptr = to_chars_z(ptr, ptr + 16, n);
+      *ptr++ = ' ';
+    }
+    ptr = general_to_chars_z(ptr, ptr + 32, refl.iobs, 6);
+    *ptr++ = ' ';
+    ptr = general_to_chars_z(ptr, ptr + 32, refl.sigma, 5);
+    *ptr++ = ' ';
     if (xds.oscillation_range != 0.) {
       double angle = xds.rot_angle(refl);
-      ptr += snprintf_z(ptr, 16, "%.5g ", angle);
+      ptr = general_to_chars_z(ptr, ptr + 16, angle, 5);
+      *ptr++ = ' ';
     }
-    ptr += snprintf_z(ptr, 16, "%d\n", refl.frame());
+    ptr = to_chars_z(ptr, ptr + 16, refl.frame());
+    *ptr++ = '\n';
     os.write(buf, ptr - buf);
   }
 }
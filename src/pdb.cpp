@@ -12,6 +12,7 @@
 #include "gemmi/input.hpp"
 #include "gemmi/metadata.hpp" // for Metadata
 #include "gemmi/model.hpp"    // for Structure, impl::find_or_add
+#include "gemmi/parallel.hpp" // for parallel_for_chunks
 #include "gemmi/polyheur.hpp" // for assign_subchains
 #include "gemmi/util.hpp"     // for trim_str, alpha_up, istarts_with
 
@@ -953,6 +954,96 @@ void read_metadata_from_remarks(Structure& st) {
   }
 }
 
+// Data from ATOM/HETATM or ANISOU record. Records are parsed in parallel
+// and then added to the model hierarchy in the original order.
+struct AtomRecord {
+  std::string chain_name;
+  ResidueId rid;
+  Atom atom;
+};
+
+AtomRecord parse_atom_record(const char* line, size_t len) {
+  AtomRecord rec{read_string(line+20, 2), read_res_id(line+22, line+17), Atom()};
+  // Non-standard but widely used 4-character segment identifier.
+  // Left-justified, and may include a space in the middle.
+  // The segment may be a portion of a chain or a complete chain.
+  if (len > 72)
+    rec.rid.segment = read_string(line+72, 4);
+  Atom& atom = rec.atom;
+  atom.serial = read_serial(line+6);
+  atom.name = read_string(line+12, 4);
+  atom.altloc = read_altloc(line[16]);
+  atom.pos.x = read_double(line+30, 8);
+  atom.pos.y = read_double(line+38, 8);
+  atom.pos.z = read_double(line+46, 8);
+  if (len > 58)
+    atom.occ = (float) read_double(line+54, 6);
+  if (len > 64)
+    atom.b_iso = (float) read_double(line+60, 6);
+  if (len > 76 && (std::isalpha(line[76]) || std::isalpha(line[77])))
+    atom.element = Element(line + 76);
+  else
+    atom.element = infer_element_from_padded_name(line+12);
+  atom.charge = (len > 78 ? read_charge(line[78], line[79]) : 0);
+  return rec;
+}
+
+void parse_anisou_record(const char* line, SMat33<float>& aniso) {
+  aniso.u11 = read_int(line+28, 7) * 1e-4f;
+  aniso.u22 = read_int(line+35, 7) * 1e-4f;
+  aniso.u33 = read_int(line+42, 7) * 1e-4f;
+  aniso.u12 = read_int(line+49, 7) * 1e-4f;
+  aniso.u13 = read_int(line+56, 7) * 1e-4f;
+  aniso.u23 = read_int(line+63, 7) * 1e-4f;
+}
+
+// Lines read ahead, so that coordinate records can be parsed in parallel.
+// Each line is stored together with the rest of the line buffer (bytes after
+// the terminating NUL), so it's parsed exactly as in the reading buffer.
+struct PdbLineBlock {
+  static constexpr size_t max_lines = 8192;
+  size_t stride;
+  size_t pos = 0;  // the next line to be processed
+  std::vector<char> text;
+  std::vector<size_t> lens;
+  std::vector<AtomRecord> records;
+  // If false, records are parsed one by one in the main loop.
+  bool preparsed = false;
+
+  explicit PdbLineBlock(size_t buffer_size) : stride(buffer_size) {}
+  size_t size() const { return lens.size(); }
+  char* line(size_t i) { return &text[i * stride]; }
+  void add(const char* buffer, size_t len) {
+    size_t n = lens.size();
+    if (text.size() < (n + 1) * stride)
+      text.resize(max_lines * stride);
+    std::memcpy(&text[n * stride], buffer, stride);
+    lens.push_back(len);
+  }
+  void clear() {
+    lens.clear();
+    pos = 0;
+  }
+  void parse_coordinates(int nthreads) {
+    preparsed = resolve_thread_count(nthreads) > 1;
+    if (!preparsed)
+      return;
+    if (records.size() < size())
+      records.resize(size());
+    parallel_for_chunks(size(), 512, nthreads, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i != end; ++i) {
+        const char* ln = line(i);
+        if (is_record_type4(ln, "ATOM") || is_record_type4(ln, "HETATM")) {
+          if (lens[i] >= 55)
+            records[i] = parse_atom_record(ln, lens[i]);
+        } else if (is_record_type4(ln, "ANISOU")) {
+          parse_anisou_record(ln, records[i].atom.aniso);
+        }
+      }
+    });
+  }
+};
+
 } // anonymous namespace
 
 void populate_structure_from_pdb_stream(AnyStream& line_reader, const std::string& source,
@@ -969,13 +1060,40 @@ void populate_structure_from_pdb_stream(AnyStream& line_reader, const std::strin
   Model *model = nullptr;
   Chain *chain = nullptr;
   Residue *resi = nullptr;
-  char line[122] = {0};
+  char buffer[122] = {0};
   int line_num = 0;
   bool after_ter = false;
   auto wrong = [&line_num](const std::string& msg) {
     fail("Problem in line ", std::to_string(line_num), ": ", msg);
   };
-  while (size_t len = line_reader.copy_line(line, options.max_line_length+1)) {
+  // Lines are read ahead in blocks. Coordinates from ATOM/HETATM/ANISOU
+  // records in a block are parsed in parallel, then the lines are processed
+  // one by one, in order.
+  PdbLineBlock block(sizeof(buffer));
+  bool at_end = false;  // EOF or END record
+  auto next_line = [&](size_t& len) -> char* {
+    if (block.pos == block.size()) {
+      block.clear();
+      while (!at_end && block.size() < PdbLineBlock::max_lines) {
+        size_t n = line_reader.copy_line(buffer, options.max_line_length+1);
+        if (n == 0) {
+          at_end = true;
+        } else {
+          block.add(buffer, n);
+          // the END record stops reading, the same as in the loop below
+          if (is_record_type3(buffer, "END"))
+            at_end = true;
+        }
+      }
+      if (block.size() == 0)
+        return nullptr;
+      block.parse_coordinates(options.nthreads);
+    }
+    len = block.lens[block.pos];
+    return block.line(block.pos++);
+  };
+  size_t len;
+  while (char* line = next_line(len)) {
     ++line_num;
     if (options.check_non_ascii && st.non_ascii_line == 0)
       for (size_t i = 0; i < len; ++i)
@@ -986,9 +1104,10 @@ void populate_structure_from_pdb_stream(AnyStream& line_reader, const std::strin
     if (is_record_type4(line, "ATOM") || is_record_type4(line, "HETATM")) {
       if (len < 55)
         wrong("The line is too short to be correct:\n" + std::string(line));
-      std::string chain_name = read_string(line+20, 2);
-      ResidueId rid = read_res_id(line+22, line+17);
-
+      AtomRecord rec = block.preparsed ? std::move(block.records[block.pos - 1])
+                                       : parse_atom_record(line, len);
+      const std::string& chain_name = rec.chain_name;
+      const ResidueId& rid = rec.rid;
       if (!chain || chain_name != chain->name) {
         if (!model) {
           // A single model usually doesn't have the MODEL record. Also,
@@ -1007,11 +1126,6 @@ void populate_structure_from_pdb_stream(AnyStream& line_reader, const std::strin
         resmap.clear();
         resi = nullptr;
       }
-      // Non-standard but widely used 4-character segment identifier.
-      // Left-justified, and may include a space in the middle.
-      // The segment may be a portion of a chain or a complete chain.
-      if (len > 72)
-        rid.segment = read_string(line+72, 4);
       if (!resi || !resi->matches(rid)) {
         auto it = resmap.find(rid);
         // In normal PDB files it is fast enough to use
@@ -1032,23 +1146,7 @@ void populate_structure_from_pdb_stream(AnyStream& line_reader, const std::strin
         }
       }
 
-      Atom atom;
-      atom.serial = read_serial(line+6);
-      atom.name = read_string(line+12, 4);
-      atom.altloc = read_altloc(line[16]);
-      atom.pos.x = read_double(line+30, 8);
-      atom.pos.y = read_double(line+38, 8);
-      atom.pos.z = read_double(line+46, 8);
-      if (len > 58)
-        atom.occ = (float) read_double(line+54, 6);
-      if (len > 64)
-        atom.b_iso = (float) read_double(line+60, 6);
-      if (len > 76 && (std::isalpha(line[76]) || std::isalpha(line[77])))
-        atom.element = Element(line + 76);
-      else
-        atom.element = infer_element_from_padded_name(line+12);
-      atom.charge = (len > 78 ? read_charge(line[78], line[79]) : 0);
-      resi->atoms.emplace_back(atom);
+      resi->atoms.emplace_back(std::move(rec.atom));
 
     } else if (is_record_type4(line, "ANISOU")) {
       if (!model || !chain || !resi || resi->atoms.empty())
@@ -1058,12 +1156,10 @@ void populate_structure_from_pdb_stream(AnyStream& line_reader, const std::strin
       Atom &atom = resi->atoms.back();
       if (atom.aniso.u11 != 0.)
         wrong("Duplicated ANISOU record or not directly after ATOM/HETATM.");
-      atom.aniso.u11 = read_int(line+28, 7) * 1e-4f;
-      atom.aniso.u22 = read_int(line+35, 7) * 1e-4f;
-      atom.aniso.u33 = read_int(line+42, 7) * 1e-4f;
-      atom.aniso.u12 = read_int(line+49, 7) * 1e-4f;
-      atom.aniso.u13 = read_int(line+56, 7) * 1e-4f;
-      atom.aniso.u23 = read_int(line+63, 7) * 1e-4f;
+      if (block.preparsed)
+        atom.aniso = block.records[block.pos - 1].atom.aniso;
+      else
+        parse_anisou_record(line, atom.aniso);
 
     } else if (is_record_type4(line, "REMARK")) {
       if (line[len-1] == '\n')
@@ -2,10 +2,13 @@
 
 #include <gemmi/sprintf.hpp>
 #include <stdarg.h>  // for va_list
+#include <cmath>     // for fabs, floor, signbit
+#include <cstdint>   // for uint64_t
+#include <cstring>   // for memcpy, memset
+#include <algorithm> // for min
 
 #ifdef USE_STD_SNPRINTF  // useful for benchmarking and testing only
 # include <cstdio>
-# include <algorithm> // for min
 #else
 # define STB_SPRINTF_IMPLEMENTATION
 # define STB_SPRINTF_STATIC
@@ -65,4 +68,149 @@ int snprintf_z(char *buf, int count, char const *fmt, ...) {
   return result;
 }
 
+namespace {
+
+// Powers of 10 that are exactly representable as double.
+const double pow10_table[23] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Sets n to a*10^prec rounded to integer. Returns false if n could differ
+// from the correctly rounded value (ties and too large numbers).
+bool round_scaled(double a, int prec, uint64_t& n) {
+  if (prec < 0 || prec > 22)
+    return false;
+  double scaled = a * pow10_table[prec];
+  if (!(scaled < 4e15))  // also rejects NaN
+    return false;
+  double r = std::floor(scaled);
+  double frac = scaled - r;  // exact
+  // the multiplication above has error <= 0.5 ulp
+  if (std::fabs(frac - 0.5) <= scaled * 2.3e-16)
+    return false;
+  n = (uint64_t) r + (frac > 0.5);
+  return true;
+}
+
+// Writes n with a decimal point before the last prec digits.
+char* write_fixed_digits(char* p, uint64_t n, int prec) {
+  char digits[40];
+  char* end = digits + sizeof(digits);
+  char* d = end;
+  do {
+    *--d = char('0' + n % 10);
+    n /= 10;
+  } while (n != 0 || end - d <= prec);
+  size_t int_len = end - d - prec;
+  std::memcpy(p, d, int_len);
+  p += int_len;
+  if (prec > 0) {
+    *p++ = '.';
+    std::memcpy(p, d + int_len, prec);
+    p += prec;
+  }
+  return p;
+}
+
+// Copies s to [first, last), padding it on the left to the given width.
+char* copy_padded(char* first, char* last, const char* s, size_t len, int width) {
+  size_t avail = last - first - 1;
+  size_t pad = width > (int) len ? std::min(width - len, avail) : 0;
+  std::memset(first, ' ', pad);
+  first += pad;
+  len = std::min(len, avail - pad);
+  std::memcpy(first, s, len);
+  first[len] = '\0';
+  return first + len;
+}
+
+// conv is 'f' or 'g'
+char* snprintf_fallback(char* first, char* last, char conv,
+                        int width, int prec, double d) {
+  int size = int(last - first);
+  int len = conv == 'f' ? snprintf_z(first, size, "%*.*f", width, prec, d)
+                        : snprintf_z(first, size, "%*.*g", width, prec, d);
+  return first + std::min(std::max(len, 0), size - 1);
+}
+
+}  // anonymous namespace
+
+char* fixed_to_chars_z(char* first, char* last, double d, int prec, int width) {
+  uint64_t n;
+  if (prec >= 0 && prec <= 17 && round_scaled(std::fabs(d), prec, n)) {
+    char buf[48];
+    char* p = buf;
+    if (std::signbit(d))
+      *p++ = '-';
+    p = write_fixed_digits(p, n, prec);
+    return copy_padded(first, last, buf, p - buf, width);
+  }
+  return snprintf_fallback(first, last, 'f', width, prec, d);
+}
+
+char* general_to_chars_z(char* first, char* last, double d, int prec, int width) {
+  if (prec == 0)
+    prec = 1;
+  double a = std::fabs(d);
+  if (prec > 0 && prec <= 15 && ((a >= 1e-4 && a < 1e15) || a == 0)) {
+    char buf[48];
+    char* p = buf;
+    if (std::signbit(d))
+      *p++ = '-';
+    if (a == 0) {
+      *p++ = '0';
+      return copy_padded(first, last, buf, p - buf, width);
+    }
+    // decimal exponent; if it's off by one, n is out of range below
+    int e = 0;
+    if (a >= 1) {
+      while (a >= pow10_table[e+1])
+        ++e;
+    } else {
+      e = -1;
+      for (double x = 0.1; a < x && e > -4; x *= 0.1)
+        --e;
+    }
+    int frac_digits = prec - 1 - e;
+    uint64_t n;
+    if (frac_digits >= 0 && round_scaled(a, frac_digits, n) &&
+        n >= (uint64_t) pow10_table[prec-1] && n < (uint64_t) pow10_table[prec]) {
+      p = write_fixed_digits(p, n, frac_digits);
+      // %g removes trailing zeros
+      if (frac_digits > 0) {
+        while (p[-1] == '0')
+          --p;
+        if (p[-1] == '.')
+          --p;
+      }
+      return copy_padded(first, last, buf, p - buf, width);
+    }
+  }
+  return snprintf_fallback(first, last, 'g', width, prec, d);
+}
+
+// std::to_chars for floating-point numbers is in C++17, but it was added
+// to compilers later than the integer version.
+// __cpp_lib_to_chars is defined only when both are available.
+char* shortest_to_chars_z(char* first, char* last, double d) {
+#if __cpp_lib_to_chars >= 201611L
+  char buf[32];
+  auto result = std::to_chars(buf, buf + sizeof(buf), d);
+  return copy_padded(first, last, buf, result.ptr - buf, 0);
+#else
+  return snprintf_fallback(first, last, 'g', 0, 17, d);
+#endif
+}
+
+char* shortest_to_chars_z(char* first, char* last, float f) {
+#if __cpp_lib_to_chars >= 201611L
+  char buf[32];
+  auto result = std::to_chars(buf, buf + sizeof(buf), f);
+  return copy_padded(first, last, buf, result.ptr - buf, 0);
+#else
+  return snprintf_fallback(first, last, 'g', 0, 9, f);
+#endif
+}
+
 }  // namespace gemmi
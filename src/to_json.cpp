@@ -6,12 +6,13 @@
 #include <gemmi/numb.hpp>  // for is_numb
 #include <gemmi/util.hpp>  // for starts_with
 #include <gemmi/cifdoc.hpp>
+#include <gemmi/parallel.hpp>  // for parallel_for
 
 namespace gemmi {
 namespace cif {
 
 // based on tao/json/internal/escape.hpp
-static void escape(std::ostream& os, const std::string& s, size_t pos, bool to_lower) {
+static void escape(std::string& out, const std::string& s, size_t pos, bool to_lower) {
   static const char* h = "0123456789abcdef";
   const char* p = s.data() + pos;
   const char* l = p;
@@ -19,53 +20,71 @@ static void escape(std::ostream& os, const std::string& s, size_t pos, bool to_l
   while (p != e) {
     const unsigned char c = *p;
     if (c == '\\') {
-      os.write(l, p - l);
+      out.append(l, p - l);
       l = ++p;
-      os << "\\\\";
+      out += "\\\\";
     } else if (c == '"') {
-      os.write(l, p - l);
+      out.append(l, p - l);
       l = ++p;
-      os << "\\\"";
+      out += "\\\"";
     } else if (c < 32) {
-      os.write(l, p - l);
+      out.append(l, p - l);
       l = ++p;
       switch ( c ) {
-        case '\b': os << "\\b"; break;
-        case '\f': os << "\\f"; break;
-        case '\n': os << "\\n"; break;
-        case '\r': os << "\\r"; break;
-        case '\t': os << "\\t"; break;
-        default: os << "\\u00" << h[(c & 0xf0) >> 4] << h[c & 0x0f];
+        case '\b': out += "\\b"; break;
+        case '\f': out += "\\f"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+          out += "\\u00";
+          out += h[(c & 0xf0) >> 4];
+          out += h[c & 0x0f];
       }
     } else if (to_lower && c >= 'A' && c <= 'Z') {
-      os.write(l, p - l);
+      out.append(l, p - l);
       l = ++p;
-      os.put(c + 32);
+      out += char(c + 32);
     } else if (c == 127) {
-      os.write(l, p - l);
+      out.append(l, p - l);
       l = ++p;
-      os << "\\u007f";
+      out += "\\u007f";
     } else {
       ++p;
     }
   }
-  os.write(l, p - l);
+  out.append(l, p - l);
 }
 
-
 class JsonWriter {
 public:
-  explicit JsonWriter(std::ostream& os) : os_(os), linesep_("\n ") {}
+  JsonWriter(std::ostream& os, int nthreads)
+    : os_(os), nthreads_(nthreads), linesep_("\n ") {
+    out_.reserve(flush_size + (flush_size >> 2));
+  }
   void write_json(const Document& d);
 
   JsonWriteOptions opt;
 
 private:
+  // Output is formatted into out_ and written to os_ in large chunks.
+  static constexpr size_t flush_size = 1 << 20;
   std::ostream& os_;
+  std::string out_;
+  int nthreads_;
   std::string linesep_;
 
   void change_indent(int n) { linesep_.resize(linesep_.size() + n, ' '); }
 
+  void flush() {
+    os_.write(out_.data(), out_.size());
+    out_.clear();
+  }
+  void flush_if_full() {
+    if (out_.size() >= flush_size)
+      flush();
+  }
+
   // returns category with trailing dot
   std::string get_tag_category(const std::string& tag) const {
     if (!opt.group_ddl2_categories)
@@ -86,59 +105,66 @@ private:
     return cat;
   }
 
+  static void write_string(std::string& out, const std::string& s,
+                           size_t pos=0, bool to_lower=false) {
+    out += '"';
+    escape(out, s, pos, to_lower);
+    out += '"';
+  }
   void write_string(const std::string& s, size_t pos=0, bool to_lower=false) {
-    os_.put('"');
-    escape(os_, s, pos, to_lower);
-    os_.put('"');
+    write_string(out_, s, pos, to_lower);
   }
 
-  void write_as_number(const std::string& value) {
+  static void write_as_number(std::string& out, const std::string& value) {
     // if we are here, value is not empty
     // in JSON the number cannot start with +
     size_t pos = 0;
     if (value[pos] == '+') {
       pos = 1;
     } else if (value[pos] == '-') { // make handling -001 easier
-      os_.put('-');
+      out += '-';
       pos = 1;
     }
     // in JSON numbers cannot start with dot (handles both .99 and -.99)
     if (value[pos] == '.')
-      os_.put('0');
+      out += '0';
     // in JSON left-padding with 0s is not allowed
     while (value[pos] == '0' && std::isdigit(value[pos+1]))
       ++pos;
     // in JSON dot must be followed by digit
     size_t dotpos = value.find('.');
     if (dotpos != std::string::npos && !std::isdigit(value[dotpos+1])) {
-      os_ << value.substr(pos, dotpos+1-pos) << '0';
+      out.append(value, pos, dotpos+1-pos);
+      out += '0';
       pos = dotpos + 1;
     }
     if (value.back() != ')')
-      os_ << value.c_str() + pos;
+      out.append(value, pos, std::string::npos);
     else
-      os_ << value.substr(pos, value.find('(', pos) - pos);
+      out.append(value, pos, value.find('(', pos) - pos);
   }
 
-  void write_value(const std::string& value) {
+  // const, so that it can be called from multiple threads
+  void write_value(std::string& out, const std::string& value) const {
     if (value == "?")
-      os_ << "null";
+      out += "null";
     else if (value == ".")
-      os_ << opt.cif_dot;
+      out += opt.cif_dot;
     else if (opt.quote_numbers < 2 && is_numb(value) &&
              // exception: 012 (but not 0.12) is assumed to be a string
              (value[0] != '0' || value[1] == '.' || value[1] == '\0') &&
              (opt.quote_numbers == 0 || value.back() != ')'))
-      write_as_number(value);
+      write_as_number(out, value);
     else
-      write_string(as_string(value));
+      write_string(out, as_string(value));
   }
 
   void open_cat(const std::string& cat, size_t* tag_pos) {
     if (!cat.empty()) {
       change_indent(+1);
       write_string(cat.substr(0, cat.size() - 1), opt.bare_tags ? 1 : 0, opt.lowercase_names);
-      os_ << ": {" << linesep_;
+      out_ += ": {";
+      out_ += linesep_;
       *tag_pos += cat.size() - 1;
     }
   }
@@ -146,29 +172,52 @@ private:
   void close_cat(std::string& cat, size_t* tag_pos) {
     if (!cat.empty()) {
       change_indent(-1);
-      os_ << linesep_ << '}';
+      out_ += linesep_;
+      out_ += '}';
       *tag_pos -= cat.size() - 1;
       cat.clear();
     }
   }
 
-  void write_loop(const Loop& loop) {
+  void write_column(std::string& out, const Loop& loop, size_t i) const {
     size_t ncol = loop.tags.size();
     const auto& vals = loop.values;
+    out += '[';
+    for (size_t j = i; j < vals.size(); j += ncol) {
+      if (j != i)
+        out += ',';
+      write_value(out, vals[j]);
+    }
+    out += ']';
+  }
+
+  void write_loop(const Loop& loop) {
+    size_t ncol = loop.tags.size();
     std::string cat = get_loop_category(loop);
     size_t tag_pos = opt.bare_tags ? 1 : 0;
     open_cat(cat, &tag_pos);
+    // Columns of large loops (atom_site) are formatted in parallel.
+    std::vector<std::string> columns;
+    if (nthreads_ != 1 && ncol > 1 && loop.values.size() >= 10000) {
+      columns.resize(ncol);
+      parallel_for(ncol, nthreads_, [&](size_t i) {
+        write_column(columns[i], loop, i);
+      });
+    }
     for (size_t i = 0; i < ncol; i++) {
-      if (i != 0)
-        os_ << "," << linesep_;
+      if (i != 0) {
+        out_ += ',';
+        out_ += linesep_;
+      }
       write_string(loop.tags[i], tag_pos, opt.lowercase_names);
-      os_ << ": [";
-      for (size_t j = i; j < vals.size(); j += ncol) {
-        if (j != i)
-          os_.put(',');
-        write_value(vals[j]);
+      out_ += ": ";
+      if (columns.empty()) {
+        write_column(out_, loop, i);
+      } else {
+        out_ += columns[i];
+        std::string().swap(columns[i]);
       }
-      os_.put(']');
+      flush_if_full();
     }
     close_cat(cat, &tag_pos);
   }
@@ -177,7 +226,7 @@ private:
   // works for both block and frame
   void write_map(const std::string& name, const std::vector<Item>& items) {
     write_string(name, 0, opt.lowercase_names);
-    os_ << ": ";
+    out_ += ": ";
     change_indent(+1);
     char first = '{';
     bool has_frames = false;
@@ -190,25 +239,27 @@ private:
         case ItemType::Pair:
           if (!cat.empty() && !starts_with(item.pair[0], cat))
             close_cat(cat, &tag_pos);
-          os_ << first << linesep_;
+          out_ += first;
+          out_ += linesep_;
           if (opt.group_ddl2_categories && cat.empty()) {
             cat = get_tag_category(item.pair[0]);
             if (seen_cats.insert(cat).second)
               open_cat(cat, &tag_pos);
           }
           write_string(item.pair[0], tag_pos, opt.lowercase_names);
-          os_ << ": ";
+          out_ += ": ";
           if (opt.values_as_arrays)
-            os_.put('[');
-          write_value(item.pair[1]);
+            out_ += '[';
+          write_value(out_, item.pair[1]);
           if (opt.values_as_arrays)
-            os_.put(']');
+            out_ += ']';
           first = ',';
           break;
         case ItemType::Loop:
           if (!item.loop.values.empty()) {
             close_cat(cat, &tag_pos);
-            os_ << first << linesep_;
+            out_ += first;
+            out_ += linesep_;
             write_loop(item.loop);
             first = ',';
           }
@@ -221,30 +272,36 @@ private:
         case ItemType::Erased:
           break;
       }
+      flush_if_full();
     }
     if (has_frames) {  // usually, we don't have any frames
-      os_ << first << linesep_ << "\"Frames\": ";
+      out_ += first;
+      out_ += linesep_;
+      out_ += "\"Frames\": ";
       change_indent(+1);
       first = '{';
       for (const Item& item : items)
         if (item.type == ItemType::Frame) {
-          os_ << first << linesep_;
+          out_ += first;
+          out_ += linesep_;
           write_map(item.frame.name, item.frame.items);
           first = ',';
         }
       change_indent(-1);
-      os_ << linesep_ << '}';
+      out_ += linesep_;
+      out_ += '}';
     }
     close_cat(cat, &tag_pos);
     change_indent(-1);
-    os_ << linesep_ << '}';
+    out_ += linesep_;
+    out_ += '}';
   }
 };
 
 void JsonWriter::write_json(const Document& d) {
-  os_.put('{');
+  out_ += '{';
   if (opt.as_comcifs) {
-    os_ << R"(
+    out_ += R"(
  "CIF-JSON": {
   "Metadata": {
    "cif-version": "2.0",
@@ -256,20 +313,22 @@ void JsonWriter::write_json(const Document& d) {
   }
   for (const Block& block : d.blocks) {
     if (&block != &d.blocks[0])
-      os_.put(',');
+      out_ += ',';
     // start mmJSON with {"data_ so it can be easily recognized
     if (&block != &d.blocks[0] || opt.as_comcifs || !opt.with_data_keyword)
-      os_ << linesep_;
+      out_ += linesep_;
     write_map((opt.with_data_keyword ? "data_" : "") + block.name, block.items);
   }
   if (opt.as_comcifs)
-    os_ << "\n }";
-  os_ << "\n}\n";
+    out_ += "\n }";
+  out_ += "\n}\n";
+  flush();
 }
 
 
-void write_json_to_stream(std::ostream& os, const Document& doc, const JsonWriteOptions& options) {
-  cif::JsonWriter writer(os);
+void write_json_to_stream(std::ostream& os, const Document& doc,
+                          const JsonWriteOptions& options, int nthreads) {
+  cif::JsonWriter writer(os, nthreads);
   writer.opt = options;
   writer.write_json(doc);
 }
@@ -4,13 +4,16 @@
 
 #include <cassert>
 #include <cmath>  // for isnan
+#include <cstdint>  // for SIZE_MAX
 #include <set>
+#include <sstream>  // for ostringstream
 #include <string>
 #include <utility>  // std::pair
 
 #include <gemmi/atox.hpp>       // no_sign_atoi
 #include <gemmi/sprintf.hpp>
 #include <gemmi/enumstr.hpp>    // for entity_type_to_string, ...
+#include <gemmi/parallel.hpp>   // for parallel_for
 #include <gemmi/seqtools.hpp>   // for pdbx_one_letter_code, ...
 #include <gemmi/to_pdb.hpp>     // for use_hetatm
 
@@ -100,8 +103,25 @@ std::string site_details_or_fallback(const StructSite& site) {
 }
 
 
-void add_cif_atoms(const Structure& st, cif::Block& block,
-                   bool use_group_pdb, bool auth_all) {
+// Optional columns of _atom_site and the number of rows in
+// _atom_site and _atom_site_anisotrop.
+struct AtomSiteColumns {
+  bool group_pdb = false;
+  bool auth_all = false;
+  bool calc_flag = false;
+  bool tls_group_id = false;
+  bool d_fraction = false;
+  size_t atom_count = 0;
+  size_t aniso_count = 0;
+};
+
+// Adds _atom_site and _atom_site_anisotrop loops with tags, but no values.
+AtomSiteColumns add_atom_site_tags(const Structure& st, cif::Block& block,
+                                   bool use_group_pdb, bool auth_all) {
+  AtomSiteColumns c;
+  c.group_pdb = use_group_pdb;
+  c.auth_all = auth_all;
+  c.d_fraction = st.has_d_fraction;
   // atom list
   cif::Loop& atom_loop = block.init_mmcif_loop("_atom_site.", {
       "id",
@@ -128,81 +148,27 @@ void add_cif_atoms(const Structure& st, cif::Block& block,
     atom_loop.tags.erase(atom_loop.tags.begin() + 15, atom_loop.tags.begin() + 17);
   if (use_group_pdb)
     atom_loop.tags.emplace(atom_loop.tags.begin(), "_atom_site.group_PDB");
-  bool has_calc_flag = false;
-  bool has_tls_group_id = false;
-  size_t atom_site_count = 0;
   for (const Model& model : st.models)
     for (const Chain& chain : model.chains)
       for (const Residue& res : chain.residues)
         for (const Atom& atom : res.atoms) {
-          ++atom_site_count;
+          ++c.atom_count;
           if (atom.calc_flag != CalcFlag::NotSet &&
               atom.calc_flag != CalcFlag::NoHydrogen)
-            has_calc_flag = true;
+            c.calc_flag = true;
           if (atom.tls_group_id >= 0)
-            has_tls_group_id = true;
+            c.tls_group_id = true;
+          if (atom.aniso.nonzero())
+            ++c.aniso_count;
         }
-  if (has_calc_flag)
+  if (c.calc_flag)
     atom_loop.tags.emplace_back("_atom_site.calc_flag");
-  if (has_tls_group_id)
+  if (c.tls_group_id)
     atom_loop.tags.emplace_back("_atom_site.pdbx_tls_group_id");
-  if (st.has_d_fraction)
+  if (c.d_fraction)
     atom_loop.tags.emplace_back("_atom_site.ccp4_deuterium_fraction");
 
-  std::vector<std::string>& vv = atom_loop.values;
-  vv.reserve(atom_site_count * atom_loop.tags.size());
-  std::vector<std::tuple<int, int, const Atom*>> aniso;
-  int serial = 0;
-  for (const Model& model : st.models) {
-    for (const Chain& chain : model.chains) {
-      for (const Residue& res : chain.residues) {
-        bool as_het = use_hetatm(res);
-        std::string label_seq_id = res.label_seq.str('.');
-        std::string auth_seq_id = res.seqid.num.str();
-        std::string entity_id;
-        if (const Entity* ent = gemmi::find_entity_of_subchain(res.subchain, st.entities))
-          entity_id = cif::quote(ent->name);
-        else
-          entity_id = string_or_dot(res.entity_id);
-        for (const Atom& atom : res.atoms) {
-          if (use_group_pdb)
-            vv.emplace_back(as_het ? "HETATM" : "ATOM");
-          vv.emplace_back(std::to_string(++serial));
-          vv.emplace_back(atom.element.uname());
-          vv.emplace_back(cif::quote(atom.name));
-          vv.emplace_back(1, atom.altloc_or('.'));
-          vv.emplace_back(cif::quote(res.name));
-          vv.emplace_back(subchain_or_dot(res));
-          vv.emplace_back(entity_id);
-          vv.emplace_back(label_seq_id);
-          vv.emplace_back(pdbx_icode(res));
-          vv.emplace_back(to_str(atom.pos.x));
-          vv.emplace_back(to_str(atom.pos.y));
-          vv.emplace_back(to_str(atom.pos.z));
-          vv.emplace_back(to_str(atom.occ));
-          vv.emplace_back(to_str(atom.b_iso));
-          vv.emplace_back(atom.charge == 0 ? "?" : std::to_string(atom.charge));
-          if (auth_all) {
-            size_t atom_name_idx = vv.size() - 13;
-            vv.emplace_back(vv[atom_name_idx]);  // auth_atom_id = label_atom_id
-            vv.emplace_back(vv[atom_name_idx + 2]);  // auth_comp_id = label_comp_id
-          }
-          vv.emplace_back(auth_seq_id);
-          vv.emplace_back(qchain(chain.name));
-          vv.emplace_back(std::to_string(model.num));
-          if (has_calc_flag)
-            vv.emplace_back(&".\0.\0d\0c\0dum"[2 * (int) atom.calc_flag]);
-          if (has_tls_group_id)
-            vv.emplace_back(int_or_qmark(atom.tls_group_id));
-          if (st.has_d_fraction)
-            vv.emplace_back(to_str(atom.fraction));
-          if (atom.aniso.nonzero())
-            aniso.emplace_back(serial, model.num, &atom);
-        }
-      }
-    }
-  }
-  if (aniso.empty()) {
+  if (c.aniso_count == 0) {
     block.find_mmcif_category("_atom_site_anisotrop.").erase();
   } else {
     cif::Loop& aniso_loop = block.init_mmcif_loop("_atom_site_anisotrop.", {
@@ -210,24 +176,227 @@ void add_cif_atoms(const Structure& st, cif::Block& block,
                                   "U[3][3]", "U[1][2]", "U[1][3]", "U[2][3]"});
     if (st.models.size() > 1)
       aniso_loop.tags.push_back("_atom_site_anisotrop.pdbx_PDB_model_num");
-    std::vector<std::string>& aniso_val = aniso_loop.values;
-    aniso_val.reserve(aniso_loop.tags.size() * aniso.size());
-    for (const auto& a : aniso) {
-      aniso_val.emplace_back(std::to_string(std::get<0>(a)));
-      const Atom* atom = std::get<2>(a);
-      aniso_val.emplace_back(atom->element.uname());
-      aniso_val.emplace_back(to_str(atom->aniso.u11));
-      aniso_val.emplace_back(to_str(atom->aniso.u22));
-      aniso_val.emplace_back(to_str(atom->aniso.u33));
-      aniso_val.emplace_back(to_str(atom->aniso.u12));
-      aniso_val.emplace_back(to_str(atom->aniso.u13));
-      aniso_val.emplace_back(to_str(atom->aniso.u23));
-      if (st.models.size() > 1)
-        aniso_loop.values.push_back(std::to_string(std::get<1>(a)));
+  }
+  return c;
+}
+
+// Like to_str(), but re-using the string's buffer.
+void assign_num(std::string& s, double d) {
+  char buf[24];
+  s.assign(buf, general_to_chars_z(buf, buf + sizeof(buf), d, 9));
+}
+void assign_num(std::string& s, float d) {
+  char buf[16];
+  s.assign(buf, general_to_chars_z(buf, buf + sizeof(buf), d, 6));
+}
+void assign_int(std::string& s, int n) {
+  char buf[16];
+  s.assign(buf, to_chars_z(buf, buf + sizeof(buf), n));
+}
+
+// Consecutive residues from one chain.
+struct AtomSiteChunk {
+  const Model* model;
+  const Chain* chain;
+  const Residue* begin;
+  const Residue* end;
+  int serial;  // _atom_site.id before the first atom
+};
+
+// Splits atoms into chunks of whole residues from one chain,
+// with at least chunk_atoms atoms (except the last chunk in a chain).
+std::vector<AtomSiteChunk> split_atom_site(const Structure& st, size_t chunk_atoms) {
+  std::vector<AtomSiteChunk> chunks;
+  int serial = 0;
+  for (const Model& model : st.models)
+    for (const Chain& chain : model.chains) {
+      const Residue* begin = chain.residues.data();
+      const Residue* end = begin + chain.residues.size();
+      AtomSiteChunk chunk{&model, &chain, begin, begin, serial};
+      size_t natoms = 0;
+      for (const Residue* res = begin; res != end; ++res) {
+        if (natoms >= chunk_atoms) {
+          chunk.end = res;
+          chunks.push_back(chunk);
+          chunk = AtomSiteChunk{&model, &chain, res, res, serial};
+          natoms = 0;
+        }
+        natoms += res->atoms.size();
+        serial += (int) res->atoms.size();
+      }
+      chunk.end = end;
+      chunks.push_back(chunk);
+    }
+  return chunks;
+}
+
+// Calls func(row) for each row of _atom_site in the chunk. The row vector
+// is re-used, so no memory is allocated for most of the values.
+template<typename Func>
+void for_each_atom_site_row(const Structure& st, const AtomSiteColumns& c,
+                            const AtomSiteChunk& chunk, Func&& func) {
+  size_t ncol = 18 + c.group_pdb + 2 * c.auth_all + c.calc_flag + c.tls_group_id + c.d_fraction;
+  std::vector<std::string> row(ncol);
+  std::string model_num = std::to_string(chunk.model->num);
+  std::string auth_asym_id = qchain(chunk.chain->name);
+  int serial = chunk.serial;
+  for (const Residue* res_ptr = chunk.begin; res_ptr != chunk.end; ++res_ptr) {
+    const Residue& res = *res_ptr;
+    const char* group_pdb = use_hetatm(res) ? "HETATM" : "ATOM";
+    std::string comp_id = cif::quote(res.name);
+    std::string label_asym_id = subchain_or_dot(res);
+    std::string label_seq_id = res.label_seq.str('.');
+    std::string ins_code = pdbx_icode(res);
+    std::string auth_seq_id = res.seqid.num.str();
+    std::string entity_id;
+    if (const Entity* ent = gemmi::find_entity_of_subchain(res.subchain, st.entities))
+      entity_id = cif::quote(ent->name);
+    else
+      entity_id = string_or_dot(res.entity_id);
+    for (const Atom& atom : res.atoms) {
+      std::string* v = row.data();
+      if (c.group_pdb)
+        (v++)->assign(group_pdb);
+      assign_int(*v++, ++serial);
+      (v++)->assign(atom.element.uname());
+      std::string& atom_id = *v;
+      *v++ = cif::quote(atom.name);
+      (v++)->assign(1, atom.altloc_or('.'));
+      *v++ = comp_id;
+      *v++ = label_asym_id;
+      *v++ = entity_id;
+      *v++ = label_seq_id;
+      *v++ = ins_code;
+      assign_num(*v++, atom.pos.x);
+      assign_num(*v++, atom.pos.y);
+      assign_num(*v++, atom.pos.z);
+      assign_num(*v++, atom.occ);
+      assign_num(*v++, atom.b_iso);
+      if (atom.charge == 0)
+        (v++)->assign(1, '?');
+      else
+        assign_int(*v++, atom.charge);
+      if (c.auth_all) {
+        *v++ = atom_id;  // auth_atom_id = label_atom_id
+        *v++ = comp_id;  // auth_comp_id = label_comp_id
+      }
+      *v++ = auth_seq_id;
+      *v++ = auth_asym_id;
+      *v++ = model_num;
+      if (c.calc_flag)
+        (v++)->assign(&".\0.\0d\0c\0dum"[2 * (int) atom.calc_flag]);
+      if (c.tls_group_id)
+        *v++ = int_or_qmark(atom.tls_group_id);
+      if (c.d_fraction)
+        assign_num(*v++, atom.fraction);
+      func(row);
     }
   }
 }
 
+// Calls func(row) for each row of _atom_site_anisotrop in the chunk.
+template<typename Func>
+void for_each_atom_site_aniso_row(bool multi_model, const AtomSiteChunk& chunk,
+                                  Func&& func) {
+  std::vector<std::string> row(multi_model ? 9 : 8);
+  int serial = chunk.serial;
+  for (const Residue* res = chunk.begin; res != chunk.end; ++res)
+    for (const Atom& atom : res->atoms) {
+      ++serial;
+      if (!atom.aniso.nonzero())
+        continue;
+      assign_int(row[0], serial);
+      row[1].assign(atom.element.uname());
+      assign_num(row[2], atom.aniso.u11);
+      assign_num(row[3], atom.aniso.u22);
+      assign_num(row[4], atom.aniso.u33);
+      assign_num(row[5], atom.aniso.u12);
+      assign_num(row[6], atom.aniso.u13);
+      assign_num(row[7], atom.aniso.u23);
+      if (multi_model)
+        assign_int(row[8], chunk.model->num);
+      func(row);
+    }
+}
+
+void add_cif_atoms(const Structure& st, cif::Block& block,
+                   bool use_group_pdb, bool auth_all) {
+  AtomSiteColumns c = add_atom_site_tags(st, block, use_group_pdb, auth_all);
+  // one chunk per chain
+  std::vector<AtomSiteChunk> chunks = split_atom_site(st, SIZE_MAX);
+  cif::Loop& atom_loop = block.find_mmcif_category("_atom_site.").loop_item->loop;
+  std::vector<std::string>& vv = atom_loop.values;
+  vv.reserve(c.atom_count * atom_loop.tags.size());
+  for (const AtomSiteChunk& chunk : chunks)
+    for_each_atom_site_row(st, c, chunk, [&](const std::vector<std::string>& row) {
+      vv.insert(vv.end(), row.begin(), row.end());
+    });
+  if (c.aniso_count != 0) {
+    cif::Loop& aniso_loop =
+      block.find_mmcif_category("_atom_site_anisotrop.").loop_item->loop;
+    std::vector<std::string>& aniso_val = aniso_loop.values;
+    aniso_val.reserve(aniso_loop.tags.size() * c.aniso_count);
+    for (const AtomSiteChunk& chunk : chunks)
+      for_each_atom_site_aniso_row(st.models.size() > 1, chunk,
+                                   [&](const std::vector<std::string>& row) {
+        aniso_val.insert(aniso_val.end(), row.begin(), row.end());
+      });
+  }
+}
+
+// Writes a loop with rows from for_each_row_in(chunk, func).
+// Chunks are formatted on multiple threads (a few chunks per thread
+// at a time) and written in order. The output is the same as from
+// cif::write_out_generated_loop().
+template<typename ForEachRowIn>
+void write_chunked_loop(cif::BufOstream& os, const std::vector<std::string>& tags,
+                        size_t nrows, const std::vector<AtomSiteChunk>& chunks,
+                        ForEachRowIn&& for_each_row_in, cif::WriteOptions options,
+                        int nthreads) {
+  if (nthreads == 1 || chunks.size() < 2 || (options.prefer_pairs && nrows == 1)) {
+    cif::write_out_generated_loop(os, tags, nrows, [&](auto&& func) {
+      for (const AtomSiteChunk& chunk : chunks)
+        for_each_row_in(chunk, func);
+    }, options);
+    return;
+  }
+  if (nrows == 0 || tags.empty())
+    return;
+  nthreads = resolve_thread_count(nthreads);
+  cif::write_out_loop_tags_(os, tags);
+  std::vector<size_t> col_width(tags.size(), 0);
+  if (options.align_loops > 0) {
+    std::vector<std::vector<size_t>> chunk_widths(chunks.size(), col_width);
+    parallel_for(chunks.size(), nthreads, [&](size_t i) {
+      for_each_row_in(chunks[i], [&](const std::vector<std::string>& row) {
+        cif::update_col_width_(chunk_widths[i], row.data());
+      });
+    });
+    for (const std::vector<size_t>& widths : chunk_widths)
+      for (size_t j = 0; j != col_width.size(); ++j)
+        col_width[j] = std::max(col_width[j], widths[j]);
+    for (size_t& w : col_width)
+      w = std::min(w, (size_t)options.align_loops);
+  }
+  std::vector<std::string> outputs(std::min(size_t(4 * nthreads), chunks.size()));
+  for (size_t w = 0; w < chunks.size(); w += outputs.size()) {
+    size_t n = std::min(outputs.size(), chunks.size() - w);
+    parallel_for(n, nthreads, [&](size_t k) {
+      std::ostringstream chunk_os;
+      {
+        cif::BufOstream chunk_buf(chunk_os);
+        for_each_row_in(chunks[w + k], [&](const std::vector<std::string>& row) {
+          cif::write_out_loop_row_(chunk_buf, row.data(), col_width);
+        });
+      }
+      outputs[k] = chunk_os.str();
+    });
+    for (size_t k = 0; k != n; ++k)
+      os.write(outputs[k].data(), outputs[k].size());
+  }
+  os.put('\n');
+}
+
 // the names are: monomeric, dimeric, ...meric, 21-meric, 22-meric, ...
 int xmeric_to_number(const std::string& oligomeric) {
   static const char names[20][10] = {
@@ -586,7 +755,12 @@ void write_struct_sites(const Structure& st, cif::Block& block) {
   }
 }
 
-void update_mmcif_block(const Structure& st, cif::Block& block, MmcifOutputGroups groups) {
+namespace {
+
+// If atom_columns is not null, _atom_site loops get only tags
+// (the values are to be written by write_mmcif_to_stream()).
+void update_mmcif_block_(const Structure& st, cif::Block& block,
+                         MmcifOutputGroups groups, AtomSiteColumns* atom_columns) {
   if (st.models.empty())
     return;
 
@@ -1344,8 +1518,12 @@ void update_mmcif_block(const Structure& st, cif::Block& block, MmcifOutputGroup
       }
   }
 
-  if (groups.atoms)
-    add_cif_atoms(st, block, groups.group_pdb, groups.auth_all);
+  if (groups.atoms) {
+    if (atom_columns)
+      *atom_columns = add_atom_site_tags(st, block, groups.group_pdb, groups.auth_all);
+    else
+      add_cif_atoms(st, block, groups.group_pdb, groups.auth_all);
+  }
 
   if (groups.tls && st.meta.get_tls_groups() != nullptr) {
     // pdbx_refine_id doesn't make sense here, but it's required
@@ -1423,6 +1601,45 @@ void update_mmcif_block(const Structure& st, cif::Block& block, MmcifOutputGroup
   }
 }
 
+} // anonymous namespace
+
+void update_mmcif_block(const Structure& st, cif::Block& block, MmcifOutputGroups groups) {
+  update_mmcif_block_(st, block, groups, nullptr);
+}
+
+void write_mmcif_to_stream(std::ostream& os_, const Structure& st,
+                           MmcifOutputGroups groups, cif::WriteOptions options,
+                           int nthreads) {
+  cif::Block block;
+  AtomSiteColumns c;
+  update_mmcif_block_(st, block, groups, &c);
+  const cif::Item* atom_item = nullptr;
+  const cif::Item* aniso_item = nullptr;
+  std::vector<AtomSiteChunk> chunks;
+  if (groups.atoms && !st.models.empty()) {
+    atom_item = block.find_loop_item("_atom_site.id");
+    if (c.aniso_count != 0)
+      aniso_item = block.find_loop_item("_atom_site_anisotrop.id");
+    chunks = split_atom_site(st, nthreads == 1 ? SIZE_MAX : 4096);
+  }
+  bool multi_model = st.models.size() > 1;
+  cif::BufOstream os(os_);
+  cif::write_cif_block_items_(os, block, options, [&](const cif::Item& item) {
+    if (&item == atom_item)
+      write_chunked_loop(os, item.loop.tags, c.atom_count, chunks,
+          [&](const AtomSiteChunk& chunk, auto&& func) {
+            for_each_atom_site_row(st, c, chunk, func);
+          }, options, nthreads);
+    else if (&item == aniso_item)
+      write_chunked_loop(os, item.loop.tags, c.aniso_count, chunks,
+          [&](const AtomSiteChunk& chunk, auto&& func) {
+            for_each_atom_site_aniso_row(multi_model, chunk, func);
+          }, options, nthreads);
+    else
+      cif::write_out_item(os, item, options);
+  });
+}
+
 cif::Document make_mmcif_document(const Structure& st, MmcifOutputGroups groups) {
   cif::Document doc;
   doc.blocks.resize(1);
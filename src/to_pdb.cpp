@@ -10,6 +10,7 @@
 #include <sstream>       // for ostringstream
 
 #include <gemmi/fail.hpp>       // for fail
+#include <gemmi/parallel.hpp>   // for parallel_for
 #include <gemmi/sprintf.hpp>
 #include <gemmi/resinfo.hpp>    // for find_tabulated_residue
 #include <gemmi/util.hpp>
@@ -279,13 +280,33 @@ void write_remarks(const Structure& st, std::ostream& os) {
   write_site_remarks(st, os);
 }
 
-void write_chain_atoms(const Chain& chain, std::ostream& os,
-                       int& serial, PdbWriteOptions opt) {
+bool is_followed_by_ter(const Chain& chain, const Residue& res, const PdbWriteOptions& opt) {
+  return opt.ter_ignores_type ? &res == &chain.residues.back()
+                              : (res.entity_type == EntityType::Polymer &&
+                                 (&res == &chain.residues.back() ||
+                                  (&res + 1)->entity_type != EntityType::Polymer));
+}
+
+// Writes ATOM/HETATM/ANISOU/TER records for residues [begin, end) of chain.
+// prev_res is the last residue in the chain before begin that has atoms
+// (TER record copies residue fields from the last atom record).
+// Output type Out must have function write(const char*, size_t).
+template<typename Out>
+void write_chain_atoms(const Chain& chain, const Residue* begin, const Residue* end,
+                       const Residue* prev_res, Out& os, int& serial,
+                       const PdbWriteOptions& opt) {
   char buf[88];
   buf[0] = '\0';
   if (chain.name.length() > 2)
     fail("long chain name: " + chain.name);
-  for (const Residue& res : chain.residues) {
+  if (prev_res) {
+    buf[0] = 'A';
+    snprintf_z(buf+17, 82-17, "%3.3s%2s%5s ",
+               prev_res->name.c_str(), chain.name.c_str(),
+               write_seq_id(prev_res->seqid).data());
+  }
+  for (const Residue* res_ptr = begin; res_ptr != end; ++res_ptr) {
+    const Residue& res = *res_ptr;
     bool as_het = use_hetatm(res);
     for (const Atom& a : res.atoms) {
       serial = opt.preserve_serial ? a.serial : serial + 1;
@@ -309,40 +330,40 @@ void write_chain_atoms(const Chain& chain, std::ostream& os,
       // 73-76      segment identifier, left-justified (non-standard)
       // 77-78  2s  element symbol, right-justified
       // 79-80  2s  charge
-      int written_bytes = snprintf_z(buf, 82,
-            "%-6s%5s %-4.4s%c%3.3s"
-            "%2s%5s   %8.3f%8.3f%8.3f",
+      int prefix_len = snprintf_z(buf, 82,
+            "%-6s%5s %-4.4s%c%3.3s%2s%5s   ",
             as_het ? "HETATM" : "ATOM",
             encode_serial_in_hybrid36(serial).data(),
             a.padded_name().c_str(),
             a.altloc ? std::toupper(a.altloc) : ' ',
             res.name.c_str(),
             chain.name.c_str(),
-            write_seq_id(res.seqid).data(),
-            // We want to avoid negative zero and round the numbers up
-            // if they originally had one digit more and that digit was 5.
-            a.pos.x > -5e-4 && a.pos.x < 0 ? 0 : a.pos.x + 1e-10,
-            a.pos.y > -5e-4 && a.pos.y < 0 ? 0 : a.pos.y + 1e-10,
-            a.pos.z > -5e-4 && a.pos.z < 0 ? 0 : a.pos.z + 1e-10);
-      if GEMMI_UNLIKELY(written_bytes > 54) {
+            write_seq_id(res.seqid).data());
+      char* ptr = buf + std::min(prefix_len, 81);
+      // We want to avoid negative zero and round the numbers up
+      // if they originally had one digit more and that digit was 5.
+      for (double coor : {a.pos.x, a.pos.y, a.pos.z})
+        ptr = fixed_to_chars_z(ptr, buf + 82,
+                               coor > -5e-4 && coor < 0 ? 0 : coor + 1e-10, 3, 8);
+      if GEMMI_UNLIKELY(ptr - buf > 54) {
         // The only items expected to overflow above are the coordinates,
         // if the integer part of the number exceeds 5 characters.
         // This happens when something goes wrong and the model is far from
         // the origin. Such a model should be shifted; it can't be written it
         // in a spec-conforming format: Real(8.3). Here we overwrite the last
         // digits - trimming is better than overflowing the line.
-        snprintf_z(buf+38, 82-38, "%8.3f", a.pos.y);
-        snprintf_z(buf+46, 82-46, "%8.3f", a.pos.z);
+        fixed_to_chars_z(buf+38, buf+82, a.pos.y, 3, 8);
+        fixed_to_chars_z(buf+46, buf+82, a.pos.z, 3, 8);
       }
-      snprintf_z(buf+54, 82-54,
-            "%6.2f%6.2f      %-4.4s%2s%c%c",
-            // Occupancy is stored as single prec, but we know it's <= 1,
-            // so no precision is lost even if it had 6 digits after dot.
-            a.occ + 1e-6,
-            // B is harder to get rounded right. It is stored as float,
-            // and may be given with more than single precision in mmCIF
-            // If it was originally %.5f (5TIS) we need to add 0.5 * 10^-5.
-            std::min(a.b_iso + 0.5e-5, 999.99),
+      // Occupancy is stored as single prec, but we know it's <= 1,
+      // so no precision is lost even if it had 6 digits after dot.
+      ptr = fixed_to_chars_z(buf+54, buf+82, a.occ + 1e-6, 2, 6);
+      // B is harder to get rounded right. It is stored as float,
+      // and may be given with more than single precision in mmCIF
+      // If it was originally %.5f (5TIS) we need to add 0.5 * 10^-5.
+      ptr = fixed_to_chars_z(ptr, buf+82, std::min(a.b_iso + 0.5e-5, 999.99), 2, 6);
+      snprintf_z(ptr, int(buf + 82 - ptr),
+            "      %-4.4s%2s%c%c",
             res.segment.c_str(),
             a.element.uname(),
             // Charge is written as 1+ or 2-, etc, or just empty space.
@@ -355,20 +376,16 @@ void write_chain_atoms(const Chain& chain, std::ostream& os,
         // re-using part of the buffer
         std::memcpy(buf, "ANISOU", 6);
         const double eps = 1e-6;
-        snprintf_z(buf+28, 43, "%7.0f%7.0f%7.0f%7.0f%7.0f%7.0f",
-                   a.aniso.u11*1e4 + eps, a.aniso.u22*1e4 + eps,
-                   a.aniso.u33*1e4 + eps, a.aniso.u12*1e4 + eps,
-                   a.aniso.u13*1e4 + eps, a.aniso.u23*1e4 + eps);
+        ptr = buf + 28;
+        for (float u : {a.aniso.u11, a.aniso.u22, a.aniso.u33,
+                        a.aniso.u12, a.aniso.u13, a.aniso.u23})
+          ptr = fixed_to_chars_z(ptr, buf + 28 + 43, u*1e4 + eps, 0, 7);
         buf[28+42] = ' ';
         buf[80] = '\n';
         os.write(buf, 81);
       }
     }
-    if (opt.ter_records && buf[0] != '\0' &&
-        (opt.ter_ignores_type ? &res == &chain.residues.back()
-                              : (res.entity_type == EntityType::Polymer &&
-                                (&res == &chain.residues.back() ||
-                                 (&res + 1)->entity_type != EntityType::Polymer)))) {
+    if (opt.ter_records && buf[0] != '\0' && is_followed_by_ter(chain, res, opt)) {
       if (opt.numbered_ter) {
         // re-using part of the buffer in the middle, e.g.:
         // TER    4153      LYS B 286
@@ -385,9 +402,71 @@ void write_chain_atoms(const Chain& chain, std::ostream& os,
   }
 }
 
+template<typename Out>
+void write_chain_atoms(const Chain& chain, Out& os, int& serial, const PdbWriteOptions& opt) {
+  const Residue* begin = chain.residues.data();
+  write_chain_atoms(chain, begin, begin + chain.residues.size(), nullptr, os, serial, opt);
+}
+
+// Consecutive residues from one chain, written by one thread.
+struct PdbAtomChunk {
+  size_t model_idx;
+  const Chain* chain;  // null for models without chains
+  const Residue* begin;
+  const Residue* end;
+  const Residue* prev_res;  // see write_chain_atoms()
+  int serial;  // serial number before the first record
+};
+
+// Splits models into chunks of about chunk_atoms atoms and calculates
+// serial numbers at the start of each chunk.
+std::vector<PdbAtomChunk> split_into_atom_chunks(const Structure& st,
+                                                 const PdbWriteOptions& opt,
+                                                 size_t chunk_atoms) {
+  std::vector<PdbAtomChunk> chunks;
+  for (size_t im = 0; im != st.models.size(); ++im) {
+    const Model& model = st.models[im];
+    if (model.chains.empty())
+      chunks.push_back({im, nullptr, nullptr, nullptr, nullptr, 0});
+    int serial = 0;
+    for (const Chain& chain : model.chains) {
+      const Residue* prev_res = nullptr;
+      const Residue* begin = chain.residues.data();
+      const Residue* end = begin + chain.residues.size();
+      PdbAtomChunk chunk{im, &chain, begin, begin, nullptr, serial};
+      size_t natoms = 0;
+      for (const Residue* res = begin; res != end; ++res) {
+        if (natoms >= chunk_atoms) {
+          chunk.end = res;
+          chunks.push_back(chunk);
+          chunk = PdbAtomChunk{im, &chain, res, res, prev_res, serial};
+          natoms = 0;
+        }
+        if (!res->atoms.empty()) {
+          natoms += res->atoms.size();
+          serial = opt.preserve_serial ? res->atoms.back().serial
+                                       : serial + (int) res->atoms.size();
+          prev_res = res;
+        }
+        if (opt.ter_records && opt.numbered_ter && prev_res &&
+            is_followed_by_ter(chain, *res, opt))
+          ++serial;
+      }
+      chunk.end = end;
+      chunks.push_back(chunk);
+    }
+  }
+  return chunks;
+}
+
+struct StringAppender {
+  std::string& str;
+  void write(const char* s, size_t n) { str.append(s, n); }
+};
+
 } // anonymous namespace
 
-void write_pdb(const Structure& st, std::ostream& os, PdbWriteOptions opt) {
+void write_pdb(const Structure& st, std::ostream& os, PdbWriteOptions opt, int nthreads) {
   // check if structure can be written as pdb
   for (const gemmi::Model& model : st.models)
     for (const gemmi::Chain& chain : model.chains)
@@ -751,7 +830,7 @@ void write_pdb(const Structure& st, std::ostream& os, PdbWriteOptions opt) {
   }
 
   // MODEL, ATOM, HETATM, TER, ENDMDL
-  if (opt.atom_records) {
+  if (opt.atom_records && nthreads == 1) {
     for (const Model& model : st.models) {
       int serial = 0;
       if (st.models.size() > 1)
@@ -761,6 +840,35 @@ void write_pdb(const Structure& st, std::ostream& os, PdbWriteOptions opt) {
       if (st.models.size() > 1)
         WRITE("%-80s", "ENDMDL");
     }
+  } else if (opt.atom_records) {
+    // The same as above, but chunks of atoms are formatted on multiple threads
+    // (a few chunks per thread at a time) and then written in order.
+    std::vector<PdbAtomChunk> chunks = split_into_atom_chunks(st, opt, 4096);
+    nthreads = resolve_thread_count(nthreads);
+    std::vector<std::string> outputs(std::min(size_t(4 * nthreads), chunks.size()));
+    for (size_t w = 0; w < chunks.size(); w += outputs.size()) {
+      size_t n = std::min(outputs.size(), chunks.size() - w);
+      parallel_for(n, nthreads, [&](size_t k) {
+        const PdbAtomChunk& chunk = chunks[w + k];
+        outputs[k].clear();
+        if (!chunk.chain)
+          return;
+        StringAppender out{outputs[k]};
+        int serial = chunk.serial;
+        write_chain_atoms(*chunk.chain, chunk.begin, chunk.end, chunk.prev_res,
+                          out, serial, opt);
+      });
+      for (size_t k = 0; k != n; ++k) {
+        size_t im = chunks[w + k].model_idx;
+        bool model_start = w + k == 0 || chunks[w + k - 1].model_idx != im;
+        bool model_end = w + k + 1 == chunks.size() || chunks[w + k + 1].model_idx != im;
+        if (model_start && st.models.size() > 1)
+          WRITE("MODEL %8d %65s", st.models[im].num, "");
+        os.write(outputs[k].data(), outputs[k].size());
+        if (model_end && st.models.size() > 1)
+          WRITE("%-80s", "ENDMDL");
+      }
+    }
   }
 
   // CONECT
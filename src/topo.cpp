@@ -7,6 +7,7 @@
 #include <gemmi/polyheur.hpp>  // for get_or_check_polymer_type, ...
 #include <gemmi/riding_h.hpp>  // for place_hydrogens_on_all_atoms, ...
 #include <gemmi/modify.hpp>    // for remove_hydrogens
+#include <gemmi/modelindex.hpp> // for ModelIndex
 
 namespace gemmi {
 
@@ -507,9 +508,12 @@ void Topo::initialize_refmac_topology(Structure& st, Model& model0,
   }
 
   // add extra links
+  ModelIndex index;
+  if (!st.connections.empty())
+    index.build(model0);
   for (Connection& conn : st.connections)
     if (conn.type != Connection::Hydrog) // ignoring hydrogen bonds
-      setup_connection(conn, model0, monlib, ignore_unknown_links);
+      setup_connection(conn, index, monlib, ignore_unknown_links);
 
   // Add modifications from standard links. We do it here b/c polymer links
   // could be disabled (link_id.clear()) in setup_connection().
@@ -662,7 +666,7 @@ Topo::Link* Topo::find_polymer_link(const AtomAddress& aa1, const AtomAddress& a
 
 // Tries to construct Topo::Link and append it to extras.
 // Side-effects: it may modify conn.link_id and add ChemLink to monlib.links.
-void Topo::setup_connection(Connection& conn, Model& model0, MonLib& monlib,
+void Topo::setup_connection(Connection& conn, const ModelIndex& index, MonLib& monlib,
                             bool ignore_unknown_links) {
   if (conn.link_id == "gap") {
     if (Link* polymer_link = find_polymer_link(conn.partner1, conn.partner2))
@@ -671,8 +675,8 @@ void Topo::setup_connection(Connection& conn, Model& model0, MonLib& monlib,
   }
 
   Link extra;
-  CRA cra1 = model0.find_cra(conn.partner1, true);
-  CRA cra2 = model0.find_cra(conn.partner2, true);
+  CRA cra1 = index.find_cra(conn.partner1, true);
+  CRA cra2 = index.find_cra(conn.partner2, true);
   if (!cra1.atom || !cra2.atom)
     return;
   extra.res1 = cra1.residue;
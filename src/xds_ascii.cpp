@@ -6,6 +6,7 @@
 #include <gemmi/util.hpp>      // for trim_str
 #include <gemmi/gz.hpp>
 #include <gemmi/math.hpp>
+#include <gemmi/parallel.hpp>  // for parallel_for_chunks
 
 namespace gemmi {
 
@@ -123,10 +124,79 @@ void parse_numbers_into_vec3(const char* start, const char* end,
     start = parse_number_into(start, end, *val, line);
 }
 
+// line must be NUL-terminated, len doesn't include the terminator
+void parse_data_line(const char* line, size_t len, int read_columns, int iset_col,
+                     XdsAscii::Refl& r) {
+  const char* p = line;
+  for (int i = 0; i < 3; ++i)
+    r.hkl[i] = simple_atoi(p, &p);
+  auto result = fast_from_chars(p, line+len, r.iobs); // 4
+  result = fast_from_chars(result.ptr, line+len, r.sigma); // 5
+  if (read_columns >= 8) {
+    result = fast_from_chars(result.ptr, line+len, r.xd); // 6
+    result = fast_from_chars(result.ptr, line+len, r.yd); // 7
+    result = fast_from_chars(result.ptr, line+len, r.zd); // 8
+    if (read_columns >= 11) {
+      result = fast_from_chars(result.ptr, line+len, r.rlp); // 9
+      result = fast_from_chars(result.ptr, line+len, r.peak); // 10
+      result = fast_from_chars(result.ptr, line+len, r.corr); // 11
+      if (read_columns >= 12) {
+        result = fast_from_chars(result.ptr, line+len, r.maxc); // 12
+      } else {
+        r.maxc = 0;  // 12
+      }
+    } else {
+      r.rlp = r.peak = r.corr = r.maxc = 0;  // 9-11
+    }
+  } else {
+    r.xd = r.yd = r.zd = 0;  // 6-8
+  }
+  if (result.ec != std::errc())
+    fail("failed to parse data line:\n", line);
+  if (iset_col >= read_columns) {
+    const char* iset_ptr = result.ptr;
+    for (int j = read_columns+1; j < iset_col; ++j)
+      iset_ptr = skip_word(skip_blank(iset_ptr));
+    r.iset = simple_atoi(iset_ptr);
+  }
+}
+
+// Number of data lines parsed together and passed to the consumer.
+const size_t xds_batch_size = 16384;
+
+// Data lines collected for parsing in parallel.
+struct LineBlock {
+  std::vector<char> text;         // NUL-terminated lines
+  std::vector<size_t> starts;     // start of each line in text
+
+  size_t size() const { return starts.size(); }
+  void add(const char* line, size_t len) {
+    starts.push_back(text.size());
+    text.insert(text.end(), line, line + len);
+    text.push_back('\0');
+  }
+  void clear() {
+    text.clear();
+    starts.clear();
+  }
+};
+
 
 } // anonymous namespace
 
-void XdsAscii::read_stream(AnyStream& line_reader, const std::string& source) {
+void XdsAscii::read_stream(AnyStream& line_reader, const std::string& source,
+                           int nthreads) {
+  read_stream(line_reader, source, [&](std::vector<Refl>& batch) {
+    if (data.empty())
+      data.swap(batch);
+    else
+      data.insert(data.end(), batch.begin(), batch.end());
+  }, nthreads);
+}
+
+void XdsAscii::read_stream(AnyStream& line_reader, const std::string& source,
+                           const std::function<void(std::vector<Refl>&)>& func,
+                           int nthreads) {
   source_path = source;
   read_columns = 12;
   char line[256];
@@ -146,8 +216,30 @@ void XdsAscii::read_stream(AnyStream& line_reader, const std::string& source) {
   if (!xds_ascii_type && !starts_with(line, "!OUTPUT_FILE=INTEGRATE.HKL"))
     fail("not an XDS_ASCII nor INTEGRATE.HKL file: " + source_path);
   const char* rhs;
+  LineBlock block;
+  std::vector<Refl> batch;
+  auto flush_block = [&]() {
+    if (block.size() == 0)
+      return;
+    batch.clear();
+    batch.resize(block.size());
+    parallel_for_chunks(block.size(), 4096, nthreads, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i != end; ++i) {
+        const char* start = &block.text[block.starts[i]];
+        size_t next = i + 1 < block.size() ? block.starts[i+1] : block.text.size();
+        parse_data_line(start, next - block.starts[i] - 1, read_columns, iset_col, batch[i]);
+      }
+    });
+    block.clear();
+    int max_iset = isets.empty() ? 1 : (int) isets.size();
+    for (const Refl& refl : batch)
+      if (refl.iset < 1 || refl.iset > max_iset)
+        fail("unexpected ITEM_ISET " + std::to_string(refl.iset));
+    func(batch);
+  };
   while (size_t len = line_reader.copy_line(line, 255)) {
     if (line[0] == '!') {
+      flush_block();
       if (starts_with_ptr(line+1, "Generated by ", &rhs)) {
         generated_by = read_word(rhs, &rhs);
         version_str = trim_str(rhs);
@@ -252,54 +344,20 @@ void XdsAscii::read_stream(AnyStream& line_reader, const std::string& source) {
           isets.emplace_back(1);
           isets.back().wavelength = wavelength;
         }
-        for (XdsAscii::Refl& refl : data)
-          if (size_t(refl.iset - 1) >= isets.size())
-            fail("unexpected ITEM_ISET " + std::to_string(refl.iset));
         return;
       }
     } else {
-      data.emplace_back();
-      XdsAscii::Refl& r = data.back();
-      const char* p = line;
-      for (int i = 0; i < 3; ++i)
-        r.hkl[i] = simple_atoi(p, &p);
-      auto result = fast_from_chars(p, line+len, r.iobs); // 4
-      result = fast_from_chars(result.ptr, line+len, r.sigma); // 5
-      if (read_columns >= 8) {
-        result = fast_from_chars(result.ptr, line+len, r.xd); // 6
-        result = fast_from_chars(result.ptr, line+len, r.yd); // 7
-        result = fast_from_chars(result.ptr, line+len, r.zd); // 8
-        if (read_columns >= 11) {
-          result = fast_from_chars(result.ptr, line+len, r.rlp); // 9
-          result = fast_from_chars(result.ptr, line+len, r.peak); // 10
-          result = fast_from_chars(result.ptr, line+len, r.corr); // 11
-          if (read_columns >= 12) {
-            result = fast_from_chars(result.ptr, line+len, r.maxc); // 12
-          } else {
-            r.maxc = 0;  // 12
-          }
-        } else {
-          r.rlp = r.peak = r.corr = r.maxc = 0;  // 9-11
-        }
-      } else {
-        r.xd = r.yd = r.zd = 0;  // 6-8
-      }
-      if (result.ec != std::errc())
-        fail("failed to parse data line:\n", line);
-      if (iset_col >= read_columns) {
-        const char* iset_ptr = result.ptr;
-        for (int j = read_columns+1; j < iset_col; ++j)
-          iset_ptr = skip_word(skip_blank(iset_ptr));
-        r.iset = simple_atoi(iset_ptr);
-      }
+      block.add(line, len);
+      if (block.size() >= xds_batch_size)
+        flush_block();
     }
   }
   fail("incorrect or unfinished file: " + source_path);
 }
 
-XdsAscii read_xds_ascii(const std::string& path) {
+XdsAscii read_xds_ascii(const std::string& path, int nthreads) {
   XdsAscii xds_ascii;
-  xds_ascii.read_input(gemmi::MaybeGzipped(path));
+  xds_ascii.read_input(gemmi::MaybeGzipped(path), nthreads);
   return xds_ascii;
 }
 
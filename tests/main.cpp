@@ -2,14 +2,44 @@
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include "doctest.h"
 
-#include <cstdlib>  // for rand
+#include <algorithm>  // for sort
+#include <cstdio>   // for snprintf
+#include <cstdlib>  // for rand, strtod
 #include <climits>  // for INT_MIN, INT_MAX
+#include <cstring>  // for strcmp
+#include <stdexcept>  // for runtime_error
 #include <vector>
 #include <gemmi/atox.hpp>
 #include <gemmi/math.hpp>
 #include <gemmi/it92.hpp>
 #include <gemmi/util.hpp>  // for is_in_list
+#include <gemmi/sprintf.hpp>  // for fixed_to_chars_z, ...
 #include <gemmi/asudata.hpp>  // for ComplexCorrelation
+#include <gemmi/parallel.hpp>  // for parallel_pipeline
+#include <gemmi/pdb.hpp>  // for read_pdb_string
+#include <gemmi/to_pdb.hpp>  // for make_pdb_string
+#include <gemmi/to_mmcif.hpp>  // for write_mmcif_to_stream
+#include <gemmi/polyheur.hpp>  // for setup_entities
+#include <gemmi/to_json.hpp>  // for write_json_to_stream
+#include <gemmi/mmindex.hpp>  // for make_model_file_index
+#include <gemmi/mmcif.hpp>  // for make_structure
+#include <gemmi/read_cif.hpp>  // for read_cif_from_memory
+#include <gemmi/solmask.hpp>  // for mask_points_in_radius, mask_with_node_info
+#include <gemmi/atomtable.hpp>  // for AtomTable
+#include <gemmi/dencalc.hpp>  // for DensityCalculator
+#include <gemmi/sfcalc.hpp>  // for StructureFactorCalculator
+#include <gemmi/neighbor.hpp>  // for NeighborSearch
+#include <gemmi/modelindex.hpp>  // for ModelIndex
+#include <gemmi/assembly.hpp>  // for make_assembly, make_instanced_assembly
+#include <gemmi/mmread_gz.hpp>  // for read_structure_gz
+#include <gemmi/intensit.hpp>  // for Intensities, CompactIntensities
+#include <gemmi/binner.hpp>  // for Binner
+#include <gemmi/xds_ascii.hpp>  // for XdsAscii
+#include <gemmi/fileutil.hpp>  // for read_file_into_buffer
+#include <gemmi/levmar.hpp>  // for LevMar, compute_lm_matrices
+#include <gemmi/mtz2cif.hpp>  // for MtzToCif
+#include <gemmi/gz.hpp>  // for MaybeGzipped, MaybeGzippedOfstream
+#include <sstream>
 #include <linalg.h>
 
 static double draw() { return 10.0 * std::rand() / RAND_MAX - 5; }
@@ -24,6 +54,12 @@ static gemmi::Transform random_transform() {
   return a;
 }
 
+// path to a file in the tests/ directory
+static std::string test_path(const char* name) {
+  std::string path = __FILE__;
+  return path.substr(0, path.find_last_of("/\\") + 1) + name;
+}
+
 TEST_CASE("Transform::inverse") {
   std::srand(12345);
   gemmi::Transform tr = random_transform();
@@ -139,6 +175,55 @@ TEST_CASE("string_to_int") {
   CHECK_EQ(gemmi::string_to_int("", false), 0);
 }
 
+TEST_CASE("to_chars_z") {
+  char buf[32];
+  gemmi::to_chars_z(buf, buf + 32, INT_MIN);
+  CHECK_EQ(std::string(buf), std::to_string(INT_MIN));
+  char* end = gemmi::fixed_to_chars_z(buf, buf + 8, -12345.678, 3, 12);
+  CHECK_EQ(std::string(buf, end), "  -1234");
+}
+
+TEST_CASE("fixed_to_chars_z and general_to_chars_z") {
+  char expected[64], buf[64];
+  for (int i = 0; i < 20000; ++i) {
+    // random numbers of different magnitude, in the fast path and not
+    double d = (std::rand() - RAND_MAX / 2) * std::pow(10., i % 24 - 12);
+    for (int prec : {0, 1, 3, 6}) {
+      gemmi::snprintf_z(expected, 64, "%8.*f", prec, d);
+      gemmi::fixed_to_chars_z(buf, buf + 64, d, prec, 8);
+      CHECK_EQ(std::strcmp(buf, expected), 0);
+    }
+    for (int prec : {1, 6, 9, 15}) {
+      gemmi::snprintf_z(expected, 64, "%.*g", prec, d);
+      gemmi::general_to_chars_z(buf, buf + 64, d, prec);
+      CHECK_EQ(std::strcmp(buf, expected), 0);
+    }
+  }
+}
+
+TEST_CASE("shortest_to_chars_z") {
+  char buf[32];
+  for (int i = 0; i < 20000; ++i) {
+    double d = (std::rand() - RAND_MAX / 2) * std::pow(10., i % 40 - 20) / 3;
+    char* end = gemmi::shortest_to_chars_z(buf, buf + 32, d);
+    CHECK_EQ(std::strtod(buf, nullptr), d);
+    CHECK_EQ((size_t)(end - buf), std::strlen(buf));
+    float f = (float) d;
+    gemmi::shortest_to_chars_z(buf, buf + 32, f);
+    CHECK_EQ(std::strtof(buf, nullptr), f);
+  }
+  gemmi::shortest_to_chars_z(buf, buf + 32, -0.0);
+  CHECK_EQ(std::string(buf), "-0");
+  char* end = gemmi::shortest_to_chars_z(buf, buf + 4, 12345.5);
+  CHECK_EQ(std::string(buf, end), "123");
+#if __cpp_lib_to_chars >= 201611L
+  gemmi::shortest_to_chars_z(buf, buf + 32, 0.1);
+  CHECK_EQ(std::string(buf), "0.1");
+  gemmi::shortest_to_chars_z(buf, buf + 32, 0.1f);
+  CHECK_EQ(std::string(buf), "0.1");
+#endif
+}
+
 TEST_CASE("is_in_list") {
   CHECK(gemmi::is_in_list("abc", "abc"));
   CHECK(gemmi::is_in_list("abc", "a,abc"));
@@ -183,3 +268,930 @@ TEST_CASE("vector_Vec3") {
   auto offset = x1 - x0;
   CHECK_EQ(offset, 3);
 }
+
+TEST_CASE("parallel_pipeline") {
+  const int n = 1000;
+  auto generate = [&](const auto& emit) {
+    for (int i = 0; i < n; ++i)
+      emit(i);
+  };
+  auto square = [](const int& i) { return (long) i * i; };
+  for (int nthreads : {1, 3}) {
+    std::vector<int> items;
+    long sum = 0;
+    gemmi::parallel_pipeline<int>(nthreads, true, generate, square,
+                                  [&](int& i, long& sq) { items.push_back(i); sum += sq; });
+    CHECK_EQ(items.size(), (size_t) n);
+    bool in_order = true;
+    for (int i = 0; i < n; ++i)
+      if (items[i] != i)
+        in_order = false;
+    CHECK(in_order);
+    CHECK_EQ(sum, (long) (n - 1) * n * (2 * n - 1) / 6);
+
+    items.clear();
+    gemmi::parallel_pipeline<int>(nthreads, false, generate, square,
+                                  [&](int& i, long&) { items.push_back(i); });
+    CHECK_EQ(items.size(), (size_t) n);
+
+    auto throw_at_500 = [](const int& i) {
+      if (i == 500)
+        throw std::runtime_error("500");
+      return i;
+    };
+    CHECK_THROWS_AS(gemmi::parallel_pipeline<int>(nthreads, true, generate, throw_at_500,
+                                                  [](int&, int&) {}),
+                    std::runtime_error);
+
+    // items emitted before generate() throws are processed and consumed
+    auto generate_and_throw = [&](const auto& emit) {
+      for (int i = 0; i < 100; ++i)
+        emit(i);
+      throw std::runtime_error("generate");
+    };
+    for (bool ordered : {true, false}) {
+      items.clear();
+      std::string msg;
+      try {
+        gemmi::parallel_pipeline<int>(nthreads, ordered, generate_and_throw, square,
+                                      [&](int& i, long&) { items.push_back(i); });
+      } catch (std::runtime_error& e) {
+        msg = e.what();
+      }
+      CHECK_EQ(msg, "generate");
+      std::sort(items.begin(), items.end());
+      CHECK_EQ(items.size(), 100);
+      CHECK_EQ(items.back(), 99);
+    }
+  }
+
+  // after an exception in process(), emit() returns false
+  int n_emitted = 0;
+  auto generate_until_stopped = [&](const auto& emit) {
+    for (int i = 0; i < n; ++i, ++n_emitted)
+      if (!emit(i))
+        return;
+  };
+  auto throw_at_0 = [](const int& i) {
+    if (i == 0)
+      throw std::runtime_error("0");
+    return i;
+  };
+  CHECK_THROWS_AS(gemmi::parallel_pipeline<int>(3, true, generate_until_stopped, throw_at_0,
+                                                [](int&, int&) {}),
+                  std::runtime_error);
+  CHECK(n_emitted < n);
+}
+
+TEST_CASE("read_pdb_string with nthreads") {
+  // many models, so that coordinate lines span several blocks of lines
+  std::string pdb = "CRYST1   20.000   20.000   20.000  90.00  90.00  90.00 P 1\n";
+  char line[82];
+  for (int m = 1; m <= 30; ++m) {
+    snprintf(line, sizeof line, "MODEL     %4d\n", m);
+    pdb += line;
+    for (int i = 0; i < 500; ++i) {
+      snprintf(line, sizeof line,
+               "%-6s%5d  CA  ALA %c%4d    %8.3f%8.3f%8.3f  1.00%6.2f           C\n",
+               i % 7 == 0 ? "HETATM" : "ATOM", i + 1, 'A' + i / 200, i,
+               0.1 * i, 0.01 * m, -0.2 * i, 0.01 * (i + m));
+      pdb += line;
+      if (i % 3 == 0)
+        pdb += "ANISOU    1  CA  ALA A   1     1234   2345   3456   -123    -12     12"
+               "       C\n";
+    }
+    pdb += "ENDMDL\n";
+  }
+  pdb += "END\nATOM      1  CA  ALA A   1       0.000   0.000   0.000\n";
+  gemmi::PdbReadOptions options;
+  gemmi::Structure st1 = gemmi::read_pdb_string(pdb, "test", options);
+  options.nthreads = 3;
+  gemmi::Structure st3 = gemmi::read_pdb_string(pdb, "test", options);
+  CHECK_EQ(st1.models.size(), 30);
+  CHECK_EQ(st1.models[29].chains.size(), 3);
+  CHECK_EQ(st1.models[0].chains[0].residues[0].atoms[0].aniso.u11, doctest::Approx(0.1234));
+  CHECK_EQ(gemmi::make_pdb_string(st1), gemmi::make_pdb_string(st3));
+}
+
+TEST_CASE("make_model_file_index") {
+  auto model_text = [](const std::string& text, const gemmi::ModelFileIndex& index,
+                       int num) {
+    const gemmi::ModelFileIndex::Entry* e = index.find(num);
+    REQUIRE(e != nullptr);
+    return text.substr(index.head.begin, index.head.size()) +
+           text.substr(e->range.begin, e->range.size()) +
+           text.substr(index.tail.begin, index.tail.size());
+  };
+  std::string pdb = "CRYST1   20.000   20.000   20.000  90.00  90.00  90.00 P 1\n";
+  std::string cif = "data_test\n_cell.length_a 20\n"
+                    "loop_\n_atom_site.id\n_atom_site.type_symbol\n"
+                    "_atom_site.label_atom_id\n_atom_site.label_alt_id\n"
+                    "_atom_site.label_comp_id\n_atom_site.label_asym_id\n"
+                    "_atom_site.label_seq_id\n_atom_site.Cartn_x\n"
+                    "_atom_site.Cartn_y\n_atom_site.Cartn_z\n"
+                    "_atom_site.pdbx_PDB_model_num\n";
+  char line[82];
+  for (int m = 1; m <= 3; ++m) {
+    snprintf(line, sizeof line, "MODEL     %4d\n", m);
+    pdb += line;
+    for (int i = 1; i <= 4; ++i) {
+      snprintf(line, sizeof line,
+               "ATOM  %5d  CA  ALA A%4d    %8.3f%8.3f%8.3f  1.00 10.00           C\n",
+               i, i, 1.0 * i, 1.0 * m, 0.);
+      pdb += line;
+      snprintf(line, sizeof line, "%d C CA . ALA A %d %g %g 0 %d\n", i, i, 1.0 * i,
+               1.0 * m, m);
+      cif += line;
+    }
+    pdb += "ENDMDL\n";
+  }
+  pdb += "END\n";
+  cif += "#\n_exptl.method 'SOLUTION NMR'\n";
+
+  gemmi::ModelFileIndex pdb_index =
+      gemmi::make_model_file_index(pdb.data(), pdb.size(), "test.pdb");
+  CHECK(pdb_index.format == gemmi::CoorFormat::Pdb);
+  CHECK_EQ(pdb_index.models.size(), 3);
+  CHECK_EQ(pdb_index.head.end, pdb.find("MODEL"));
+  gemmi::Structure st = gemmi::read_pdb_string(model_text(pdb, pdb_index, 2), "test");
+  REQUIRE_EQ(st.models.size(), 1);
+  CHECK_EQ(st.models[0].num, 2);
+  CHECK_EQ(st.models[0].chains[0].residues.size(), 4);
+  CHECK_EQ(st.models[0].chains[0].residues[0].atoms[0].pos.y, 2.0);
+  CHECK_EQ(st.cell.a, 20.0);
+
+  gemmi::ModelFileIndex cif_index =
+      gemmi::make_model_file_index(cif.data(), cif.size(), "test.cif");
+  CHECK(cif_index.format == gemmi::CoorFormat::Mmcif);
+  CHECK_EQ(cif_index.models.size(), 3);
+  std::string text = model_text(cif, cif_index, 3);
+  st = gemmi::make_structure(gemmi::read_cif_from_memory(text.data(), text.size(), "test"));
+  REQUIRE_EQ(st.models.size(), 1);
+  CHECK_EQ(st.models[0].num, 3);
+  CHECK_EQ(st.models[0].chains[0].residues.size(), 4);
+  CHECK_EQ(st.models[0].chains[0].residues[3].atoms[0].pos.y, 3.0);
+  CHECK_EQ(st.get_info("_exptl.method"), "SOLUTION NMR");
+
+  // rows of one model must be contiguous
+  std::string bad = "data_bad\nloop_\n_atom_site.id\n_atom_site.pdbx_PDB_model_num\n"
+                    "1 1\n2 2\n3 1\n";
+  CHECK_THROWS_AS(gemmi::make_model_file_index(bad.data(), bad.size(), "bad.cif"),
+                  std::runtime_error);
+}
+
+TEST_CASE("SphereBricks vs per-atom masking") {
+  for (const char* name : {"1orc.pdb", "5e5z.pdb"}) {
+    gemmi::Structure st = gemmi::read_pdb_file(test_path(name));
+    const gemmi::Model& model = st.models[0];
+    gemmi::Grid<std::int8_t> bricked;
+    bricked.setup_from(st, 0.5);
+    bricked.fill(1);
+    gemmi::Grid<std::int8_t> per_atom = bricked;
+    gemmi::mask_points_in_radius(bricked, model, gemmi::AtomicRadiiSet::VanDerWaals,
+                                 1.0, (std::int8_t)0, false, false, 3);
+    gemmi::Grid<std::int8_t> per_point = per_atom;
+    for (const gemmi::Chain& chain : model.chains)
+      for (const gemmi::Residue& res : chain.residues)
+        for (const gemmi::Atom& atom : res.atoms) {
+          double r = 1.0 + gemmi::vdw_radius(atom.element.elem);
+          per_atom.set_points_around(atom.pos, r, (std::int8_t)0);
+          per_point.use_points_around<true>(per_point.unit_cell.fractionalize(atom.pos), r,
+                                            [](std::int8_t& ref, double) { ref = 0; }, false);
+        }
+    CHECK(bricked.data == per_point.data);
+    CHECK(per_atom.data == per_point.data);
+
+    // set_points_around() without PBC, for spheres that cross the grid boundary
+    gemmi::Grid<std::int8_t> nopbc1;
+    nopbc1.copy_metadata_from(bricked);
+    nopbc1.fill(1);
+    gemmi::Grid<std::int8_t> nopbc2 = nopbc1;
+    for (double x : {-2.0, 0.3, 0.5, 7.7})
+      for (double r : {0.9, 3.0, 6.5}) {
+        gemmi::Position pos = nopbc1.unit_cell.orthogonalize(gemmi::Fractional(0.01, x / 8, 0.99));
+        nopbc1.set_points_around(pos, r, (std::int8_t)0, false);
+        nopbc2.use_points_around<false>(nopbc2.unit_cell.fractionalize(pos), r,
+                                        [](std::int8_t& ref, double) { ref = 0; }, false);
+      }
+    CHECK(std::count(nopbc1.data.begin(), nopbc1.data.end(), 0) > 0);
+    CHECK(nopbc1.data == nopbc2.data);
+
+    // mask_with_node_info() uses SphereBricks::use_points()
+    const double radius = 2.5;
+    gemmi::Grid<gemmi::NodeInfo> nodes;
+    nodes.copy_metadata_from(bricked);
+    gemmi::mask_with_node_info(nodes, model, radius, 2);
+    gemmi::Grid<gemmi::NodeInfo> ref_nodes;
+    ref_nodes.copy_metadata_from(bricked);
+    gemmi::NodeInfo default_ni;
+    default_ni.dist_sq = radius * radius;
+    ref_nodes.fill(default_ni);
+    int du = (int) std::ceil(radius / ref_nodes.spacing[0]);
+    int dv = (int) std::ceil(radius / ref_nodes.spacing[1]);
+    int dw = (int) std::ceil(radius / ref_nodes.spacing[2]);
+    ref_nodes.check_size_for_points_in_box<true>(du, dv, dw, false);
+    for (const gemmi::Chain& chain : model.chains)
+      for (const gemmi::Residue& res : chain.residues)
+        for (const gemmi::Atom& atom : res.atoms)
+          ref_nodes.do_use_points_in_box<true>(
+              ref_nodes.unit_cell.fractionalize(atom.pos), du, dv, dw,
+              [&](gemmi::NodeInfo& ni, double d2, const gemmi::Position&,
+                  int u, int v, int w) {
+                if (d2 < ni.dist_sq) {
+                  ni.dist_sq = d2;
+                  ni.found = true;
+                  ni.u = u;
+                  ni.v = v;
+                  ni.w = w;
+                }
+              }, radius);
+    size_t n_found = 0;
+    size_t n_diff = 0;
+    for (size_t i = 0; i != nodes.data.size(); ++i) {
+      const gemmi::NodeInfo& a = nodes.data[i];
+      const gemmi::NodeInfo& b = ref_nodes.data[i];
+      n_found += a.found;
+      if (a.found != b.found || a.u != b.u || a.v != b.v || a.w != b.w ||
+          a.dist_sq != b.dist_sq)
+        ++n_diff;
+    }
+    CHECK(n_found > 0);
+    CHECK_EQ(n_diff, 0);
+  }
+}
+
+TEST_CASE("AtomTable gives the same results as Model") {
+  for (const char* name : {"1orc.pdb", "5e5z.pdb"}) {
+    gemmi::Structure st = gemmi::read_pdb_file(test_path(name));
+    gemmi::Model& model = st.models[0];
+    gemmi::AtomTable table(model);
+    REQUIRE(table.matches(model));
+
+    gemmi::DensityCalculator<gemmi::IT92<float>, float> dc1, dc2;
+    dc1.d_min = dc2.d_min = 2.0;
+    dc1.grid.setup_from(st);
+    dc2.grid.setup_from(st);
+    dc1.put_model_density_on_grid(model);
+    dc2.put_model_density_on_grid(table);
+    size_t n_diff = 0;
+    for (size_t i = 0; i != dc1.grid.data.size(); ++i) {
+      float a = dc1.grid.data[i];
+      float b = dc2.grid.data[i];
+      // 5e5z has atoms with zero B and ADPs, which give NaNs; compare them too
+      if (a != b && !(std::isnan(a) && std::isnan(b)))
+        ++n_diff;
+    }
+    CHECK_EQ(n_diff, 0);
+
+    gemmi::StructureFactorCalculator<gemmi::IT92<double>> calc(st.cell);
+    for (gemmi::Miller hkl : {gemmi::Miller{1, 2, 3}, gemmi::Miller{-4, 0, 7},
+                              gemmi::Miller{10, -3, 1}}) {
+      std::complex<double> sf1 = calc.calculate_sf_from_model(model, hkl);
+      std::complex<double> sf2 = calc.calculate_sf_from_model(table, hkl);
+      CHECK_EQ(sf1.real(), sf2.real());
+      CHECK_EQ(sf1.imag(), sf2.imag());
+    }
+
+    for (bool include_h : {true, false}) {
+      gemmi::NeighborSearch ns1(model, st.cell, 5);
+      gemmi::NeighborSearch ns2(model, st.cell, 5);
+      ns1.populate(include_h);
+      ns2.populate(table, include_h);
+      REQUIRE_EQ(ns1.grid.data.size(), ns2.grid.data.size());
+      n_diff = 0;
+      size_t n_marks = 0;
+      for (size_t i = 0; i != ns1.grid.data.size(); ++i) {
+        const std::vector<gemmi::NeighborSearch::Mark>& v1 = ns1.grid.data[i];
+        const std::vector<gemmi::NeighborSearch::Mark>& v2 = ns2.grid.data[i];
+        n_marks += v1.size();
+        if (v1.size() != v2.size()) {
+          ++n_diff;
+          continue;
+        }
+        for (size_t j = 0; j != v1.size(); ++j)
+          if (v1[j].pos.x != v2[j].pos.x || v1[j].pos.y != v2[j].pos.y ||
+              v1[j].pos.z != v2[j].pos.z || v1[j].altloc != v2[j].altloc ||
+              v1[j].element != v2[j].element || v1[j].image_idx != v2[j].image_idx ||
+              v1[j].chain_idx != v2[j].chain_idx ||
+              v1[j].residue_idx != v2[j].residue_idx ||
+              v1[j].atom_idx != v2[j].atom_idx)
+            ++n_diff;
+      }
+      CHECK(n_marks > 0);
+      CHECK_EQ(n_diff, 0);
+    }
+
+    // after the model is edited, the table can't be used
+    gemmi::Model edited = model;
+    edited.chains[0].residues.erase(edited.chains[0].residues.begin());
+    gemmi::NeighborSearch ns(edited, st.cell, 5);
+    CHECK_THROWS_AS(ns.populate(table), std::runtime_error);
+    ns.populate(gemmi::AtomTable(edited));
+  }
+}
+
+TEST_CASE("ModelIndex gives the same results as linear search") {
+  // 1orc has insertion codes and altlocs, 1pfe has microheterogeneity,
+  // HEM has a residue with more than min_atoms_to_index atoms.
+  for (const char* name : {"1orc.pdb", "1pfe.cif.gz", "HEM.pdb"}) {
+    gemmi::Structure st = gemmi::read_structure_gz(test_path(name));
+    gemmi::Model& model = st.models[0];
+    if (model.chains[0].residues.size() > 6) {
+      // Make a large residue with repeated atom names and more altlocs,
+      // to test the hashed lookup ("the first matching atom" rules).
+      std::vector<gemmi::Residue>& residues = model.chains[0].residues;
+      std::vector<gemmi::Atom>& atoms = residues[0].atoms;
+      for (int i = 1; i != 6; ++i)
+        for (gemmi::Atom atom : residues[i].atoms) {
+          if (i % 2 == 0)
+            atom.altloc = char('A' + i % 3);
+          atoms.push_back(atom);
+        }
+      REQUIRE(atoms.size() > gemmi::ModelIndex::min_atoms_to_index);
+      // names longer than 4 characters are not packed into integer keys
+      atoms[1].name = "LONGER";
+      atoms.back().name = "LONGER";
+    }
+    gemmi::ModelIndex index(model);
+    size_t n_checked = 0;
+    for (gemmi::Chain& chain : model.chains)
+      for (gemmi::Residue& res : chain.residues) {
+        gemmi::ResidueId rid = res;
+        CHECK_EQ(index.find_residue(chain.name, rid), model.find_residue(chain.name, rid));
+        gemmi::ResidueGroup group1 = model.find_residue_group(chain.name, res.seqid);
+        gemmi::ResidueGroup group2 = index.find_residue_group(chain.name, res.seqid);
+        CHECK_EQ(group1.size(), group2.size());
+        CHECK_EQ(&group1[0], &group2[0]);
+        std::vector<std::string> names = {"XX", "LONGNAME"};
+        for (const gemmi::Atom& atom : res.atoms)
+          names.push_back(atom.name);
+        for (const std::string& atom_name : names)
+          for (char altloc : {'\0', '*', 'A', 'B', 'C', 'Z'}) {
+            CHECK_EQ(index.find_atom(res, atom_name, altloc),
+                     res.find_atom(atom_name, altloc));
+            gemmi::AtomAddress address(chain.name, rid, atom_name, altloc);
+            for (bool ignore_segment : {false, true}) {
+              gemmi::CRA cra1 = model.find_cra(address, ignore_segment);
+              gemmi::CRA cra2 = index.find_cra(address, ignore_segment);
+              CHECK_EQ(cra1.chain, cra2.chain);
+              CHECK_EQ(cra1.residue, cra2.residue);
+              CHECK_EQ(cra1.atom, cra2.atom);
+            }
+            ++n_checked;
+          }
+        // residue-only address
+        gemmi::AtomAddress address(chain.name, rid, "");
+        CHECK_EQ(index.find_cra(address).residue, model.find_cra(address).residue);
+      }
+    CHECK(n_checked > 0);
+
+    // addresses that are not in the model
+    gemmi::SeqId missing(9999, 'Q');
+    gemmi::AtomAddress address(model.chains[0].name, missing, "ALA", "CA");
+    CHECK_EQ(index.find_cra(address).residue, nullptr);
+    CHECK_EQ(index.find_residue("no such chain", model.chains[0].residues[0]), nullptr);
+    CHECK_THROWS_AS(index.find_residue_group(model.chains[0].name, missing),
+                    std::runtime_error);
+    CHECK_THROWS_AS(model.find_residue_group(model.chains[0].name, missing),
+                    std::runtime_error);
+  }
+}
+
+TEST_CASE("make_instanced_assembly and make_assembly") {
+  // 1pfe: assembly from subchains, 4oz7: from chains (PDB REMARK 350)
+  for (const char* name : {"1pfe.cif.gz", "4oz7.pdb", "5i55.cif"}) {
+    gemmi::Structure st = gemmi::read_structure_gz(test_path(name));
+    REQUIRE(!st.assemblies.empty());
+    const gemmi::Model& model = st.models[0];
+    for (const gemmi::Assembly& assembly : st.assemblies)
+      for (auto how : {gemmi::HowToNameCopiedChain::Short,
+                       gemmi::HowToNameCopiedChain::AddNumber,
+                       gemmi::HowToNameCopiedChain::Dup}) {
+        gemmi::Model bio = gemmi::make_assembly(assembly, model, how, {}, 3);
+        gemmi::InstancedAssembly view = gemmi::make_instanced_assembly(assembly, model,
+                                                                       how, {});
+        REQUIRE_EQ(view.instances.size(), bio.chains.size());
+        for (size_t i = 0; i != bio.chains.size(); ++i)
+          CHECK_EQ(view.instances[i].name, bio.chains[i].name);
+        std::vector<std::pair<const gemmi::Residue*, const gemmi::Atom*>> atoms;
+        for (const gemmi::Chain& chain : bio.chains)
+          for (const gemmi::Residue& res : chain.residues)
+            for (const gemmi::Atom& atom : res.atoms)
+              atoms.emplace_back(&res, &atom);
+        CHECK_EQ(view.atom_count(), atoms.size());
+        size_t n = 0;
+        size_t n_diff = 0;
+        view.for_each_atom([&](const gemmi::AssemblyInstance& inst, const gemmi::Residue& res,
+                               const gemmi::Atom& atom, const gemmi::Position& pos) {
+          if (n < atoms.size()) {
+            const gemmi::Residue& r = *atoms[n].first;
+            const gemmi::Atom& a = *atoms[n].second;
+            if (a.name != atom.name || a.pos.x != pos.x || a.pos.y != pos.y ||
+                a.pos.z != pos.z || r.name != res.name || r.seqid != res.seqid ||
+                r.segment != (inst.segment.empty() ? res.segment : inst.segment))
+              ++n_diff;
+          }
+          ++n;
+        });
+        CHECK_EQ(n, atoms.size());
+        CHECK_EQ(n_diff, 0);
+      }
+  }
+}
+
+static void check_same_stats(const std::vector<gemmi::MergingStats>& a,
+                             const std::vector<gemmi::MergingStats>& b) {
+  REQUIRE_EQ(a.size(), b.size());
+  for (size_t i = 0; i < a.size(); ++i) {
+    CHECK_EQ(a[i].all_refl, b[i].all_refl);
+    CHECK_EQ(a[i].unique_refl, b[i].unique_refl);
+    CHECK_EQ(a[i].stats_refl, b[i].stats_refl);
+    CHECK_EQ(a[i].r_merge_num, b[i].r_merge_num);
+    CHECK_EQ(a[i].r_meas_num, b[i].r_meas_num);
+    CHECK_EQ(a[i].r_pim_num, b[i].r_pim_num);
+    CHECK_EQ(a[i].r_denom, b[i].r_denom);
+    CHECK_EQ(a[i].sum_ibar, b[i].sum_ibar);
+    CHECK_EQ(a[i].sum_ibar2, b[i].sum_ibar2);
+    CHECK_EQ(a[i].sum_sig2_eps, b[i].sum_sig2_eps);
+  }
+}
+
+TEST_CASE("merging gives the same results with any number of threads") {
+  // more rows than in a few merging chunks, with groups crossing chunk ends
+  gemmi::Intensities intensities;
+  intensities.spacegroup = gemmi::find_spacegroup_by_name("P 21 21 21");
+  intensities.unit_cell.set(50, 60, 70, 90, 90, 90);
+  intensities.type = gemmi::DataType::Unmerged;
+  std::srand(31);
+  for (int i = 0; i < 60000; ++i) {
+    gemmi::Miller hkl{{std::rand() % 20, std::rand() % 20, 1 + std::rand() % 20}};
+    double value = 100 + draw() * std::rand() / RAND_MAX * 20;
+    intensities.add_if_valid(hkl, 0, int8_t(1 + std::rand() % 8), value,
+                             1 + std::rand() % 10);
+  }
+  gemmi::Binner binner;
+  binner.setup(10, gemmi::Binner::Method::Dstar3,
+               gemmi::IntensitiesDataProxy{intensities});
+  gemmi::CompactIntensities compact;
+  compact.copy_from(intensities);
+  for (gemmi::DataType type : {gemmi::DataType::Mean, gemmi::DataType::Anomalous}) {
+    gemmi::Intensities prepared = intensities;
+    prepared.prepare_for_merging(type);
+    gemmi::Intensities prepared4 = intensities;
+    prepared4.prepare_for_merging(type, 4);
+    for (char use_weights : {'Y', 'U', 'X'}) {
+      check_same_stats(prepared.calculate_merging_stats(&binner, use_weights, 1),
+                       prepared4.calculate_merging_stats(&binner, use_weights, 4));
+      check_same_stats(prepared.calculate_merging_stats(nullptr, use_weights, 1),
+                       prepared.calculate_merging_stats(nullptr, use_weights, 4));
+    }
+    gemmi::Intensities merged1 = intensities.merged(type, 1);
+    gemmi::Intensities merged4 = intensities.merged(type, 4);
+    CHECK_EQ(merged1.type, merged4.type);
+    REQUIRE_EQ(merged1.data.size(), merged4.data.size());
+    CHECK(merged1.data.size() > 2000);
+    for (size_t i = 0; i < merged1.data.size(); ++i) {
+      const gemmi::Intensities::Refl& a = merged1.data[i];
+      const gemmi::Intensities::Refl& b = merged4.data[i];
+      CHECK_EQ(a.hkl, b.hkl);
+      CHECK_EQ(a.isign, b.isign);
+      CHECK_EQ(a.nobs, b.nobs);
+      CHECK_EQ(a.value, b.value);
+      CHECK_EQ(a.sigma, b.sigma);
+    }
+
+    gemmi::CompactIntensities cprepared = compact;
+    cprepared.prepare_for_merging(type);
+    gemmi::CompactIntensities cprepared4 = compact;
+    cprepared4.prepare_for_merging(type, 4);
+    check_same_stats(cprepared.calculate_merging_stats(&binner, 'Y', 1),
+                     cprepared4.calculate_merging_stats(&binner, 'Y', 4));
+    gemmi::CompactIntensities cmerged1 = compact;
+    cmerged1.merge_in_place(type, 1);
+    gemmi::CompactIntensities cmerged4 = compact;
+    cmerged4.merge_in_place(type, 4);
+    CHECK_EQ(cmerged1.key, cmerged4.key);
+    CHECK_EQ(cmerged1.value, cmerged4.value);
+    CHECK_EQ(cmerged1.sigma, cmerged4.sigma);
+    CHECK_EQ(cmerged1.nobs, cmerged4.nobs);
+  }
+}
+
+TEST_CASE("XdsAscii reports the first wrong line with any number of threads") {
+  gemmi::CharArray mem = gemmi::read_file_into_buffer(test_path("INTEGRATE-tiny.HKL"));
+  std::string tiny(mem.data(), mem.size());
+  size_t data_start = tiny.find('\n', tiny.find("!END_OF_HEADER")) + 1;
+  size_t data_end = tiny.find("!END_OF_DATA");
+  std::string header = tiny.substr(0, data_start);
+  std::string data_lines = tiny.substr(data_start, data_end - data_start);
+  // 12000 lines (one batch) in three parsing chunks (4096 lines);
+  // wrong1 is at the end of the second chunk, wrong2 at the start of the third
+  std::string text = header;
+  size_t pos = 0;
+  for (int i = 0; i < 12000; ++i) {
+    if (i == 8000) {
+      text += " 1 2 3 wrong1\n";
+    } else if (i == 8200) {
+      text += " 1 2 3 wrong2\n";
+    } else {
+      size_t eol = data_lines.find('\n', pos) + 1;
+      text.append(data_lines, pos, eol - pos);
+      pos = eol < data_lines.size() ? eol : 0;
+    }
+  }
+  text += "!END_OF_DATA\n";
+  for (int nthreads : {1, 2, 4}) {
+    gemmi::XdsAscii xds;
+    gemmi::MemoryStream stream(text.data(), text.size());
+    std::string msg;
+    try {
+      xds.read_stream(stream, "test", nthreads);
+    } catch (std::runtime_error& e) {
+      msg = e.what();
+    }
+    CHECK(msg.find("wrong1") != std::string::npos);
+  }
+}
+
+namespace {
+// y = a * exp(-b * x) + c
+struct ExpDecayTarget {
+  struct Point {
+    double x, y, weight;
+    double get_y() const { return y; }
+    double get_weight() const { return weight; }
+  };
+  std::vector<Point> points;
+  double a = 1, b = 1, c = 0;
+
+  std::vector<double> get_parameters() const { return {a, b, c}; }
+  void set_parameters(const std::vector<double>& p) { a = p[0]; b = p[1]; c = p[2]; }
+  double compute_value(const Point& p) const { return a * std::exp(-b * p.x) + c; }
+  double compute_value_and_derivatives(const Point& p, std::vector<double>& dy_da) const {
+    double e = std::exp(-b * p.x);
+    dy_da[0] = e;
+    dy_da[1] = -a * p.x * e;
+    dy_da[2] = 1;
+    return a * e + c;
+  }
+};
+} // anonymous namespace
+
+TEST_CASE("LevMar with multiple blocks of points") {
+  ExpDecayTarget target;
+  std::srand(37);
+  size_t n = 3 * gemmi::levmar_block_size + 100;
+  for (size_t i = 0; i < n; ++i) {
+    double x = 5.0 * i / n;
+    double y = 3 * std::exp(-0.7 * x) + 0.5 + 0.01 * draw();
+    target.points.push_back({x, y, 0.5 + std::rand() % 3});
+  }
+  // compare with sums over all points in one loop
+  double wssr = 0;
+  std::vector<double> alpha(9, 0.), beta(3, 0.), dy_da(3);
+  for (const ExpDecayTarget::Point& p : target.points) {
+    double dy = p.weight * (p.y - target.compute_value_and_derivatives(p, dy_da));
+    wssr += dy * dy;
+    for (int j = 0; j < 3; ++j) {
+      for (int k = 0; k < 3; ++k)
+        alpha[3 * j + k] += p.weight * dy_da[j] * p.weight * dy_da[k];
+      beta[j] += dy * p.weight * dy_da[j];
+    }
+  }
+  CHECK_EQ(gemmi::compute_wssr(target), doctest::Approx(wssr).epsilon(1e-12));
+  std::vector<double> alpha1(9), beta1(3), alpha4(9), beta4(3);
+  double wssr1 = gemmi::compute_lm_matrices(target, alpha1, beta1, 1);
+  double wssr4 = gemmi::compute_lm_matrices(target, alpha4, beta4, 4);
+  CHECK_EQ(wssr1, doctest::Approx(wssr).epsilon(1e-12));
+  for (int i = 0; i < 9; ++i)
+    CHECK_EQ(alpha1[i], doctest::Approx(alpha[i]).epsilon(1e-12));
+  for (int i = 0; i < 3; ++i)
+    CHECK_EQ(beta1[i], doctest::Approx(beta[i]).epsilon(1e-12));
+  // results don't depend on the number of threads
+  CHECK_EQ(wssr1, wssr4);
+  CHECK_EQ(alpha1, alpha4);
+  CHECK_EQ(beta1, beta4);
+  CHECK_EQ(gemmi::compute_wssr(target, 1), gemmi::compute_wssr(target, 4));
+
+  ExpDecayTarget target4 = target;
+  gemmi::LevMar levmar;
+  double final_wssr = levmar.fit(target);
+  levmar.nthreads = 4;
+  CHECK_EQ(levmar.fit(target4), final_wssr);
+  CHECK_EQ(target.get_parameters(), target4.get_parameters());
+  CHECK_EQ(target.a, doctest::Approx(3).epsilon(0.01));
+  CHECK_EQ(target.b, doctest::Approx(0.7).epsilon(0.01));
+  CHECK_EQ(target.c, doctest::Approx(0.5).epsilon(0.02));
+}
+
+TEST_CASE("Binner::get_bins gives the same results as get_bin") {
+  gemmi::UnitCell cell(50, 60, 70, 90, 100, 90);
+  std::srand(38);
+  std::vector<double> inv_d2;
+  for (int i = 0; i < 40000; ++i)
+    inv_d2.push_back(0.25 * std::rand() / RAND_MAX);
+  gemmi::Binner binner;
+  binner.setup_from_1_d2(20, gemmi::Binner::Method::EqualCount,
+                         std::vector<double>(inv_d2), &cell);
+  // values equal to the limits and outside of the range
+  for (size_t i = 0; i + 1 < binner.limits.size(); ++i)
+    inv_d2.push_back(binner.limits[i]);
+  inv_d2.push_back(0.);
+  inv_d2.push_back(1.);
+  // sorted values, then unsorted: the chunk switches to branchless search
+  std::vector<double> mixed(inv_d2.begin(), inv_d2.begin() + 10000);
+  std::sort(mixed.begin(), mixed.end());
+  mixed.insert(mixed.end(), inv_d2.begin(), inv_d2.end());
+  for (const std::vector<double>* values : {&inv_d2, &mixed}) {
+    REQUIRE(values->size() > 2 * (1 << 14));
+    std::vector<int> expected;
+    for (double x : *values)
+      expected.push_back(binner.get_bin_from_1_d2(x));
+    CHECK_EQ(binner.get_bins_from_1_d2(*values), expected);
+    CHECK_EQ(binner.get_bins_from_1_d2(*values, 3), expected);
+  }
+
+  gemmi::Intensities intensities;
+  intensities.unit_cell = cell;
+  for (int i = 0; i < 40000; ++i) {
+    gemmi::Miller hkl{{std::rand() % 50 - 25, std::rand() % 50 - 25, std::rand() % 50 - 25}};
+    intensities.data.push_back({hkl, 0, 0, 0, 1., 1.});
+  }
+  gemmi::IntensitiesDataProxy proxy{intensities};
+  std::vector<int> expected;
+  for (const gemmi::Intensities::Refl& refl : intensities.data)
+    expected.push_back(binner.get_bin(refl.hkl));
+  CHECK_EQ(binner.get_bins(proxy), expected);
+  CHECK_EQ(binner.get_bins(proxy, 3), expected);
+}
+
+TEST_CASE("HklIndex and for_matching_reflections") {
+  using Refl = gemmi::HklValue<float>;
+  std::srand(39);
+  auto random_refl = [](int scale) {
+    gemmi::Miller hkl{{std::rand() % 41 - 20, std::rand() % 41 - 20, std::rand() % 21}};
+    for (int& x : hkl)
+      x *= scale;
+    return Refl{hkl, float(std::rand() % 100)};
+  };
+  for (int scale : {1, 1000}) {
+    // with scale=1000 the table would span ~10^12 entries, so HklIndex
+    // uses a hash map; with scale=1 it uses the dense table
+    std::vector<Refl> a, b;
+    for (int i = 0; i < 5000; ++i) {
+      a.push_back(random_refl(scale));
+      b.push_back(random_refl(scale));
+    }
+    gemmi::HklIndex b_index(b);
+    CHECK_EQ(b_index.size(), b.size());
+    // find() returns the first position of hkl, or -1
+    for (const Refl& r : a) {
+      int expected = -1;
+      for (size_t i = 0; i < b.size(); ++i)
+        if (b[i].hkl == r.hkl) {
+          expected = (int) i;
+          break;
+        }
+      CHECK_EQ(b_index.find(r.hkl), expected);
+    }
+    CHECK_EQ(b_index.find({{100000, 0, 0}}), -1);
+    CHECK_EQ(b_index.find({{-100000, 0, -100000}}), -1);
+
+    // remove duplicates, which are paired differently by the sorted merge
+    std::sort(a.begin(), a.end());
+    std::sort(b.begin(), b.end());
+    auto same_hkl = [](const Refl& x, const Refl& y) { return x.hkl == y.hkl; };
+    a.erase(std::unique(a.begin(), a.end(), same_hkl), a.end());
+    b.erase(std::unique(b.begin(), b.end(), same_hkl), b.end());
+    std::vector<std::pair<float,float>> expected;
+    gemmi::for_matching_reflections(a, b, [&](const Refl& x, const Refl& y) {
+        expected.emplace_back(x.value, y.value);
+    });
+    CHECK(expected.size() > 100);
+    int expected_equal = gemmi::count_equal_values(a, b);
+    gemmi::Correlation expected_cor = gemmi::calculate_hkl_value_correlation(a, b);
+
+    // the same with b in a different order (a is still sorted)
+    std::reverse(b.begin(), b.end());
+    std::swap(b[0], b[b.size() / 2]);
+    b_index = gemmi::HklIndex(b);
+    std::vector<std::pair<float,float>> pairs;
+    gemmi::for_matching_reflections(a, b, b_index, [&](const Refl& x, const Refl& y) {
+        CHECK_EQ(x.hkl, y.hkl);
+        pairs.emplace_back(x.value, y.value);
+    });
+    CHECK_EQ(pairs, expected);
+    CHECK_EQ(gemmi::count_equal_values(a, b, &b_index), expected_equal);
+    gemmi::Correlation cor = gemmi::calculate_hkl_value_correlation(a, b, &b_index);
+    CHECK_EQ(cor.n, expected_cor.n);
+    CHECK_EQ(cor.coefficient(), doctest::Approx(expected_cor.coefficient()));
+    gemmi::HklIndex wrong_index(a);
+    CHECK_THROWS_AS(gemmi::count_equal_values(a, b, &wrong_index), std::runtime_error);
+  }
+}
+
+static std::string mtz_to_cif_string(gemmi::MtzToCif& m2c, const gemmi::Mtz& mtz,
+                                     int nthreads) {
+  std::ostringstream os;
+  m2c.nthreads = nthreads;
+  m2c.write_cif(mtz, nullptr, nullptr, os);
+  return os.str();
+}
+
+TEST_CASE("MtzToCif with zero-padded formats") {
+  gemmi::Mtz mtz = gemmi::read_mtz_file(test_path("5e5z.mtz"));
+  gemmi::MtzToCif m2c;
+  m2c.with_comments = false;
+  m2c.spec_lines = {"H H index_h", "K H index_k", "L H index_l",
+                    "FP F F_meas_au 08.3f", "SIGFP Q F_meas_sigma_au 012.4g",
+                    "I J intensity_meas 8.2f"};
+  std::string out = mtz_to_cif_string(m2c, mtz, 1);
+  const char* tag = "_refln.intensity_meas\n";
+  size_t pos = out.find(tag);
+  REQUIRE(pos != std::string::npos);
+  std::istringstream rows(out.substr(pos + std::strlen(tag)));
+  std::string line;
+  int n = 0;
+  for (size_t i = 0; i < mtz.data.size(); i += mtz.columns.size(), ++n) {
+    const float* row = &mtz.data[i];
+    char expected[128];
+    int len = gemmi::snprintf_z(expected, 128, "%d %d %d ", (int) row[0], (int) row[1], (int) row[2]);
+    const int widths[3] = {8, 12, 8};
+    for (int j = 0; j < 3; ++j) {
+      if (j != 0)
+        expected[len++] = ' ';
+      float v = row[4 + j];  // FP, SIGFP, I
+      if (std::isnan(v))
+        len += gemmi::snprintf_z(expected + len, 128 - len, "%*s", widths[j], "?");
+      else if (j == 0)
+        len += gemmi::snprintf_z(expected + len, 128 - len, "%08.3f", v);
+      else if (j == 1)
+        len += gemmi::snprintf_z(expected + len, 128 - len, "%012.4g", v);
+      else
+        len += gemmi::snprintf_z(expected + len, 128 - len, "%8.2f", v);
+    }
+    REQUIRE(std::getline(rows, line));
+    CHECK_EQ(line, expected);
+  }
+  CHECK_EQ(n, mtz.nreflections);
+}
+
+TEST_CASE("MtzToCif output doesn't depend on the number of threads") {
+  // merged data: 5e5z.mtz repeated to get rows in several blocks (4096 rows)
+  gemmi::Mtz merged = gemmi::read_mtz_file(test_path("5e5z.mtz"));
+  std::vector<float> data;
+  for (int i = 0; i < 25; ++i)
+    data.insert(data.end(), merged.data.begin(), merged.data.end());
+  for (size_t i = 3; i < data.size(); i += 7)
+    data[i] = NAN;
+  merged.set_data(data.data(), data.size());
+  REQUIRE(merged.nreflections > 2 * 4096);
+
+  // unmerged data with a reflection counter
+  gemmi::Mtz unmerged(/*with_base=*/true);
+  unmerged.spacegroup = gemmi::find_spacegroup_by_name("P 21 21 21");
+  unmerged.set_cell_for_all(gemmi::UnitCell(50, 60, 70, 90, 90, 90));
+  unmerged.add_dataset("sweep").crystal_name = "xtal";
+  for (const char* col : {"M/ISYM Y", "BATCH B", "I J", "SIGI Q"})
+    unmerged.add_column(std::string(col, std::strchr(col, ' ')),
+                        std::strchr(col, ' ')[1], -1, -1, false);
+  for (int n = 1; n <= 60; ++n) {
+    gemmi::Mtz::Batch batch;
+    batch.number = n;
+    batch.set_cell(unmerged.cell);
+    batch.set_dataset_id(1);
+    unmerged.batches.push_back(batch);
+  }
+  std::srand(40);
+  data.clear();
+  for (int i = 0; i < 10000; ++i) {
+    float sigma = float(std::rand() % 20 - 2);
+    float row[] = {float(std::rand() % 20), float(std::rand() % 20), float(std::rand() % 20),
+                   float(1 + std::rand() % 8), float(1 + i / 200), float(draw()), sigma};
+    data.insert(data.end(), std::begin(row), std::end(row));
+  }
+  unmerged.set_data(data.data(), data.size());
+
+  for (bool filtered : {false, true}) {
+    gemmi::MtzToCif m2c;
+    m2c.skip_empty = filtered;
+    m2c.skip_negative_sigi = filtered;
+    for (const gemmi::Mtz* mtz : {&merged, &unmerged}) {
+      std::string out1 = mtz_to_cif_string(m2c, *mtz, 1);
+      CHECK(out1.size() > 100000);
+      CHECK_EQ(mtz_to_cif_string(m2c, *mtz, 3), out1);
+      CHECK_EQ(mtz_to_cif_string(m2c, *mtz, 0), out1);
+      if (mtz == &unmerged) {
+        // the counter (_diffrn_refln.id) ends with the number of rows
+        size_t n_rows = filtered ? 0 : data.size() / 7;
+        if (filtered)
+          for (size_t i = 6; i < data.size(); i += 7)
+            n_rows += data[i] >= 0;
+        size_t pos = out1.rfind('\n', out1.size() - 2) + 1;
+        CHECK_EQ(std::atoi(out1.c_str() + pos + 2), (int) n_rows);
+      }
+    }
+  }
+
+  // gzipped output
+  gemmi::MtzToCif m2c;
+  std::string expected = mtz_to_cif_string(m2c, merged, 1);
+  const char* gz_path = "gemmi_test_mtz2cif.cif.gz";
+  {
+    gemmi::MaybeGzippedOfstream os(gz_path);
+    m2c.write_cif(merged, nullptr, nullptr, os.ref());
+    os.close();
+  }
+  gemmi::CharArray mem = gemmi::MaybeGzipped(gz_path).uncompress_into_buffer();
+  std::remove(gz_path);
+  CHECK_EQ(std::string(mem.data(), mem.size()), expected);
+}
+
+TEST_CASE("write_pdb and write_mmcif_to_stream don't depend on the number of threads") {
+  gemmi::Structure st = gemmi::read_structure_gz(test_path("1orc.pdb"));
+  gemmi::Model& model = st.models[0];
+  // chain A: 1orc (protein and waters) repeated 16 times, so that it's split
+  // into chunks of 4096 atoms, chains B and C: the original chain
+  std::vector<gemmi::Residue> orig = model.chains[0].residues;
+  gemmi::Chain& chain_a = model.chains[0];
+  for (int k = 1; k < 16; ++k)
+    for (gemmi::Residue res : orig) {
+      res.seqid.num += 1000 * k;
+      chain_a.residues.push_back(res);
+    }
+  // At the start of the second chunk: an empty polymer residue followed by
+  // water. TER after it must repeat the residue from the previous chunk.
+  size_t natoms = 0;
+  for (size_t i = 0; i < chain_a.residues.size(); ++i) {
+    if (natoms >= 4096) {
+      chain_a.residues.insert(chain_a.residues.begin() + i, orig.back());
+      chain_a.residues.emplace(chain_a.residues.begin() + i,
+                               gemmi::ResidueId{{9999, ' '}, "", "XXX"});
+      break;
+    }
+    natoms += chain_a.residues[i].atoms.size();
+  }
+  REQUIRE_EQ(orig.back().name, "HOH");
+  for (const char* name : {"B", "C"}) {
+    model.chains.push_back(st.models[0].chains[0]);
+    model.chains.back().name = name;
+    model.chains.back().residues = orig;
+  }
+  CHECK(gemmi::count_atom_sites(model.chains[0]) > 2 * 4096);
+  st.models.push_back(st.models[0]);
+  st.models[1].num = 2;
+  st.models.push_back(gemmi::Model(3));  // model without chains
+  gemmi::setup_entities(st);
+  for (gemmi::Model& mdl : st.models)
+    for (gemmi::Chain& chain : mdl.chains)
+      for (gemmi::Residue& res : chain.residues)
+        if (res.name == "XXX")
+          res.entity_type = gemmi::EntityType::Polymer;
+
+  auto pdb_string = [&](const gemmi::PdbWriteOptions& opt, int nthreads) {
+    std::ostringstream os;
+    gemmi::write_pdb(st, os, opt, nthreads);
+    return os.str();
+  };
+  std::vector<gemmi::PdbWriteOptions> options(5);
+  options[1].numbered_ter = false;
+  options[2].ter_ignores_type = true;
+  options[3].ter_records = false;
+  options[4].preserve_serial = true;
+  for (const gemmi::PdbWriteOptions& opt : options) {
+    std::string expected = pdb_string(opt, 1);
+    CHECK(expected.find("ENDMDL") != std::string::npos);
+    CHECK_EQ(pdb_string(opt, 3), expected);
+    CHECK_EQ(pdb_string(opt, 0), expected);
+  }
+
+  auto mmcif_string = [&](int nthreads) {
+    std::ostringstream os;
+    gemmi::write_mmcif_to_stream(os, st, gemmi::MmcifOutputGroups(true),
+                                 gemmi::cif::WriteOptions(), nthreads);
+    return os.str();
+  };
+  std::string expected = mmcif_string(1);
+  CHECK(expected.size() > 500000);
+  CHECK_EQ(mmcif_string(3), expected);
+  CHECK_EQ(mmcif_string(0), expected);
+}
+
+TEST_CASE("write_json_to_stream with nthreads") {
+  // loops with at least 10000 values are formatted on multiple threads
+  std::string text = "data_big\nloop_ _t.id _t.s _t.x _t.q _t.d _t.n\n";
+  for (int i = 0; i < 3000; ++i)
+    text += std::to_string(i) + " 'a \"b' x" + std::to_string(i) + " ? . -." +
+            std::to_string(i % 10) + "\n";
+  text += "_other.tag 1\n";
+  gemmi::cif::Document doc = gemmi::read_cif_from_memory(text.data(), text.size(), "big");
+  REQUIRE(doc.blocks[0].items[0].loop.values.size() >= 10000);
+  for (const gemmi::cif::JsonWriteOptions& options :
+       {gemmi::cif::JsonWriteOptions(), gemmi::cif::JsonWriteOptions::mmjson()}) {
+    std::ostringstream os1, os3;
+    gemmi::cif::write_json_to_stream(os1, doc, options, 1);
+    gemmi::cif::write_json_to_stream(os3, doc, options, 3);
+    CHECK(os1.str().size() > 100000);
+    CHECK_EQ(os3.str(), os1.str());
+  }
+}
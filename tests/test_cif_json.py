@@ -52,6 +52,21 @@ class TestCifAsJson(unittest.TestCase):
         self.assertEqual(parsed, {'test': {'_a': -0.99, '_b': 0.04,
                                            '_c': -0.04, '_d': 0.5}})
 
+    def test_large_loop_with_threads(self):
+        # loops with at least 10000 values are formatted on multiple threads
+        rows = ['%d "a b" x%d ? . -.%d' % (i, i, i % 10) for i in range(3000)]
+        doc = cif.read_string('data_big loop_ _t.id _t.s _t.x _t.q _t.d _t.n\n'
+                              + '\n'.join(rows))
+        for mmjson in (False, True):
+            expected = doc.as_json(mmjson=mmjson)
+            self.assertEqual(doc.as_json(mmjson=mmjson, nthreads=3), expected)
+            self.assertEqual(doc.as_json(mmjson=mmjson, nthreads=0), expected)
+        parsed = json.loads(doc.as_json(nthreads=3))['big']
+        self.assertEqual(parsed['_t.id'], list(range(3000)))
+        self.assertEqual(parsed['_t.s'], ['a b'] * 3000)
+        self.assertEqual(parsed['_t.x'][-1], 'x2999')
+        self.assertEqual(parsed['_t.n'][:3], [-0.0, -0.1, -0.2])
+
 class TestMmjson(unittest.TestCase):
     def test_read_1pfe(self):
         path = full_path('1pfe.json')
@@ -82,5 +97,18 @@ class TestMmjson(unittest.TestCase):
         doc = cif.read_mmjson_string(b'{"data_1PFE":{"entry":{"id":["1ABC"]}}}')
         self.assertEqual(doc[0].find_value('_entry.id'), '1ABC')
 
+    def test_read_values(self):
+        doc = cif.read_mmjson_string(
+            b'{"data_x":{"c":{"a":[true,null,[1,2],"\\u00e9 q",-1.5e3],'
+            b'"b":[false,"","?","x\\ny",0]}}}')
+        loop = doc[0].find_loop('_c.a').get_loop()
+        self.assertEqual(list(loop.values),
+                         ['YES', 'NO', '?', "''", "'1 2'", "'?'",
+                          "'\u00e9 q'", ';x\ny\n;', '-1.5e3', '0'])
+        with self.assertRaises(RuntimeError):
+            cif.read_mmjson_string(b'{"data_x":{"c":{"a":[1,2],"b":[1]}}}')
+        with self.assertRaises(RuntimeError):
+            cif.read_mmjson_string(b'{"data_x":{"c":{"a":[1,]}}}')
+
 if __name__ == '__main__':
     unittest.main()
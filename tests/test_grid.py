@@ -253,5 +253,31 @@ class TestCcp4Map(unittest.TestCase):
         volume = span[0] * span[1] * span[2]
         self.assertAlmostEqual(orig_point_count / m.grid.point_count, volume)
 
+class TestSolventMask(unittest.TestCase):
+    def test_threads(self):
+        st = gemmi.read_structure(full_path('1orc.pdb'))
+        masker = gemmi.SolventMasker(gemmi.AtomicRadiiSet.VanDerWaals)
+        grids = []
+        for nthreads in [1, 3]:
+            masker.nthreads = nthreads
+            grid = gemmi.Int8Grid()
+            grid.setup_from(st, spacing=0.7)
+            masker.put_mask_on_int8_grid(grid, st[0])
+            grids.append(grid)
+        self.assertTrue(0 < grids[0].sum() < grids[0].point_count)
+        self.assertEqual(grids[0].sum(), grids[1].sum())
+        self.assertEqual([p.value for p in grids[0]],
+                         [p.value for p in grids[1]])
+
+    def test_constant_radius(self):
+        st = gemmi.read_structure(full_path('1orc.pdb'))
+        grid = gemmi.FloatGrid()
+        grid.setup_from(st, spacing=1.0)
+        grid.mask_points_in_constant_radius(st[0], radius=1.5, value=1.0,
+                                            nthreads=2)
+        # each atom marks at least the nearest grid point
+        for cra in st[0].all():
+            self.assertEqual(grid.interpolate_value(cra.atom.pos, order=0), 1.0)
+
 if __name__ == '__main__':
     unittest.main()
@@ -92,6 +92,34 @@ class TestMtz(unittest.TestCase):
             assert_numpy_equal(self, mtz.array, mtz2.array)
             self.assertEqual(mtz3.array.shape, (0, 8))
 
+    @unittest.skipIf(numpy is None, "requires NumPy")
+    def test_stream_writer(self):
+        mtz = gemmi.read_mtz_file(full_path('5e5z.mtz'))
+        data = mtz.array
+        out_name = get_path_for_tempfile()
+        writer = gemmi.MtzStreamWriter(mtz, out_name)
+        for start in range(0, len(data), 100):
+            writer.append_rows(data[start:start+100])
+        writer.finish()
+        self.assertEqual(writer.nreflections, mtz.nreflections)
+        with open(out_name, 'rb') as f:
+            self.assertEqual(f.read(), mtz.write_to_bytes())
+        os.remove(out_name)
+
+    @unittest.skipIf(numpy is None, "requires NumPy")
+    def test_sort_and_asu_threads(self):
+        path = full_path('5e5z.mtz')
+        mtz1 = gemmi.read_mtz_file(path)
+        mtz2 = gemmi.read_mtz_file(path)
+        for mtz, nthreads in [(mtz1, 1), (mtz2, 2)]:
+            mtz.expand_to_p1()
+            mtz.ensure_asu(nthreads=nthreads)
+            self.assertTrue(mtz.sort(nthreads=nthreads))
+        assert_numpy_equal(self, mtz1.array, mtz2.array)
+        asu = gemmi.ReciprocalAsu(mtz1.spacegroup)
+        hkl_list = mtz1.make_miller_array().tolist()
+        self.assertTrue(all(asu.is_in(hkl) for hkl in hkl_list))
+
     def test_remove_and_add_column(self):
         path = full_path('5e5z.mtz')
         col_name = 'FREE'
@@ -212,7 +240,14 @@ class TestSfMmcif(unittest.TestCase):
         scaling = gemmi.Scaling(fc_data.unit_cell, fc_data.spacegroup)
         scaling.prepare_points(fc_data, fobs_data)
         scaling.fit_isotropic_b_approximately()
-        scaling.fit_parameters()
+        initial = scaling.parameters
+        wssr = scaling.fit_parameters()
+        fitted = scaling.parameters
+        # the result doesn't depend on the number of threads
+        # (367 points is one block; multiple blocks are tested in main.cpp)
+        scaling.parameters = initial
+        self.assertEqual(scaling.fit_parameters(nthreads=2), wssr)
+        self.assertEqual(scaling.parameters, fitted)
         #print(scaling.k_overall, scaling.b_overall)
         scaling.scale_data(fc_data)
 
@@ -252,6 +287,51 @@ class TestBinner(unittest.TestCase):
         # TODO: remove explicit call to numpy.array, as above
         inv_d2 = numpy.array([mtz.cell.calculate_1_d2(h) for h in hkls])
         self.assertEqual(list(binner.get_bins_from_1_d2(inv_d2)), bins)
+        # bulk functions on multiple threads, unsorted data
+        hkl_array = mtz.make_miller_array()[::-1].copy()
+        expected = [binner.get_bin(h) for h in hkl_array.tolist()]
+        self.assertEqual(binner.get_bins(hkl_array, nthreads=3).tolist(), expected)
+        self.assertEqual(binner.get_bins(mtz, nthreads=3).tolist(), expected[::-1])
+
+    @unittest.skipIf(numpy is None, "requires NumPy")
+    def test_reflection_geometry(self):
+        mtz = gemmi.read_mtz_file(full_path('5e5z.mtz'))
+        geom = gemmi.ReflectionGeometry(mtz, nthreads=2)
+        self.assertEqual(len(geom), mtz.nreflections)
+        self.assertTrue(numpy.allclose(geom.inv_d2_array,
+                                       mtz.make_1_d2_array(), rtol=1e-6))
+        gops = mtz.spacegroup.operations()
+        hkls = mtz.make_miller_array().tolist()
+        self.assertEqual(geom.epsilon_array.tolist(),
+                         [gops.epsilon_factor(h) for h in hkls])
+        self.assertEqual(geom.centric_array.tolist(),
+                         [gops.is_reflection_centric(h) for h in hkls])
+        self.assertEqual(set(geom.isym_array.tolist()), {1})
+        binner = gemmi.Binner()
+        geom.setup_binner(binner, 17, gemmi.Binner.Method.Dstar3)
+        self.assertAlmostEqual(binner.limits[10], 0.27026277234462415)
+        geom.assign_bins(binner)
+        self.assertEqual(geom.bin_array.tolist(),
+                         binner.get_bins(mtz).tolist())
+        binner.setup(10, gemmi.Binner.Method.Dstar3, mtz)
+        n1 = gemmi.calculate_amplitude_normalizers(mtz, 'FP', binner)
+        n2 = gemmi.calculate_amplitude_normalizers(mtz, 'FP', binner, geom)
+        assert_numpy_equal(self, n1, n2)
+
+    @unittest.skipIf(numpy is None, "requires NumPy")
+    def test_hkl_match(self):
+        mtz = gemmi.read_mtz_file(full_path('5e5z.mtz'))
+        hkl = mtz.make_miller_array()
+        # unsorted reference with a reflection that is not in hkl
+        ref = numpy.vstack([hkl[::-7], [[99, 99, 99]]]).astype(hkl.dtype)
+        match = gemmi.HklMatch(hkl, ref)
+        expected = list(range(len(hkl) - 1, -1, -7)) + [-1]
+        self.assertEqual(list(match.pos), expected)
+        ref = numpy.ascontiguousarray(ref[::-1])
+        match = gemmi.HklMatch(ref, hkl)
+        pos = numpy.array(match.pos)
+        self.assertTrue((ref[pos[pos >= 0]] == hkl[pos >= 0]).all())
+        self.assertEqual((pos >= 0).sum(), len(ref) - 1)
 
 class TestMerging(unittest.TestCase):
     def test_reading(self):
@@ -278,8 +358,50 @@ class TestMerging(unittest.TestCase):
         self.assertAlmostEqual(x_stats.r_merge(), 0.312, delta=5e-4)
         self.assertAlmostEqual(x_stats.r_meas(), 0.342, delta=5e-4)
         self.assertAlmostEqual(x_stats.r_pim(), 0.139, delta=5e-4)
+        stats2 = intens.calculate_merging_stats(None, use_weights='Y', nthreads=2)
+        self.assertEqual(stats2[0].unique_refl, 2)
+        self.assertAlmostEqual(stats2[0].r_meas(), y_stats.r_meas(), delta=1e-9)
+        intens2 = intens.merged(gemmi.DataType.Mean, nthreads=2)
         intens.merge_in_place(gemmi.DataType.Mean)
         self.assertEqual(len(intens), 2)
+        self.assertEqual(len(intens2), 2)
+
+    def test_compact(self):
+        doc = gemmi.cif.read(full_path('cc12-hkl.cif'))
+        rblock = gemmi.as_refln_blocks(doc)[0]
+        intens = gemmi.Intensities()
+        intens.import_refln_block(rblock)
+        compact = gemmi.CompactIntensities()
+        compact.import_refln_block(rblock)
+        self.assertEqual(len(compact), 12)
+        self.assertEqual(compact.miller_array.tolist(),
+                         intens.miller_array.tolist())
+        intens.prepare_for_merging(gemmi.DataType.Anomalous)
+        compact.prepare_for_merging(gemmi.DataType.Anomalous)
+        stats = intens.calculate_merging_stats(None)[0]
+        c_stats = compact.calculate_merging_stats(None)[0]
+        self.assertEqual(c_stats.unique_refl, stats.unique_refl)
+        self.assertAlmostEqual(c_stats.r_meas(), stats.r_meas(), delta=1e-6)
+        self.assertAlmostEqual(c_stats.cc_half(), stats.cc_half(), delta=1e-6)
+        intens.merge_in_place(gemmi.DataType.Mean)
+        compact.merge_in_place(gemmi.DataType.Mean)
+        self.assertEqual(list(compact.nobs_array), list(intens.nobs_array))
+        for a, b in zip(compact.value_array, intens.value_array):
+            self.assertAlmostEqual(a, b, delta=1e-4 * abs(b))
+        self.assertEqual(len(compact.to_intensities()), 2)
+
+    def test_xds_file(self):
+        path = full_path('INTEGRATE-tiny.HKL')
+        xds = gemmi.read_xds_ascii(path)
+        self.assertEqual(xds.data_size, 129)
+        intens = gemmi.Intensities()
+        intens.import_xds(xds)
+        streamed = gemmi.Intensities()
+        streamed.import_xds_file(path, nthreads=2)
+        self.assertEqual(streamed.type, gemmi.DataType.Unmerged)
+        self.assertEqual(streamed.miller_array.tolist(),
+                         intens.miller_array.tolist())
+        self.assertEqual(list(streamed.value_array), list(intens.value_array))
 
 class TestConversion(unittest.TestCase):
     def test_4aap(self):
@@ -295,6 +417,9 @@ class TestConversion(unittest.TestCase):
         mtz = gemmi.CifToMtz().convert_block_to_mtz(rblock)
         check_metadata(mtz, mtz.datasets[1])
         cif_string = gemmi.MtzToCif().write_cif_to_string(mtz)
+        mtz_to_cif = gemmi.MtzToCif()
+        mtz_to_cif.nthreads = 3
+        self.assertEqual(mtz_to_cif.write_cif_to_string(mtz), cif_string)
         doc_out = gemmi.cif.read_string(cif_string)
         (rblock_out,) = gemmi.as_refln_blocks(doc_out)
         self.assertEqual(rblock.default_loop.tags[3:],
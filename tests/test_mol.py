@@ -503,6 +503,15 @@ class TestMol(unittest.TestCase):
         os.remove(out_name)
         self.check_1pfe(st2)
 
+        # the same, but without cif.Document
+        for options in [gemmi.cif.WriteOptions(), gemmi.cif.Style.Aligned]:
+            mmcif_doc.write_file(out_name, options)
+            expected = read_lines_and_remove(out_name)
+            st.write_mmcif(out_name, options=options)
+            self.assertEqual(read_lines_and_remove(out_name), expected)
+            st.write_mmcif(out_name, options=options, nthreads=2)
+            self.assertEqual(read_lines_and_remove(out_name), expected)
+
         # write structure to mmJSON string and read it back
         json_str = mmcif_doc.as_json(mmjson=True)
         doc = gemmi.cif.read_mmjson_string(json_str)
@@ -580,6 +589,10 @@ class TestMol(unittest.TestCase):
         st = gemmi.read_structure(path)
         out_lines = self.write_and_read(st, via_cif)
         self.assertEqual(expected, out_lines)
+        if not via_cif:
+            out_name = get_path_for_tempfile()
+            st.write_pdb(out_name, nthreads=3)
+            self.assertEqual(read_lines_and_remove(out_name), out_lines)
 
     def test_read_write_1orc_via_cif(self):
         self.test_read_write_1orc(via_cif=True)
@@ -965,6 +978,11 @@ class TestMol(unittest.TestCase):
                                   gemmi.HowToNameCopiedChain.AddNumber)
         self.assertEqual([ch.name for ch in bio],
                          [x+'1' for x in ch_names] + [x+'2' for x in ch_names])
+        bio2 = gemmi.make_assembly(asem, model,
+                                   gemmi.HowToNameCopiedChain.AddNumber,
+                                   nthreads=3)
+        self.assertEqual([ch.name for ch in bio2], [ch.name for ch in bio])
+        self.assertEqual(bio2[5][3][1].pos, bio[5][3][1].pos)
 
     def test_assembly_naming(self):
         st = gemmi.read_structure(full_path('4oz7.pdb'))
@@ -1035,6 +1053,49 @@ class TestMol(unittest.TestCase):
         self.assertEqual(st.make_pdb_string(), stback.make_pdb_string())
         #self.assertEqual(pickle.dumps(st), pickle.dumps(stback))
 
+    def test_atom_table(self):
+        st = gemmi.read_structure(full_path('5e5z.pdb'))
+        model = st[0]
+        table = gemmi.AtomTable(model)
+        self.assertEqual(len(table), model.count_atom_sites())
+        self.assertTrue(table.matches(model))
+        com = table.calculate_center_of_mass()
+        self.assertTrue(com.approx(model.calculate_center_of_mass(), 1e-9))
+        cra = table.to_cra(model, 5)
+        self.assertEqual(cra.atom.name, model[0][0][5].name)
+        expected = model[0][0][5].pos + gemmi.Position(1, 2, 3)
+        tr = gemmi.Transform(gemmi.Mat33(), gemmi.Vec3(1, 2, 3))
+        table.transform_pos_and_adp(tr)
+        table.copy_to(model)
+        self.assertTrue(model[0][0][5].pos.approx(expected, 1e-6))
+        del model[0][0][5]
+        self.assertFalse(table.matches(model))
+        self.assertRaises(RuntimeError, table.copy_to, model)
+
+    @unittest.skipIf(numpy is None, "requires NumPy")
+    def test_model_arrays(self):
+        st = gemmi.read_structure(full_path('5e5z.pdb'))
+        model = st[0]
+        atoms = [cra.atom for cra in model.all()]
+        xyz = model.get_positions()
+        self.assertEqual(xyz.shape, (len(atoms), 3))
+        self.assertEqual(list(xyz[7]), atoms[7].pos.tolist())
+        model.set_positions(xyz * 2)
+        self.assertEqual(atoms[7].pos.tolist(), list(xyz[7] * 2))
+        b = model.get_b_iso()
+        self.assertEqual(b[-1], atoms[-1].b_iso)
+        model.set_b_iso(b + 1)
+        self.assertEqual(atoms[-1].b_iso, b[-1] + 1)
+        model.set_occ(numpy.full(len(atoms), 0.5))
+        self.assertEqual(atoms[0].occ, 0.5)
+        self.assertRaises(Exception, model.set_occ, numpy.ones(3))
+        table = gemmi.AtomTable(model)
+        self.assertTrue(numpy.array_equal(table.pos, model.get_positions()))
+        self.assertEqual(table.aniso.shape, (len(atoms), 6))
+        table.aniso[0] = [1, 2, 3, 4, 5, 6]
+        table.copy_to(model)
+        self.assertEqual(atoms[0].aniso.elements_pdb(), [1, 2, 3, 4, 5, 6])
+
     @unittest.skipIf(numpy is None, "requires NumPy")
     def test_flat_arrays(self):
         st = gemmi.read_structure(full_path('5e5z.pdb'))
@@ -1110,5 +1171,35 @@ class TestMol(unittest.TestCase):
         for cra in st_modified[0].all():
             self.assertAlmostEqual(cra.atom.b_iso, 20.0, places=1)
 
+    def test_model_file_index(self):
+        st = gemmi.read_structure(full_path('1orc.pdb'))
+        for num in [2, 3]:
+            st.add_model(st[0])
+            st[num-1].num = num
+            st[num-1][0][0][0].pos = gemmi.Position(num, 0, 0)
+        st.setup_entities()
+        for suffix in ['.pdb', '.cif']:
+            path = get_path_for_tempfile(suffix=suffix)
+            if suffix == '.pdb':
+                st.write_pdb(path)
+            else:
+                st.make_mmcif_document().write_file(path)
+            index = gemmi.make_model_file_index(path)
+            self.assertEqual([e.num for e in index.models], [1, 2, 3])
+            index_path = path + '.idx'
+            gemmi.write_model_file_index(index, index_path)
+            index = gemmi.read_model_file_index(index_path)
+            os.remove(index_path)
+            model_st = gemmi.read_model(path, index, 3)
+            os.remove(path)
+            self.assertEqual(len(model_st), 1)
+            self.assertEqual(model_st[0].num, 3)
+            self.assertEqual(model_st[0].count_atom_sites(),
+                             st[2].count_atom_sites())
+            self.assertEqual(model_st[0][0][0][0].pos.x, 3)
+            self.assertEqual(model_st.cell.a, st.cell.a)
+            with self.assertRaises(RuntimeError):
+                gemmi.read_model(full_path('1orc.pdb'), index, 4)
+
 if __name__ == '__main__':
     unittest.main()
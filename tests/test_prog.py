@@ -1,5 +1,6 @@
 #!/usr/bin/env python
 
+import glob
 import os
 import sys
 import subprocess
@@ -8,6 +9,7 @@ try:
     import gemmi
 except ImportError:
     gemmi = None
+from common import get_path_for_tempfile
 
 TOP_DIR = os.path.join(os.path.dirname(__file__), "..")
 
@@ -159,6 +161,51 @@ metalc6      S   22Q A   1                CU   CU1 B 101     1555   6345  2.26
 metalc7      N   22Q B   1                CU   CU1 A 101     1555   6344  2.07
 metalc8      S   22Q B   1                CU   CU1 A 101     1555   6344  2.22
 ''')
+    def test_grep_fast(self):
+        # gemmi grep --fast must give the same output as the CIF grammar
+        def grep(args):
+            p = subprocess.run(['gemmi', 'grep'] + args, cwd=TOP_DIR,
+                               stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+            return p.returncode, p.stdout
+        paths = sorted(glob.glob(os.path.join(TOP_DIR, 'tests', '*.cif')))
+        paths += [os.path.join(TOP_DIR, 'tests', name)
+                  for name in ['1pfe.cif.gz', 'r5wkdsf.ent', 'pdb1gdr.ent']]
+        option_sets = [[], ['-O'], ['-c'], ['-l'], ['-n', '-t'], ['-w', '-H'],
+                       ['-m', '2'], ['-T'], ['-d,', '-b']]
+        for path in paths:
+            _, out = grep(['-T', '_*', path])
+            tags = sorted(set(line.split(b':')[-1].decode()
+                              for line in out.splitlines()))
+            tags = tags[::max(1, len(tags) // 6)]
+            tags += ['_none.such', '_*free', '_cell.length_?']
+            for tag in tags:
+                for opts in option_sets:
+                    args = opts + [tag, path]
+                    self.assertEqual(grep(args), grep(['--fast'] + args),
+                                     msg=' '.join(args))
+                if '?' not in tag and '*' not in tag:
+                    args = [tag, '-a', '_cell.length_a', path]
+                    self.assertEqual(grep(args), grep(['--fast'] + args),
+                                     msg=' '.join(args))
+
+    def test_grep_fast_errors(self):
+        # syntax errors in lines without tags must be reported with --fast
+        def grep(args):
+            p = subprocess.run(['gemmi', 'grep'] + args,
+                               stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+            return p.returncode, p.stdout
+        invalid = [b'_a.y\nfoo bar\n',           # two values after a tag
+                   b"_a.y\n'unterminated\n",     # unterminated string
+                   b'_a.y\nvalue\xc3\xa9\n',     # non-ASCII character
+                   b'loop_\n_a.y\n_a.w\n1 2\n3 $4\n']  # frame code
+        for body in invalid:
+            path = get_path_for_tempfile(suffix='.cif')
+            with open(path, 'wb') as f:
+                f.write(b'data_a\n_a.x 1\n' + body + b'_a.z 3\n')
+            result = grep(['_a.z', path])
+            self.assertEqual(result[0], 2, msg=body)
+            self.assertEqual(grep(['--fast', '_a.z', path]), result, msg=body)
+            os.remove(path)
 
 if __name__ == '__main__':
     unittest.main()
@@ -0,0 +1,121 @@
+#!/usr/bin/env python
+"""
+Functions that release the GIL, run from multiple Python threads.
+Results must be the same as when the functions are run sequentially.
+"""
+
+import concurrent.futures
+import os
+import unittest
+import gemmi
+from common import full_path, get_path_for_tempfile, numpy
+
+NTHREADS = 4
+NJOBS = 8
+
+def run_in_threads(func, args):
+    with concurrent.futures.ThreadPoolExecutor(max_workers=NTHREADS) as pool:
+        return list(pool.map(func, args))
+
+class TestThreads(unittest.TestCase):
+    def test_reading(self):
+        paths = [full_path(name) for name in ['1orc.pdb', '1pfe.cif.gz',
+                                              '5i55.cif', '4oz7.pdb']]
+        def read(path):
+            st = gemmi.read_structure(path)
+            return st.name, st[0].count_atom_sites()
+        expected = [read(path) for path in paths]
+        self.assertEqual(run_in_threads(read, paths * 2), expected * 2)
+
+        def read_cif(path):
+            doc = gemmi.cif.read(path)
+            return doc.as_string()
+        path = full_path('1pfe.cif.gz')
+        expected = read_cif(path)
+        for result in run_in_threads(read_cif, [path] * NJOBS):
+            self.assertEqual(result, expected)
+
+    def test_reading_bytes(self):
+        with open(full_path('5i55.cif'), 'rb') as f:
+            cif_data = f.read()
+        with open(full_path('4oz7.pdb'), 'rb') as f:
+            pdb_data = f.read()
+        def read(data):
+            if data is cif_data:
+                doc = gemmi.cif.read_string(data)
+                st = gemmi.read_structure_string(data)
+                return doc[0].name, st[0].count_atom_sites()
+            st = gemmi.read_pdb_string(data)
+            return st.name, st[0].count_atom_sites()
+        args = [cif_data, pdb_data] * NJOBS
+        expected = [read(data) for data in args]
+        self.assertEqual(run_in_threads(read, args), expected)
+
+    def test_mtz(self):
+        path = full_path('5e5z.mtz')
+        messages = []
+        def read_mtz(n):
+            mtz = gemmi.read_mtz_file(path, logging=messages.append)
+            return mtz.nreflections, mtz.column_labels()
+        expected = read_mtz(0)
+        self.assertEqual(run_in_threads(read_mtz, range(NJOBS)),
+                         [expected] * NJOBS)
+
+    @unittest.skipIf(numpy is None, 'requires NumPy')
+    def test_transform_f_phi_to_map(self):
+        mtz = gemmi.read_mtz_file(full_path('5e5z.mtz'))
+        def transform(n):
+            grid = mtz.transform_f_phi_to_map('FP', 'SIGI', sample_rate=2 + n)
+            return grid.array.copy()
+        maps = run_in_threads(transform, [0, 1] * NJOBS)
+        self.assertEqual(maps[0].shape, transform(0).shape)
+        for i in range(2, len(maps)):
+            self.assertTrue(numpy.array_equal(maps[i], maps[i % 2]))
+
+    @unittest.skipIf(numpy is None, 'requires NumPy')
+    def test_density_and_mask(self):
+        st = gemmi.read_structure(full_path('1orc.pdb'))
+        st.setup_entities()
+        def density(n):
+            dencalc = gemmi.DensityCalculatorX()
+            dencalc.d_min = 2.5
+            dencalc.grid.setup_from(st)
+            dencalc.put_model_density_on_grid(st[0])
+            return dencalc.grid.array.copy()
+        def mask(n):
+            masker = gemmi.SolventMasker(gemmi.AtomicRadiiSet.VanDerWaals)
+            grid = gemmi.Int8Grid()
+            grid.setup_from(st, spacing=0.7)
+            masker.put_mask_on_int8_grid(grid, st[0])
+            return grid.array.copy()
+        for func in [density, mask]:
+            expected = func(0)
+            for result in run_in_threads(func, range(NJOBS)):
+                self.assertTrue(numpy.array_equal(result, expected))
+
+    def test_contacts(self):
+        st = gemmi.read_structure(full_path('4oz7.pdb'))
+        st.setup_entities()
+        def contacts(n):
+            ns = gemmi.NeighborSearch(st[0], st.cell, 5).populate()
+            cs = gemmi.ContactSearch(4.0)
+            cs.ignore = gemmi.ContactSearch.Ignore.SameResidue
+            return len(cs.find_contacts(ns))
+        self.assertEqual(run_in_threads(contacts, range(NJOBS)), [607] * NJOBS)
+
+    def test_writing(self):
+        st = gemmi.read_structure(full_path('1orc.pdb'))
+        def write(n):
+            out_name = get_path_for_tempfile(suffix='.pdb')
+            st.write_pdb(out_name)
+            with open(out_name) as f:
+                content = f.read()
+            os.remove(out_name)
+            return content
+        expected = st.make_pdb_string()
+        for result in run_in_threads(write, range(NJOBS)):
+            self.assertEqual(result, expected)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -26,7 +26,6 @@ TAGGED_REPOS = {
 }
 
 NOT_TAGGED_REPOS = {
-    'chadaustin/sajson': 'include/sajson.h',
     'sgorsten/linalg': 'linalg.h',
     'nothings/stb': 'stb_sprintf.h',
 }